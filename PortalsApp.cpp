@@ -1,7 +1,17 @@
 #include "PortalsApp.h"
 
 #include "GeometryGenerator.h"
-#include "SpherePath.h"
+#include "MeshChunker.h"
+#include "MeshOptimizer.h"
+#include "PolygonTriangulator.h"
+#include "RoomFile.h"
+#include "ShaderCache.h"
+#include "TaskGraph.h"
+
+#include <stdexcept>
+
+// Frames the CPU may record ahead of the GPU.  Set with PortalsApp::SetFramesInFlight.
+int gNumFrameResources = 3;
 
 namespace {
   const UINT CB_PER_OBJECT_ROOT_INDEX = 0;
@@ -19,18 +29,226 @@ namespace {
   const int CLIP_PLANE_PORTAL_B_A_CB_INDEX = 2;
   const int NUM_CLIP_PLANE_CBS = 3;
 
+  // Parts of the frame recorded by each record thread, in submission order.
+  const int RECORD_MAIN_VIEW = 0;
+  const int RECORD_PORTAL_A = 1;
+  const int RECORD_PORTAL_B = 2;
+  static_assert(gNumRecordThreads == 3, "Draw records exactly 3 command lists.");
+
   const int WORLD2_IDENTITY_CB_INDEX = 0;
   const int WORLD2_PORTAL_A_TO_B_CB_INDEX = 1;
   const int WORLD2_PORTAL_B_TO_A_CB_INDEX = 2;
   const int NUM_WORLD2_CBS = 3;
 
-  bool GetNextDataLine(std::ifstream* ifs, std::string* line) {
-    line->clear();
-    do {
-      *ifs >> std::ws;  // read leading whitespace
-      // line can't be empty, so line->front() is safe
-    } while (std::getline(*ifs, *line) && line->front() == '#');
-    return !ifs->eof();
+  // Per-frame constants are allocated from a ring shared by all frames in flight.
+  const UINT64 CONSTANT_RING_BYTE_SIZE = 1 << 20;
+
+  // Stencil values marking the inside of each portal, and how many rooms deep each is rendered.
+  const UINT PORTAL_A_STENCIL_REF = 2;
+  const UINT PORTAL_B_STENCIL_REF = 1;
+  const UINT PORTAL_A_ITERATIONS = 8;
+  const UINT PORTAL_B_ITERATIONS = 8;
+
+  // The player sphere is built with up to this many tessellations; each LOD has one fewer, down to
+  // the icosahedron.  The coarsest LOD whose triangle edges are no longer than
+  // PLAYER_LOD_EDGE_PIXELS on screen is drawn in each pass.
+  const unsigned int PLAYER_SPHERE_TESSELLATIONS = 3;
+  const int NUM_PLAYER_LODS = PLAYER_SPHERE_TESSELLATIONS + 1;
+  const float PLAYER_LOD_EDGE_PIXELS = 12.0f;
+  // Edge length of an icosahedron relative to the radius of its circumscribed sphere.
+  const float ICOSAHEDRON_EDGE_RATIO = 1.0515f;
+
+  // Largest piece of the room mesh that's culled as a unit.
+  const size_t ROOM_CHUNK_TRIANGLES = 512;
+
+  // Resolution of the software occlusion buffer; the width must be a multiple of 4.
+  const int OCCLUSION_BUFFER_WIDTH = 256;
+  const int OCCLUSION_BUFFER_HEIGHT = 144;
+
+  // How far in front of its wall a portal is tested, so the wall itself never hides it.
+  const float PORTAL_OCCLUSION_BIAS = 0.05f;
+
+  // A recursion level isn't culled to a portal's opening while the eye is this close to it.  The
+  // camera's near plane is far smaller, so the wall around the opening is never clipped away.
+  const float PORTAL_CULL_MIN_EYE_DISTANCE = 0.1f;
+
+  // Pulls the portal decals toward the camera so they pass the LESS_EQUAL depth test against the
+  // wall under them, which is triangulated differently.  In units of the 24-bit depth buffer and
+  // of the decal's largest depth slope per pixel.
+  const INT PORTAL_DECAL_DEPTH_BIAS = -64;
+  const float PORTAL_DECAL_SLOPE_SCALED_DEPTH_BIAS = -2.0f;
+
+  // Compiled shaders are kept here between runs, relative to the working directory.
+  const char* const SHADER_CACHE_DIRECTORY = "shadercache";
+
+  // Upper limit on the threads Initialize runs its stages on; no more stages than this are ever
+  // ready at once.
+  const int MAX_INIT_THREADS = 8;
+
+  // Textures keep their mips up to this many texels across resident; the rest are streamed in
+  // within the budget as they're needed.
+  const uint32_t MIN_RESIDENT_TEXTURE_SIZE = 64;
+  const uint64_t TEXTURE_STREAMING_BUDGET = 32 << 20;
+  const int MAX_TEXTURE_LOADS_IN_FLIGHT = 2;
+
+  // The world is read from WORLD_FILE, or is one room alone if there isn't one: BINARY_ROOM_FILE
+  // if it exists (see "-convert-room" in WinMain), or else ROOM_FILE.  Rooms within
+  // ROOM_STREAMING_HOPS doorways of the player's are loaded in the background, and farther ones
+  // are evicted once they no longer fit in the budget.
+  const char* const WORLD_FILE = "world.txt";
+  const char* const ROOM_FILE = "room.txt";
+  const char* const BINARY_ROOM_FILE = "room.bin";
+  const int ROOM_STREAMING_HOPS = 2;
+  const uint64_t ROOM_STREAMING_BUDGET = 256 << 20;
+  const int MAX_ROOM_LOADS_IN_FLIGHT = 2;
+
+  // How close the player's sphere must come to a doorway to walk through it.
+  const float DOORWAY_TOUCH_DISTANCE = 0.001f;
+
+  // How far compressing a vertex may move it before the shapes keep float positions instead;
+  // about the offset of the clip planes from the portals.
+  const float MAX_POSITION_ERROR = 0.001f;
+
+  // Size of the shader-visible ring that each frame's descriptor tables are copied into.
+  const UINT TRANSIENT_SRV_DESCRIPTORS = 1024;
+
+  ObjectConstants MakeObjectConstants(const PortalsApp::RenderItem& item) {
+    ObjectConstants objConstants;
+    XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(item.World));
+    XMStoreFloat4x4(&objConstants.WorldInvTranspose, XMMatrixTranspose(
+        MathHelper::InverseTranspose(item.World)));
+    XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(item.TexTransform));
+    objConstants.MaterialIndex = item.Mat->MatCBIndex;
+    const VertexQuantization& q = item.Quantization;
+    objConstants.PosScale = XMFLOAT3(q.PosScale[0], q.PosScale[1], q.PosScale[2]);
+    objConstants.PosOffset = XMFLOAT3(q.PosOffset[0], q.PosOffset[1], q.PosOffset[2]);
+    objConstants.TexCScale = XMFLOAT2(q.TexCScale[0], q.TexCScale[1]);
+    objConstants.TexCOffset = XMFLOAT2(q.TexCOffset[0], q.TexCOffset[1]);
+    return objConstants;
+  }
+
+  // Compresses one submesh's vertices over their own ranges and reports how much they moved.
+  VertexQuantization CompressSubmesh(const char* name, const FloatVertex* vertices, size_t count,
+                                     CompressedVertex* compressed,
+                                     VertexCompressionError* error) {
+    const VertexQuantization quantization = ComputeVertexQuantization(vertices, count);
+    CompressVertices(vertices, count, quantization, compressed);
+    *error = MeasureCompressionError(vertices, compressed, count, quantization);
+    dprintf("Compressed %s vertices: position error %g, normal error %g degrees, "
+        "texcoord error %g\n", name, error->MaxPositionError, error->MaxNormalErrorDegrees,
+        error->MaxTexCError);
+    return quantization;
+  }
+
+  // Index ranges of a mesh, drawn in this order.
+  struct IndexRange {
+    UINT* Indices;
+    size_t Count;
+  };
+
+  // Reorders the triangles within each range for the vertex cache (and, for sortForOverdraw, so
+  // the likely occluders come first), then numbers the vertices in the order they're drawn.
+  // Prints the simulated cache's ACMR and ATVR before and after for each range.
+  void OptimizeMesh(const char* name, std::vector<GeometryGenerator::Vertex>* vertices,
+                    const std::vector<IndexRange>& ranges, bool sortForOverdraw) {
+    static_assert(sizeof(UINT) == sizeof(uint32_t), "Indices must be 32-bit.");
+    for (size_t r = 0; r < ranges.size(); ++r) {
+      uint32_t* indices = ranges[r].Indices;
+      const size_t count = ranges[r].Count;
+      const VertexCacheStats before = AnalyzeVertexCache(indices, count, vertices->size());
+      OptimizeVertexCache(indices, count, vertices->size());
+      if (sortForOverdraw) {
+        OptimizeOverdraw(indices, count, &(*vertices)[0].Position.x,
+            sizeof(GeometryGenerator::Vertex), vertices->size());
+      }
+      const VertexCacheStats after = AnalyzeVertexCache(indices, count, vertices->size());
+      dprintf("%s range %zu: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", name, r, before.Acmr,
+          after.Acmr, before.Atvr, after.Atvr);
+    }
+
+    std::vector<uint32_t> drawnIndices;
+    for (const IndexRange& range : ranges)
+      drawnIndices.insert(drawnIndices.end(), range.Indices, range.Indices + range.Count);
+    const std::vector<uint32_t> order =
+        ComputeVertexFetchOrder(drawnIndices.data(), drawnIndices.size(), vertices->size());
+    for (const IndexRange& range : ranges)
+      RemapIndices(range.Indices, range.Count, order);
+    std::vector<GeometryGenerator::Vertex> reordered(vertices->size());
+    for (size_t i = 0; i < order.size(); ++i)
+      reordered[i] = (*vertices)[order[i]];
+    vertices->swap(reordered);
+  }
+
+  // Builds a room's mesh on the room loader's thread.  The mesh is split into chunks that can be
+  // culled separately, and each chunk is optimized as a range of its own, so its triangles stay
+  // together.
+  void PrepareRoomMesh(LoadedRoom* room) {
+    GeometryGenerator::MeshData& mesh = room->Mesh;
+    SubmeshGeometry wallsSubmesh;
+    SubmeshGeometry floorSubmesh;
+    SubmeshGeometry ceilingSubmesh;
+    room->Collision.BuildMeshData(&mesh, &wallsSubmesh, &floorSubmesh, &ceilingSubmesh);
+    room->Chunks = BuildMeshChunks(mesh.Indices.data(), mesh.Indices.size(),
+        &mesh.Vertices[0].Position.x, sizeof(GeometryGenerator::Vertex), ROOM_CHUNK_TRIANGLES);
+    std::vector<IndexRange> chunkRanges;
+    for (const MeshChunk& chunk : room->Chunks)
+      chunkRanges.push_back({ &mesh.Indices[chunk.StartIndex], chunk.IndexCount });
+    OptimizeMesh(room->Path.c_str(), &mesh.Vertices, chunkRanges, true);
+    dprintf("%s: %zu vertices, %zu triangles in %zu chunks\n", room->Path.c_str(),
+        mesh.Vertices.size(), mesh.Indices.size() / 3, room->Chunks.size());
+  }
+
+  void PlacePortal(const PortalPlacement& placement, Portal* portal) {
+    portal->SetMaxPhysicalRadius(std::numeric_limits<float>::infinity());
+    portal->SetIntendedPhysicalRadius(placement.Radius);
+    portal->SetPosition(XMFLOAT3(placement.Position));
+    portal->SetNormalAndUp(XMFLOAT3(placement.Normal), XMFLOAT3(placement.Up));
+  }
+
+  // The software renderer's constant structs have the same layout as the cbuffers, so the bytes
+  // uploaded to the GPU can be handed to it unchanged.
+  template <typename SoftwareConstants, typename Constants>
+  void CopyConstants(SoftwareConstants* dst, const Constants& src) {
+    static_assert(sizeof(SoftwareConstants) == sizeof(Constants),
+        "Software constants must match the cbuffer layout.");
+    memcpy(dst, &src, sizeof(Constants));
+  }
+
+  // The front of the portal's box, which is what marks its opening in the stencil buffer.
+  void GetPortalOpening(const Portal& portal, XMFLOAT3 opening[PORTAL_BOX_N_SIDES]) {
+    const XMMATRIX portalToWorld = portal.GetXYScaledPortalToWorldMatrix();
+    const float radiansPerSlice = 2.0f * PI / PORTAL_BOX_N_SIDES;
+    const float r = 1.0f / cosf(radiansPerSlice / 2.0f);
+    for (int i = 0; i < PORTAL_BOX_N_SIDES; ++i) {
+      const float theta = i * radiansPerSlice;
+      XMStoreFloat3(&opening[i], XMVector3TransformCoord(
+          XMVectorSet(r * cosf(theta), r * sinf(theta), 0.0f, 1.0f), portalToWorld));
+    }
+  }
+
+  void TransformOpening(XMFLOAT3 opening[PORTAL_BOX_N_SIDES], const XMMATRIX& m) {
+    for (int i = 0; i < PORTAL_BOX_N_SIDES; ++i)
+      XMStoreFloat3(&opening[i], XMVector3TransformCoord(XMLoadFloat3(&opening[i]), m));
+  }
+
+  SwRenderItem MakeSoftwareRenderItem(const PortalsApp::RenderItem& item) {
+    SwRenderItem swItem;
+    CopyConstants(&swItem.Object, MakeObjectConstants(item));
+    swItem.IndexCount = item.IndexCount;
+    swItem.StartIndexLocation = item.StartIndexLocation;
+    swItem.BaseVertexLocation = item.BaseVertexLocation;
+    return swItem;
+  }
+
+  ComPtr<ID3DBlob> CompileShader(const ShaderCompileDesc& desc) {
+    std::vector<D3D_SHADER_MACRO> macros;
+    for (const ShaderDefine& define : desc.Defines) {
+      macros.push_back({ define.Name.c_str(),
+                         define.Definition.empty() ? nullptr : define.Definition.c_str() });
+    }
+    macros.push_back({ nullptr, nullptr });
+    return d3dUtil::CompileShader(
+        AnsiToWString(desc.Path), macros.data(), desc.EntryPoint, desc.Target);
   }
 
   std::array<const CD3DX12_STATIC_SAMPLER_DESC, 7> GetStaticSamplers()
@@ -103,6 +321,25 @@ namespace {
     };
   }
 
+  // Marks the cells that might be seen from within radius of center, in the XZ plane.
+  void MarkCellsVisibleFrom(const CellGraph& cells, const XMFLOAT3& center, float radius,
+                            std::vector<bool>* visible) {
+    const PolygonPoint boundsMin = { center.x - radius, center.z - radius };
+    const PolygonPoint boundsMax = { center.x + radius, center.z + radius };
+    cells.MarkVisibleFromBounds(boundsMin, boundsMax, visible);
+  }
+
+  // Whether any of cells is marked in visible.  Without cells to go by, everything is.
+  bool AnyCellVisible(const std::vector<int>& cells, const std::vector<bool>& visible) {
+    if (cells.empty() || visible.empty())
+      return true;
+    for (int cell : cells) {
+      if (visible[cell])
+        return true;
+    }
+    return false;
+  }
+
 } // namespace
 
 PortalsApp::PortalsApp(HINSTANCE hInstance)
@@ -113,6 +350,7 @@ PortalsApp::PortalsApp(HINSTANCE hInstance)
     mOtherPortal(&mPortalB),
     mPlayerIntersectPortalA(false),
     mPlayerIntersectPortalB(false),
+    mOcclusionBuffer(OCCLUSION_BUFFER_WIDTH, OCCLUSION_BUFFER_HEIGHT),
     mCurrentPortalBoxRenderItem(&mPortalBoxARenderItem) {
   mClientWidth = 1280;
   mClientHeight = 720;
@@ -146,29 +384,66 @@ bool PortalsApp::Initialize() {
   // so we have to query this information.
   mCbvSrvDescriptorSize =
       md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-  
-  ReadRoomFile("room.txt");
-  mRightCamera.AttachToObject(&mPlayer);  // Updates mRightCamera's position, orientation
-  mPortalAToB = Portal::CalculateVirtualizationMatrix(mPortalA, mPortalB);
-  mPortalBToA = Portal::CalculateVirtualizationMatrix(mPortalB, mPortalA);
 
-  LoadTexture("portalA", L"textures/orange_portal2.dds");
-  LoadTexture("portalB", L"textures/blue_portal2.dds");
-  LoadTexture("room", L"textures/tile.dds");
-  LoadTexture("player", L"textures/stone.dds");
+  mTextureStreamer = std::make_unique<D3D12TextureStreamer>(
+      md3dDevice.Get(), TEXTURE_STREAMING_BUDGET, MAX_TEXTURE_LOADS_IN_FLIGHT);
+  
+  // Independent stages run at the same time on a pool of threads; each one starts once the stages
+  // it depends on are done.  Stages that record into mCommandList lock mInitCommandListMutex
+  // around it.
+  TaskGraph init;
+  const TaskGraph::StageId room = init.AddStage("room", [this] {
+    LoadWorld(WORLD_FILE,
+              std::ifstream(BINARY_ROOM_FILE).good() ? BINARY_ROOM_FILE : ROOM_FILE);
+    mRightCamera.AttachToObject(&mPlayer);  // Updates mRightCamera's position, orientation
+    mPortalA.SetTextureRadiusRatio(PORTAL_TEX_RAD_RATIO);
+    mPortalB.SetTextureRadiusRatio(PORTAL_TEX_RAD_RATIO);
+  });
+  const TaskGraph::StageId portalATexture = init.AddStage("portalA texture", [this] {
+    LoadTexture(TEXTURE_PORTAL_A, "portalA", L"textures/orange_portal2.dds");
+  });
+  const TaskGraph::StageId portalBTexture = init.AddStage("portalB texture", [this] {
+    LoadTexture(TEXTURE_PORTAL_B, "portalB", L"textures/blue_portal2.dds");
+  });
+  const TaskGraph::StageId roomTexture = init.AddStage("room texture", [this] {
+    LoadTexture(TEXTURE_ROOM, "room", L"textures/tile.dds");
+  });
+  const TaskGraph::StageId playerTexture = init.AddStage("player texture", [this] {
+    LoadTexture(TEXTURE_PLAYER, "player", L"textures/stone.dds");
+  });
+  init.AddStage("descriptor heaps", [this] { BuildDescriptorHeaps(); },
+                { portalATexture, portalBTexture, roomTexture, playerTexture });
+  const TaskGraph::StageId rootSignature =
+      init.AddStage("root signature", [this] { BuildRootSignature(); });
+  const TaskGraph::StageId shaders =
+      init.AddStage("shaders", [this] { BuildShadersAndInputLayout(); });
+  const TaskGraph::StageId geometry =
+      init.AddStage("geometry", [this] { BuildShapeGeometry(); }, { room });
+  // The geometry picks the input layout.
+  init.AddStage("PSOs", [this] { BuildPSOs(); }, { rootSignature, shaders, geometry });
+  const TaskGraph::StageId materials = init.AddStage("materials", [this] { BuildMaterials(); });
+  init.AddStage("render items", [this] { BuildRenderItems(); }, { geometry, materials });
+  const TaskGraph::StageId frameResources =
+      init.AddStage("frame resources", [this] { BuildFrameResources(); });
+  init.AddStage("record command lists", [this] { BuildRecordCommandLists(); },
+                { frameResources });
+
+  int numInitThreads = static_cast<int>(std::thread::hardware_concurrency());
+  if (numInitThreads < 1)
+    numInitThreads = 1;
+  if (numInitThreads > MAX_INIT_THREADS)
+    numInitThreads = MAX_INIT_THREADS;
+  {
+    WorkerThreads initThreads(numInitThreads);
+    init.Run(&initThreads);
+  }
 
-  mPortalA.SetTextureRadiusRatio(PORTAL_TEX_RAD_RATIO);
-  mPortalB.SetTextureRadiusRatio(PORTAL_TEX_RAD_RATIO);
+  dprintf("Initialize: %.1f ms on %d threads\n", init.GetTotalMs(), numInitThreads);
+  for (const TaskGraph::StageTiming& timing : init.GetTimings()) {
+    dprintf("  %-22s %7.1f ms  (started at %7.1f ms on thread %d)\n", timing.Name.c_str(),
+        timing.DurationMs, timing.StartMs, timing.ThreadIndex);
+  }
 
-  BuildRootSignature();
-  BuildDescriptorHeaps();
-  BuildShadersAndInputLayout();
-  BuildShapeGeometry();
-  BuildMaterials();
-  BuildRenderItems();
-  BuildFrameResources();
-  BuildPSOs();
-  
   // Execute the initialization commands.
   ThrowIfFailed(mCommandList->Close());
   ID3D12CommandList* cmdList = mCommandList.Get();
@@ -180,12 +455,19 @@ bool PortalsApp::Initialize() {
   return true;
 }
 
-void PortalsApp::LoadTexture(const std::string& name, const std::wstring& path) {
-  Texture& texture = mTextures[name];
+void PortalsApp::LoadTexture(TextureId id, const std::string& name, const std::wstring& path) {
+  Texture& texture = mTextures[id];
   texture.Name = name;
   texture.Filename = path;
-  ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-    mCommandList.Get(), path.c_str(), texture.Resource, texture.UploadHeap));
+
+  // Only the smallest mips are uploaded now; the streamer brings in the rest once the texture is
+  // drawn.  The file is mapped and copied into upload memory without holding the lock; only the
+  // copies into the texture are recorded under it.  Initialize's final flush signals
+  // mCurrentFence + 1.
+  mStreamedTextureIndices[id] = mTextureStreamer->AddTexture(path, MIN_RESIDENT_TEXTURE_SIZE);
+  texture.Resource = mTextureStreamer->GetResource(mStreamedTextureIndices[id]);
+  std::lock_guard<std::mutex> lock(mInitCommandListMutex);
+  mTextureStreamer->RecordCopies(mCommandList.Get(), mCurrentFence + 1);
 }
 
 void PortalsApp::BuildRootSignature() {
@@ -253,70 +535,93 @@ void PortalsApp::BuildRootSignature() {
 }
 
 void PortalsApp::BuildDescriptorHeaps() {
-  // Create the SRV heap.
-  D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-  srvHeapDesc.NumDescriptors = 4;
-  srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-  srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-  ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
-
-  // Fill the heap with descriptors.
-  ComPtr<ID3D12Resource> tex2DList[4] = {
-    // Put the descriptors for the textures used for gTextureMaps[2] first in the heap so that
-    // PhongMaterial::DiffuseSrvHeapIndex matches PhongMaterialData::DiffuseMapIndex.
-    mTextures["room"].Resource,
-    mTextures["player"].Resource,
-    mTextures["portalA"].Resource,
-    mTextures["portalB"].Resource
-  };
-  CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(
-      mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
-  D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-  srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-  srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-  srvDesc.Texture2D.MostDetailedMip = 0;
-  srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-  for (int i = 0; i < _countof(tex2DList); ++i) {
-    srvDesc.Format = tex2DList[i]->GetDesc().Format;
-    srvDesc.Texture2D.MipLevels = tex2DList[i]->GetDesc().MipLevels;
-    md3dDevice->CreateShaderResourceView(tex2DList[i].Get(), &srvDesc, hDescriptor);
-    // Next descriptor
-    hDescriptor.Offset(1, mCbvSrvUavDescriptorSize);
+  // The persistent heap starts with room for the textures loaded now and grows if more are added.
+  mSrvDescriptors = std::make_unique<DescriptorAllocator>(
+      md3dDevice.Get(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, NUM_TEXTURES,
+      TRANSIENT_SRV_DESCRIPTORS);
+  for (int i = 0; i < NUM_TEXTURES; ++i) {
+    mTextureSrvs[i] = mSrvDescriptors->AllocatePersistent(1);
+    mTextureStreamer->CreateSrv(
+        mStreamedTextureIndices[i], mSrvDescriptors->GetPersistentHandle(mTextureSrvs[i].Offset));
   }
 }
 
 void PortalsApp::BuildShadersAndInputLayout() {
-  D3D_SHADER_MACRO defines[] = {
-      { nullptr, nullptr },
-      { nullptr, nullptr },
-      { nullptr, nullptr },
-      { nullptr, nullptr },
-      { nullptr, nullptr },
-      { nullptr, nullptr } };
-  mShaders["portalBoxVS"] = d3dUtil::CompileShader(L"fx/PortalBox.hlsl", defines, "VS", "vs_5_1");
-  mShaders["portalBoxPS"] = d3dUtil::CompileShader(L"fx/PortalBox.hlsl", defines, "PS", "ps_5_1");
-  defines[0] = { "CLEAR_DEPTH", nullptr };
-  mShaders["portalBoxClearDepthVS"] = d3dUtil::CompileShader(L"fx/PortalBox.hlsl", defines, "VS", "vs_5_1");  
-  defines[0] = { "CLIP_PLANE", nullptr };
-  mShaders["portalBoxClipPS"] = d3dUtil::CompileShader(L"fx/PortalBox.hlsl", defines, "PS", "ps_5_1");
-
-  std::string numLightsStr = std::to_string(NUM_LIGHTS);
-  std::string portalTexRadRatioStr = std::to_string(PORTAL_TEX_RAD_RATIO);
-  defines[0] = { "NUM_LIGHTS", numLightsStr.c_str() };
-  defines[1] = { "PORTAL_TEX_RAD_RATIO", portalTexRadRatioStr.c_str() };
-  mShaders["defaultVS"] = d3dUtil::CompileShader(L"fx/Default.hlsl", defines, "VS", "vs_5_1");
-  defines[2] = { "CLIP_PLANE", nullptr };
-  mShaders["defaultClipPS"] = d3dUtil::CompileShader(L"fx/Default.hlsl", defines, "PS", "ps_5_1");
-  defines[3] = { "CLIP_PLANE_2", nullptr };
-  mShaders["defaultClipTwicePS"] = d3dUtil::CompileShader(L"fx/Default.hlsl", defines, "PS", "ps_5_1");
-  defines[3] = { "DRAW_PORTALS", nullptr };
-  mShaders["defaultPortalsVS"] = d3dUtil::CompileShader(L"fx/Default.hlsl", defines, "VS", "vs_5_1");
-  mShaders["defaultPortalsClipPS"] = d3dUtil::CompileShader(L"fx/Default.hlsl", defines, "PS", "ps_5_1");
+  const std::string numLightsStr = std::to_string(NUM_LIGHTS);
+  const std::string portalTexRadRatioStr = std::to_string(PORTAL_TEX_RAD_RATIO);
+  const ShaderDefine numLights = { "NUM_LIGHTS", numLightsStr };
+  const ShaderDefine portalTexRadRatio = { "PORTAL_TEX_RAD_RATIO", portalTexRadRatioStr };
+  const ShaderDefine clearDepth = { "CLEAR_DEPTH", "" };
+  const ShaderDefine clipPlane = { "CLIP_PLANE", "" };
+  const ShaderDefine clipPlane2 = { "CLIP_PLANE_2", "" };
+  const ShaderDefine clipPortalHoles = { "CLIP_PORTAL_HOLES", "" };
+  const ShaderDefine portalMapA = { "PORTAL_MAP", "gPortalAMap" };
+  const ShaderDefine portalMapB = { "PORTAL_MAP", "gPortalBMap" };
+
+  std::array<ShaderCompileDesc, NUM_SHADERS> descs;
+  descs[SHADER_PORTAL_BOX_VS] = { "fx/PortalBox.hlsl", {}, "VS", "vs_5_1" };
+  descs[SHADER_PORTAL_BOX_PS] = { "fx/PortalBox.hlsl", {}, "PS", "ps_5_1" };
+  descs[SHADER_PORTAL_BOX_CLEAR_DEPTH_VS] = { "fx/PortalBox.hlsl", { clearDepth }, "VS", "vs_5_1" };
+  descs[SHADER_PORTAL_BOX_CLIP_PS] = { "fx/PortalBox.hlsl", { clipPlane }, "PS", "ps_5_1" };
+  descs[SHADER_DEFAULT_VS] = { "fx/Default.hlsl", { numLights }, "VS", "vs_5_1" };
+  descs[SHADER_DEFAULT_CLIP_PS] = {
+      "fx/Default.hlsl", { numLights, clipPlane }, "PS", "ps_5_1" };
+  descs[SHADER_DEFAULT_CLIP_TWICE_PS] = {
+      "fx/Default.hlsl", { numLights, clipPlane, clipPlane2 }, "PS", "ps_5_1" };
+  descs[SHADER_DEFAULT_PORTALS_CLIP_PS] = {
+      "fx/Default.hlsl", { numLights, clipPlane, clipPortalHoles }, "PS", "ps_5_1" };
+  descs[SHADER_PORTAL_DECAL_VS] = { "fx/PortalDecal.hlsl", {}, "VS", "vs_5_1" };
+  descs[SHADER_PORTAL_DECAL_A_CLIP_PS] = {
+      "fx/PortalDecal.hlsl", { portalTexRadRatio, clipPlane, portalMapA }, "PS", "ps_5_1" };
+  descs[SHADER_PORTAL_DECAL_B_CLIP_PS] = {
+      "fx/PortalDecal.hlsl", { portalTexRadRatio, clipPlane, portalMapB }, "PS", "ps_5_1" };
+
+  // Load what's already in the cache.
+  CreateDirectoryA(SHADER_CACHE_DIRECTORY, nullptr);   // Fails harmlessly if it exists
+  ShaderCache cache(SHADER_CACHE_DIRECTORY);
+  std::array<uint64_t, NUM_SHADERS> keys;
+  std::vector<int> misses;
+  for (int i = 0; i < NUM_SHADERS; ++i) {
+    descs[i].Flags = d3dUtil::GetShaderCompileFlags();
+    if (!ShaderCache::ComputeKey(descs[i], &keys[i]))
+      throw std::runtime_error("Could not read shader source.");
+    if (cache.Contains(keys[i]))
+      mShaders[i] = d3dUtil::LoadBinary(AnsiToWString(cache.GetBinaryPath(keys[i])));
+    else
+      misses.push_back(i);
+  }
+
+  // Compile the rest in parallel, each thread taking every numThreads-th miss, and cache them.
+  if (!misses.empty()) {
+    int numThreads = static_cast<int>(std::thread::hardware_concurrency());
+    if (numThreads < 1)
+      numThreads = 1;
+    if (numThreads > static_cast<int>(misses.size()))
+      numThreads = static_cast<int>(misses.size());
+
+    WorkerThreads compileThreads(numThreads);
+    compileThreads.Run([&](int threadIndex) {
+      for (size_t i = threadIndex; i < misses.size(); i += numThreads)
+        mShaders[misses[i]] = CompileShader(descs[misses[i]]);
+    });
+
+    for (int id : misses)
+      cache.Store(keys[id], mShaders[id]->GetBufferPointer(), mShaders[id]->GetBufferSize());
+  }
+
+  const ShaderCache::Stats& cacheStats = cache.GetStats();
+  dprintf("Shader cache: %u hits, %u compiled, %u stored (%u failed)\n",
+      cacheStats.Hits, cacheStats.Misses, cacheStats.Stores, cacheStats.StoreFailures);
 
   mInputLayout = {
+    { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    { "TEXCOORD", 0, DXGI_FORMAT_R16G16_UNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+  };
+  mFloatPositionInputLayout = {
     { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    { "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    { "TEXCOORD", 0, DXGI_FORMAT_R16G16_UNORM, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
   };
 }
 
@@ -324,22 +629,42 @@ void PortalsApp::BuildShapeGeometry() {
   UINT numTotalIndices = 0;
   INT numTotalVertices = 0;
 
-  // Generate room mesh and wall, floor, ceiling submeshes.
-  SubmeshGeometry wallsSubmesh;
-  SubmeshGeometry floorSubmesh;
-  SubmeshGeometry ceilingSubmesh;
-  GeometryGenerator::MeshData roomMesh;
-  mRoom.BuildMeshData(&roomMesh, &wallsSubmesh, &floorSubmesh, &ceilingSubmesh);
+  // The current room's mesh, already chunked and optimized by the room loader (see
+  // PrepareRoomMesh), or read that way from a binary room file, in which case it's still in the
+  // mapping and this is its only copy.
+  const GeometryGenerator::Vertex* roomVertices = mCurrentRoom->MeshVertices;
+  const size_t roomVertexCount = mCurrentRoom->MeshVertexCount;
+  const uint32_t* roomIndices = mCurrentRoom->MeshIndices;
+  const size_t roomIndexCount = mCurrentRoom->MeshIndexCount;
+  const std::vector<MeshChunk>& roomChunks = mCurrentRoom->Chunks;
   SubmeshGeometry roomSubmesh;
-  roomSubmesh.IndexCount = static_cast<UINT>(roomMesh.Indices.size());
+  roomSubmesh.IndexCount = static_cast<UINT>(roomIndexCount);
   roomSubmesh.StartIndexLocation = numTotalIndices;
   roomSubmesh.BaseVertexLocation = numTotalVertices;
-  numTotalIndices += static_cast<UINT>(roomMesh.Indices.size());
-  numTotalVertices += static_cast<INT>(roomMesh.Vertices.size());
+  numTotalIndices += static_cast<UINT>(roomIndexCount);
+  numTotalVertices += static_cast<INT>(roomVertexCount);
+  std::vector<SubmeshGeometry> roomChunkSubmeshes(roomChunks.size());
+  for (size_t i = 0; i < roomChunks.size(); ++i) {
+    const MeshChunk& chunk = roomChunks[i];
+    SubmeshGeometry& chunkSubmesh = roomChunkSubmeshes[i];
+    chunkSubmesh.IndexCount = static_cast<UINT>(chunk.IndexCount);
+    chunkSubmesh.StartIndexLocation =
+        roomSubmesh.StartIndexLocation + static_cast<UINT>(chunk.StartIndex);
+    chunkSubmesh.BaseVertexLocation = roomSubmesh.BaseVertexLocation;
+    BoundingBox::CreateFromPoints(chunkSubmesh.Bounds,
+        XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(chunk.BoundsMin)),
+        XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(chunk.BoundsMax)));
+  }
 
-  // Generate player mesh and submesh.
-  GeometryGenerator::MeshData playerMesh;
-  GeometryGenerator::GenerateSphere(playerMesh, 1.0f, 3);
+  // Generate player mesh and submesh.  The less detailed LODs use some of its vertices, so they
+  // only add indices, which go after everything else's.
+  std::vector<GeometryGenerator::MeshData> playerLods;
+  GeometryGenerator::GenerateSphereLods(playerLods, 1.0f, PLAYER_SPHERE_TESSELLATIONS);
+  std::vector<IndexRange> playerLodRanges;
+  for (GeometryGenerator::MeshData& lod : playerLods)
+    playerLodRanges.push_back({ lod.Indices.data(), lod.Indices.size() });
+  OptimizeMesh("Player", &playerLods[0].Vertices, playerLodRanges, false);
+  const GeometryGenerator::MeshData& playerMesh = playerLods[0];
   SubmeshGeometry playerSubmesh;
   playerSubmesh.IndexCount = static_cast<UINT>(playerMesh.Indices.size());
   playerSubmesh.StartIndexLocation = numTotalIndices;
@@ -350,6 +675,8 @@ void PortalsApp::BuildShapeGeometry() {
   // Generate portal-box mesh and submesh
   GeometryGenerator::MeshData portalBoxMesh;
   Portal::BuildBoxMeshData(&portalBoxMesh);
+  OptimizeMesh("Portal box", &portalBoxMesh.Vertices,
+      { { portalBoxMesh.Indices.data(), portalBoxMesh.Indices.size() } }, false);
   SubmeshGeometry portalBoxSubmesh;
   portalBoxSubmesh.IndexCount = static_cast<UINT>(portalBoxMesh.Indices.size());
   portalBoxSubmesh.StartIndexLocation = numTotalIndices;
@@ -357,13 +684,24 @@ void PortalsApp::BuildShapeGeometry() {
   numTotalIndices += static_cast<UINT>(portalBoxMesh.Indices.size());
   numTotalVertices += static_cast<INT>(portalBoxMesh.Vertices.size());
 
+  std::vector<SubmeshGeometry> playerLodSubmeshes(NUM_PLAYER_LODS);
+  playerLodSubmeshes[0] = playerSubmesh;
+  for (int lod = 1; lod < NUM_PLAYER_LODS; ++lod) {
+    playerLodSubmeshes[lod].IndexCount = static_cast<UINT>(playerLods[lod].Indices.size());
+    playerLodSubmeshes[lod].StartIndexLocation = numTotalIndices;
+    playerLodSubmeshes[lod].BaseVertexLocation = playerSubmesh.BaseVertexLocation;
+    numTotalIndices += static_cast<UINT>(playerLods[lod].Indices.size());
+  }
+  dprintf("Player LODs: %zu vertices, %zu to %zu triangles\n", playerMesh.Vertices.size(),
+      playerLods[0].Indices.size() / 3, playerLods[NUM_PLAYER_LODS - 1].Indices.size() / 3);
+
   // Concatenate room and player mesh vertices into one vector.
   std::vector<Vertex> vertices(numTotalVertices);
   int k = 0;
-  for (size_t i = 0; i < roomMesh.Vertices.size(); ++i, ++k) {
-    vertices[k].Pos = roomMesh.Vertices[i].Position;
-    vertices[k].Normal = roomMesh.Vertices[i].Normal;
-    vertices[k].TexC = roomMesh.Vertices[i].TexCoord;
+  for (size_t i = 0; i < roomVertexCount; ++i, ++k) {
+    vertices[k].Pos = roomVertices[i].Position;
+    vertices[k].Normal = roomVertices[i].Normal;
+    vertices[k].TexC = roomVertices[i].TexCoord;
   }
   for (size_t i = 0; i < playerMesh.Vertices.size(); ++i, ++k) {
     vertices[k].Pos = playerMesh.Vertices[i].Position;
@@ -377,110 +715,314 @@ void PortalsApp::BuildShapeGeometry() {
   }
 
   // Concatenate room and player mesh indices into one vector.
-  std::vector<std::uint16_t> indices(numTotalIndices);
+  std::vector<std::uint32_t> indices(numTotalIndices);
   k = 0;
-  for (size_t i = 0; i < roomMesh.Indices.size(); ++i, ++k) {
-    indices[k] = static_cast<std::uint16_t>(roomMesh.Indices[i]);
+  for (size_t i = 0; i < roomIndexCount; ++i, ++k) {
+    indices[k] = roomIndices[i];
   }
   for (size_t i = 0; i < playerMesh.Indices.size(); ++i, ++k) {
-    indices[k] = static_cast<std::uint16_t>(playerMesh.Indices[i]);
+    indices[k] = playerMesh.Indices[i];
   }
   for (size_t i = 0; i < portalBoxMesh.Indices.size(); ++i, ++k) {
-    indices[k] = static_cast<std::uint16_t>(portalBoxMesh.Indices[i]);
+    indices[k] = portalBoxMesh.Indices[i];
   }
+  for (int lod = 1; lod < NUM_PLAYER_LODS; ++lod) {
+    for (size_t i = 0; i < playerLods[lod].Indices.size(); ++i, ++k) {
+      indices[k] = playerLods[lod].Indices[i];
+    }
+  }
+
+  // Indices are relative to each submesh's BaseVertexLocation, so 16 bits do unless a single
+  // submesh has more than 65536 vertices; the buffer as a whole may have more.
+  const bool wideIndices = GetMaxIndex(indices.data(), indices.size()) > 0xFFFF;
+  std::vector<std::uint16_t> narrowIndices;
+  if (!wideIndices) {
+    narrowIndices.resize(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+      narrowIndices[i] = static_cast<std::uint16_t>(indices[i]);
+  }
+  const void* indexData = wideIndices ?
+      static_cast<const void*>(indices.data()) : static_cast<const void*>(narrowIndices.data());
   
+  // The GPU gets the vertices compressed, each submesh over its own ranges.  If that would move
+  // any position further than MAX_POSITION_ERROR, every position stays a float instead; a buffer
+  // has only the one layout.  The occlusion buffer and the software renderer read the float
+  // vertices from VertexBufferCPU.
+  static_assert(sizeof(Vertex) == sizeof(FloatVertex), "Vertex must match FloatVertex.");
+  const FloatVertex* floatVertices = reinterpret_cast<const FloatVertex*>(vertices.data());
+  const char* const submeshNames[NUM_SUBMESHES] = { "room", "player", "portalBox" };
+  const int submeshBases[NUM_SUBMESHES] = { roomSubmesh.BaseVertexLocation,
+      playerSubmesh.BaseVertexLocation, portalBoxSubmesh.BaseVertexLocation };
+  const size_t submeshVertexCounts[NUM_SUBMESHES] = {
+      roomVertexCount, playerMesh.Vertices.size(), portalBoxMesh.Vertices.size() };
+  std::vector<CompressedVertex> compressedVertices(numTotalVertices);
+  float maxPositionError = 0.0f;
+  for (int s = 0; s < NUM_SUBMESHES; ++s) {
+    VertexCompressionError error;
+    mVertexQuantizations[s] = CompressSubmesh(submeshNames[s], &floatVertices[submeshBases[s]],
+        submeshVertexCounts[s], &compressedVertices[submeshBases[s]], &error);
+    if (error.MaxPositionError > maxPositionError)
+      maxPositionError = error.MaxPositionError;
+  }
+  mFloatPositions = maxPositionError > MAX_POSITION_ERROR;
+  std::vector<FloatPositionVertex> floatPositionVertices;
+  if (mFloatPositions) {
+    dprintf("Keeping float positions; compressed, they'd move up to %g\n", maxPositionError);
+    floatPositionVertices.resize(numTotalVertices);
+    for (int s = 0; s < NUM_SUBMESHES; ++s) {
+      KeepFloatPositions(&mVertexQuantizations[s]);
+      CompressVertices(&floatVertices[submeshBases[s]], submeshVertexCounts[s],
+          mVertexQuantizations[s], &floatPositionVertices[submeshBases[s]]);
+    }
+  }
+  const void* vertexData = mFloatPositions ?
+      static_cast<const void*>(floatPositionVertices.data()) :
+      static_cast<const void*>(compressedVertices.data());
+  const UINT vertexByteStride = static_cast<UINT>(
+      mFloatPositions ? sizeof(FloatPositionVertex) : sizeof(CompressedVertex));
+
   // Generate MeshGeometry of concatenated meshes.
-  const UINT vbByteSize = static_cast<UINT>(vertices.size() * sizeof(Vertex));
-  const UINT ibByteSize = static_cast<UINT>(indices.size() * sizeof(std::uint16_t));
-  MeshGeometry* geo = &mGeometries["shapeGeo"];
+  const UINT vbCpuByteSize = static_cast<UINT>(vertices.size() * sizeof(Vertex));
+  const UINT vbByteSize = static_cast<UINT>(numTotalVertices * vertexByteStride);
+  const UINT ibByteSize = static_cast<UINT>(indices.size() *
+      (wideIndices ? sizeof(std::uint32_t) : sizeof(std::uint16_t)));
+  dprintf("Vertex buffer: %u bytes compressed, %u as floats\n", vbByteSize, vbCpuByteSize);
+  dprintf("Index buffer: %zu %s-bit indices\n", indices.size(), wideIndices ? "32" : "16");
+  MeshGeometry* geo = &mGeometries[GEOMETRY_SHAPES];
   geo->Name = "shapeGeo";
-  ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-  CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+  ThrowIfFailed(D3DCreateBlob(vbCpuByteSize, &geo->VertexBufferCPU));
+  CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbCpuByteSize);
   ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-  CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-  geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-    mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-  geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-    mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-  geo->VertexByteStride = sizeof(Vertex);
+  CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indexData, ibByteSize);
+  {
+    std::lock_guard<std::mutex> lock(mInitCommandListMutex);
+    geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+      mCommandList.Get(), vertexData, vbByteSize, geo->VertexBufferUploader);
+    geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+      mCommandList.Get(), indexData, ibByteSize, geo->IndexBufferUploader);
+  }
+  geo->VertexByteStride = vertexByteStride;
   geo->VertexBufferByteSize = vbByteSize;
-  geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+  geo->IndexFormat = wideIndices ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
   geo->IndexBufferByteSize = ibByteSize;
+  geo->DrawArgs.clear();
   geo->DrawArgs["room"] = roomSubmesh;
-  //geo->DrawArgs["walls"] = wallsSubmesh;
-  //geo->DrawArgs["floor"] = floorSubmesh;
-  //geo->DrawArgs["ceiling"] = ceilingSubmesh;
+  for (size_t i = 0; i < roomChunkSubmeshes.size(); ++i)
+    geo->DrawArgs["roomChunk" + std::to_string(i)] = roomChunkSubmeshes[i];
   geo->DrawArgs["player"] = playerSubmesh;
+  for (int lod = 1; lod < NUM_PLAYER_LODS; ++lod)
+    geo->DrawArgs["playerLod" + std::to_string(lod)] = playerLodSubmeshes[lod];
   geo->DrawArgs["portalBox"] = portalBoxSubmesh;
 }
 
 void PortalsApp::BuildMaterials() {
-  PhongMaterial* roomMaterial = &mMaterials["room"];
+  PhongMaterial* roomMaterial = &mMaterials[MATERIAL_ROOM];
   roomMaterial->Diffuse = XMFLOAT4(0.8f, 0.8f, 0.8f, 1.0f);
   roomMaterial->Specular = XMFLOAT4(0.6f, 0.6f, 0.6f, 64.0f);
-  roomMaterial->MatCBIndex = 0;
-  roomMaterial->DiffuseSrvHeapIndex = 0;
+  roomMaterial->MatCBIndex = MATERIAL_ROOM;
+  roomMaterial->DiffuseSrvHeapIndex = TEXTURE_ROOM;
 
-  PhongMaterial* playerMaterial = &mMaterials["player"];
+  PhongMaterial* playerMaterial = &mMaterials[MATERIAL_PLAYER];
   playerMaterial->Diffuse = XMFLOAT4(0.8f, 0.8f, 0.8f, 1.0f);
   playerMaterial->Specular = XMFLOAT4(0.6f, 0.6f, 0.6f, 64.0f);
-  playerMaterial->MatCBIndex = 1;
-  playerMaterial->DiffuseSrvHeapIndex = 1;
+  playerMaterial->MatCBIndex = MATERIAL_PLAYER;
+  playerMaterial->DiffuseSrvHeapIndex = TEXTURE_PLAYER;
 }
 
 void PortalsApp::BuildRenderItems() {
   mRoomRenderItem.World = XMMatrixIdentity();
   mRoomRenderItem.TexTransform = XMMatrixScaling(0.25f, 0.25f, 1.0f);
   mRoomRenderItem.ObjCBIndex = 0;
-  mRoomRenderItem.Mat = &mMaterials["room"];
-  mRoomRenderItem.Geo = &mGeometries["shapeGeo"];
+  mRoomRenderItem.Mat = &mMaterials[MATERIAL_ROOM];
+  mRoomRenderItem.Geo = &mGeometries[GEOMETRY_SHAPES];
   mRoomRenderItem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
   const SubmeshGeometry& roomSubMesh = mRoomRenderItem.Geo->DrawArgs["room"];
   mRoomRenderItem.IndexCount = roomSubMesh.IndexCount;
   mRoomRenderItem.StartIndexLocation = roomSubMesh.StartIndexLocation;
   mRoomRenderItem.BaseVertexLocation = roomSubMesh.BaseVertexLocation;
+  mRoomRenderItem.Quantization = mVertexQuantizations[SUBMESH_ROOM];
+  mRoomRenderItem.NumFramesDirty = gNumFrameResources;
+  mRoomRenderItem.Chunks.clear();
+  for (size_t i = 0; ; ++i) {
+    auto chunk = mRoomRenderItem.Geo->DrawArgs.find("roomChunk" + std::to_string(i));
+    if (chunk == mRoomRenderItem.Geo->DrawArgs.end())
+      break;
+    mRoomRenderItem.Chunks.push_back(chunk->second);
+  }
+  mRoomChunkCells.assign(mRoomRenderItem.Chunks.size(), std::vector<int>());
+  for (size_t i = 0; i < mRoomRenderItem.Chunks.size(); ++i) {
+    const BoundingBox& bounds = mRoomRenderItem.Chunks[i].Bounds;
+    const PolygonPoint boundsMin = {
+        bounds.Center.x - bounds.Extents.x, bounds.Center.z - bounds.Extents.z };
+    const PolygonPoint boundsMax = {
+        bounds.Center.x + bounds.Extents.x, bounds.Center.z + bounds.Extents.z };
+    mRoom.GetCells().GatherCellsInBounds(boundsMin, boundsMax, &mRoomChunkCells[i]);
+  }
 
   mPlayerRenderItem.World = mPlayer.GetWorldMatrix();   // Update whenever player moves
   mPlayerRenderItem.TexTransform = XMMatrixIdentity();
   mPlayerRenderItem.ObjCBIndex = 1;
-  mPlayerRenderItem.Mat = &mMaterials["player"];
-  mPlayerRenderItem.Geo = &mGeometries["shapeGeo"];
+  mPlayerRenderItem.Mat = &mMaterials[MATERIAL_PLAYER];
+  mPlayerRenderItem.Geo = &mGeometries[GEOMETRY_SHAPES];
   mPlayerRenderItem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
   const SubmeshGeometry& playerSubmesh = mPlayerRenderItem.Geo->DrawArgs["player"];
   mPlayerRenderItem.IndexCount = playerSubmesh.IndexCount;
   mPlayerRenderItem.StartIndexLocation = playerSubmesh.StartIndexLocation;
   mPlayerRenderItem.BaseVertexLocation = playerSubmesh.BaseVertexLocation;
+  mPlayerRenderItem.Quantization = mVertexQuantizations[SUBMESH_PLAYER];
+  mPlayerRenderItem.NumFramesDirty = gNumFrameResources;
+  mPlayerRenderItem.Lods.assign(1, playerSubmesh);
+  for (int lod = 1; lod < NUM_PLAYER_LODS; ++lod) {
+    mPlayerRenderItem.Lods.push_back(
+        mPlayerRenderItem.Geo->DrawArgs["playerLod" + std::to_string(lod)]);
+  }
 
   mPortalBoxARenderItem.World = mPortalA.GetXYScaledPortalToWorldMatrix(); // Update whenever portal A moves
   mPortalBoxARenderItem.TexTransform = XMMatrixIdentity();    // unused
   mPortalBoxARenderItem.ObjCBIndex = 2;
-  mPortalBoxARenderItem.Mat = &mMaterials["room"];            // unused
-  mPortalBoxARenderItem.Geo = &mGeometries["shapeGeo"];
+  mPortalBoxARenderItem.Mat = &mMaterials[MATERIAL_ROOM];     // unused
+  mPortalBoxARenderItem.Geo = &mGeometries[GEOMETRY_SHAPES];
   mPortalBoxARenderItem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
   const SubmeshGeometry& portalBoxASubmesh = mPortalBoxARenderItem.Geo->DrawArgs["portalBox"];
   mPortalBoxARenderItem.IndexCount = portalBoxASubmesh.IndexCount;
   mPortalBoxARenderItem.StartIndexLocation = portalBoxASubmesh.StartIndexLocation;
   mPortalBoxARenderItem.BaseVertexLocation = portalBoxASubmesh.BaseVertexLocation;
+  mPortalBoxARenderItem.Quantization = mVertexQuantizations[SUBMESH_PORTAL_BOX];
+  mPortalBoxARenderItem.NumFramesDirty = gNumFrameResources;
 
   mPortalBoxBRenderItem.World = mPortalB.GetXYScaledPortalToWorldMatrix(); // Update whenever portal B moves
   mPortalBoxBRenderItem.TexTransform = XMMatrixIdentity();    // unused
   mPortalBoxBRenderItem.ObjCBIndex = 3;
-  mPortalBoxBRenderItem.Mat = &mMaterials["room"];            // unused
-  mPortalBoxBRenderItem.Geo = &mGeometries["shapeGeo"];
+  mPortalBoxBRenderItem.Mat = &mMaterials[MATERIAL_ROOM];     // unused
+  mPortalBoxBRenderItem.Geo = &mGeometries[GEOMETRY_SHAPES];
   mPortalBoxBRenderItem.PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
   const SubmeshGeometry& portalBoxBSubmesh = mPortalBoxBRenderItem.Geo->DrawArgs["portalBox"];
   mPortalBoxBRenderItem.IndexCount = portalBoxBSubmesh.IndexCount;
   mPortalBoxBRenderItem.StartIndexLocation = portalBoxBSubmesh.StartIndexLocation;
   mPortalBoxBRenderItem.BaseVertexLocation = portalBoxBSubmesh.BaseVertexLocation;
+  mPortalBoxBRenderItem.Quantization = mVertexQuantizations[SUBMESH_PORTAL_BOX];
+  mPortalBoxBRenderItem.NumFramesDirty = gNumFrameResources;
+
+  // The decals' geometry is filled in by BuildPortalDecals.
+  mPortalDecalARenderItem.World = XMMatrixIdentity();
+  mPortalDecalARenderItem.ObjCBIndex = 4;
+  mPortalDecalARenderItem.Mat = &mMaterials[MATERIAL_ROOM];   // unused
+  mPortalDecalBRenderItem.World = XMMatrixIdentity();
+  mPortalDecalBRenderItem.ObjCBIndex = 5;
+  mPortalDecalBRenderItem.Mat = &mMaterials[MATERIAL_ROOM];   // unused
+  // No portal matrix has a zero diagonal, so the first call always builds them.
+  mPortalDecalAToWorld = XMFLOAT4X4();
+  mPortalDecalBToWorld = XMFLOAT4X4();
+  BuildPortalDecals();
+}
+
+// Rebuilds the rims around the portals' holes if either portal moved or resized since they were
+// last built.  Each rim is clipped to the wall, floor or ceiling its portal is on.
+void PortalsApp::BuildPortalDecals() {
+  XMFLOAT4X4 portalAToWorld, portalBToWorld;
+  XMStoreFloat4x4(&portalAToWorld, mPortalA.GetXYScaledPortalToWorldMatrix());
+  XMStoreFloat4x4(&portalBToWorld, mPortalB.GetXYScaledPortalToWorldMatrix());
+  if (memcmp(&portalAToWorld, &mPortalDecalAToWorld, sizeof(XMFLOAT4X4)) == 0 &&
+      memcmp(&portalBToWorld, &mPortalDecalBToWorld, sizeof(XMFLOAT4X4)) == 0)
+    return;
+  mPortalDecalAToWorld = portalAToWorld;
+  mPortalDecalBToWorld = portalBToWorld;
+
+  static_assert(sizeof(Vertex) == sizeof(PortalDecalVertex),
+      "Vertex must match PortalDecalVertex.");
+  const Portal* portals[2] = { &mPortalA, &mPortalB };
+  const XMFLOAT4X4* portalToWorlds[2] = { &portalAToWorld, &portalBToWorld };
+  RenderItem* items[2] = { &mPortalDecalARenderItem, &mPortalDecalBRenderItem };
+  mPortalDecalVertices.clear();
+  mPortalDecalIndices.clear();
+  PortalDecalMesh mesh;
+  std::vector<XMFLOAT3> surface;
+  for (int i = 0; i < 2; ++i) {
+    if (!mRoom.GetSurfacePolygon(portals[i]->GetPosition(), portals[i]->GetNormal(), &surface))
+      surface.clear();
+    BuildPortalDecal(portalToWorlds[i]->m, portals[i]->GetTextureRadiusRatio(),
+        reinterpret_cast<const float (*)[3]>(surface.data()), static_cast<int>(surface.size()),
+        &mesh);
+
+    items[i]->IndexCount = static_cast<UINT>(mesh.Indices.size());
+    items[i]->StartIndexLocation = static_cast<UINT>(mPortalDecalIndices.size());
+    items[i]->BaseVertexLocation = static_cast<int>(mPortalDecalVertices.size());
+    const Vertex* vertices = reinterpret_cast<const Vertex*>(mesh.Vertices.data());
+    mPortalDecalVertices.insert(
+        mPortalDecalVertices.end(), vertices, vertices + mesh.Vertices.size());
+    for (uint32_t index : mesh.Indices)
+      mPortalDecalIndices.push_back(static_cast<std::uint16_t>(index));
+  }
+
+  // Positions over the room's ranges; texture coordinates over the decals' own.
+  static_assert(sizeof(Vertex) == sizeof(FloatVertex), "Vertex must match FloatVertex.");
+  const FloatVertex* floatVertices =
+      reinterpret_cast<const FloatVertex*>(mPortalDecalVertices.data());
+  VertexQuantization quantization =
+      ComputeVertexQuantization(floatVertices, mPortalDecalVertices.size());
+  const VertexQuantization& roomQuantization = mRoomRenderItem.Quantization;
+  for (int i = 0; i < 3; ++i) {
+    quantization.PosOffset[i] = roomQuantization.PosOffset[i];
+    quantization.PosScale[i] = roomQuantization.PosScale[i];
+  }
+  if (mFloatPositions) {
+    mPortalDecalCompressedVertices.clear();
+    mPortalDecalFloatPositionVertices.resize(mPortalDecalVertices.size());
+    CompressVertices(floatVertices, mPortalDecalVertices.size(), quantization,
+                     mPortalDecalFloatPositionVertices.data());
+  } else {
+    mPortalDecalFloatPositionVertices.clear();
+    mPortalDecalCompressedVertices.resize(mPortalDecalVertices.size());
+    CompressVertices(floatVertices, mPortalDecalVertices.size(), quantization,
+                     mPortalDecalCompressedVertices.data());
+  }
+  for (RenderItem* item : items) {
+    item->Quantization = quantization;
+    item->NumFramesDirty = gNumFrameResources;
+  }
+}
+
+void PortalsApp::SetFramesInFlight(int count) {
+  if (count < 1)
+    throw std::runtime_error("Frames in flight must be at least 1");
+
+  if (md3dDevice == nullptr || mFrameResources.empty()) {
+    gNumFrameResources = count;
+    return;
+  }
+
+  // No frame resource may be in use by the GPU while they are rebuilt.
+  FlushCommandQueue();
+  mFrameResources.clear();
+  mCurrentFrameResource = nullptr;
+
+  gNumFrameResources = count;
+  BuildFrameResources();
+  mCurrentFrameResourceIndex = 0;
+
+  // Every new frame resource needs the current constants.
+  mRoomRenderItem.NumFramesDirty = gNumFrameResources;
+  mPlayerRenderItem.NumFramesDirty = gNumFrameResources;
+  mPortalBoxARenderItem.NumFramesDirty = gNumFrameResources;
+  mPortalBoxBRenderItem.NumFramesDirty = gNumFrameResources;
+  mPortalDecalARenderItem.NumFramesDirty = gNumFrameResources;
+  mPortalDecalBRenderItem.NumFramesDirty = gNumFrameResources;
+  for (PhongMaterial& material : mMaterials)
+    material.NumFramesDirty = gNumFrameResources;
 }
 
 void PortalsApp::BuildFrameResources() {
   for (int i = 0; i < gNumFrameResources; ++i) {
     mFrameResources.push_back(std::make_unique<FrameResource>(
-        md3dDevice.Get(), /*objectCount=*/4, NUM_CLIP_PLANE_CBS, NUM_WORLD2_CBS,
-        /*passCount=*/1 + 2 * PORTAL_ITERATIONS,
-        /*materialCount=*/static_cast<UINT>(mMaterials.size())));
+        md3dDevice.Get(), gNumRecordThreads, /*objectCount=*/6,
+        /*materialCount=*/NUM_MATERIALS));
   }
+
+  mConstantRing = std::make_unique<UploadRing>(md3dDevice.Get(), CONSTANT_RING_BYTE_SIZE);
+  mClipPlaneCBAddresses.resize(NUM_CLIP_PLANE_CBS);
+  mWorld2CBAddresses.resize(NUM_WORLD2_CBS);
+  mClipPlaneCBData.resize(NUM_CLIP_PLANE_CBS);
+  mWorld2CBData.resize(NUM_WORLD2_CBS);
 }
 
 void PortalsApp::BuildPSOs() {
@@ -488,7 +1030,9 @@ void PortalsApp::BuildPSOs() {
   ZeroMemory(&psoDesc, sizeof(D3D12_GRAPHICS_PIPELINE_STATE_DESC));
 
   // Common settings used by all PSOs.
-  psoDesc.InputLayout = { mInputLayout.data(), (UINT)mInputLayout.size() };
+  const std::vector<D3D12_INPUT_ELEMENT_DESC>& inputLayout =
+      mFloatPositions ? mFloatPositionInputLayout : mInputLayout;
+  psoDesc.InputLayout = { inputLayout.data(), (UINT)inputLayout.size() };
   psoDesc.pRootSignature = mRootSignature.Get();
   psoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
   psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
@@ -503,84 +1047,84 @@ void PortalsApp::BuildPSOs() {
   // default PSO, for rendering room and player
   
   // default PSO, pixels are clipped against a plane, and stencil test pass when >= ref value.
-  ID3DBlob* shader = mShaders["defaultVS"].Get();
+  ID3DBlob* shader = mShaders[SHADER_DEFAULT_VS].Get();
   psoDesc.VS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
-  shader = mShaders["defaultClipPS"].Get();
+  shader = mShaders[SHADER_DEFAULT_CLIP_PS].Get();
   psoDesc.PS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
   psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
   psoDesc.DepthStencilState.StencilEnable = true;
   psoDesc.DepthStencilState.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
   ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
-      &psoDesc, IID_PPV_ARGS(&mPSOs["defaultClip"])));
+      &psoDesc, IID_PPV_ARGS(&mPSOs[PSO_DEFAULT_CLIP])));
 
   // default PSO, pixels are clipped against two planes, and stencil test pass when >= ref value.
-  shader = mShaders["defaultVS"].Get();
+  shader = mShaders[SHADER_DEFAULT_VS].Get();
   psoDesc.VS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
-  shader = mShaders["defaultClipTwicePS"].Get();
+  shader = mShaders[SHADER_DEFAULT_CLIP_TWICE_PS].Get();
   psoDesc.PS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
   psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
   psoDesc.DepthStencilState.StencilEnable = true;
   psoDesc.DepthStencilState.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
   ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
-      &psoDesc, IID_PPV_ARGS(&mPSOs["defaultClipTwice"])));
+      &psoDesc, IID_PPV_ARGS(&mPSOs[PSO_DEFAULT_CLIP_TWICE])));
   
-  // default PSO with portal hole and textures rendered,
+  // default PSO with portal holes cut out,
   // pixels are clipped against a plane, and stencil test pass when >= ref value.
-  shader = mShaders["defaultPortalsVS"].Get();
+  shader = mShaders[SHADER_DEFAULT_VS].Get();
   psoDesc.VS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
-  shader = mShaders["defaultPortalsClipPS"].Get();
+  shader = mShaders[SHADER_DEFAULT_PORTALS_CLIP_PS].Get();
   psoDesc.PS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
   psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
   psoDesc.DepthStencilState.StencilEnable = true;
   psoDesc.DepthStencilState.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
   ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
-      &psoDesc, IID_PPV_ARGS(&mPSOs["defaultPortalsClip"])));
+      &psoDesc, IID_PPV_ARGS(&mPSOs[PSO_DEFAULT_PORTALS_CLIP])));
 
   // portalBox PSO, for rendering a box behind a portal hole to stencil.
 
   // portalBox PSO with stencil test always passes and replaces with ref value.
-  shader = mShaders["portalBoxVS"].Get();
+  shader = mShaders[SHADER_PORTAL_BOX_VS].Get();
   psoDesc.VS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
-  shader = mShaders["portalBoxPS"].Get();
+  shader = mShaders[SHADER_PORTAL_BOX_PS].Get();
   psoDesc.PS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
   psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
   psoDesc.DepthStencilState.StencilEnable = true;
   psoDesc.DepthStencilState.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_ALWAYS;
   psoDesc.DepthStencilState.FrontFace.StencilPassOp = D3D12_STENCIL_OP_REPLACE;
   ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
-      &psoDesc, IID_PPV_ARGS(&mPSOs["portalBoxStencilSet"])));
+      &psoDesc, IID_PPV_ARGS(&mPSOs[PSO_PORTAL_BOX_STENCIL_SET])));
 
   // portalbox PSO with pixels clipped against a plane, stencil test pass when >= ref value,
   // and increments stencil values.
-  shader = mShaders["portalBoxVS"].Get();
+  shader = mShaders[SHADER_PORTAL_BOX_VS].Get();
   psoDesc.VS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
-  shader = mShaders["portalBoxClipPS"].Get();
+  shader = mShaders[SHADER_PORTAL_BOX_CLIP_PS].Get();
   psoDesc.PS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
   psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
   psoDesc.DepthStencilState.StencilEnable = true;
   psoDesc.DepthStencilState.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
   psoDesc.DepthStencilState.FrontFace.StencilPassOp = D3D12_STENCIL_OP_INCR;
   ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
-      &psoDesc, IID_PPV_ARGS(&mPSOs["portalBoxStencilIncr"])));
+      &psoDesc, IID_PPV_ARGS(&mPSOs[PSO_PORTAL_BOX_STENCIL_INCR])));
 
   // portalbox PSO with stencil test pass when >= ref value, disable depth test, and write
   // max depth value to depth buffer.
-  shader = mShaders["portalBoxClearDepthVS"].Get();
+  shader = mShaders[SHADER_PORTAL_BOX_CLEAR_DEPTH_VS].Get();
   psoDesc.VS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
-  shader = mShaders["portalBoxPS"].Get();
+  shader = mShaders[SHADER_PORTAL_BOX_PS].Get();
   psoDesc.PS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
   psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
   psoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_ALWAYS;
   psoDesc.DepthStencilState.StencilEnable = true;
   psoDesc.DepthStencilState.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
   ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
-      &psoDesc, IID_PPV_ARGS(&mPSOs["portalBoxClearDepth"])));
+      &psoDesc, IID_PPV_ARGS(&mPSOs[PSO_PORTAL_BOX_CLEAR_DEPTH])));
 
   // portalbox PSO with stencil test pass when >= ref value, disable depth test, and zero stencil
   // values. Does not write any colors to render target.
-  shader = mShaders["portalBoxVS"].Get();
+  shader = mShaders[SHADER_PORTAL_BOX_VS].Get();
   psoDesc.VS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
-  shader = mShaders["portalBoxPS"].Get();
+  shader = mShaders[SHADER_PORTAL_BOX_PS].Get();
   psoDesc.PS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
   psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
   psoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_ALWAYS;
@@ -590,7 +1134,49 @@ void PortalsApp::BuildPSOs() {
   psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
   psoDesc.BlendState.RenderTarget[0].RenderTargetWriteMask = 0;
   ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
-      &psoDesc, IID_PPV_ARGS(&mPSOs["portalBoxDepthAlwaysStencilZero"])));
+      &psoDesc, IID_PPV_ARGS(&mPSOs[PSO_PORTAL_BOX_DEPTH_ALWAYS_STENCIL_ZERO])));
+
+  // portalDecal PSOs, alpha-blended over the room with depth biased toward the camera and no
+  // depth writes, pixels are clipped against a plane, and stencil test pass when >= ref value.
+  psoDesc.RasterizerState.DepthBias = PORTAL_DECAL_DEPTH_BIAS;
+  psoDesc.RasterizerState.SlopeScaledDepthBias = PORTAL_DECAL_SLOPE_SCALED_DEPTH_BIAS;
+  psoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+  D3D12_RENDER_TARGET_BLEND_DESC& blend = psoDesc.BlendState.RenderTarget[0];
+  blend.BlendEnable = true;
+  blend.SrcBlend = D3D12_BLEND_SRC_ALPHA;
+  blend.DestBlend = D3D12_BLEND_INV_SRC_ALPHA;
+  blend.SrcBlendAlpha = D3D12_BLEND_SRC_ALPHA;
+  blend.DestBlendAlpha = D3D12_BLEND_INV_SRC_ALPHA;
+  psoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+  psoDesc.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+  psoDesc.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ZERO;
+  psoDesc.DepthStencilState.StencilEnable = true;
+  psoDesc.DepthStencilState.FrontFace.StencilFunc = D3D12_COMPARISON_FUNC_LESS_EQUAL;
+  const PsoId decalPsos[2] = { PSO_PORTAL_DECAL_A_CLIP, PSO_PORTAL_DECAL_B_CLIP };
+  const ShaderId decalShaders[2] = { SHADER_PORTAL_DECAL_A_CLIP_PS, SHADER_PORTAL_DECAL_B_CLIP_PS };
+  for (int i = 0; i < 2; ++i) {
+    shader = mShaders[SHADER_PORTAL_DECAL_VS].Get();
+    psoDesc.VS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
+    shader = mShaders[decalShaders[i]].Get();
+    psoDesc.PS = { reinterpret_cast<BYTE*>(shader->GetBufferPointer()), shader->GetBufferSize() };
+    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(
+        &psoDesc, IID_PPV_ARGS(&mPSOs[decalPsos[i]])));
+  }
+}
+
+void PortalsApp::BuildRecordCommandLists() {
+  // Command lists are created against the first frame resource's allocators; BeginRecording
+  // resets them onto the current frame resource's allocators every frame.
+  for (int i = 0; i < gNumRecordThreads; ++i) {
+    ThrowIfFailed(md3dDevice->CreateCommandList(
+        0, D3D12_COMMAND_LIST_TYPE_DIRECT, mFrameResources[0]->CmdListAllocs[i].Get(), nullptr,
+        IID_PPV_ARGS(mRecordCommandLists[i].GetAddressOf())));
+
+    // Start off in a closed state, like mCommandList.
+    ThrowIfFailed(mRecordCommandLists[i]->Close());
+  }
+
+  mRecordThreads = std::make_unique<WorkerThreads>(gNumRecordThreads);
 }
 
 void PortalsApp::OnResize() {
@@ -607,13 +1193,9 @@ void PortalsApp::Update(float dt) {
 
   // Has the GPU finished processing the commands of the current frame resource?
   // If not, wait until the GPU has completed commands up to this fence point.
-  if (mCurrentFrameResource->Fence != 0 &&
-      mFence->GetCompletedValue() < mCurrentFrameResource->Fence) {
-    HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
-    ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFrameResource->Fence, eventHandle));
-    WaitForSingleObject(eventHandle, INFINITE);
-    CloseHandle(eventHandle);
-  }
+  mFramePacer->WaitForGpu(mCurrentFrameResource->Fence);
+  mConstantRing->Reclaim(mFence->GetCompletedValue());
+  mSrvDescriptors->Reclaim(mFence->GetCompletedValue());
 
   // Portals cannot be changed if either portal intersects the player or the spectator camera
   bool modifyPortal = (!mPlayerIntersectPortalA && !mPlayerIntersectPortalB) &&
@@ -622,10 +1204,42 @@ void PortalsApp::Update(float dt) {
     !mPortalB.IntersectSphereFromFront(
         mLeftCamera.GetPosition(), mLeftCamera.GetBoundingSphereRadius() + 0.001f);
 
+  mFramePacer->OnInputSampled();
   OnKeyboardInput(dt, modifyPortal);
+  CrossDoorways();
+  BuildPortalDecals();
   UpdateObjectCBs();
   UpdateMaterialBuffer();
   UpdateFrameCB();
+  UploadPortalDecals();
+
+  // Stream texture mips for where things are now.  Textures replaced by the streamer only show up
+  // in this frame's descriptor table; frames in flight keep the tables they were recorded with.
+  RequestTextureSizes();
+  mTextureStreamer->Update(mCurrentFence + 1, mFence->GetCompletedValue());
+  UpdateTextureDescriptors();
+
+  const TextureStreamer::Stats& streamingStats = mTextureStreamer->GetStats();
+  if (streamingStats.LoadsCompleted != mTextureStreamingStats.LoadsCompleted ||
+      streamingStats.MipsEvicted != mTextureStreamingStats.MipsEvicted) {
+    dprintf("Texture streaming: %.1f of %.1f MB resident, %u loads (%u deferred), "
+        "%u mips evicted\n", streamingStats.ResidentBytes / 1048576.0,
+        streamingStats.BudgetBytes / 1048576.0, streamingStats.LoadsCompleted,
+        streamingStats.LoadsDeferred, streamingStats.MipsEvicted);
+    mTextureStreamingStats = streamingStats;
+  }
+
+  // Stream rooms for where the player is now.
+  mRoomLoader->Update(mCurrentFence + 1, mCurrentRoomIndex);
+  const RoomStreamer::Stats& roomStats = mRoomLoader->GetStats();
+  if (roomStats.LoadsCompleted != mRoomStreamingStats.LoadsCompleted ||
+      roomStats.RoomsEvicted != mRoomStreamingStats.RoomsEvicted) {
+    dprintf("Room streaming: %u rooms, %.1f of %.1f MB resident, %u loads (%u deferred), "
+        "%u rooms evicted\n", roomStats.ResidentRooms, roomStats.ResidentBytes / 1048576.0,
+        roomStats.BudgetBytes / 1048576.0, roomStats.LoadsCompleted, roomStats.LoadsDeferred,
+        roomStats.RoomsEvicted);
+    mRoomStreamingStats = roomStats;
+  }
 
   XMFLOAT3 zero(0.0f, 0.0f, 0.0f);
   const float clipPlaneOffest = -0.001f;
@@ -646,64 +1260,12 @@ void PortalsApp::Update(float dt) {
 }
 
 void PortalsApp::Draw(float dt) {
-  ComPtr<ID3D12CommandAllocator> cmdListAlloc = mCurrentFrameResource->CmdListAlloc;
-
-  // Reuse the memory associated with command recording.
-  // We can only reset when the associated command lists have finished execution on the GPU.
-  ThrowIfFailed(cmdListAlloc->Reset());
-
-  // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
-  // Reusing the command list reuses memory.
-  ThrowIfFailed(
-      mCommandList->Reset(cmdListAlloc.Get(), mPSOs["defaultPortalsClip"].Get()));
-
-  // Indicate a state transition on the resource usage.
-  mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-    D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
-
-  mCommandList->RSSetViewports(1, &mScreenViewport);
-  mCommandList->RSSetScissorRects(1, &mScissorRect);
-
-  // Clear the back buffer.
-  mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::SkyBlue, 0, nullptr);
-  // Clear depth and stencil buffers.
-  mCommandList->ClearDepthStencilView(
-    DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
-
-  // Specify the buffers we are going to render to.
-  mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
-
-  ID3D12DescriptorHeap* descriptorHeap = mSrvDescriptorHeap.Get();
-  mCommandList->SetDescriptorHeaps(1, &descriptorHeap);
-
-  mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
-
-  // Bind all the materials used in this scene.  For structured buffers, we can bypass the heap and 
-  // set as a root descriptor.
-  mCommandList->SetGraphicsRootShaderResourceView(
-      SRV_MATERIAL_DATA_ROOT_INDEX,
-      mCurrentFrameResource->MaterialBuffer.Resource()->GetGPUVirtualAddress());
-
-  // Bind room and player textures to gTextureMaps[2].
-  CD3DX12_GPU_DESCRIPTOR_HANDLE srvDescriptor(
-      mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-  mCommandList->SetGraphicsRootDescriptorTable(DT_TEXTURE_MAPS_ROOT_INDEX, srvDescriptor);
-
-  // Bind portalA and portalB textures to gPortalADiffuseMap and gPortalBDiffuseMap.
-  srvDescriptor.Offset(2, mCbvSrvUavDescriptorSize);
-  mCommandList->SetGraphicsRootDescriptorTable(DT_PORTAL_MAPS_ROOT_INDEX, srvDescriptor);
-
-  // Bind per-frame constant buffer.
-  mCommandList->SetGraphicsRootConstantBufferView(
-      CB_PER_FRAME_ROOT_INDEX, mCurrentFrameResource->FrameCB.Resource()->GetGPUVirtualAddress());
-
-  
-  const UINT portalAStencilRef = 2;
-  const UINT portalBStencilRef = 1;
+  const UINT portalAStencilRef = PORTAL_A_STENCIL_REF;
+  const UINT portalBStencilRef = PORTAL_B_STENCIL_REF;
   assert(portalAStencilRef > portalBStencilRef);
   
-  const UINT portalAIterations = 8;
-  const UINT portalBIterations = 8;
+  const UINT portalAIterations = PORTAL_A_ITERATIONS;
+  const UINT portalBIterations = PORTAL_B_ITERATIONS;
 
   // Compute per-pass constant buffer values for all iterations.
 
@@ -712,142 +1274,240 @@ void PortalsApp::Draw(float dt) {
   const float distDilation = 1.0f / mLeftCamera.GetViewScale();
   const float radiusAoverB = mPortalA.GetPhysicalRadius() / mPortalB.GetPhysicalRadius();
 
+  mPassCBAddresses.resize(1 + portalAIterations + portalBIterations);
+  mPassCBData.resize(1 + portalAIterations + portalBIterations);
+  mPlayerPassLods.resize(1 + portalAIterations + portalBIterations);
+  mRoomPassRanges.resize(1 + portalAIterations + portalBIterations);
+  mPlayerPassVisible.resize(1 + portalAIterations + portalBIterations);
   UpdatePassCB(0, viewProj, eyePosW, distDilation);
+  mPlayerPassLods[0] = ChoosePlayerLod(XMMatrixIdentity());
+
+  // The main view sees what the camera's cell can.  Looking into portal A is looking out of
+  // portal B, so the passes inside A see what the cells around B can, and the other way round.
+  const CellGraph& cells = mRoom.GetCells();
+  MarkCellsVisibleFrom(cells, eyePosW, mLeftCamera.GetBoundingSphereRadius(), &mViewCells);
+  MarkCellsVisibleFrom(
+      cells, mPortalB.GetPosition(), mPortalB.GetPhysicalRadius(), &mPortalAPassCells);
+  MarkCellsVisibleFrom(
+      cells, mPortalA.GetPosition(), mPortalA.GetPhysicalRadius(), &mPortalBPassCells);
+  const XMFLOAT3 playerPositionW = mPlayer.GetPosition();
+  const float playerRadius = mPlayer.GetBoundingSphereRadius();
+  const PolygonPoint playerMin = {
+      playerPositionW.x - playerRadius, playerPositionW.z - playerRadius };
+  const PolygonPoint playerMax = {
+      playerPositionW.x + playerRadius, playerPositionW.z + playerRadius };
+  mPlayerCells.clear();
+  cells.GatherCellsInBounds(playerMin, playerMax, &mPlayerCells);
+
+  XMFLOAT4X4 viewProjF;
+  XMStoreFloat4x4(&viewProjF, viewProj);
+  mViewFrustum.SetViewProj(viewProjF.m);
+  CullPass(0, mViewFrustum, mViewCells);
+
+  // Each level inside a portal is seen through the openings of all the levels before it.  In the
+  // main view's space, those are the portal's own opening moved by the virtualization matrix once
+  // per level; the frustum narrowed by them is moved into world space to cull the level.
+  XMFLOAT3 opening[PORTAL_BOX_N_SIDES];
+  XMFLOAT4X4 worldToVirtualF;
 
   const UINT portalACBIndexBase = 1;
   const UINT portalBCBIndexBase = portalACBIndexBase + portalAIterations;
   // Compute per-pass constant buffer values for rendering inside portal A.
   XMMATRIX virtualViewProj = viewProj;
+  XMMATRIX worldToVirtual = XMMatrixIdentity();
   XMVECTOR virtualEyePosWH = XMVectorSet(eyePosW.x, eyePosW.y, eyePosW.z, 1.0f);
   float virtualDistDilation = distDilation;
+  mPortalFrustum = mViewFrustum;
+  GetPortalOpening(mPortalA, opening);
   for (UINT i = portalACBIndexBase; i < portalACBIndexBase + portalAIterations; ++i) {
     virtualViewProj = mPortalBToA * virtualViewProj;
+    worldToVirtual = mPortalBToA * worldToVirtual;
     virtualEyePosWH = XMVector4Transform(virtualEyePosWH, mPortalAToB);
     virtualDistDilation *= radiusAoverB;
 
     XMFLOAT3 virtualEyePosW;
     DirectX::XMStoreFloat3(&virtualEyePosW, virtualEyePosWH);
     UpdatePassCB(i, virtualViewProj, virtualEyePosW, virtualDistDilation);
+    mPlayerPassLods[i] = ChoosePlayerLod(worldToVirtual);
+
+    mPortalFrustum.ClipToOpening(&eyePosW.x, reinterpret_cast<const float (*)[3]>(opening),
+        PORTAL_BOX_N_SIDES, PORTAL_CULL_MIN_EYE_DISTANCE);
+    XMStoreFloat4x4(&worldToVirtualF, worldToVirtual);
+    mPortalFrustum.Transform(worldToVirtualF.m, &mPassFrustum);
+    CullPass(i, mPassFrustum, mPortalAPassCells);
+    TransformOpening(opening, mPortalBToA);
   }
   // Compute per-pass constant buffer values for rendering inside portal B.
   virtualViewProj = viewProj;
+  worldToVirtual = XMMatrixIdentity();
   virtualEyePosWH = XMVectorSet(eyePosW.x, eyePosW.y, eyePosW.z, 1.0f);
   virtualDistDilation = distDilation;
+  mPortalFrustum = mViewFrustum;
+  GetPortalOpening(mPortalB, opening);
   for (UINT i = portalBCBIndexBase; i < portalBCBIndexBase + portalBIterations; ++i) {
     virtualViewProj = mPortalAToB * virtualViewProj;
+    worldToVirtual = mPortalAToB * worldToVirtual;
     virtualEyePosWH = XMVector4Transform(virtualEyePosWH, mPortalBToA);
     virtualDistDilation /= radiusAoverB;
 
     XMFLOAT3 virtualEyePosW;
     DirectX::XMStoreFloat3(&virtualEyePosW, virtualEyePosWH);
     UpdatePassCB(i, virtualViewProj, virtualEyePosW, virtualDistDilation);
+    mPlayerPassLods[i] = ChoosePlayerLod(worldToVirtual);
+
+    mPortalFrustum.ClipToOpening(&eyePosW.x, reinterpret_cast<const float (*)[3]>(opening),
+        PORTAL_BOX_N_SIDES, PORTAL_CULL_MIN_EYE_DISTANCE);
+    XMStoreFloat4x4(&worldToVirtualF, worldToVirtual);
+    mPortalFrustum.Transform(worldToVirtualF.m, &mPassFrustum);
+    CullPass(i, mPassFrustum, mPortalBPassCells);
+    TransformOpening(opening, mPortalAToB);
   }
 
-  // Draw room without clipping or stencil-rejecting anything (clip plane is set to dummy plane
-  // and stencil buffer is all 0s initially, so stencil test will always pass).
-
-  // Set clip plane to no clipping.
-  mCommandList->SetGraphicsRootConstantBufferView(
-      CB_CLIP_PLANE_ROOT_INDEX,
-      mCurrentFrameResource->ClipPlaneCB.GetResourceGPUVirtualAddress(
-          CLIP_PLANE_DUMMY_CB_INDEX));
-  // Set per-pass constant buffer to unmodified view space.
-  mCommandList->SetGraphicsRootConstantBufferView(
-      CB_PER_PASS_ROOT_INDEX,
-      mCurrentFrameResource->PassCB.GetResourceGPUVirtualAddress(0));
-  // Set world2 matrix to identity matrix.
-  mCommandList->SetGraphicsRootConstantBufferView(
-      CB_WORLD2_ROOT_INDEX,
-      mCurrentFrameResource->World2CB.GetResourceGPUVirtualAddress(
-          WORLD2_IDENTITY_CB_INDEX));
-  mCommandList->OMSetStencilRef(0);
-
-  // Draw real room
-  DrawRenderItem(mCommandList.Get(), &mRoomRenderItem);
-
-  // Draw real player or player halves.
-  if (mPlayerIntersectPortalA) {
-    DrawIntersectingPlayerRealHalves(
-        CLIP_PLANE_PORTAL_A_B_CB_INDEX, CLIP_PLANE_PORTAL_B_A_CB_INDEX, WORLD2_PORTAL_A_TO_B_CB_INDEX);
-  } else if (mPlayerIntersectPortalB) {
-    DrawIntersectingPlayerRealHalves(
-        CLIP_PLANE_PORTAL_B_A_CB_INDEX, CLIP_PLANE_PORTAL_A_B_CB_INDEX, WORLD2_PORTAL_B_TO_A_CB_INDEX);
-  } else {
-    mCommandList->SetPipelineState(mPSOs["defaultClip"].Get());
-    DrawRenderItem(mCommandList.Get(), &mPlayerRenderItem);
-  }
-
-  // Draw portal boxes for both portals to cover their holes. This is done before rendering the
-  // insides of either portal to prevent pixels of portal box A appearing inside an uncovered
-  // portal B hole. While rendering the inside of portal A, those pixels might be rendered to with
-  // a depth closer than portal B. Then, when portal B's box is rendered, those pixels will remain
-  // "in front" which means they won't be properly marked in the stencil as being inside portal B.
-  // Note: portal boxes must be drawn after player so that portal pixels behind the player are not
-  // marked in the stencil buffer.
-  mCommandList->SetPipelineState(mPSOs["portalBoxStencilSet"].Get());
-  mCommandList->OMSetStencilRef(portalAStencilRef);
-  DrawRenderItem(mCommandList.Get(), &mPortalBoxARenderItem);
-  mCommandList->OMSetStencilRef(portalBStencilRef);
-  DrawRenderItem(mCommandList.Get(), &mPortalBoxBRenderItem);
-
-  // At this point, the stencil buffer is 2 inside portal A, 1 inside portal B, and 0 everywhere
-  // else. First, the inside of portal A is rendered using stencil tests >=2, >=3, ... .  Then,
-  // portal box A is rendered again with depth-test-always, stencil test >=2, and zeroing the
-  // stencil buffer. This shoud leave the stencil buffer 0 everywhere except inside portal B, where
-  // it's still 1. Finally, the inside of portal B is rendered using stencil tests >=1, >=2, ...
-
-  if (mPlayerIntersectPortalA || mPlayerIntersectPortalB) {
-    // Render insides of portal A and part of player sticking out of portal A.
-    DrawRoomsAndIntersectingPlayersForPortal(
-        portalAStencilRef, &mPortalBoxARenderItem, portalACBIndexBase, portalAIterations,
-        CLIP_PLANE_PORTAL_A_B_CB_INDEX, CLIP_PLANE_PORTAL_B_A_CB_INDEX, mPlayerIntersectPortalA,
-        WORLD2_PORTAL_A_TO_B_CB_INDEX, WORLD2_PORTAL_B_TO_A_CB_INDEX);
-
-    // Clear stencil buffer for pixels inside portal A.
-    DrawPortalBoxToCoverDepthHoleAndZeroStencil(portalAStencilRef, &mPortalBoxARenderItem);
-
-    // Render insides of portal B and part of player sticking out of portal B.
-    DrawRoomsAndIntersectingPlayersForPortal(
-        portalBStencilRef, &mPortalBoxBRenderItem, portalBCBIndexBase, portalBIterations,
-        CLIP_PLANE_PORTAL_B_A_CB_INDEX, CLIP_PLANE_PORTAL_A_B_CB_INDEX, mPlayerIntersectPortalB,
-        WORLD2_PORTAL_B_TO_A_CB_INDEX, WORLD2_PORTAL_A_TO_B_CB_INDEX);
-  } else {
-    // Render insides of portal A.
-    DrawRoomAndPlayerIterations(
-        portalAStencilRef, &mPortalBoxARenderItem, portalACBIndexBase, portalAIterations,
-        CLIP_PLANE_PORTAL_B_A_CB_INDEX, true);
-
-    // Clear stencil buffer for pixels inside portal A and cover up its hole in the depth buffer.
-    // This way, the first portal B box can't appear "in front" of portal A due to portal A's depth
-    // hole, and stencil tests for rendering inside portal B won't pass for any pixels inside
-    // portal A.
-    DrawPortalBoxToCoverDepthHoleAndZeroStencil(portalAStencilRef, &mPortalBoxARenderItem);
-
-    // Render insides of portal B.
-    DrawRoomAndPlayerIterations(
-        portalBStencilRef, &mPortalBoxBRenderItem, portalBCBIndexBase, portalBIterations,
-        CLIP_PLANE_PORTAL_A_B_CB_INDEX, true);
-
-  }
-
+  // The main view, the inside of portal A and the inside of portal B are recorded at the same time
+  // into separate command lists.  They're submitted in that order, so the GPU still sees them in
+  // the same sequence as when everything was recorded into one list.  Only the stencil and depth
+  // buffer contents carry over from one list to the next; each list sets up its own pipeline
+  // state.
+  const bool playerIntersectPortal = mPlayerIntersectPortalA || mPlayerIntersectPortalB;
+  UpdatePortalVisibility(viewProj, playerIntersectPortal);
+  mRecordThreads->Run([&](int threadIndex) {
+    ID3D12GraphicsCommandList* rawCmdList = BeginRecording(threadIndex);
+    StateFilteredCommandList filteredCmdList(rawCmdList, mPSOs[PSO_DEFAULT_PORTALS_CLIP].Get());
+    StateFilteredCommandList* cmdList = &filteredCmdList;
+    SetCommonDrawState(cmdList);
+
+    switch (threadIndex) {
+    case RECORD_MAIN_VIEW:
+      // Fill textures the streamer replaced in Update before anything samples them.  This list is
+      // submitted first, and the frame's fence value is signaled after all of them.
+      mTextureStreamer->RecordCopies(rawCmdList, mCurrentFence + 1);
+
+      // Indicate a state transition on the resource usage.
+      rawCmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+        D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
+
+      // Clear the back buffer.
+      rawCmdList->ClearRenderTargetView(CurrentBackBufferView(), Colors::SkyBlue, 0, nullptr);
+      // Clear depth and stencil buffers.
+      rawCmdList->ClearDepthStencilView(
+        DepthStencilView(), D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
+
+      // Draw room without clipping or stencil-rejecting anything (clip plane is set to dummy plane
+      // and stencil buffer is all 0s initially, so stencil test will always pass).
+      DrawRenderItemRanges(cmdList, &mRoomRenderItem, mRoomPassRanges[0]);
+      DrawPortalDecals(cmdList);
+
+      // Draw real player or player halves.
+      if (mPlayerIntersectPortalA) {
+        DrawIntersectingPlayerRealHalves(
+            cmdList, CLIP_PLANE_PORTAL_A_B_CB_INDEX, CLIP_PLANE_PORTAL_B_A_CB_INDEX,
+            WORLD2_PORTAL_A_TO_B_CB_INDEX, portalBCBIndexBase);
+      } else if (mPlayerIntersectPortalB) {
+        DrawIntersectingPlayerRealHalves(
+            cmdList, CLIP_PLANE_PORTAL_B_A_CB_INDEX, CLIP_PLANE_PORTAL_A_B_CB_INDEX,
+            WORLD2_PORTAL_B_TO_A_CB_INDEX, portalACBIndexBase);
+      } else if (mPlayerPassVisible[0]) {
+        cmdList->SetPipelineState(mPSOs[PSO_DEFAULT_CLIP].Get());
+        DrawRenderItem(cmdList, &mPlayerRenderItem, false, mPlayerPassLods[0]);
+      }
+
+      // Draw portal boxes for both portals to cover their holes. This is done before rendering the
+      // insides of either portal to prevent pixels of portal box A appearing inside an uncovered
+      // portal B hole. While rendering the inside of portal A, those pixels might be rendered to
+      // with a depth closer than portal B. Then, when portal B's box is rendered, those pixels will
+      // remain "in front" which means they won't be properly marked in the stencil as being inside
+      // portal B.
+      // Note: portal boxes must be drawn after player so that portal pixels behind the player are
+      // not marked in the stencil buffer.
+      cmdList->SetPipelineState(mPSOs[PSO_PORTAL_BOX_STENCIL_SET].Get());
+      cmdList->OMSetStencilRef(portalAStencilRef);
+      DrawRenderItem(cmdList, &mPortalBoxARenderItem);
+      cmdList->OMSetStencilRef(portalBStencilRef);
+      DrawRenderItem(cmdList, &mPortalBoxBRenderItem);
+      break;
+
+    // At this point, the stencil buffer is 2 inside portal A, 1 inside portal B, and 0 everywhere
+    // else. First, the inside of portal A is rendered using stencil tests >=2, >=3, ... .  Then,
+    // portal box A is rendered again with depth-test-always, stencil test >=2, and zeroing the
+    // stencil buffer. This shoud leave the stencil buffer 0 everywhere except inside portal B,
+    // where it's still 1. Finally, the inside of portal B is rendered using stencil tests >=1,
+    // >=2, ...
+
+    case RECORD_PORTAL_A:
+      // If portal A's box is hidden, no pixel is marked as inside portal A, so there's nothing to
+      // render inside it and no stencil to zero.
+      if (!mPortalAVisible)
+        break;
+
+      if (playerIntersectPortal) {
+        // Render insides of portal A and part of player sticking out of portal A.
+        DrawRoomsAndIntersectingPlayersForPortal(
+            cmdList, portalAStencilRef, &mPortalBoxARenderItem, portalACBIndexBase,
+            portalAIterations, CLIP_PLANE_PORTAL_A_B_CB_INDEX, CLIP_PLANE_PORTAL_B_A_CB_INDEX,
+            mPlayerIntersectPortalA, WORLD2_PORTAL_A_TO_B_CB_INDEX, WORLD2_PORTAL_B_TO_A_CB_INDEX);
+      } else {
+        // Render insides of portal A.
+        DrawRoomAndPlayerIterations(
+            cmdList, portalAStencilRef, &mPortalBoxARenderItem, portalACBIndexBase,
+            portalAIterations, CLIP_PLANE_PORTAL_B_A_CB_INDEX, true);
+      }
+
+      // Clear stencil buffer for pixels inside portal A and cover up its hole in the depth buffer.
+      // This way, the first portal B box can't appear "in front" of portal A due to portal A's
+      // depth hole, and stencil tests for rendering inside portal B won't pass for any pixels
+      // inside portal A.
+      DrawPortalBoxToCoverDepthHoleAndZeroStencil(
+          cmdList, portalAStencilRef, &mPortalBoxARenderItem);
+      break;
+
+    case RECORD_PORTAL_B:
+      if (mPortalBVisible) {
+        if (playerIntersectPortal) {
+          // Render insides of portal B and part of player sticking out of portal B.
+          DrawRoomsAndIntersectingPlayersForPortal(
+              cmdList, portalBStencilRef, &mPortalBoxBRenderItem, portalBCBIndexBase,
+              portalBIterations, CLIP_PLANE_PORTAL_B_A_CB_INDEX, CLIP_PLANE_PORTAL_A_B_CB_INDEX,
+              mPlayerIntersectPortalB, WORLD2_PORTAL_B_TO_A_CB_INDEX,
+              WORLD2_PORTAL_A_TO_B_CB_INDEX);
+        } else {
+          // Render insides of portal B.
+          DrawRoomAndPlayerIterations(
+              cmdList, portalBStencilRef, &mPortalBoxBRenderItem, portalBCBIndexBase,
+              portalBIterations, CLIP_PLANE_PORTAL_A_B_CB_INDEX, true);
+        }
+      }
+
+      // Indicate a state transition on the resource usage.
+      rawCmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
+          D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+      break;
+    }
 
-  // Indicate a state transition on the resource usage.
-  mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-      D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
+    // Done recording commands.
+    ThrowIfFailed(rawCmdList->Close());
+    mRecordStats[threadIndex] = cmdList->GetStats();
+  });
 
-  // Done recording commands.
-  ThrowIfFailed(mCommandList->Close());
+  // Totals for the window caption.
+  mStateFilterStats = StateFilteredCommandList::Stats();
+  for (int i = 0; i < gNumRecordThreads; ++i)
+    mStateFilterStats += mRecordStats[i];
 
-  // Add the command list to the queue for execution.
-  ID3D12CommandList* cmdList = mCommandList.Get();
-  mCommandQueue->ExecuteCommandLists(1, &cmdList);
+  // Add the command lists to the queue for execution.
+  ID3D12CommandList* cmdLists[gNumRecordThreads];
+  for (int i = 0; i < gNumRecordThreads; ++i)
+    cmdLists[i] = mRecordCommandLists[i].Get();
+  mCommandQueue->ExecuteCommandLists(gNumRecordThreads, cmdLists);
 
   // Swap the back and front buffers
   ThrowIfFailed(mSwapChain->Present(0, 0));
   mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
+  mFramePacer->OnPresent();
 
   // Advance the fence value to mark commands up to this fence point.
   mCurrentFrameResource->Fence = ++mCurrentFence;
+  mConstantRing->FinishFrame(mCurrentFence);
+  mSrvDescriptors->FinishFrame(mCurrentFence);
 
   // Add an instruction to the command queue to set a new fence point. 
   // Because we are on the GPU timeline, the new fence point won't be 
@@ -855,6 +1515,134 @@ void PortalsApp::Draw(float dt) {
   mCommandQueue->Signal(mFence.Get(), mCurrentFence);
 }
 
+// Resets the record thread's allocator and command list for the current frame resource.  Called
+// on the record thread.
+ID3D12GraphicsCommandList* PortalsApp::BeginRecording(int threadIndex) {
+  ID3D12CommandAllocator* cmdListAlloc = mCurrentFrameResource->CmdListAllocs[threadIndex].Get();
+  ID3D12GraphicsCommandList* cmdList = mRecordCommandLists[threadIndex].Get();
+
+  // Reuse the memory associated with command recording.
+  // We can only reset when the associated command lists have finished execution on the GPU.
+  ThrowIfFailed(cmdListAlloc->Reset());
+
+  // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
+  // Reusing the command list reuses memory.
+  ThrowIfFailed(cmdList->Reset(cmdListAlloc, mPSOs[PSO_DEFAULT_PORTALS_CLIP].Get()));
+
+  return cmdList;
+}
+
+// Sets all the state that's common to every part of the frame.
+void PortalsApp::SetCommonDrawState(StateFilteredCommandList* cmdList) {
+  ID3D12GraphicsCommandList* rawCmdList = cmdList->Get();
+  rawCmdList->RSSetViewports(1, &mScreenViewport);
+  rawCmdList->RSSetScissorRects(1, &mScissorRect);
+
+  // Specify the buffers we are going to render to.
+  rawCmdList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
+
+  ID3D12DescriptorHeap* descriptorHeap = mSrvDescriptors->GetShaderVisibleHeap();
+  rawCmdList->SetDescriptorHeaps(1, &descriptorHeap);
+
+  cmdList->SetGraphicsRootSignature(mRootSignature.Get());
+
+  // Bind all the materials used in this scene.  For structured buffers, we can bypass the heap and 
+  // set as a root descriptor.
+  rawCmdList->SetGraphicsRootShaderResourceView(
+      SRV_MATERIAL_DATA_ROOT_INDEX,
+      mCurrentFrameResource->MaterialBuffer.Resource()->GetGPUVirtualAddress());
+
+  // Bind room and player textures to gTextureMaps[2].
+  CD3DX12_GPU_DESCRIPTOR_HANDLE srvDescriptor(
+      mSrvDescriptors->GetTransientGpuHandle(mTextureTable.Offset));
+  rawCmdList->SetGraphicsRootDescriptorTable(DT_TEXTURE_MAPS_ROOT_INDEX, srvDescriptor);
+
+  // Bind portalA and portalB textures to gPortalADiffuseMap and gPortalBDiffuseMap.
+  srvDescriptor.Offset(2, mCbvSrvUavDescriptorSize);
+  rawCmdList->SetGraphicsRootDescriptorTable(DT_PORTAL_MAPS_ROOT_INDEX, srvDescriptor);
+
+  // Bind per-frame constant buffer.
+  cmdList->SetGraphicsRootConstantBufferView(
+      CB_PER_FRAME_ROOT_INDEX, mFrameCBAddress);
+
+  // Set clip plane to no clipping.
+  cmdList->SetGraphicsRootConstantBufferView(
+      CB_CLIP_PLANE_ROOT_INDEX,
+      mClipPlaneCBAddresses[CLIP_PLANE_DUMMY_CB_INDEX]);
+  // Set per-pass constant buffer to unmodified view space.
+  cmdList->SetGraphicsRootConstantBufferView(
+      CB_PER_PASS_ROOT_INDEX,
+      mPassCBAddresses[0]);
+  // Set world2 matrix to identity matrix.
+  cmdList->SetGraphicsRootConstantBufferView(
+      CB_WORLD2_ROOT_INDEX,
+      mWorld2CBAddresses[WORLD2_IDENTITY_CB_INDEX]);
+  cmdList->OMSetStencilRef(0);
+}
+
+void PortalsApp::AddOccluder(const RenderItem& ri) {
+  const MeshGeometry& geo = *ri.Geo;
+  XMFLOAT4X4 world;
+  XMStoreFloat4x4(&world, ri.World);
+  if (geo.IndexFormat == DXGI_FORMAT_R32_UINT) {
+    mOcclusionBuffer.AddOccluder(
+        geo.VertexBufferCPU->GetBufferPointer(), sizeof(Vertex),
+        static_cast<const std::uint32_t*>(geo.IndexBufferCPU->GetBufferPointer()) +
+            ri.StartIndexLocation,
+        ri.IndexCount, ri.BaseVertexLocation, world.m);
+  } else {
+    mOcclusionBuffer.AddOccluder(
+        geo.VertexBufferCPU->GetBufferPointer(), sizeof(Vertex),
+        static_cast<const std::uint16_t*>(geo.IndexBufferCPU->GetBufferPointer()) +
+            ri.StartIndexLocation,
+        ri.IndexCount, ri.BaseVertexLocation, world.m);
+  }
+}
+
+bool PortalsApp::IsPortalOccluded(const Portal& portal) {
+  // Corners of the square around the portal box's N-gon, slightly in front of the wall.
+  const float r = 1.0f / cosf(PI / PORTAL_BOX_N_SIDES);
+  const XMMATRIX portalToWorld = portal.GetXYScaledPortalToWorldMatrix();
+  float corners[4][3];
+  for (int i = 0; i < 4; ++i) {
+    XMVECTOR cornerP = XMVectorSet(
+        (i & 1) ? r : -r, (i & 2) ? r : -r, PORTAL_OCCLUSION_BIAS, 1.0f);
+    XMFLOAT3 cornerW;
+    XMStoreFloat3(&cornerW, XMVector3TransformCoord(cornerP, portalToWorld));
+    corners[i][0] = cornerW.x;
+    corners[i][1] = cornerW.y;
+    corners[i][2] = cornerW.z;
+  }
+  return mOcclusionBuffer.IsOccluded(corners, 4);
+}
+
+void PortalsApp::UpdatePortalVisibility(const XMMATRIX& viewProj, bool playerIntersectPortal) {
+  // A player in a portal is drawn clipped against it, and the camera can see into both portals
+  // through the halves, so both are recursed into.
+  bool portalAVisible = true;
+  bool portalBVisible = true;
+  if (!playerIntersectPortal) {
+    XMFLOAT4X4 viewProjF;
+    XMStoreFloat4x4(&viewProjF, viewProj);
+    mOcclusionBuffer.Begin(viewProjF.m);
+    AddOccluder(mRoomRenderItem);
+    AddOccluder(mPlayerRenderItem);
+    portalAVisible = !IsPortalOccluded(mPortalA);
+    portalBVisible = !IsPortalOccluded(mPortalB);
+  }
+
+  if (portalAVisible != mPortalAVisible || portalBVisible != mPortalBVisible) {
+    const OcclusionBuffer::Stats& stats = mOcclusionBuffer.GetStats();
+    dprintf("Portal visibility: A %s, B %s (%u occluder triangles, %u culled; "
+        "%u of %u queries occluded, %u outside view)\n",
+        portalAVisible ? "visible" : "occluded", portalBVisible ? "visible" : "occluded",
+        stats.OccluderTriangles, stats.OccluderTrianglesCulled, stats.QueriesOccluded,
+        stats.Queries, stats.QueriesOutsideView);
+    mPortalAVisible = portalAVisible;
+    mPortalBVisible = portalBVisible;
+  }
+}
+
 void PortalsApp::OnMouseDown(WPARAM btnState, int x, int y) {
   mLastMousePos.x = x;
   mLastMousePos.y = y;
@@ -884,87 +1672,236 @@ void PortalsApp::OnMouseMove(WPARAM btnState, int x, int y) {
   mLastMousePos.y = y;
 }
 
+// How camera moves have been split into substeps (see SpherePath::MoveCameraAlongPathAdaptive),
+// and the last frame's state changes: those issued, and those filtered as redundant.
+std::wstring PortalsApp::GetFrameStatsText() {
+  const StateFilteredCommandList::Stats& state = mStateFilterStats;
+  const UINT issued = state.RootSignatures + state.PipelineStates + state.RootCbvs +
+                      state.StencilRefs + state.IABindings;
+  const UINT filtered = state.RootSignaturesFiltered + state.PipelineStatesFiltered +
+                        state.RootCbvsFiltered + state.StencilRefsFiltered +
+                        state.IABindingsFiltered;
+  return L"   split moves: " + std::to_wstring(mSubstepStats.SplitMoves) + L" of " +
+         std::to_wstring(mSubstepStats.Moves) + L" (at most " +
+         std::to_wstring(mSubstepStats.MaxSubsteps) + L" substeps)" +
+         L"   state changes: " + std::to_wstring(issued) + L" (" + std::to_wstring(filtered) +
+         L" filtered)   PSOs: " + std::to_wstring(state.PipelineStates) + L" (" +
+         std::to_wstring(state.PipelineStatesFiltered) + L" filtered)   draws: " +
+         std::to_wstring(state.Draws);
+}
+
+void PortalsApp::OnKeyUp(WPARAM key) {
+  // F9 writes a software-rendered reference of the last frame.
+  if (key == VK_F9)
+    WriteSoftwareReference();
+}
+
+void PortalsApp::BuildSoftwareScene(SoftwarePortalScene* scene) const {
+  static_assert(sizeof(SwVertex) == sizeof(Vertex), "SwVertex must match Vertex.");
+  static_assert(SW_NUM_LIGHTS == NUM_LIGHTS, "Light counts must match.");
+  static_assert(SoftwarePortalScene::NUM_CLIP_PLANES == NUM_CLIP_PLANE_CBS &&
+      SoftwarePortalScene::CLIP_PLANE_DUMMY == CLIP_PLANE_DUMMY_CB_INDEX &&
+      SoftwarePortalScene::CLIP_PLANE_PORTAL_A_B == CLIP_PLANE_PORTAL_A_B_CB_INDEX &&
+      SoftwarePortalScene::CLIP_PLANE_PORTAL_B_A == CLIP_PLANE_PORTAL_B_A_CB_INDEX,
+      "Clip plane indices must match.");
+  static_assert(SoftwarePortalScene::NUM_WORLD2S == NUM_WORLD2_CBS &&
+      SoftwarePortalScene::WORLD2_IDENTITY == WORLD2_IDENTITY_CB_INDEX &&
+      SoftwarePortalScene::WORLD2_PORTAL_A_TO_B == WORLD2_PORTAL_A_TO_B_CB_INDEX &&
+      SoftwarePortalScene::WORLD2_PORTAL_B_TO_A == WORLD2_PORTAL_B_TO_A_CB_INDEX,
+      "World2 indices must match.");
+
+  const MeshGeometry& geo = mGeometries[GEOMETRY_SHAPES];
+  scene->Vertices.resize(geo.VertexBufferCPU->GetBufferSize() / sizeof(SwVertex));
+  memcpy(scene->Vertices.data(), geo.VertexBufferCPU->GetBufferPointer(),
+      geo.VertexBufferCPU->GetBufferSize());
+  if (geo.IndexFormat == DXGI_FORMAT_R32_UINT) {
+    scene->Indices.resize(geo.IndexBufferByteSize / sizeof(uint32_t));
+    memcpy(scene->Indices.data(), geo.IndexBufferCPU->GetBufferPointer(), geo.IndexBufferByteSize);
+  } else {
+    const uint16_t* indices = static_cast<const uint16_t*>(geo.IndexBufferCPU->GetBufferPointer());
+    scene->Indices.assign(indices, indices + geo.IndexBufferByteSize / sizeof(uint16_t));
+  }
+
+  scene->Room = MakeSoftwareRenderItem(mRoomRenderItem);
+  scene->Player = MakeSoftwareRenderItem(mPlayerRenderItem);
+  scene->PortalBoxA = MakeSoftwareRenderItem(mPortalBoxARenderItem);
+  scene->PortalBoxB = MakeSoftwareRenderItem(mPortalBoxBRenderItem);
+
+  // The decals live in a buffer of their own; append them to the scene's.
+  scene->PortalDecalA = MakeSoftwareRenderItem(mPortalDecalARenderItem);
+  scene->PortalDecalB = MakeSoftwareRenderItem(mPortalDecalBRenderItem);
+  for (SwRenderItem* decal : { &scene->PortalDecalA, &scene->PortalDecalB }) {
+    decal->StartIndexLocation += static_cast<uint32_t>(scene->Indices.size());
+    decal->BaseVertexLocation += static_cast<int>(scene->Vertices.size());
+  }
+  const SwVertex* decalVertices = reinterpret_cast<const SwVertex*>(mPortalDecalVertices.data());
+  scene->Vertices.insert(
+      scene->Vertices.end(), decalVertices, decalVertices + mPortalDecalVertices.size());
+  scene->Indices.insert(
+      scene->Indices.end(), mPortalDecalIndices.begin(), mPortalDecalIndices.end());
+
+  scene->Materials.resize(NUM_MATERIALS);
+  for (const PhongMaterial& mat : mMaterials) {
+    PhongMaterialData matData;
+    matData.Diffuse = mat.Diffuse;
+    matData.Specular = mat.Specular;
+    matData.DiffuseMapIndex = mat.DiffuseSrvHeapIndex;
+    CopyConstants(&scene->Materials[mat.MatCBIndex], matData);
+  }
+  scene->TextureMaps.clear();
+  scene->PortalAMap = SwTexture();
+  scene->PortalBMap = SwTexture();
+
+  CopyConstants(&scene->Frame, mFrameCBData);
+  for (int i = 0; i < NUM_CLIP_PLANE_CBS; ++i)
+    CopyConstants(&scene->ClipPlanes[i], mClipPlaneCBData[i]);
+  for (int i = 0; i < NUM_WORLD2_CBS; ++i)
+    CopyConstants(&scene->World2s[i], mWorld2CBData[i]);
+  scene->Passes.resize(mPassCBData.size());
+  for (size_t i = 0; i < mPassCBData.size(); ++i)
+    CopyConstants(&scene->Passes[i], mPassCBData[i]);
+
+  scene->PortalAStencilRef = PORTAL_A_STENCIL_REF;
+  scene->PortalBStencilRef = PORTAL_B_STENCIL_REF;
+  scene->PortalAIterations = PORTAL_A_ITERATIONS;
+  scene->PortalBIterations = PORTAL_B_ITERATIONS;
+  scene->PlayerIntersectPortalA = mPlayerIntersectPortalA;
+  scene->PlayerIntersectPortalB = mPlayerIntersectPortalB;
+}
+
+// Renders the last frame with SoftwarePortalRenderer and writes its color, depth and stencil
+// buffers next to the executable.
+void PortalsApp::WriteSoftwareReference() {
+  if (mPassCBData.empty())
+    return;   // Nothing drawn yet
+
+  SoftwarePortalScene scene;
+  BuildSoftwareScene(&scene);
+
+  SwShaderDefines defines;
+  defines.PortalTexRadRatio = PORTAL_TEX_RAD_RATIO;
+  SoftwarePortalRenderer renderer(defines);
+  SwRenderTarget target(mClientWidth, mClientHeight);
+
+  GameTimer timer;
+  timer.Reset();
+  renderer.Render(scene, &target);
+  timer.Tick();
+
+  const SoftwareRasterizer::Stats& stats = renderer.GetStats();
+  dprintf("Software reference: %.1f ms, %u draws, %u triangles (%u culled), %llu pixels\n",
+      1000.0f * timer.DeltaTime(), stats.Draws, stats.Triangles, stats.TrianglesCulled,
+      static_cast<unsigned long long>(stats.PixelsShaded));
+
+  if (!target.WriteColorPpm("reference_color.ppm") ||
+      !target.WriteDepthPgm("reference_depth.pgm") ||
+      !target.WriteStencilPgm("reference_stencil.pgm")) {
+    dprintf("Could not write software reference images\n");
+  }
+}
+
+
 
 
+// Reads the world file, or makes a world of roomPath alone if there isn't one, and waits for the
+// first room to load.
+void PortalsApp::LoadWorld(const std::string& worldPath, const std::string& roomPath) {
+  if (std::ifstream(worldPath).good()) {
+    std::string error;
+    if (!ReadWorldFile(worldPath, &mWorld, &error))
+      throw std::runtime_error(error);
+  } else {
+    mWorld = WorldFileData();
+    mWorld.RoomPaths.push_back(roomPath);
+  }
+  dprintf("World: %zu rooms, %zu doorways\n", mWorld.RoomPaths.size(), mWorld.Links.size());
+
+  mRoomLoader = std::make_unique<RoomLoader>(mWorld, ROOM_STREAMING_BUDGET, ROOM_STREAMING_HOPS,
+                                             MAX_ROOM_LOADS_IN_FLIGHT, PrepareRoomMesh);
+  mCurrentRoomIndex = 0;
+  mRoomLoader->Update(0, mCurrentRoomIndex);
+  EnterRoom(mRoomLoader->WaitForRoom(mCurrentRoomIndex), true);
+}
+
+// Makes room current: its collision data replaces mRoom, the spectator camera and the portals go
+// where its file puts them, and so does the player if spawnPlayer.  The geometry is left alone.
+void PortalsApp::EnterRoom(std::shared_ptr<const LoadedRoom> room, bool spawnPlayer) {
+  mCurrentRoom = std::move(room);
+  mRoom = mCurrentRoom->Collision;
+  const RoomFileData& file = mCurrentRoom->File;
+  mLeftCamera.SetPosition(XMFLOAT3(file.CameraPosition));
+  if (spawnPlayer) {
+    mPlayer.SetBoundingSphereRadius(file.PlayerRadius);
+    mPlayer.SetPosition(XMFLOAT3(file.PlayerPosition));
+  }
+  PlacePortal(file.PortalA, &mPortalA);
+  PlacePortal(file.PortalB, &mPortalB);
+  mPortalAToB = Portal::CalculateVirtualizationMatrix(mPortalA, mPortalB);
+  mPortalBToA = Portal::CalculateVirtualizationMatrix(mPortalB, mPortalA);
+}
 
-void PortalsApp::ReadRoomFile(const std::string& path) {
-  std::ifstream ifs(path, std::ifstream::in);
-  if (!ifs.good()) {
-    throw std::exception("Could not open room file.");
-  }
-
-  std::string line;
-  float a, b, c, d, e, f;
-
-  // Left camera initial position
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f %f %f", &a, &b, &c);
-  mLeftCamera.SetPosition(XMFLOAT3(a, b, c));
-
-  // Player
-  // Radius
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f", &a);
-  mPlayer.SetBoundingSphereRadius(a);
-  // Initial position
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f %f %f", &a, &b, &c);
-  mPlayer.SetPosition(XMFLOAT3(a, b, c));
-
-  // Portal A
-  // Initial radius
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f", &a);
-  mPortalA.SetIntendedPhysicalRadius(a);
-  // Initial position
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f %f %f", &a, &b, &c);
-  mPortalA.SetPosition(XMFLOAT3(a, b, c));
-  // Initial normal
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f %f %f", &a, &b, &c);
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f %f %f", &d, &e, &f);
-  mPortalA.SetNormalAndUp(XMFLOAT3(a, b, c), XMFLOAT3(d, e, f));
-
-  // Portal B
-  // Initial radius
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f", &a);
-  mPortalB.SetIntendedPhysicalRadius(a);
-  // Initial position
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f %f %f", &a, &b, &c);
-  mPortalB.SetPosition(XMFLOAT3(a, b, c));
-  // Initial normal
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f %f %f", &a, &b, &c);
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f %f %f", &d, &e, &f);
-  mPortalB.SetNormalAndUp(XMFLOAT3(a, b, c), XMFLOAT3(d, e, f));
-
-  // Floor, ceiling heights
-  GetNextDataLine(&ifs, &line);
-  sscanf_s(line.c_str(), "%f %f", &a, &b);
-  mRoom.SetFloorAndCeiling(a, b);
-
-  // Room boundary polygons
-  std::vector<std::vector<XMFLOAT2>> polygonList;
-  while (GetNextDataLine(&ifs, &line)) {
-    int num_vertices;
-    sscanf_s(line.c_str(), "%d", &num_vertices);
-    std::vector<XMFLOAT2> vertices(num_vertices);
-    for (int i = 0; i < num_vertices; ++i) {
-      GetNextDataLine(&ifs, &line);
-      sscanf_s(line.c_str(), "%f %f", &a, &b);
-      vertices[i] = XMFLOAT2(a, b);
+// Walking into a doorway of the current room takes the player through it, if the room on the
+// other side is resident; until then the doorway is just wall.  The end the player comes out of
+// doesn't take it back until it has stepped away.
+void PortalsApp::CrossDoorways() {
+  const XMFLOAT3 position = mPlayer.GetPosition();
+  const float radius = mPlayer.GetBoundingSphereRadius() + DOORWAY_TOUCH_DISTANCE;
+  for (size_t i = 0; i < mWorld.Links.size(); ++i) {
+    const WorldLink& link = mWorld.Links[i];
+    for (int end = 0; end < 2; ++end) {
+      if (link.Rooms[end] != mCurrentRoomIndex)
+        continue;
+      const int doorway = static_cast<int>(i) * 2 + end;
+      Portal from;
+      PlacePortal(link.Ends[end], &from);
+      const bool touching = from.IntersectSphereFromFront(position, radius);
+      if (doorway == mArrivalDoorway) {
+        if (!touching)
+          mArrivalDoorway = -1;
+        continue;
+      }
+      if (!touching || mRoomLoader->GetRoom(link.Rooms[1 - end]) == nullptr)
+        continue;
+
+      Portal to;
+      PlacePortal(link.Ends[1 - end], &to);
+      SwitchRoom(link.Rooms[1 - end], from, to);
+      mArrivalDoorway = static_cast<int>(i) * 2 + (1 - end);
+      return;
     }
-    polygonList.push_back(std::move(vertices));
   }
-  mRoom.SetTopography(polygonList);
-  mRoom.PrintBoundaries();
+}
+
+// Carries the player from the doorway end from in the current room to to in room, and rebuilds
+// the shape geometry and render items for room.  The GPU is flushed first, since the old geometry
+// may still be in use.
+void PortalsApp::SwitchRoom(int room, const Portal& from, const Portal& to) {
+  // Through the doorway as through a portal, which leaves the player as far behind to as it was
+  // in front of from; then out in front of it.
+  const float depth = XMFloat3Dot(mPlayer.GetPosition() - from.GetPosition(), from.GetNormal()) *
+      to.GetPhysicalRadius() / from.GetPhysicalRadius();
+  mRightCamera.Transform(Portal::CalculateVirtualizationMatrix(from, to));
+  mRightCamera.SetPosition(mRightCamera.GetPosition() + (2.0f * depth) * to.GetNormal());
+
+  mCurrentRoomIndex = room;
+  EnterRoom(mRoomLoader->GetRoom(room), false);
+  mPlayerIntersectPortalA = mPortalA.IntersectSphereFromFront(
+      mPlayer.GetPosition(), mPlayer.GetBoundingSphereRadius() + 0.001f);
+  mPlayerIntersectPortalB = mPortalB.IntersectSphereFromFront(
+      mPlayer.GetPosition(), mPlayer.GetBoundingSphereRadius() + 0.001f);
 
-  ifs.close();
+  FlushCommandQueue();
+  ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
+  const bool floatPositions = mFloatPositions;
+  BuildShapeGeometry();
+  if (mFloatPositions != floatPositions)
+    BuildPSOs();    // For the other input layout; none are in use after the flush
+  BuildRenderItems();
+  ThrowIfFailed(mCommandList->Close());
+  ID3D12CommandList* cmdList = mCommandList.Get();
+  mCommandQueue->ExecuteCommandLists(1, &cmdList);
+  FlushCommandQueue();
+  dprintf("Entered room %d (%s)\n", room, mCurrentRoom->Path.c_str());
 }
 
 void PortalsApp::OnKeyboardInput(float dt, bool modifyPortal) {
@@ -1009,8 +1946,8 @@ void PortalsApp::OnKeyboardInput(float dt, bool modifyPortal) {
     if (GetAsyncKeyState(VK_SHIFT) & 0x8000)
       speed *= CAMERA_MOVEMENT_SPRINT_MULTIPLIER;
     dir = dir / dir_length;
-    SpherePath::MoveCameraAlongPathIterative(
-        *mCurrentCamera, dir, speed * dt, mRoom, mPortalA, mPortalB);
+    SpherePath::MoveCameraAlongPathAdaptive(
+        *mCurrentCamera, dir, speed * dt, mRoom, mPortalA, mPortalB, &mSubstepStats);
     // Update player world matrix and portal intersect flags if this is the camera attached to the
     // player.
     if (mCurrentCamera->GetAttachedTo() == &mPlayer) {
@@ -1078,10 +2015,10 @@ void PortalsApp::OnKeyboardInput(float dt, bool modifyPortal) {
 }
 
 void PortalsApp::UpdateMaterialBuffer() {
-  for (std::pair<const std::string, PhongMaterial>& e : mMaterials) {
+  for (PhongMaterial& e : mMaterials) {
     // Only update the cbuffer data if the constants have changed.  If the cbuffer
     // data changes, it needs to be updated for each FrameResource.
-    PhongMaterial* mat = &e.second;
+    PhongMaterial* mat = &e;
     if (mat->NumFramesDirty > 0) {
       PhongMaterialData matData;
       matData.Diffuse = mat->Diffuse;
@@ -1098,19 +2035,13 @@ void PortalsApp::UpdateMaterialBuffer() {
 void PortalsApp::UpdateObjectCBs() {
 
   RenderItem* items[] = {
-      &mRoomRenderItem, &mPlayerRenderItem, &mPortalBoxARenderItem, &mPortalBoxBRenderItem };
+      &mRoomRenderItem, &mPlayerRenderItem, &mPortalBoxARenderItem, &mPortalBoxBRenderItem,
+      &mPortalDecalARenderItem, &mPortalDecalBRenderItem };
   for (RenderItem* item : items) {
     // Only update the buffer data if the constants have changed. This needs to be tracked per
     // frame resource.
     if (item->NumFramesDirty > 0) {
-      ObjectConstants objConstants;
-      XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(item->World));
-      XMStoreFloat4x4(&objConstants.WorldInvTranspose, XMMatrixTranspose(
-          MathHelper::InverseTranspose(item->World)));
-      XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(item->TexTransform));
-      objConstants.MaterialIndex = item->Mat->MatCBIndex;
-
-      mCurrentFrameResource->ObjectCB.CopyData(item->ObjCBIndex, objConstants);
+      mCurrentFrameResource->ObjectCB.CopyData(item->ObjCBIndex, MakeObjectConstants(*item));
 
       item->NumFramesDirty--;
     }
@@ -1126,7 +2057,8 @@ void PortalsApp::UpdateClipPlaneCB(
   clipPlaneCB.ClipPlane2Normal = normal2;
   clipPlaneCB.ClipPlane2Offset = XMFloat3Dot(position2, normal2) + offset2;
 
-  mCurrentFrameResource->ClipPlaneCB.CopyData(index, clipPlaneCB);
+  mClipPlaneCBAddresses[index] = mConstantRing->AllocateConstants(clipPlaneCB);
+  mClipPlaneCBData[index] = clipPlaneCB;
 }
 
 void PortalsApp::UpdateWorld2CB(int index, const XMMATRIX& world2) {
@@ -1135,7 +2067,8 @@ void PortalsApp::UpdateWorld2CB(int index, const XMMATRIX& world2) {
   XMStoreFloat4x4(&world2CB.World2InvTranspose, XMMatrixTranspose(
       MathHelper::InverseTranspose(world2)));
 
-  mCurrentFrameResource->World2CB.CopyData(index, world2CB);
+  mWorld2CBAddresses[index] = mConstantRing->AllocateConstants(world2CB);
+  mWorld2CBData[index] = world2CB;
 }
 
 void PortalsApp::UpdatePassCB(
@@ -1145,24 +2078,178 @@ void PortalsApp::UpdatePassCB(
   passCB.EyePosW = eyePosW;
   passCB.DistDilation = distDilation;
 
-  mCurrentFrameResource->PassCB.CopyData(index, passCB);
+  mPassCBAddresses[index] = mConstantRing->AllocateConstants(passCB);
+  mPassCBData[index] = passCB;
 }
 
 void PortalsApp::UpdateFrameCB() {
   FrameConstants frameCB;
-  XMStoreFloat4x4(&frameCB.PortalA, XMMatrixTranspose(mPortalA.GetXYScaledWorldToPortalMatrix()));
-  XMStoreFloat4x4(&frameCB.PortalB, XMMatrixTranspose(mPortalB.GetXYScaledWorldToPortalMatrix()));
+  const XMFLOAT3 portalAPosition = mPortalA.GetPosition();
+  const XMFLOAT3 portalBPosition = mPortalB.GetPosition();
+  frameCB.PortalAHole = XMFLOAT4(
+      portalAPosition.x, portalAPosition.y, portalAPosition.z, mPortalA.GetPhysicalRadius());
+  frameCB.PortalANormal = mPortalA.GetNormal();
+  frameCB.PortalBHole = XMFLOAT4(
+      portalBPosition.x, portalBPosition.y, portalBPosition.z, mPortalB.GetPhysicalRadius());
+  frameCB.PortalBNormal = mPortalB.GetNormal();
   frameCB.AmbientLight = mAmbientLight;
   for (int i = 0; i < NUM_LIGHTS; ++i) {
     frameCB.Lights[i].Strength = mDirLights[i].Strength;
     frameCB.Lights[i].Direction = mDirLights[i].Direction;
   }
 
-  mCurrentFrameResource->FrameCB.CopyData(0, frameCB);
+  mFrameCBAddress = mConstantRing->AllocateConstants(frameCB);
+  mFrameCBData = frameCB;
+}
+
+// Copies the portal decals into this frame's part of the constant ring.
+void PortalsApp::UploadPortalDecals() {
+  if (mPortalDecalIndices.empty())
+    return;   // Both rims were clipped away; there's nothing to draw
+  const void* vertexData = mFloatPositions ?
+      static_cast<const void*>(mPortalDecalFloatPositionVertices.data()) :
+      static_cast<const void*>(mPortalDecalCompressedVertices.data());
+  const UINT vertexByteStride = static_cast<UINT>(
+      mFloatPositions ? sizeof(FloatPositionVertex) : sizeof(CompressedVertex));
+  const UINT vbByteSize = static_cast<UINT>(mPortalDecalVertices.size() * vertexByteStride);
+  const UINT ibByteSize = static_cast<UINT>(mPortalDecalIndices.size() * sizeof(std::uint16_t));
+  UploadAllocation vertices = mConstantRing->Allocate(vbByteSize);
+  memcpy(vertices.CpuAddress, vertexData, vbByteSize);
+  UploadAllocation indices = mConstantRing->Allocate(ibByteSize);
+  memcpy(indices.CpuAddress, mPortalDecalIndices.data(), ibByteSize);
+
+  mPortalDecalVertexBufferView.BufferLocation = vertices.GpuAddress;
+  mPortalDecalVertexBufferView.StrideInBytes = vertexByteStride;
+  mPortalDecalVertexBufferView.SizeInBytes = vbByteSize;
+  mPortalDecalIndexBufferView.BufferLocation = indices.GpuAddress;
+  mPortalDecalIndexBufferView.Format = DXGI_FORMAT_R16_UINT;
+  mPortalDecalIndexBufferView.SizeInBytes = ibByteSize;
+}
+
+// Roughly how many pixels across the main view a sphere of the given diameter is.
+float PortalsApp::ScreenPixels(const XMFLOAT3& position, float diameter) const {
+  // Pixels covered by one unit of world space one unit in front of the camera.
+  const float pixelsPerUnit =
+      XMVectorGetY(mLeftCamera.GetProjMatrix().r[1]) * 0.5f * static_cast<float>(mClientHeight);
+  const XMFLOAT3 eyePosW = mLeftCamera.GetPosition();
+  float distance =
+      XMVectorGetX(XMVector3Length(XMLoadFloat3(&position) - XMLoadFloat3(&eyePosW)));
+  if (distance < diameter)
+    distance = diameter;
+  return diameter * pixelsPerUnit / distance;
+}
+
+// Keeps the room chunks and the player that pass passCBIndex's frustum, in world space, can see,
+// and that are in one of visibleCells.  The room is drawn in one range when it isn't split into
+// chunks.
+void PortalsApp::CullPass(int passCBIndex, const PortalFrustum& frustumW,
+                          const std::vector<bool>& visibleCells) {
+  std::vector<SubmeshGeometry>& ranges = mRoomPassRanges[passCBIndex];
+  ranges.clear();
+  if (mRoomRenderItem.Chunks.empty()) {
+    SubmeshGeometry room;
+    room.IndexCount = mRoomRenderItem.IndexCount;
+    room.StartIndexLocation = mRoomRenderItem.StartIndexLocation;
+    room.BaseVertexLocation = mRoomRenderItem.BaseVertexLocation;
+    ranges.push_back(room);
+  }
+  for (size_t i = 0; i < mRoomRenderItem.Chunks.size(); ++i) {
+    const SubmeshGeometry& chunk = mRoomRenderItem.Chunks[i];
+    if (!AnyCellVisible(mRoomChunkCells[i], visibleCells))
+      continue;
+
+    // The room's world matrix is the identity, so the chunks' bounds are in world space already.
+    const XMVECTOR center = XMLoadFloat3(&chunk.Bounds.Center);
+    const XMVECTOR extents = XMLoadFloat3(&chunk.Bounds.Extents);
+    XMFLOAT3 boxMin, boxMax;
+    XMStoreFloat3(&boxMin, center - extents);
+    XMStoreFloat3(&boxMax, center + extents);
+    if (!frustumW.IntersectsBox(&boxMin.x, &boxMax.x))
+      continue;
+    if (!ranges.empty() &&
+        ranges.back().StartIndexLocation + ranges.back().IndexCount == chunk.StartIndexLocation) {
+      ranges.back().IndexCount += chunk.IndexCount;
+    } else {
+      ranges.push_back(chunk);
+    }
+  }
+
+  const XMFLOAT3 playerPositionW = mPlayer.GetPosition();
+  mPlayerPassVisible[passCBIndex] = AnyCellVisible(mPlayerCells, visibleCells) &&
+      frustumW.IntersectsSphere(&playerPositionW.x, mPlayer.GetBoundingSphereRadius());
+}
+
+// The least detailed player LOD that still looks round in a pass whose view proj is
+// worldToVirtual * viewProj, i.e. where the player appears transformed by worldToVirtual.
+int PortalsApp::ChoosePlayerLod(const XMMATRIX& worldToVirtual) {
+  const XMFLOAT3 positionW = mPlayer.GetPosition();
+  const float radius = mPlayer.GetBoundingSphereRadius();
+  const XMVECTOR position = XMLoadFloat3(&positionW);
+  const XMVECTOR virtualPosition = XMVector3TransformCoord(position, worldToVirtual);
+  const XMVECTOR virtualSurface =
+      XMVector3TransformCoord(position + XMVectorSet(radius, 0.0f, 0.0f, 0.0f), worldToVirtual);
+  const float virtualRadius = XMVectorGetX(XMVector3Length(virtualSurface - virtualPosition));
+
+  XMFLOAT3 virtualPositionW;
+  XMStoreFloat3(&virtualPositionW, virtualPosition);
+  const float radiusPixels = 0.5f * ScreenPixels(virtualPositionW, 2.0f * virtualRadius);
+
+  // Each tessellation halves the edges, starting from the icosahedron's in the last LOD.
+  float edgePixels = ICOSAHEDRON_EDGE_RATIO * radiusPixels;
+  int lod = NUM_PLAYER_LODS - 1;
+  while (lod > 0 && edgePixels > PLAYER_LOD_EDGE_PIXELS) {
+    edgePixels *= 0.5f;
+    --lod;
+  }
+  return lod;
+}
+
+// Rewrites the SRVs of the textures the streamer replaced and copies all of them into this frame's
+// table, in TextureId order.  The textures used for gTextureMaps[2] come first so that
+// PhongMaterial::DiffuseSrvHeapIndex matches PhongMaterialData::DiffuseMapIndex.
+void PortalsApp::UpdateTextureDescriptors() {
+  UINT offsets[NUM_TEXTURES];
+  for (int i = 0; i < NUM_TEXTURES; ++i) {
+    ID3D12Resource* resource = mTextureStreamer->GetResource(mStreamedTextureIndices[i]);
+    if (resource != mTextures[i].Resource.Get()) {
+      mTextureStreamer->CreateSrv(
+          mStreamedTextureIndices[i], mSrvDescriptors->GetPersistentHandle(mTextureSrvs[i].Offset));
+      mTextures[i].Resource = resource;
+    }
+    offsets[i] = mTextureSrvs[i].Offset;
+  }
+  mTextureTable = mSrvDescriptors->CopyToTransient(offsets, NUM_TEXTURES);
+}
+
+// Tells the texture streamer how many pixels across each texture is drawn in the main view, which
+// is also its priority.  The room fills the screen; the player and the portals are estimated from
+// their size and distance.  Whatever is seen through a portal is farther away, so it never needs
+// a more detailed mip than this.
+void PortalsApp::RequestTextureSizes() {
+  const float roomPixels = static_cast<float>(mClientHeight);
+  mTextureStreamer->RequestSize(mStreamedTextureIndices[TEXTURE_ROOM], roomPixels, roomPixels);
+
+  const float playerPixels =
+      ScreenPixels(mPlayer.GetPosition(), 2.0f * mPlayer.GetBoundingSphereRadius());
+  mTextureStreamer->RequestSize(
+      mStreamedTextureIndices[TEXTURE_PLAYER], playerPixels, playerPixels);
+
+  if (mPortalAVisible) {
+    const float portalPixels =
+        ScreenPixels(mPortalA.GetPosition(), 2.0f * mPortalA.GetTextureRadius());
+    mTextureStreamer->RequestSize(
+        mStreamedTextureIndices[TEXTURE_PORTAL_A], portalPixels, portalPixels);
+  }
+  if (mPortalBVisible) {
+    const float portalPixels =
+        ScreenPixels(mPortalB.GetPosition(), 2.0f * mPortalB.GetTextureRadius());
+    mTextureStreamer->RequestSize(
+        mStreamedTextureIndices[TEXTURE_PORTAL_B], portalPixels, portalPixels);
+  }
 }
 
 void PortalsApp::DrawRenderItem(
-    ID3D12GraphicsCommandList* cmdList, RenderItem* ri, bool sameAsPrevious) {
+    StateFilteredCommandList* cmdList, RenderItem* ri, bool sameAsPrevious, int lod) {
   if (!sameAsPrevious) {
     cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
     cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
@@ -1172,165 +2259,207 @@ void PortalsApp::DrawRenderItem(
       CB_PER_OBJECT_ROOT_INDEX,
       mCurrentFrameResource->ObjectCB.GetResourceGPUVirtualAddress(ri->ObjCBIndex));
   }
-  cmdList->DrawIndexedInstanced(
-      ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+  if (lod > 0) {
+    cmdList->DrawIndexedInstanced(ri->Lods[lod].IndexCount, 1, ri->Lods[lod].StartIndexLocation,
+        ri->BaseVertexLocation, 0);
+  } else {
+    cmdList->DrawIndexedInstanced(
+        ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+  }
+}
+
+void PortalsApp::DrawRenderItemRanges(StateFilteredCommandList* cmdList, RenderItem* ri,
+                                      const std::vector<SubmeshGeometry>& ranges) {
+  if (ranges.empty())
+    return;
+  cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+  cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+  cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+  cmdList->SetGraphicsRootConstantBufferView(
+    CB_PER_OBJECT_ROOT_INDEX,
+    mCurrentFrameResource->ObjectCB.GetResourceGPUVirtualAddress(ri->ObjCBIndex));
+  for (const SubmeshGeometry& range : ranges) {
+    cmdList->DrawIndexedInstanced(
+        range.IndexCount, 1, range.StartIndexLocation, range.BaseVertexLocation, 0);
+  }
+}
+
+// Draws both portals' rims over the room just drawn, with the current pass, clip plane and stencil
+// ref.  Leaves the pipeline state set to portal B's decal PSO.
+void PortalsApp::DrawPortalDecals(StateFilteredCommandList* cmdList) {
+  if (mPortalDecalIndices.empty())
+    return;
+  cmdList->IASetVertexBuffers(0, 1, &mPortalDecalVertexBufferView);
+  cmdList->IASetIndexBuffer(&mPortalDecalIndexBufferView);
+  cmdList->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+  const PsoId psos[2] = { PSO_PORTAL_DECAL_A_CLIP, PSO_PORTAL_DECAL_B_CLIP };
+  RenderItem* items[2] = { &mPortalDecalARenderItem, &mPortalDecalBRenderItem };
+  for (int i = 0; i < 2; ++i) {
+    if (items[i]->IndexCount == 0)
+      continue;
+    cmdList->SetPipelineState(mPSOs[psos[i]].Get());
+    cmdList->SetGraphicsRootConstantBufferView(
+      CB_PER_OBJECT_ROOT_INDEX,
+      mCurrentFrameResource->ObjectCB.GetResourceGPUVirtualAddress(items[i]->ObjCBIndex));
+    cmdList->DrawIndexedInstanced(items[i]->IndexCount, 1, items[i]->StartIndexLocation,
+        items[i]->BaseVertexLocation, 0);
+  }
 }
 
 void PortalsApp::DrawIntersectingPlayerRealHalves(
-    int clipPlanePortalCBIndex, int clipPlaneOtherPortalCBIndex, int world2ThisToOtherCBIndex) {
+    StateFilteredCommandList* cmdList, int clipPlanePortalCBIndex,
+    int clipPlaneOtherPortalCBIndex, int world2ThisToOtherCBIndex, int otherPortalPassCBIndex) {
   // Assume stencil ref is already set to 0.
 
-  mCommandList->SetPipelineState(mPSOs["defaultClip"].Get());
+  cmdList->SetPipelineState(mPSOs[PSO_DEFAULT_CLIP].Get());
 
   // Set clip plane to this portal.
-  mCommandList->SetGraphicsRootConstantBufferView(
+  cmdList->SetGraphicsRootConstantBufferView(
       CB_CLIP_PLANE_ROOT_INDEX,
-      mCurrentFrameResource->ClipPlaneCB.GetResourceGPUVirtualAddress(clipPlanePortalCBIndex));
+      mClipPlaneCBAddresses[clipPlanePortalCBIndex]);
   // Draw larger half of player.
-  DrawRenderItem(mCommandList.Get(), &mPlayerRenderItem);
+  DrawRenderItem(cmdList, &mPlayerRenderItem, false, mPlayerPassLods[0]);
 
   // Set clip plane to other portal.
-  mCommandList->SetGraphicsRootConstantBufferView(
+  cmdList->SetGraphicsRootConstantBufferView(
       CB_CLIP_PLANE_ROOT_INDEX,
-      mCurrentFrameResource->ClipPlaneCB.GetResourceGPUVirtualAddress(clipPlaneOtherPortalCBIndex));
+      mClipPlaneCBAddresses[clipPlaneOtherPortalCBIndex]);
   // Set world2 matrix to this-to-other.
-  mCommandList->SetGraphicsRootConstantBufferView(
+  cmdList->SetGraphicsRootConstantBufferView(
       CB_WORLD2_ROOT_INDEX,
-      mCurrentFrameResource->World2CB.GetResourceGPUVirtualAddress(
-          world2ThisToOtherCBIndex));
-  // Draw smaller half of player.
-  DrawRenderItem(mCommandList.Get(), &mPlayerRenderItem);
+      mWorld2CBAddresses[world2ThisToOtherCBIndex]);
+  // Draw smaller half of player.  It's moved by this-to-other, like everything in the first pass
+  // inside the other portal, so its size on screen is that pass's.
+  DrawRenderItem(cmdList, &mPlayerRenderItem, false, mPlayerPassLods[otherPortalPassCBIndex]);
   // Restore world2 matrix to identity.
-  mCommandList->SetGraphicsRootConstantBufferView(
+  cmdList->SetGraphicsRootConstantBufferView(
       CB_WORLD2_ROOT_INDEX,
-      mCurrentFrameResource->World2CB.GetResourceGPUVirtualAddress(
-          WORLD2_IDENTITY_CB_INDEX));
+      mWorld2CBAddresses[WORLD2_IDENTITY_CB_INDEX]);
 }
 
 void PortalsApp::DrawRoomAndPlayerIterations(
-    UINT stencilRef, RenderItem* portalBoxRi, int CBIndexBase, int numIterations,
-    int clipPlaneOtherPortalCBIndex, bool drawPlayers) {
+    StateFilteredCommandList* cmdList, UINT stencilRef, RenderItem* portalBoxRi,
+    int CBIndexBase, int numIterations, int clipPlaneOtherPortalCBIndex, bool drawPlayers) {
   // Set per-pass constant buffer to unmodified view space.
-  mCommandList->SetGraphicsRootConstantBufferView(
+  cmdList->SetGraphicsRootConstantBufferView(
       CB_PER_PASS_ROOT_INDEX,
-      mCurrentFrameResource->PassCB.GetResourceGPUVirtualAddress(0));
+      mPassCBAddresses[0]);
   
   // Set clip plane (not used by portalBoxClearDepth).
-  mCommandList->SetGraphicsRootConstantBufferView(
+  cmdList->SetGraphicsRootConstantBufferView(
       CB_CLIP_PLANE_ROOT_INDEX,
-      mCurrentFrameResource->ClipPlaneCB.GetResourceGPUVirtualAddress(clipPlaneOtherPortalCBIndex));
+      mClipPlaneCBAddresses[clipPlaneOtherPortalCBIndex]);
 
   int passCBIndex = CBIndexBase;
   for (int i = 0; i < numIterations; ++i, ++stencilRef, ++passCBIndex) {
-    mCommandList->OMSetStencilRef(stencilRef);
+    cmdList->OMSetStencilRef(stencilRef);
 
     // Draw portal box to clear depth values inside portal hole.
-    mCommandList->SetPipelineState(mPSOs["portalBoxClearDepth"].Get());
-    DrawRenderItem(mCommandList.Get(), portalBoxRi, i > 0);
+    cmdList->SetPipelineState(mPSOs[PSO_PORTAL_BOX_CLEAR_DEPTH].Get());
+    DrawRenderItem(cmdList, portalBoxRi, i > 0);
 
     // Advance per-pass constant buffer.
-    mCommandList->SetGraphicsRootConstantBufferView(
+    cmdList->SetGraphicsRootConstantBufferView(
         CB_PER_PASS_ROOT_INDEX,
-        mCurrentFrameResource->PassCB.GetResourceGPUVirtualAddress(passCBIndex));
+        mPassCBAddresses[passCBIndex]);
 
-    // Draw room
-    mCommandList->SetPipelineState(mPSOs["defaultPortalsClip"].Get());
-    DrawRenderItem(mCommandList.Get(), &mRoomRenderItem);
+    // Draw the room chunks this level can see
+    cmdList->SetPipelineState(mPSOs[PSO_DEFAULT_PORTALS_CLIP].Get());
+    DrawRenderItemRanges(cmdList, &mRoomRenderItem, mRoomPassRanges[passCBIndex]);
+    DrawPortalDecals(cmdList);
 
-    if (drawPlayers) {
-      mCommandList->SetPipelineState(mPSOs["defaultClip"].Get());
-      DrawRenderItem(mCommandList.Get(), &mPlayerRenderItem);
+    if (drawPlayers && mPlayerPassVisible[passCBIndex]) {
+      cmdList->SetPipelineState(mPSOs[PSO_DEFAULT_CLIP].Get());
+      DrawRenderItem(cmdList, &mPlayerRenderItem, false, mPlayerPassLods[passCBIndex]);
     }
 
     // Draw portal box to increment stencil values inside portal hole.
-    mCommandList->SetPipelineState(mPSOs["portalBoxStencilIncr"].Get());
-    DrawRenderItem(mCommandList.Get(), portalBoxRi);
+    cmdList->SetPipelineState(mPSOs[PSO_PORTAL_BOX_STENCIL_INCR].Get());
+    DrawRenderItem(cmdList, portalBoxRi);
   }
 }
 
 void PortalsApp::DrawPlayerIterations(
-    UINT stencilRef, int CBIndexBase, int numIterations, const std::string& psoName) {
-  mCommandList->SetPipelineState(mPSOs[psoName].Get());
+    StateFilteredCommandList* cmdList, UINT stencilRef, int CBIndexBase, int numIterations,
+    PsoId pso) {
+  cmdList->SetPipelineState(mPSOs[pso].Get());
 
   int passCBIndex = CBIndexBase;
   for (int i = 0; i < numIterations; ++i, ++stencilRef, ++passCBIndex) {
-    mCommandList->OMSetStencilRef(stencilRef);
+    cmdList->OMSetStencilRef(stencilRef);
 
     // Set per-pass constant buffer.
-    mCommandList->SetGraphicsRootConstantBufferView(
+    cmdList->SetGraphicsRootConstantBufferView(
         CB_PER_PASS_ROOT_INDEX,
-        mCurrentFrameResource->PassCB.GetResourceGPUVirtualAddress(passCBIndex));
+        mPassCBAddresses[passCBIndex]);
 
     // Draw player
-    DrawRenderItem(mCommandList.Get(), &mPlayerRenderItem, i > 0);
+    DrawRenderItem(cmdList, &mPlayerRenderItem, i > 0, mPlayerPassLods[passCBIndex]);
   }
 }
 
 void PortalsApp::DrawRoomsAndIntersectingPlayersForPortal(
-    UINT stencilRef, RenderItem* portalBoxRi, int CBIndexBase, int numIterations,
-    int clipPlanePortalCBIndex, int clipPlaneOtherPortalCBIndex, bool playerIntersectPortal,
-    int world2ThisToOtherCBIndex, int world2OtherToThisCBIndex) {
+    StateFilteredCommandList* cmdList, UINT stencilRef, RenderItem* portalBoxRi,
+    int CBIndexBase, int numIterations, int clipPlanePortalCBIndex,
+    int clipPlaneOtherPortalCBIndex, bool playerIntersectPortal, int world2ThisToOtherCBIndex,
+    int world2OtherToThisCBIndex) {
   // Draw rooms inside portal
   DrawRoomAndPlayerIterations(
-      stencilRef, portalBoxRi, CBIndexBase, numIterations, clipPlaneOtherPortalCBIndex, false);
+      cmdList, stencilRef, portalBoxRi, CBIndexBase, numIterations, clipPlaneOtherPortalCBIndex,
+      false);
 
   // Set clip plane 1 to this portal and clip plane 2 to other portal (using defaultClipTwice PSO)
-  mCommandList->SetGraphicsRootConstantBufferView(
+  cmdList->SetGraphicsRootConstantBufferView(
       CB_CLIP_PLANE_ROOT_INDEX,
-      mCurrentFrameResource->ClipPlaneCB.GetResourceGPUVirtualAddress(
-          clipPlanePortalCBIndex));
+      mClipPlaneCBAddresses[clipPlanePortalCBIndex]);
   if (playerIntersectPortal) {
     // Draw larger half of players
-    DrawPlayerIterations(stencilRef, CBIndexBase, numIterations, "defaultClipTwice");
+    DrawPlayerIterations(cmdList, stencilRef, CBIndexBase, numIterations, PSO_DEFAULT_CLIP_TWICE);
   } else {
     // Set world2 matrix to other-to-this.
-    mCommandList->SetGraphicsRootConstantBufferView(
+    cmdList->SetGraphicsRootConstantBufferView(
         CB_WORLD2_ROOT_INDEX,
-        mCurrentFrameResource->World2CB.GetResourceGPUVirtualAddress(
-            world2OtherToThisCBIndex));
+        mWorld2CBAddresses[world2OtherToThisCBIndex]);
     // Draw smaller half of players.
-    DrawPlayerIterations(stencilRef, CBIndexBase, numIterations, "defaultClipTwice");
+    DrawPlayerIterations(cmdList, stencilRef, CBIndexBase, numIterations, PSO_DEFAULT_CLIP_TWICE);
     // Restore world2 matrix to identity.
-    mCommandList->SetGraphicsRootConstantBufferView(
+    cmdList->SetGraphicsRootConstantBufferView(
         CB_WORLD2_ROOT_INDEX,
-        mCurrentFrameResource->World2CB.GetResourceGPUVirtualAddress(
-            WORLD2_IDENTITY_CB_INDEX));
+        mWorld2CBAddresses[WORLD2_IDENTITY_CB_INDEX]);
   }
     
   // Set clip plane to other portal (using defaultClip PSO)
-  mCommandList->SetGraphicsRootConstantBufferView(
+  cmdList->SetGraphicsRootConstantBufferView(
       CB_CLIP_PLANE_ROOT_INDEX,
-      mCurrentFrameResource->ClipPlaneCB.GetResourceGPUVirtualAddress(
-          clipPlaneOtherPortalCBIndex));
+      mClipPlaneCBAddresses[clipPlaneOtherPortalCBIndex]);
   if (playerIntersectPortal) {
     // Set world2 matrix to this-to-other.
-    mCommandList->SetGraphicsRootConstantBufferView(
+    cmdList->SetGraphicsRootConstantBufferView(
         CB_WORLD2_ROOT_INDEX,
-        mCurrentFrameResource->World2CB.GetResourceGPUVirtualAddress(
-            world2ThisToOtherCBIndex));
+        mWorld2CBAddresses[world2ThisToOtherCBIndex]);
     // Draw smaller half of players.
-    DrawPlayerIterations(stencilRef, CBIndexBase, numIterations, "defaultClip");
+    DrawPlayerIterations(cmdList, stencilRef, CBIndexBase, numIterations, PSO_DEFAULT_CLIP);
     // Restore world2 matrix to identity.
-    mCommandList->SetGraphicsRootConstantBufferView(
+    cmdList->SetGraphicsRootConstantBufferView(
         CB_WORLD2_ROOT_INDEX,
-        mCurrentFrameResource->World2CB.GetResourceGPUVirtualAddress(
-            WORLD2_IDENTITY_CB_INDEX));
+        mWorld2CBAddresses[WORLD2_IDENTITY_CB_INDEX]);
   } else {
     // Draw larger half of players.
-    DrawPlayerIterations(stencilRef, CBIndexBase, numIterations, "defaultClip");
+    DrawPlayerIterations(cmdList, stencilRef, CBIndexBase, numIterations, PSO_DEFAULT_CLIP);
   }
 }
 
 void PortalsApp::DrawPortalBoxToCoverDepthHoleAndZeroStencil(
-    UINT stencilRef, RenderItem* portalBoxRi) {
+    StateFilteredCommandList* cmdList, UINT stencilRef, RenderItem* portalBoxRi) {
   // No need to reset clip plane since portalBoxDepthAlwaysStencilZero PSO doesn't use it.
   // Set per-pass constant buffer to unmodified view space.
-  mCommandList->SetGraphicsRootConstantBufferView(
+  cmdList->SetGraphicsRootConstantBufferView(
       CB_PER_PASS_ROOT_INDEX,
-      mCurrentFrameResource->PassCB.GetResourceGPUVirtualAddress(0));
-  mCommandList->OMSetStencilRef(stencilRef);
-  mCommandList->SetPipelineState(mPSOs["portalBoxDepthAlwaysStencilZero"].Get());
-  DrawRenderItem(mCommandList.Get(), portalBoxRi);
+      mPassCBAddresses[0]);
+  cmdList->OMSetStencilRef(stencilRef);
+  cmdList->SetPipelineState(mPSOs[PSO_PORTAL_BOX_DEPTH_ALWAYS_STENCIL_ZERO].Get());
+  DrawRenderItem(cmdList, portalBoxRi);
 }
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
@@ -1341,9 +2470,34 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
   _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+  // "-convert-room in.txt out.bin" writes a text room file as a binary one, with its cells and
+  // mesh built, and quits.
+  const char* convertArg = strstr(cmdLine, "-convert-room ");
+  if (convertArg != nullptr) {
+    std::istringstream args(convertArg + strlen("-convert-room "));
+    std::string textPath;
+    std::string binaryPath;
+    if (!(args >> textPath >> binaryPath)) {
+      dprintf("Usage: -convert-room in.txt out.bin\n");
+      return 0;
+    }
+    try {
+      RoomLoader::ConvertRoomFile(textPath, binaryPath, PrepareRoomMesh);
+    } catch (std::exception& e) {
+      dprintf("Converting %s failed: %s\n", textPath.c_str(), e.what());
+    }
+    return 0;
+  }
+
   try
   {
     PortalsApp theApp(hInstance);
+
+    // "-frames N" sets the number of frames in flight.
+    const char* framesArg = strstr(cmdLine, "-frames ");
+    if (framesArg != nullptr)
+      theApp.SetFramesInFlight(atoi(framesArg + strlen("-frames ")));
+
     if (!theApp.Initialize())
       return 0;
 
@@ -3,9 +3,21 @@
 #include "d3dApp.h" // Include this first
 
 #include "Camera.h"
+#include "D3D12TextureStreamer.h"
+#include "DescriptorAllocator.h"
 #include "FrameResource.h"
 #include "Light.h"
+#include "OcclusionBuffer.h"
+#include "PortalDecal.h"
+#include "PortalFrustum.h"
 #include "Room.h"
+#include "RoomLoader.h"
+#include "SoftwarePortalRenderer.h"
+#include "SpherePath.h"
+#include "StateFilteredCommandList.h"
+#include "UploadRing.h"
+#include "VertexCompression.h"
+#include "WorkerThreads.h"
 
 #pragma comment(lib, "d3dcompiler.lib")
 #pragma comment(lib, "D3D12.lib")
@@ -13,7 +25,8 @@
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
 
-const int gNumFrameResources = 3;
+// Draw records the main view and each portal's recursion on its own thread.
+const int gNumRecordThreads = 3;
 
 class PortalsApp : public D3DApp {
 public:
@@ -21,6 +34,9 @@ public:
     XMMATRIX World = XMMatrixIdentity();
     XMMATRIX TexTransform = XMMatrixIdentity();
 
+    // Decodes Geo's compressed vertices for this submesh.
+    VertexQuantization Quantization = {};
+
     // Dirty flag indicating the object data has changed and we need to update the constant buffer.
     // Because we have an object cbuffer for each FrameResource, we have to apply the
     // update to each FrameResource.  Thus, when we modify obect data we should set 
@@ -38,6 +54,73 @@ public:
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+    // Index ranges of less detailed versions of the mesh, using the same vertices.  Lods[0] is the
+    // range above; empty if there's only the one.
+    std::vector<SubmeshGeometry> Lods;
+
+    // Spatially coherent pieces of the range above, in order, with their object-space bounds; empty
+    // if the mesh isn't split.  Drawing them all draws the same triangles as the whole range.
+    std::vector<SubmeshGeometry> Chunks;
+  };
+
+  // Keys for the shader, PSO, geometry, material and texture registries.  Each registry is an array
+  // indexed by its key and filled in once at build time, so Draw never looks anything up by name.
+  enum ShaderId {
+    SHADER_PORTAL_BOX_VS,
+    SHADER_PORTAL_BOX_PS,
+    SHADER_PORTAL_BOX_CLEAR_DEPTH_VS,
+    SHADER_PORTAL_BOX_CLIP_PS,
+    SHADER_DEFAULT_VS,
+    SHADER_DEFAULT_CLIP_PS,
+    SHADER_DEFAULT_CLIP_TWICE_PS,
+    SHADER_DEFAULT_PORTALS_CLIP_PS,
+    SHADER_PORTAL_DECAL_VS,
+    SHADER_PORTAL_DECAL_A_CLIP_PS,
+    SHADER_PORTAL_DECAL_B_CLIP_PS,
+    NUM_SHADERS
+  };
+
+  enum PsoId {
+    PSO_DEFAULT_CLIP,
+    PSO_DEFAULT_CLIP_TWICE,
+    PSO_DEFAULT_PORTALS_CLIP,
+    PSO_PORTAL_BOX_STENCIL_SET,
+    PSO_PORTAL_BOX_STENCIL_INCR,
+    PSO_PORTAL_BOX_CLEAR_DEPTH,
+    PSO_PORTAL_BOX_DEPTH_ALWAYS_STENCIL_ZERO,
+    PSO_PORTAL_DECAL_A_CLIP,
+    PSO_PORTAL_DECAL_B_CLIP,
+    NUM_PSOS
+  };
+
+  enum GeometryId {
+    GEOMETRY_SHAPES,
+    NUM_GEOMETRIES
+  };
+
+  // The submeshes of GEOMETRY_SHAPES whose vertices are compressed over their own ranges.
+  enum SubmeshId {
+    SUBMESH_ROOM,
+    SUBMESH_PLAYER,
+    SUBMESH_PORTAL_BOX,
+    NUM_SUBMESHES
+  };
+
+  // Also the material's index in the material buffer.
+  enum MaterialId {
+    MATERIAL_ROOM,
+    MATERIAL_PLAYER,
+    NUM_MATERIALS
+  };
+
+  // Also the texture's index in the SRV heap.
+  enum TextureId {
+    TEXTURE_ROOM,
+    TEXTURE_PLAYER,
+    TEXTURE_PORTAL_A,
+    TEXTURE_PORTAL_B,
+    NUM_TEXTURES
   };
 
   PortalsApp(HINSTANCE hInstance);
@@ -49,6 +132,14 @@ public:
   PortalsApp& operator=(PortalsApp&&) = delete;
 
   bool Initialize() override;
+
+  // Sets how many frames the CPU may record ahead of the GPU.  May be called before or after
+  // Initialize; afterwards it flushes the queue and rebuilds the frame resources.
+  void SetFramesInFlight(int count);
+
+  // Fills in scene with what the last Draw rendered, for SoftwarePortalRenderer.  Textures only
+  // exist on the GPU, so the scene's texture maps are left empty.
+  void BuildSoftwareScene(SoftwarePortalScene* scene) const;
   
 protected:
   void OnResize() override;
@@ -58,19 +149,28 @@ protected:
   void OnMouseDown(WPARAM btnState, int x, int y) override;
   void OnMouseUp(WPARAM btnState, int x, int y) override;
   void OnMouseMove(WPARAM btnState, int x, int y) override;
+  void OnKeyUp(WPARAM key) override;
+  std::wstring GetFrameStatsText() override;
 
 private:
-  void LoadTexture(const std::string& name, const std::wstring& path);
+  void LoadTexture(TextureId id, const std::string& name, const std::wstring& path);
   void BuildRootSignature();
   void BuildDescriptorHeaps();
   void BuildShadersAndInputLayout();
   void BuildShapeGeometry();
   void BuildMaterials();
   void BuildRenderItems();
+  void BuildPortalDecals();
   void BuildFrameResources();
   void BuildPSOs();
+  void BuildRecordCommandLists();
+
+  void LoadWorld(const std::string& worldPath, const std::string& roomPath);
+  void EnterRoom(std::shared_ptr<const LoadedRoom> room, bool spawnPlayer);
+  void CrossDoorways();
+  void SwitchRoom(int room, const Portal& from, const Portal& to);
 
-  void ReadRoomFile(const std::string& path);
+  void WriteSoftwareReference();
   
   void OnKeyboardInput(float dt, bool modifyPortal);
   void UpdateMaterialBuffer();
@@ -82,26 +182,47 @@ private:
   void UpdatePassCB(
       int index, const XMMATRIX& viewProj, const XMFLOAT3& eyePosW, float distDilation);
   void UpdateFrameCB();
+  void UploadPortalDecals();
+  float ScreenPixels(const XMFLOAT3& position, float diameter) const;
+  int ChoosePlayerLod(const XMMATRIX& worldToVirtual);
+  void CullPass(int passCBIndex, const PortalFrustum& frustumW,
+                const std::vector<bool>& visibleCells);
+  void RequestTextureSizes();
+  void UpdateTextureDescriptors();
 
   void DrawRenderItem(
-    ID3D12GraphicsCommandList* cmdList, RenderItem* ri, bool sameAsPrevious = false);
+    StateFilteredCommandList* cmdList, RenderItem* ri, bool sameAsPrevious = false, int lod = 0);
+  void DrawRenderItemRanges(StateFilteredCommandList* cmdList, RenderItem* ri,
+                            const std::vector<SubmeshGeometry>& ranges);
+  void DrawPortalDecals(StateFilteredCommandList* cmdList);
+
+  void AddOccluder(const RenderItem& ri);
+  bool IsPortalOccluded(const Portal& portal);
+  void UpdatePortalVisibility(const XMMATRIX& viewProj, bool playerIntersectPortal);
+
+  ID3D12GraphicsCommandList* BeginRecording(int threadIndex);
+  void SetCommonDrawState(StateFilteredCommandList* cmdList);
 
   void DrawIntersectingPlayerRealHalves(
-    int clipPlanePortalCBIndex, int clipPlaneOtherPortalCBIndex, int world2ThisToOtherCBIndex);
+    StateFilteredCommandList* cmdList, int clipPlanePortalCBIndex,
+    int clipPlaneOtherPortalCBIndex, int world2ThisToOtherCBIndex, int otherPortalPassCBIndex);
   
   void DrawRoomAndPlayerIterations(
-      UINT stencilRef, RenderItem* portalBoxRi, int CBIndexBase, int numIterations,
-      int clipPlaneCBIndex, bool drawPlayers);
+      StateFilteredCommandList* cmdList, UINT stencilRef, RenderItem* portalBoxRi,
+      int CBIndexBase, int numIterations, int clipPlaneCBIndex, bool drawPlayers);
 
   void DrawPlayerIterations(
-    UINT stencilRef, int CBIndexBase, int numIterations, const std::string& psoName);
+    StateFilteredCommandList* cmdList, UINT stencilRef, int CBIndexBase, int numIterations,
+    PsoId pso);
 
   void DrawRoomsAndIntersectingPlayersForPortal(
-      UINT stencilRef, RenderItem* portalBoxRi, int CBIndexBase, int numIterations,
-      int clipPlanePortalCBIndex, int clipPlaneOtherPortalCBIndex, bool playerIntersectPortal,
-      int world2ThisToOtherCBIndex, int world2OtherToThisCBIndex);
+      StateFilteredCommandList* cmdList, UINT stencilRef, RenderItem* portalBoxRi,
+      int CBIndexBase, int numIterations, int clipPlanePortalCBIndex,
+      int clipPlaneOtherPortalCBIndex, bool playerIntersectPortal, int world2ThisToOtherCBIndex,
+      int world2OtherToThisCBIndex);
 
-  void DrawPortalBoxToCoverDepthHoleAndZeroStencil(UINT stencilRef, RenderItem* portalBoxRi);
+  void DrawPortalBoxToCoverDepthHoleAndZeroStencil(
+      StateFilteredCommandList* cmdList, UINT stencilRef, RenderItem* portalBoxRi);
 
   XMFLOAT3 mAmbientLight;
   DirectionalLight mDirLights[NUM_LIGHTS];
@@ -120,6 +241,14 @@ private:
   float mRightViewScale;
 
   // Room
+  // The world's rooms stream in and out around the player's (see RoomLoader).  mRoom is the
+  // current one's collision data, and GEOMETRY_SHAPES holds its mesh.
+  WorldFileData mWorld;
+  std::unique_ptr<RoomLoader> mRoomLoader;
+  RoomStreamer::Stats mRoomStreamingStats;   // Last reported
+  std::shared_ptr<const LoadedRoom> mCurrentRoom;
+  int mCurrentRoomIndex = 0;
+  int mArrivalDoorway = -1;    // Link * 2 + end the player last came out of, until it steps away
   Room mRoom;
 
   // Portal
@@ -135,24 +264,86 @@ private:
   // Player
   FirstPersonObject mPlayer;
 
+  // Collision
+  SpherePath::SubstepStats mSubstepStats;
+
   // D3D12 stuff
   std::vector<std::unique_ptr<FrameResource>> mFrameResources;
   FrameResource* mCurrentFrameResource;
-  int mCurrentFrameResourceIndex;
+  int mCurrentFrameResourceIndex = 0;
+
+  // Constants written every frame, and their GPU addresses for the current frame.
+  std::unique_ptr<UploadRing> mConstantRing;
+  std::vector<D3D12_GPU_VIRTUAL_ADDRESS> mClipPlaneCBAddresses;
+  std::vector<D3D12_GPU_VIRTUAL_ADDRESS> mWorld2CBAddresses;
+  std::vector<D3D12_GPU_VIRTUAL_ADDRESS> mPassCBAddresses;
+  std::vector<int> mPlayerPassLods;     // Player LOD for each pass, indexed like mPassCBAddresses
+
+  // What each pass can see, indexed like mPassCBAddresses: the index ranges of the room chunks
+  // inside its frustum (adjacent ones merged), and whether the player is.
+  std::vector<std::vector<SubmeshGeometry>> mRoomPassRanges;
+  std::vector<bool> mPlayerPassVisible;
+
+  // The room's cells (see CellGraph) that each of its chunks overlaps, indexed like
+  // mRoomRenderItem.Chunks, and the ones the player overlaps this frame.
+  std::vector<std::vector<int>> mRoomChunkCells;
+  std::vector<int> mPlayerCells;
+  // The cells the main view might see, and the ones the passes inside portals A and B might.
+  std::vector<bool> mViewCells;
+  std::vector<bool> mPortalAPassCells;
+  std::vector<bool> mPortalBPassCells;
+  // The frustums the passes are culled against.  They're kept so their planes' storage is reused
+  // from frame to frame: mPortalFrustum is narrowed by each level's opening in turn, and
+  // mPassFrustum is it moved into world space for one pass.
+  PortalFrustum mViewFrustum;
+  PortalFrustum mPortalFrustum;
+  PortalFrustum mPassFrustum;
+  D3D12_GPU_VIRTUAL_ADDRESS mFrameCBAddress = 0;
+
+  // CPU copies of the constants above, for BuildSoftwareScene.
+  std::vector<ClipPlaneConstants> mClipPlaneCBData;
+  std::vector<World2Constants> mWorld2CBData;
+  std::vector<PassConstants> mPassCBData;
+  FrameConstants mFrameCBData;
+
+  // One command list per record thread, submitted in thread index order.
+  std::unique_ptr<WorkerThreads> mRecordThreads;
+  std::array<ComPtr<ID3D12GraphicsCommandList>, gNumRecordThreads> mRecordCommandLists;
+  std::array<StateFilteredCommandList::Stats, gNumRecordThreads> mRecordStats;
+  StateFilteredCommandList::Stats mStateFilterStats;   // Totals for the last frame
+
+  // Depth of the main view's room and player, to skip recursing into portals hidden behind them.
+  OcclusionBuffer mOcclusionBuffer;
+  bool mPortalAVisible = true;
+  bool mPortalBVisible = true;
 
   UINT mCbvSrvDescriptorSize;
 
-  ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
+  // Held by Initialize's stages while they record into mCommandList.
+  std::mutex mInitCommandListMutex;
 
-  ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
+  ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
 
-  std::unordered_map<std::string, MeshGeometry> mGeometries;
-  std::unordered_map<std::string, PhongMaterial> mMaterials;
-  std::unordered_map<std::string, Texture> mTextures;
-  std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
-  std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+  // Each texture's SRV is persistent; Update copies them into a transient table for the frame.
+  std::unique_ptr<DescriptorAllocator> mSrvDescriptors;
+  std::array<DescriptorRange, NUM_TEXTURES> mTextureSrvs;
+  DescriptorRange mTextureTable;
+
+  std::array<MeshGeometry, NUM_GEOMETRIES> mGeometries;
+  std::array<VertexQuantization, NUM_SUBMESHES> mVertexQuantizations;
+  std::array<PhongMaterial, NUM_MATERIALS> mMaterials;
+  std::array<Texture, NUM_TEXTURES> mTextures;
+  std::unique_ptr<D3D12TextureStreamer> mTextureStreamer;
+  std::array<int, NUM_TEXTURES> mStreamedTextureIndices;
+  TextureStreamer::Stats mTextureStreamingStats;   // Last reported
+  std::array<ComPtr<ID3DBlob>, NUM_SHADERS> mShaders;
+  std::array<ComPtr<ID3D12PipelineState>, NUM_PSOS> mPSOs;
 
   std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
+  std::vector<D3D12_INPUT_ELEMENT_DESC> mFloatPositionInputLayout;
+  // Whether the shapes and decals keep float positions because unorm16s would move them too far.
+  // Set by BuildShapeGeometry; picks the PSOs' input layout.
+  bool mFloatPositions = false;
 
   ComPtr<ID3D12PipelineState> mPSO = nullptr;
 
@@ -162,5 +353,21 @@ private:
   RenderItem mPortalBoxBRenderItem;
   RenderItem* mCurrentPortalBoxRenderItem;
 
+  // The textured rims around the portals' holes, drawn over the room (see PortalDecal.h).  Both
+  // share one mesh, decal A's vertices and indices first, rebuilt only when a portal moves or
+  // resizes.  Its positions are compressed over the room's ranges so they round the same way as
+  // the wall under them, or kept as floats with the room's.  It's copied into the constant ring
+  // every frame for the views below.
+  RenderItem mPortalDecalARenderItem;
+  RenderItem mPortalDecalBRenderItem;
+  std::vector<Vertex> mPortalDecalVertices;     // Uncompressed, for BuildSoftwareScene
+  std::vector<CompressedVertex> mPortalDecalCompressedVertices;
+  std::vector<FloatPositionVertex> mPortalDecalFloatPositionVertices;   // If mFloatPositions
+  std::vector<std::uint16_t> mPortalDecalIndices;
+  XMFLOAT4X4 mPortalDecalAToWorld;              // What the decals were last built for
+  XMFLOAT4X4 mPortalDecalBToWorld;
+  D3D12_VERTEX_BUFFER_VIEW mPortalDecalVertexBufferView = {};
+  D3D12_INDEX_BUFFER_VIEW mPortalDecalIndexBufferView = {};
+
   PassConstants mMainPassCB;
 };
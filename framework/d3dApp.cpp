@@ -98,8 +98,7 @@ int D3DApp::Run()
         mTimer.Tick();
 
         prevFrameTime = mTimer.DeltaTime();
-        if (prevFrameTime < mMinFrameTime)
-          Sleep((DWORD)(1000.0f * (mMinFrameTime - prevFrameTime)));
+        mFramePacer->EndFrame();
       } else
       {
         Sleep(100);
@@ -365,6 +364,8 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
       PostQuitMessage(0);
     } else if ((int)wParam == VK_F2)
       Set4xMsaaState(!m4xMsaaState);
+    else
+      OnKeyUp(wParam);
 
     return 0;
   }
@@ -446,6 +447,11 @@ bool D3DApp::InitDirect3D()
   ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE,
     IID_PPV_ARGS(&mFence)));
 
+  mPacingClock = std::make_unique<QpcPacingClock>();
+  mPacingFence = std::make_unique<D3D12PacingFence>(mFence.Get());
+  mFramePacer = std::make_unique<FramePacer>(mPacingClock.get(), mPacingFence.get());
+  mFramePacer->SetMinFrameTime(mMinFrameTime);
+
   mRtvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
   mDsvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
   mCbvSrvUavDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
@@ -542,17 +548,7 @@ void D3DApp::FlushCommandQueue()
   ThrowIfFailed(mCommandQueue->Signal(mFence.Get(), mCurrentFence));
 
   // Wait until the GPU has completed commands up to this fence point.
-  if (mFence->GetCompletedValue() < mCurrentFence)
-  {
-    HANDLE eventHandle = CreateEventEx(nullptr, false, false, EVENT_ALL_ACCESS);
-
-    // Fire event when GPU hits current fence.  
-    ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
-
-    // Wait until the GPU hits current fence event is fired.
-    WaitForSingleObject(eventHandle, INFINITE);
-    CloseHandle(eventHandle);
-  }
+  mPacingFence->WaitForValue(mCurrentFence);
 }
 
 ID3D12Resource* D3DApp::CurrentBackBuffer()const
@@ -595,9 +591,20 @@ void D3DApp::CalculateFrameStats()
     wstring fpsStr = to_wstring(fps);
     wstring mspfStr = to_wstring(mspf);
 
+    // Average time per frame spent in the frame rate limiter, waiting on the GPU, and between
+    // reading input and presenting.
+    FramePacingStats pacingStats = mFramePacer->TakeAverageStats();
+    wstring cpuWaitStr = to_wstring(1000.0 * pacingStats.CpuWait);
+    wstring gpuWaitStr = to_wstring(1000.0 * pacingStats.GpuWait);
+    wstring latencyStr = to_wstring(1000.0 * pacingStats.InputToPresent);
+
     wstring windowText = mMainWndCaption +
       L"    fps: " + fpsStr +
-      L"   mspf: " + mspfStr;
+      L"   mspf: " + mspfStr +
+      L"   cpu wait: " + cpuWaitStr +
+      L"   gpu wait: " + gpuWaitStr +
+      L"   input to present: " + latencyStr +
+      GetFrameStatsText();
 
     SetWindowText(mhMainWnd, windowText.c_str());
 
@@ -10,7 +10,9 @@
 #endif
 
 #include "d3dUtil.h"
+#include "FramePacer.h"
 #include "GameTimer.h"
+#include "Win32FramePacing.h"
 
 // Link necessary d3d12 libraries.
 #pragma comment(lib,"d3dcompiler.lib")
@@ -48,10 +50,14 @@ protected:
   virtual void Update(float dt) = 0;
   virtual void Draw(float dt) = 0;
 
-  // Convenience overrides for handling mouse input.
+  // Convenience overrides for handling mouse and keyboard input.
   virtual void OnMouseDown(WPARAM btnState, int x, int y) { }
   virtual void OnMouseUp(WPARAM btnState, int x, int y) { }
   virtual void OnMouseMove(WPARAM btnState, int x, int y) { }
+  virtual void OnKeyUp(WPARAM key) { }
+
+  // Appended to the frame stats in the window caption.
+  virtual std::wstring GetFrameStatsText() { return std::wstring(); }
 
 protected:
 
@@ -98,6 +104,11 @@ protected:
   Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
   UINT64 mCurrentFence = 0;
 
+  // Frame pacing.  Created along with mFence; mPacingFence also backs FlushCommandQueue.
+  std::unique_ptr<QpcPacingClock> mPacingClock;
+  std::unique_ptr<D3D12PacingFence> mPacingFence;
+  std::unique_ptr<FramePacer> mFramePacer;
+
   Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCommandQueue;
   Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mDirectCmdListAlloc;
   Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCommandList;
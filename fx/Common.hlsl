@@ -2,6 +2,21 @@
 #define NUM_LIGHTS 3
 #endif
 
+#ifndef FOG_START
+#define FOG_START 20.0f
+#endif
+#ifndef FOG_RANGE
+#define FOG_RANGE 80.0f //500.0f
+#endif
+#ifndef FOG_COLOR
+#define FOG_COLOR float3(0.7f, 0.7f, 0.7f)
+#endif
+
+#ifndef PORTAL_TEX_RAD_RATIO
+// Ratio of portal texture width to portal hole diameter.
+#define PORTAL_TEX_RAD_RATIO 1.0f
+#endif
+
 struct MaterialData {
   float4 Diffuse;
   float4 Specular;
@@ -41,6 +56,12 @@ cbuffer cbPerObject : register(b0) {
   uint gObjPad0;
   uint gObjPad1;
   uint gObjPad2;
+  float3 gPosScale;
+  float gObjPad3;
+  float3 gPosOffset;
+  float gObjPad4;
+  float2 gTexCScale;
+  float2 gTexCOffset;
 };
 
 cbuffer cbClipPlane : register(b1) {
@@ -62,9 +83,32 @@ cbuffer cbPass : register(b3) {
 };
 
 cbuffer cbFrame : register(b4) {
-  float4x4 gPortalA;
-  float4x4 gPortalB;
-  float3 gAmbientLight;
+  float4 gPortalAHole;      // Center of portal A's hole in xyz, its radius in w
+  float3 gPortalANormal;
   float gFramePad0;
+  float4 gPortalBHole;
+  float3 gPortalBNormal;
+  float gFramePad1;
+  float3 gAmbientLight;
+  float gFramePad2;
   DirectionalLight gLights[NUM_LIGHTS];
-};
\ No newline at end of file
+};
+
+// Vertices arrive compressed (see util/VertexCompression.h): positions and texture coordinates as
+// unorms over the mesh's ranges in cbPerObject, normals octahedral-encoded into two snorms.
+// Positions kept as floats come with an offset of 0 and a scale of 1.
+float3 DecodePosition(float3 posQ) {
+  return gPosOffset + gPosScale * posQ;
+}
+
+float2 DecodeTexC(float2 texCQ) {
+  return gTexCOffset + gTexCScale * texCQ;
+}
+
+// Same as DecodeOctahedral in VertexCompression.cpp.
+float3 DecodeOctahedral(float2 e) {
+  float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+  float t = saturate(-n.z);
+  n.xy += n.xy >= 0.0f ? -t : t;
+  return normalize(n);
+}
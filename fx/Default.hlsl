@@ -1,20 +1,5 @@
 #include "Common.hlsl"
 
-#ifndef FOG_START
-#define FOG_START 20.0f
-#endif
-#ifndef FOG_RANGE
-#define FOG_RANGE 80.0f //500.0f
-#endif
-#ifndef FOG_COLOR
-#define FOG_COLOR float3(0.7f, 0.7f, 0.7f)
-#endif
-
-#ifndef PORTAL_TEX_RAD_RATIO
-// Ratio of portal texture width to portal hole diameter.
-#define PORTAL_TEX_RAD_RATIO 1.0f
-#endif
-
 #define PORTAL_Z_EPSILON 0.001f
 
 float3 ComputeDirectionalLight(
@@ -25,10 +10,22 @@ float3 ComputeDirectionalLight(
   return L.Strength * (diffuseFactor * Diffuse + specFactor * Specular.rgb);
 }
 
+#ifdef CLIP_PORTAL_HOLES
+// Negative if posW is inside the portal's hole: in the portal's plane and within its radius of the
+// center.  hole is the center in xyz and the radius in w.
+float PortalHoleTest(float3 posW, float4 hole, float3 normal) {
+  float3 toPos = posW - hole.xyz;
+  float z = dot(toPos, normal);
+  if (abs(z) > PORTAL_Z_EPSILON)
+    return 1.0f;
+  return dot(toPos, toPos) - z * z - hole.w * hole.w;
+}
+#endif
+
 struct VertexIn {
-  float3 PosL    : POSITION;
-  float3 NormalL : NORMAL;
-  float2 TexC    : TEXCOORD;
+  float3 PosQ    : POSITION;    // Compressed; see Common.hlsl
+  float2 NormalQ : NORMAL;
+  float2 TexCQ   : TEXCOORD;
 };
 
 struct VertexOut {
@@ -36,18 +33,14 @@ struct VertexOut {
   float3 PosW         : POSITION;
   float3 NormalW      : NORMAL;
   float2 TexC         : TEXCOORD0;
-#ifdef DRAW_PORTALS
-  float3 PosPA	      : POSITION1;		// position in portalA space
-  float3 PosPB	      : POSITION2;		// position in portalB space
-#endif
 };
 
 VertexOut VS(VertexIn vin) {
   VertexOut vout;
   
   // Transform to world space.
-  float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
-  vout.NormalW = mul(vin.NormalL, (float3x3)gWorldInvTranspose);
+  float4 posW = mul(float4(DecodePosition(vin.PosQ), 1.0f), gWorld);
+  vout.NormalW = mul(DecodeOctahedral(vin.NormalQ), (float3x3)gWorldInvTranspose);
   // Modify world-space position and normal and world2 transformation.
   posW = mul(posW, gWorld2);
   vout.NormalW = mul(vout.NormalW, (float3x3)gWorld2InvTranspose); // normalize this?
@@ -58,16 +51,7 @@ VertexOut VS(VertexIn vin) {
   vout.PosH = mul(posW, gViewProj);
   
   // Output vertex attributes for interpolation across triangle.
-  vout.TexC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform).xy;
-
-  // Transform from world space to portal space of both portals.
-  // In portal space, the portal is centered at origin in XY plane with radius 1. The Z-axis
-  // of portal space is not scaled relative to world space, while the X,Y axes are scaled by the
-  // reciprocal of the portal's world-space hole radius.
-#ifdef DRAW_PORTALS
-  vout.PosPA = mul(posW, gPortalA).xyz;
-  vout.PosPB = mul(posW, gPortalB).xyz;
-#endif
+  vout.TexC = mul(float4(DecodeTexC(vin.TexCQ), 0.0f, 1.0f), gTexTransform).xy;
 
   return vout;
 }
@@ -79,6 +63,12 @@ float4 PS(VertexOut pin) : SV_TARGET {
 #ifdef CLIP_PLANE_2
   clip(dot(pin.PosW, gClipPlane2Normal) - gClipPlane2Offset);
 #endif
+#ifdef CLIP_PORTAL_HOLES
+  // Drop pixels in either portal's hole, so the portal's box behind it shows.  The rims around the
+  // holes are drawn over the room afterwards (see PortalDecal.hlsl).
+  clip(PortalHoleTest(pin.PosW, gPortalAHole, gPortalANormal));
+  clip(PortalHoleTest(pin.PosW, gPortalBHole, gPortalBNormal));
+#endif
 
   // Interpolating normal can unnormalize it, so renormalize it.
   pin.NormalW = normalize(pin.NormalW);
@@ -99,34 +89,6 @@ float4 PS(VertexOut pin) : SV_TARGET {
         gLights[i], diffuseAlbedo, matData.Specular, pin.NormalW, toEyeDirW);
   }
   
-#ifdef DRAW_PORTALS
-  // |portalDiffuse| will be alpha-blended with result from lighting calculations.
-  float4 portalDiffuse = float4(0.0f, 0.0f, 0.0f, 0.0f);
-
-  if (abs(pin.PosPA.z) <= PORTAL_Z_EPSILON) {
-    // Drop pixel if it's within the portal hole
-    clip(dot(pin.PosPA.xy, pin.PosPA.xy) - 1.0f);
-
-    // Calculate texcoord of this point for the portal texture
-    // x:[-PORTAL_TEX_RAD_RATIO, PORTAL_TEX_RAD_RATIO] -> u:[1, 0]
-    // y:[-PORTAL_TEX_RAD_RATIO, PORTAL_TEX_RAD_RATIO] -> v:[1, 0]
-    float2 texC = 0.5f * (1.0f - pin.PosPA.xy / PORTAL_TEX_RAD_RATIO);
-    portalDiffuse += gPortalAMap.Sample(gsamAnisotropicBlackBorder, texC);
-  }
-
-  if (abs(pin.PosPB.z) <= PORTAL_Z_EPSILON) {
-    // Drop pixel if it's within the portal hole
-    clip(dot(pin.PosPB.xy, pin.PosPB.xy) - 1.0f);
-
-    // Calculate texcoord of this point for the portal texture
-    // x:[-PORTAL_TEX_RAD_RATIO, PORTAL_TEX_RAD_RATIO] -> u:[1, 0]
-    // y:[-PORTAL_TEX_RAD_RATIO, PORTAL_TEX_RAD_RATIO] -> v:[1, 0]
-    float2 texC = 0.5f * (1.0f - pin.PosPB.xy / PORTAL_TEX_RAD_RATIO);
-    portalDiffuse += gPortalBMap.Sample(gsamAnisotropicBlackBorder, texC);
-  }
-
-  result = lerp(result, portalDiffuse.rgb, portalDiffuse.a);
-#endif
   
   // Blend result with fog color.
   float fogS = saturate((distToEye * gDistDilation - FOG_START) / FOG_RANGE);
@@ -5,9 +5,9 @@
 #endif
 
 struct VertexIn {
-  float3 PosL    : POSITION;
-  float3 NormalL : NORMAL;
-  float2 TexC    : TEXCOORD;
+  float3 PosQ    : POSITION;    // Compressed; see Common.hlsl
+  float2 NormalQ : NORMAL;
+  float2 TexCQ   : TEXCOORD;
 };
 
 struct VertexOut {
@@ -19,7 +19,7 @@ VertexOut VS(VertexIn vin) {
   VertexOut vout;
 
   // Transform to world space.
-  float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+  float4 posW = mul(float4(DecodePosition(vin.PosQ), 1.0f), gWorld);
   vout.PosW = posW.xyz;
   
   // Transform to homogeneous clip space.
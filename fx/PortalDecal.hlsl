@@ -0,0 +1,54 @@
+#include "Common.hlsl"
+
+// The textured rim around a portal's hole, drawn over the room where it lies on the wall.  The
+// mesh (see PortalDecal.h) already sits on the wall in world space; its texture coordinates are
+// where each point lands in the portal's texture.
+
+#ifndef PORTAL_MAP
+#define PORTAL_MAP gPortalAMap
+#endif
+
+struct VertexIn {
+  float3 PosQ    : POSITION;    // Compressed; see Common.hlsl
+  float2 NormalQ : NORMAL;
+  float2 TexCQ   : TEXCOORD;
+};
+
+struct VertexOut {
+  float4 PosH    : SV_POSITION;
+  float3 PosW    : POSITION;
+  float2 TexC    : TEXCOORD0;
+};
+
+VertexOut VS(VertexIn vin) {
+  VertexOut vout;
+
+  // Transform to world space.
+  float4 posW = mul(float4(DecodePosition(vin.PosQ), 1.0f), gWorld);
+  vout.PosW = posW.xyz;
+
+  // Transform to homogeneous clip space.
+  vout.PosH = mul(posW, gViewProj);
+
+  vout.TexC = DecodeTexC(vin.TexCQ);
+
+  return vout;
+}
+
+float4 PS(VertexOut pin) : SV_TARGET {
+#ifdef CLIP_PLANE
+  clip(dot(pin.PosW, gClipPlaneNormal) - gClipPlaneOffset);
+#endif
+
+  // The quads' inner edges cut across the hole; drop what's inside it.
+  float2 posP = PORTAL_TEX_RAD_RATIO * (1.0f - 2.0f * pin.TexC);
+  clip(dot(posP, posP) - 1.0f);
+
+  float4 portalDiffuse = PORTAL_MAP.Sample(gsamAnisotropicBlackBorder, pin.TexC);
+
+  // Fog the rim the same way as the wall under it, so blending it over the (fogged) wall gives the
+  // same color as fogging the blend.
+  float distToEye = length(gEyePosW - pin.PosW);
+  float fogS = saturate((distToEye * gDistDilation - FOG_START) / FOG_RANGE);
+  return float4(lerp(portalDiffuse.rgb, FOG_COLOR, fogS), portalDiffuse.a);
+}
@@ -0,0 +1,427 @@
+#include "Check.h"
+#include "CellGraph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+  typedef std::vector<std::vector<PolygonPoint>> Polygons;
+
+  const double AREA_TOLERANCE = 1e-3;
+  const double CONVEX_TOLERANCE = 1e-6;
+  const int POINT_SAMPLES = 2000;
+  const int PAIR_SAMPLES = 4000;
+
+  // A counterclockwise rectangle, or a clockwise one to use as a hole.
+  std::vector<PolygonPoint> Rectangle(float x0, float y0, float x1, float y1, bool hole = false) {
+    std::vector<PolygonPoint> ring = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+    if (hole)
+      std::reverse(ring.begin(), ring.end());
+    return ring;
+  }
+
+  // A room with a pillar in the middle.
+  Polygons PillarPlan() {
+    return { Rectangle(0.0f, 0.0f, 10.0f, 8.0f), Rectangle(4.0f, 3.0f, 6.0f, 5.0f, true) };
+  }
+
+  // Three lanes joined at alternate ends, so the first and last can't see each other: a line
+  // under the first divider and over the second would have to climb 8 in 4 and leave the plan.
+  Polygons SerpentinePlan() {
+    return { { { 0.0f, 0.0f }, { 8.0f, 0.0f }, { 8.0f, 10.0f }, { 9.0f, 10.0f }, { 9.0f, 0.0f },
+               { 12.0f, 0.0f }, { 12.0f, 12.0f }, { 4.0f, 12.0f }, { 4.0f, 2.0f },
+               { 3.0f, 2.0f }, { 3.0f, 12.0f }, { 0.0f, 12.0f } } };
+  }
+
+  // Two rooms side by side, joined by a doorway in the wall between them, the right one with a
+  // vertex in the middle of its far wall; then a hall of pillars.
+  Polygons RoomsPlan() {
+    Polygons polygons = { { { 0.0f, 0.0f }, { 6.0f, 0.0f }, { 6.0f, 2.0f }, { 7.0f, 2.0f },
+                            { 7.0f, 0.0f }, { 13.0f, 0.0f }, { 13.0f, 3.0f }, { 13.0f, 6.0f },
+                            { 7.0f, 6.0f }, { 7.0f, 3.0f }, { 6.0f, 3.0f }, { 6.0f, 6.0f },
+                            { 0.0f, 6.0f } } };
+    polygons.push_back(Rectangle(0.0f, 10.0f, 20.0f, 30.0f));
+    for (int y = 0; y < 4; ++y) {
+      for (int x = 0; x < 4; ++x) {
+        const float left = 2.0f + 5.0f * x;
+        const float bottom = 12.0f + 5.0f * y;
+        polygons.push_back(Rectangle(left, bottom, left + 1.0f, bottom + 1.0f, true));
+      }
+    }
+    return polygons;
+  }
+
+  double Cross(const PolygonPoint& a, const PolygonPoint& b, const PolygonPoint& c) {
+    return (static_cast<double>(b.x) - a.x) * (static_cast<double>(c.y) - a.y) -
+        (static_cast<double>(b.y) - a.y) * (static_cast<double>(c.x) - a.x);
+  }
+
+  double SignedArea(const std::vector<PolygonPoint>& ring) {
+    double area = 0.0;
+    for (size_t i = 0; i < ring.size(); ++i) {
+      const PolygonPoint& a = ring[i];
+      const PolygonPoint& b = ring[(i + 1) % ring.size()];
+      area += 0.5 * (static_cast<double>(a.x) * b.y - static_cast<double>(b.x) * a.y);
+    }
+    return area;
+  }
+
+  // Whether point is strictly inside the convex, counterclockwise ring.
+  bool InsideConvex(const std::vector<PolygonPoint>& ring, const PolygonPoint& point) {
+    for (size_t i = 0; i < ring.size(); ++i) {
+      if (Cross(ring[i], ring[(i + 1) % ring.size()], point) <= 0.0)
+        return false;
+    }
+    return true;
+  }
+
+  // Even-odd test against every polygon, so holes count as outside.
+  bool InsidePlan(const Polygons& polygons, const PolygonPoint& point) {
+    bool inside = false;
+    for (const std::vector<PolygonPoint>& polygon : polygons) {
+      for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        const PolygonPoint& a = polygon[i];
+        const PolygonPoint& b = polygon[j];
+        if ((a.y > point.y) != (b.y > point.y) &&
+            point.x < (b.x - a.x) * (point.y - a.y) / (b.y - a.y) + a.x)
+          inside = !inside;
+      }
+    }
+    return inside;
+  }
+
+  // Whether pq crosses or touches any edge of the plan.
+  bool HitsWall(const Polygons& polygons, const PolygonPoint& p, const PolygonPoint& q) {
+    for (const std::vector<PolygonPoint>& polygon : polygons) {
+      for (size_t i = 0; i < polygon.size(); ++i) {
+        const PolygonPoint& a = polygon[i];
+        const PolygonPoint& b = polygon[(i + 1) % polygon.size()];
+        if ((Cross(p, q, a) > 0.0) != (Cross(p, q, b) > 0.0) &&
+            (Cross(a, b, p) > 0.0) != (Cross(a, b, q) > 0.0))
+          return true;
+      }
+    }
+    return false;
+  }
+
+  void GetPlanBounds(const Polygons& polygons, PolygonPoint* boundsMin, PolygonPoint* boundsMax) {
+    *boundsMin = polygons[0][0];
+    *boundsMax = polygons[0][0];
+    for (const std::vector<PolygonPoint>& polygon : polygons) {
+      for (const PolygonPoint& point : polygon) {
+        boundsMin->x = std::min(boundsMin->x, point.x);
+        boundsMin->y = std::min(boundsMin->y, point.y);
+        boundsMax->x = std::max(boundsMax->x, point.x);
+        boundsMax->y = std::max(boundsMax->y, point.y);
+      }
+    }
+  }
+
+  // A random point of the plan's bounds that isn't in the plan's holes or outside it.
+  PolygonPoint RandomPointInPlan(const Polygons& polygons, std::mt19937* random) {
+    PolygonPoint boundsMin, boundsMax;
+    GetPlanBounds(polygons, &boundsMin, &boundsMax);
+    std::uniform_real_distribution<float> x(boundsMin.x, boundsMax.x);
+    std::uniform_real_distribution<float> y(boundsMin.y, boundsMax.y);
+    for (;;) {
+      const PolygonPoint point = { x(*random), y(*random) };
+      if (InsidePlan(polygons, point))
+        return point;
+    }
+  }
+
+  bool SamePoint(const PolygonPoint& a, const PolygonPoint& b) {
+    return a.x == b.x && a.y == b.y;
+  }
+
+  bool LessEdge(const CellGraph::Wall& l, const CellGraph::Wall& r) {
+    if (l.A.x != r.A.x)
+      return l.A.x < r.A.x;
+    if (l.A.y != r.A.y)
+      return l.A.y < r.A.y;
+    if (l.B.x != r.B.x)
+      return l.B.x < r.B.x;
+    return l.B.y < r.B.y;
+  }
+
+  bool SameVisibleCells(const CellGraph& graph, int cell, int other) {
+    const std::vector<int>& visible = graph.GetCell(cell).VisibleCells;
+    return std::binary_search(visible.begin(), visible.end(), other);
+  }
+
+  // The cells are convex and counterclockwise, and cover the plan without gaps or overlaps.
+  void CheckTiling(const CellGraph& graph, const Polygons& polygons) {
+    double cellArea = 0.0;
+    for (int c = 0; c < graph.GetCellCount(); ++c) {
+      const std::vector<PolygonPoint>& ring = graph.GetCell(c).Ring;
+      CHECK(ring.size() >= 3);
+      for (size_t i = 0; i < ring.size(); ++i) {
+        const double turn = Cross(ring[i], ring[(i + 1) % ring.size()],
+                                  ring[(i + 2) % ring.size()]);
+        CHECK(turn >= -CONVEX_TOLERANCE);
+      }
+      const double area = SignedArea(ring);
+      CHECK(area > 0.0);
+      cellArea += area;
+    }
+    double planArea = 0.0;
+    for (const std::vector<PolygonPoint>& polygon : polygons)
+      planArea += SignedArea(polygon);
+    CHECK_NEAR(cellArea, planArea, AREA_TOLERANCE);
+
+    // With the areas equal, a point of the plan in exactly one cell rules out overlaps.
+    std::mt19937 random(1);
+    for (int i = 0; i < POINT_SAMPLES; ++i) {
+      const PolygonPoint point = RandomPointInPlan(polygons, &random);
+      int containing = 0;
+      for (int c = 0; c < graph.GetCellCount(); ++c)
+        containing += InsideConvex(graph.GetCell(c).Ring, point) ? 1 : 0;
+      CHECK(containing <= 1);
+      const int found = graph.FindCell(point.x, point.y);
+      CHECK(found >= 0);
+      if (found >= 0 && containing == 1)
+        CHECK(InsideConvex(graph.GetCell(found).Ring, point));
+    }
+    PolygonPoint boundsMin, boundsMax;
+    GetPlanBounds(polygons, &boundsMin, &boundsMax);
+    CHECK(graph.FindCell(boundsMin.x - 1.0f, boundsMin.y) == -1);
+    CHECK(graph.FindCell(boundsMax.x + 1.0f, boundsMax.y + 1.0f) == -1);
+  }
+
+  // Every edge of the plan is a wall of exactly one cell, and walls are nothing else.  Every
+  // opening has its neighbor's going the other way.
+  void CheckEdges(const CellGraph& graph, const Polygons& polygons) {
+    std::vector<CellGraph::Wall> planEdges;
+    for (const std::vector<PolygonPoint>& polygon : polygons) {
+      for (size_t i = 0; i < polygon.size(); ++i)
+        planEdges.push_back({ polygon[i], polygon[(i + 1) % polygon.size()] });
+    }
+    std::vector<CellGraph::Wall> walls;
+    size_t openings = 0;
+    for (int c = 0; c < graph.GetCellCount(); ++c) {
+      const CellGraph::Cell& cell = graph.GetCell(c);
+      walls.insert(walls.end(), cell.Walls.begin(), cell.Walls.end());
+      openings += cell.Openings.size();
+      for (const CellGraph::Opening& opening : cell.Openings) {
+        CHECK(opening.Neighbor != c);
+        int matches = 0;
+        for (const CellGraph::Opening& back : graph.GetCell(opening.Neighbor).Openings) {
+          if (back.Neighbor == c && SamePoint(back.A, opening.B) && SamePoint(back.B, opening.A))
+            ++matches;
+        }
+        CHECK(matches == 1);
+      }
+    }
+    std::sort(planEdges.begin(), planEdges.end(), LessEdge);
+    std::sort(walls.begin(), walls.end(), LessEdge);
+    CHECK(walls.size() == planEdges.size());
+    bool sameWalls = walls.size() == planEdges.size();
+    for (size_t i = 0; i < walls.size() && sameWalls; ++i)
+      sameWalls = SamePoint(walls[i].A, planEdges[i].A) && SamePoint(walls[i].B, planEdges[i].B);
+    CHECK(sameWalls);
+
+    const CellGraph::Stats& stats = graph.GetStats();
+    CHECK(stats.Cells == static_cast<size_t>(graph.GetCellCount()));
+    CHECK(2 * stats.Openings == openings);
+  }
+
+  // Each cell sees itself and its neighbors, and can see a cell only if that cell can see it.
+  // Two points of the plan with nothing between them have cells that see each other.
+  void CheckVisibility(const CellGraph& graph, const Polygons& polygons) {
+    for (int c = 0; c < graph.GetCellCount(); ++c) {
+      const CellGraph::Cell& cell = graph.GetCell(c);
+      CHECK(std::is_sorted(cell.VisibleCells.begin(), cell.VisibleCells.end()));
+      CHECK(std::adjacent_find(cell.VisibleCells.begin(), cell.VisibleCells.end()) ==
+            cell.VisibleCells.end());
+      CHECK(SameVisibleCells(graph, c, c));
+      for (const CellGraph::Opening& opening : cell.Openings)
+        CHECK(SameVisibleCells(graph, c, opening.Neighbor));
+      for (int other : cell.VisibleCells)
+        CHECK(SameVisibleCells(graph, other, c));
+    }
+
+    std::mt19937 random(2);
+    int clearPairs = 0;
+    for (int i = 0; i < PAIR_SAMPLES; ++i) {
+      const PolygonPoint p = RandomPointInPlan(polygons, &random);
+      const PolygonPoint q = RandomPointInPlan(polygons, &random);
+      if (HitsWall(polygons, p, q))
+        continue;
+      ++clearPairs;
+      const int cellP = graph.FindCell(p.x, p.y);
+      const int cellQ = graph.FindCell(q.x, q.y);
+      CHECK(cellP >= 0 && cellQ >= 0);
+      if (cellP >= 0 && cellQ >= 0)
+        CHECK(SameVisibleCells(graph, cellP, cellQ));
+    }
+    CHECK(clearPairs > 0);
+  }
+
+  void CheckPlan(const Polygons& polygons) {
+    CellGraph graph;
+    CHECK(graph.Build(polygons));
+    CHECK(!graph.Empty());
+    CheckTiling(graph, polygons);
+    CheckEdges(graph, polygons);
+    CheckVisibility(graph, polygons);
+  }
+
+  void TestSquare() {
+    // Two triangles merge back into the square.
+    CellGraph graph;
+    CHECK(graph.Build({ Rectangle(0.0f, 0.0f, 4.0f, 4.0f) }));
+    CHECK(graph.GetCellCount() == 1);
+    CHECK(graph.GetStats().Triangles == 2);
+    CHECK(graph.GetCell(0).Walls.size() == 4);
+    CHECK(graph.GetCell(0).Openings.empty());
+    CHECK(graph.FindCell(2.0f, 2.0f) == 0);
+    CHECK(graph.FindCell(4.0f, 4.0f) == 0);
+    CHECK(graph.FindCell(5.0f, 2.0f) == -1);
+    CheckPlan({ Rectangle(0.0f, 0.0f, 4.0f, 4.0f) });
+  }
+
+  void TestPillar() {
+    CheckPlan(PillarPlan());
+  }
+
+  void TestSerpentine() {
+    const Polygons polygons = SerpentinePlan();
+    CheckPlan(polygons);
+
+    CellGraph graph;
+    graph.Build(polygons);
+    const int first = graph.FindCell(1.5f, 11.0f);
+    const int last = graph.FindCell(10.5f, 1.0f);
+    const int middle = graph.FindCell(6.0f, 6.0f);
+    CHECK(first >= 0 && last >= 0 && middle >= 0);
+    if (first >= 0 && last >= 0 && middle >= 0) {
+      CHECK(!SameVisibleCells(graph, first, last));
+      CHECK(SameVisibleCells(graph, first, middle));
+      CHECK(SameVisibleCells(graph, middle, last));
+
+      // Standing in the first lane marks the middle one but not the last.
+      std::vector<bool> visible;
+      graph.MarkVisibleFromBounds({ 1.0f, 10.5f }, { 2.0f, 11.5f }, &visible);
+      CHECK(visible.size() == static_cast<size_t>(graph.GetCellCount()));
+      CHECK(visible[first] && visible[middle] && !visible[last]);
+    }
+
+    // A box away from every cell marks them all.
+    std::vector<bool> visible;
+    graph.MarkVisibleFromBounds({ 50.0f, 50.0f }, { 51.0f, 51.0f }, &visible);
+    CHECK(std::count(visible.begin(), visible.end(), true) == graph.GetCellCount());
+  }
+
+  void TestRooms() {
+    const Polygons polygons = RoomsPlan();
+    CheckPlan(polygons);
+
+    // The gathered cells are exactly those whose bounds overlap the box.
+    CellGraph graph;
+    graph.Build(polygons);
+    const PolygonPoint boundsMin = { 5.0f, 1.0f };
+    const PolygonPoint boundsMax = { 11.0f, 14.0f };
+    std::vector<int> cells = { -1 };
+    graph.GatherCellsInBounds(boundsMin, boundsMax, &cells);
+    std::vector<int> expected = { -1 };
+    for (int c = 0; c < graph.GetCellCount(); ++c) {
+      const CellGraph::Cell& cell = graph.GetCell(c);
+      if (cell.BoundsMax.x >= boundsMin.x && cell.BoundsMin.x <= boundsMax.x &&
+          cell.BoundsMax.y >= boundsMin.y && cell.BoundsMin.y <= boundsMax.y)
+        expected.push_back(c);
+    }
+    CHECK(cells == expected);
+
+    // The two parts of the plan don't touch, so can't see each other.
+    const int room = graph.FindCell(1.0f, 1.0f);
+    const int hall = graph.FindCell(1.0f, 11.0f);
+    CHECK(room >= 0 && hall >= 0);
+    if (room >= 0 && hall >= 0)
+      CHECK(!SameVisibleCells(graph, room, hall));
+  }
+
+  void TestSaveLoad() {
+    const Polygons polygons = RoomsPlan();
+    CellGraph graph;
+    graph.Build(polygons);
+    std::vector<uint8_t> data = { 0xAB };
+    graph.Save(&data);
+    CHECK(data[0] == 0xAB);
+
+    CellGraph loaded;
+    CHECK(loaded.Load(data.data() + 1, data.size() - 1));
+    CHECK(loaded.GetCellCount() == graph.GetCellCount());
+    bool same = loaded.GetCellCount() == graph.GetCellCount();
+    for (int c = 0; c < graph.GetCellCount() && same; ++c) {
+      const CellGraph::Cell& a = graph.GetCell(c);
+      const CellGraph::Cell& b = loaded.GetCell(c);
+      same = a.Ring.size() == b.Ring.size() && a.Openings.size() == b.Openings.size() &&
+             a.Walls.size() == b.Walls.size() && a.VisibleCells == b.VisibleCells &&
+             SamePoint(a.BoundsMin, b.BoundsMin) && SamePoint(a.BoundsMax, b.BoundsMax);
+      for (size_t i = 0; i < a.Ring.size() && same; ++i)
+        same = SamePoint(a.Ring[i], b.Ring[i]);
+      for (size_t i = 0; i < a.Openings.size() && same; ++i) {
+        same = a.Openings[i].Neighbor == b.Openings[i].Neighbor &&
+               SamePoint(a.Openings[i].A, b.Openings[i].A) &&
+               SamePoint(a.Openings[i].B, b.Openings[i].B);
+      }
+      for (size_t i = 0; i < a.Walls.size() && same; ++i)
+        same = SamePoint(a.Walls[i].A, b.Walls[i].A) && SamePoint(a.Walls[i].B, b.Walls[i].B);
+    }
+    CHECK(same);
+    const CellGraph::Stats& built = graph.GetStats();
+    const CellGraph::Stats& read = loaded.GetStats();
+    CHECK(read.Triangles == built.Triangles && read.Cells == built.Cells &&
+          read.Openings == built.Openings && read.VisiblePairs == built.VisiblePairs &&
+          read.Chains == built.Chains && read.CellsGivenUp == built.CellsGivenUp);
+
+    // The lookup grid is rebuilt to match.
+    std::mt19937 random(3);
+    for (int i = 0; i < POINT_SAMPLES; ++i) {
+      const PolygonPoint point = RandomPointInPlan(polygons, &random);
+      CHECK(loaded.FindCell(point.x, point.y) == graph.FindCell(point.x, point.y));
+    }
+
+    // Anything short, long or pointing past the cells is refused and leaves no cells.
+    CHECK(!loaded.Load(data.data() + 1, data.size() - 2));
+    CHECK(loaded.Empty());
+    CHECK(!loaded.Load(data.data(), data.size()));
+    CHECK(loaded.Empty());
+    std::vector<uint8_t> longer(data.begin() + 1, data.end());
+    longer.resize(longer.size() + 4);
+    CHECK(!loaded.Load(longer.data(), longer.size()));
+    std::vector<uint8_t> bad(data.begin() + 1, data.end());
+    const uint32_t cellCount = static_cast<uint32_t>(graph.GetCellCount());
+    // Point the first cell's first visible cell one past the last cell.
+    const CellGraph::Cell& first = graph.GetCell(0);
+    const size_t visibleOffset = 4 * sizeof(uint64_t) + 4 * sizeof(uint32_t) +
+        (2 + first.Ring.size()) * sizeof(PolygonPoint) +
+        first.Openings.size() * sizeof(CellGraph::Opening) +
+        first.Walls.size() * sizeof(CellGraph::Wall);
+    memcpy(&bad[visibleOffset], &cellCount, sizeof(cellCount));
+    CHECK(!loaded.Load(bad.data(), bad.size()));
+    CHECK(loaded.Empty());
+    CHECK(loaded.Load(data.data() + 1, data.size() - 1));
+
+    // An empty graph round trips too.
+    CellGraph empty;
+    std::vector<uint8_t> emptyData;
+    empty.Save(&emptyData);
+    CHECK(loaded.Load(emptyData.data(), emptyData.size()));
+    CHECK(loaded.Empty());
+    CHECK(loaded.FindCell(0.0f, 0.0f) == -1);
+  }
+}
+
+int main() {
+  TestSquare();
+  TestPillar();
+  TestSerpentine();
+  TestRooms();
+  TestSaveLoad();
+  return CheckResult("CellGraphTest");
+}
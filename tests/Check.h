@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+// The few assertions the tests need.  A failed check prints where it is and the test carries on,
+// so one run reports every failure; main returns CheckResult().
+namespace check {
+  inline int& Failures() {
+    static int failures = 0;
+    return failures;
+  }
+
+  inline void Fail(const char* file, int line, const char* expression) {
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+    ++Failures();
+  }
+
+  inline void Near(double actual, double expected, double tolerance, const char* file, int line,
+                   const char* expression) {
+    if (std::fabs(actual - expected) <= tolerance)
+      return;
+    fprintf(stderr, "%s:%d: check failed: %s (%.9g vs. %.9g, tolerance %.3g)\n", file, line,
+            expression, actual, expected, tolerance);
+    ++Failures();
+  }
+}
+
+#define CHECK(condition) \
+  ((condition) ? (void)0 : check::Fail(__FILE__, __LINE__, #condition))
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+  check::Near((actual), (expected), (tolerance), __FILE__, __LINE__, #actual " ~ " #expected)
+
+inline int CheckResult(const char* testName) {
+  if (check::Failures() != 0) {
+    printf("%s: %d checks failed\n", testName, check::Failures());
+    return 1;
+  }
+  printf("%s: passed\n", testName);
+  return 0;
+}
@@ -0,0 +1,488 @@
+#include "Check.h"
+#include "DdsParser.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Checks ParseDds's footprints against hand-computed ones for headers built in memory, then
+// optionally parses every .dds file in a directory:
+//
+//   DdsParserTest [-benchmark] [directory]
+//
+// Each file in the directory must parse, and its subresources must tile the file in order with
+// footprints matching its format.  -benchmark times parsing, of the directory's files if one is
+// given and of the built-in headers otherwise.
+
+namespace {
+  const uint32_t DDS_MAGIC = 0x20534444;   // "DDS "
+  const uint32_t DDS_FOURCC = 0x00000004;
+  const uint32_t DDS_RGB = 0x00000040;
+  const uint32_t DDS_HEIGHT = 0x00000002;
+  const uint32_t DDS_HEADER_FLAGS_VOLUME = 0x00800000;
+  const uint32_t DDS_CUBEMAP_ALLFACES = 0x0000fe00 | 0x00000200;
+  const uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+  const size_t LEGACY_HEADER_BYTES = 4 + 124;
+  const size_t DX10_HEADER_BYTES = LEGACY_HEADER_BYTES + 20;
+
+  // DXGI_FORMAT values.
+  const uint32_t FORMAT_R32_FLOAT = 41;
+  const uint32_t FORMAT_R8G8B8A8_UNORM = 28;
+  const uint32_t FORMAT_R16_FLOAT = 54;
+  const uint32_t FORMAT_BC1_UNORM = 71;
+  const uint32_t FORMAT_BC3_UNORM = 77;
+  const uint32_t FORMAT_BC7_UNORM = 98;
+
+  const int BENCHMARK_SECONDS = 1;
+
+  uint32_t FourCC(const char* code) {
+    return static_cast<uint32_t>(code[0]) | (static_cast<uint32_t>(code[1]) << 8) |
+        (static_cast<uint32_t>(code[2]) << 16) | (static_cast<uint32_t>(code[3]) << 24);
+  }
+
+  // What goes in the headers; texel bytes are appended separately.
+  struct DdsHeaderSpec {
+    uint32_t Width = 1;
+    uint32_t Height = 1;
+    uint32_t Depth = 0;
+    uint32_t MipMapCount = 0;
+    uint32_t Flags = DDS_HEIGHT;
+    uint32_t Caps2 = 0;
+    // Legacy pixel format.
+    uint32_t PixelFormatFlags = 0;
+    uint32_t FourCC = 0;
+    uint32_t RGBBitCount = 0;
+    uint32_t Masks[4] = {};
+    // DX10 header, written if Dx10 is set.
+    bool Dx10 = false;
+    uint32_t DxgiFormat = 0;
+    uint32_t ResourceDimension = 3;
+    uint32_t MiscFlag = 0;
+    uint32_t ArraySize = 1;
+  };
+
+  void Put32(std::vector<uint8_t>* bytes, uint32_t value) {
+    for (int i = 0; i < 4; ++i)
+      bytes->push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+
+  // The headers, followed by texelBytes bytes that each hold their offset's low byte.
+  std::vector<uint8_t> MakeDds(const DdsHeaderSpec& spec, size_t texelBytes) {
+    std::vector<uint8_t> bytes;
+    Put32(&bytes, DDS_MAGIC);
+    Put32(&bytes, 124);
+    Put32(&bytes, spec.Flags);
+    Put32(&bytes, spec.Height);
+    Put32(&bytes, spec.Width);
+    Put32(&bytes, 0);                 // pitchOrLinearSize
+    Put32(&bytes, spec.Depth);
+    Put32(&bytes, spec.MipMapCount);
+    for (int i = 0; i < 11; ++i)
+      Put32(&bytes, 0);
+    Put32(&bytes, 32);
+    Put32(&bytes, spec.Dx10 ? DDS_FOURCC : spec.PixelFormatFlags);
+    Put32(&bytes, spec.Dx10 ? FourCC("DX10") : spec.FourCC);
+    Put32(&bytes, spec.RGBBitCount);
+    for (int i = 0; i < 4; ++i)
+      Put32(&bytes, spec.Masks[i]);
+    Put32(&bytes, 0x1000);            // caps: DDSCAPS_TEXTURE
+    Put32(&bytes, spec.Caps2);
+    for (int i = 0; i < 3; ++i)
+      Put32(&bytes, 0);
+    if (spec.Dx10) {
+      Put32(&bytes, spec.DxgiFormat);
+      Put32(&bytes, spec.ResourceDimension);
+      Put32(&bytes, spec.MiscFlag);
+      Put32(&bytes, spec.ArraySize);
+      Put32(&bytes, 0);
+    }
+    while (texelBytes-- > 0)
+      bytes.push_back(static_cast<uint8_t>(bytes.size()));
+    return bytes;
+  }
+
+  struct ExpectedSubresource {
+    size_t Offset;
+    uint32_t Width, Height, Depth, NumRows;
+    size_t RowBytes;
+  };
+
+  // Checks a parse of data against the expected footprints, and that dropping the last byte
+  // makes it truncated.
+  void CheckFootprints(const std::vector<uint8_t>& data, DdsDimension dimension, uint32_t format,
+                       uint32_t arraySize, uint32_t mipLevels, bool isCubeMap,
+                       const std::vector<ExpectedSubresource>& expected) {
+    DdsTexture texture;
+    CHECK(ParseDds(data.data(), data.size(), &texture) == DDS_OK);
+    CHECK(texture.Dimension == dimension);
+    CHECK(texture.Format == format);
+    CHECK(texture.ArraySize == arraySize);
+    CHECK(texture.MipLevels == mipLevels);
+    CHECK(texture.IsCubeMap == isCubeMap);
+    CHECK(texture.Subresources.size() == expected.size());
+    for (size_t i = 0; i < expected.size() && i < texture.Subresources.size(); ++i) {
+      const DdsSubresource& actual = texture.Subresources[i];
+      CHECK(actual.Offset == expected[i].Offset);
+      CHECK(actual.Width == expected[i].Width);
+      CHECK(actual.Height == expected[i].Height);
+      CHECK(actual.Depth == expected[i].Depth);
+      CHECK(actual.NumRows == expected[i].NumRows);
+      CHECK(actual.RowBytes == expected[i].RowBytes);
+      CHECK(actual.SliceBytes == expected[i].RowBytes * expected[i].NumRows);
+    }
+    if (!texture.Subresources.empty()) {
+      const DdsSubresource& last = texture.Subresources.back();
+      CHECK(last.Offset + last.SliceBytes * last.Depth == data.size());
+    }
+    CHECK(ParseDds(data.data(), data.size() - 1, &texture) == DDS_ERROR_TRUNCATED);
+  }
+
+  // DXT1 with sides that aren't multiples of 4: every mip rounds up to whole blocks, and the
+  // smallest mips still take a whole block.
+  std::vector<uint8_t> MakeLegacyBc1() {
+    DdsHeaderSpec spec;
+    spec.Width = 13;
+    spec.Height = 7;
+    spec.MipMapCount = 4;
+    spec.PixelFormatFlags = DDS_FOURCC;
+    spec.FourCC = FourCC("DXT1");
+    return MakeDds(spec, 64 + 16 + 8 + 8);
+  }
+
+  void TestLegacyBc1() {
+    const size_t base = LEGACY_HEADER_BYTES;
+    CheckFootprints(MakeLegacyBc1(), DDS_DIMENSION_TEXTURE2D, FORMAT_BC1_UNORM, 1, 4, false, {
+      { base, 13, 7, 1, 2, 32 },            // 4x2 blocks
+      { base + 64, 6, 3, 1, 1, 16 },        // 2x1 blocks
+      { base + 80, 3, 1, 1, 1, 8 },
+      { base + 88, 1, 1, 1, 1, 8 },
+    });
+  }
+
+  // A DX10 BC7 array of 3 slices of 10x10 with 3 mips.
+  std::vector<uint8_t> MakeDx10Bc7Array() {
+    DdsHeaderSpec spec;
+    spec.Width = 10;
+    spec.Height = 10;
+    spec.MipMapCount = 3;
+    spec.Dx10 = true;
+    spec.DxgiFormat = FORMAT_BC7_UNORM;
+    spec.ArraySize = 3;
+    return MakeDds(spec, 3 * (144 + 64 + 16));
+  }
+
+  void TestDx10Bc7Array() {
+    std::vector<ExpectedSubresource> expected;
+    for (size_t slice = 0; slice < 3; ++slice) {
+      const size_t base = DX10_HEADER_BYTES + slice * 224;
+      expected.push_back({ base, 10, 10, 1, 3, 48 });
+      expected.push_back({ base + 144, 5, 5, 1, 2, 32 });
+      expected.push_back({ base + 208, 2, 2, 1, 1, 16 });
+    }
+    CheckFootprints(MakeDx10Bc7Array(), DDS_DIMENSION_TEXTURE2D, FORMAT_BC7_UNORM, 3, 3, false,
+                    expected);
+  }
+
+  // A DX10 cube map: ArraySize counts the faces.
+  std::vector<uint8_t> MakeDx10Cube() {
+    DdsHeaderSpec spec;
+    spec.Width = 8;
+    spec.Height = 8;
+    spec.MipMapCount = 2;
+    spec.Dx10 = true;
+    spec.DxgiFormat = FORMAT_R8G8B8A8_UNORM;
+    spec.MiscFlag = DDS_RESOURCE_MISC_TEXTURECUBE;
+    return MakeDds(spec, 6 * (256 + 64));
+  }
+
+  void TestDx10Cube() {
+    std::vector<ExpectedSubresource> expected;
+    for (size_t face = 0; face < 6; ++face) {
+      const size_t base = DX10_HEADER_BYTES + face * 320;
+      expected.push_back({ base, 8, 8, 1, 8, 32 });
+      expected.push_back({ base + 256, 4, 4, 1, 4, 16 });
+    }
+    CheckFootprints(MakeDx10Cube(), DDS_DIMENSION_TEXTURE2D, FORMAT_R8G8B8A8_UNORM, 6, 2, true,
+                    expected);
+  }
+
+  // A legacy DXT5 cube map with all six faces and no mips.
+  std::vector<uint8_t> MakeLegacyBc3Cube() {
+    DdsHeaderSpec spec;
+    spec.Width = 4;
+    spec.Height = 4;
+    spec.Caps2 = DDS_CUBEMAP_ALLFACES;
+    spec.PixelFormatFlags = DDS_FOURCC;
+    spec.FourCC = FourCC("DXT5");
+    return MakeDds(spec, 6 * 16);
+  }
+
+  void TestLegacyBc3Cube() {
+    std::vector<ExpectedSubresource> expected;
+    for (size_t face = 0; face < 6; ++face)
+      expected.push_back({ LEGACY_HEADER_BYTES + face * 16, 4, 4, 1, 1, 16 });
+    CheckFootprints(MakeLegacyBc3Cube(), DDS_DIMENSION_TEXTURE2D, FORMAT_BC3_UNORM, 6, 1, true,
+                    expected);
+
+    // A cube map missing a face isn't supported.
+    DdsHeaderSpec partial;
+    partial.Width = 4;
+    partial.Height = 4;
+    partial.Caps2 = 0x00000200 | 0x00000400;
+    partial.PixelFormatFlags = DDS_FOURCC;
+    partial.FourCC = FourCC("DXT5");
+    const std::vector<uint8_t> data = MakeDds(partial, 16);
+    DdsTexture texture;
+    CHECK(ParseDds(data.data(), data.size(), &texture) == DDS_ERROR_UNSUPPORTED);
+  }
+
+  // A DX10 volume: each mip halves the depth too.
+  std::vector<uint8_t> MakeDx10Volume() {
+    DdsHeaderSpec spec;
+    spec.Width = 6;
+    spec.Height = 5;
+    spec.Depth = 3;
+    spec.MipMapCount = 2;
+    spec.Flags = DDS_HEIGHT | DDS_HEADER_FLAGS_VOLUME;
+    spec.Dx10 = true;
+    spec.DxgiFormat = FORMAT_R16_FLOAT;
+    spec.ResourceDimension = 4;
+    return MakeDds(spec, 180 + 12);
+  }
+
+  void TestDx10Volume() {
+    const size_t base = DX10_HEADER_BYTES;
+    CheckFootprints(MakeDx10Volume(), DDS_DIMENSION_TEXTURE3D, FORMAT_R16_FLOAT, 1, 2, false, {
+      { base, 6, 5, 3, 5, 12 },
+      { base + 180, 3, 2, 1, 2, 6 },
+    });
+  }
+
+  // A DX10 1D array.
+  std::vector<uint8_t> MakeDx10Texture1DArray() {
+    DdsHeaderSpec spec;
+    spec.Width = 5;
+    spec.Flags = 0;
+    spec.MipMapCount = 3;
+    spec.Dx10 = true;
+    spec.DxgiFormat = FORMAT_R32_FLOAT;
+    spec.ResourceDimension = 2;
+    spec.ArraySize = 2;
+    return MakeDds(spec, 2 * (20 + 8 + 4));
+  }
+
+  void TestDx10Texture1DArray() {
+    std::vector<ExpectedSubresource> expected;
+    for (size_t slice = 0; slice < 2; ++slice) {
+      const size_t base = DX10_HEADER_BYTES + slice * 32;
+      expected.push_back({ base, 5, 1, 1, 1, 20 });
+      expected.push_back({ base + 20, 2, 1, 1, 1, 8 });
+      expected.push_back({ base + 28, 1, 1, 1, 1, 4 });
+    }
+    CheckFootprints(MakeDx10Texture1DArray(), DDS_DIMENSION_TEXTURE1D, FORMAT_R32_FLOAT, 2, 3,
+                    false, expected);
+  }
+
+  // Legacy 32-bit RGB masks map to the format DDSTextureLoader would pick.
+  void TestLegacyRgba() {
+    DdsHeaderSpec spec;
+    spec.Width = 3;
+    spec.Height = 2;
+    spec.PixelFormatFlags = DDS_RGB | 0x1;
+    spec.RGBBitCount = 32;
+    const uint32_t masks[4] = { 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000 };
+    memcpy(spec.Masks, masks, sizeof(masks));
+    CheckFootprints(MakeDds(spec, 24), DDS_DIMENSION_TEXTURE2D, FORMAT_R8G8B8A8_UNORM, 1, 1,
+                    false, { { LEGACY_HEADER_BYTES, 3, 2, 1, 2, 12 } });
+  }
+
+  void TestErrors() {
+    DdsTexture texture;
+    std::vector<uint8_t> data = MakeLegacyBc1();
+    CHECK(ParseDds(data.data(), LEGACY_HEADER_BYTES - 1, &texture) == DDS_ERROR_TOO_SMALL);
+    data[0] = 'X';
+    CHECK(ParseDds(data.data(), data.size(), &texture) == DDS_ERROR_BAD_MAGIC);
+
+    // The DX10 header itself cut off.
+    data = MakeDx10Cube();
+    CHECK(ParseDds(data.data(), DX10_HEADER_BYTES - 1, &texture) == DDS_ERROR_TOO_SMALL);
+
+    DdsHeaderSpec spec;
+    spec.Width = 4;
+    spec.Height = 4;
+    spec.Dx10 = true;
+    spec.DxgiFormat = FORMAT_R8G8B8A8_UNORM;
+    spec.ArraySize = 0;
+    data = MakeDds(spec, 64);
+    CHECK(ParseDds(data.data(), data.size(), &texture) == DDS_ERROR_BAD_HEADER);
+
+    spec.ArraySize = 1;
+    spec.DxgiFormat = 1000;
+    data = MakeDds(spec, 64);
+    CHECK(ParseDds(data.data(), data.size(), &texture) == DDS_ERROR_UNSUPPORTED);
+
+    DdsHeaderSpec huge;
+    huge.Width = 0x8000;
+    huge.Height = 4;
+    huge.Dx10 = true;
+    huge.DxgiFormat = FORMAT_R8G8B8A8_UNORM;
+    data = MakeDds(huge, 0);
+    CHECK(ParseDds(data.data(), data.size(), &texture) == DDS_ERROR_UNSUPPORTED);
+
+    DdsHeaderSpec unknownLegacy;
+    unknownLegacy.PixelFormatFlags = DDS_FOURCC;
+    unknownLegacy.FourCC = FourCC("UYVY");
+    data = MakeDds(unknownLegacy, 16);
+    CHECK(ParseDds(data.data(), data.size(), &texture) == DDS_ERROR_UNSUPPORTED);
+  }
+
+  void TestCopyIntoPitchedFootprint() {
+    const std::vector<uint8_t> data = MakeLegacyBc1();
+    DdsTexture texture;
+    CHECK(ParseDds(data.data(), data.size(), &texture) == DDS_OK);
+    const DdsSubresource& top = texture.Subresources[0];
+    const size_t rowPitch = 256;
+    std::vector<uint8_t> dst(rowPitch * top.NumRows, 0xcd);
+    CopyDdsSubresource(data.data(), top, dst.data(), rowPitch, dst.size());
+    for (uint32_t row = 0; row < top.NumRows; ++row) {
+      CHECK(memcmp(&dst[row * rowPitch], &data[top.Offset + row * top.RowBytes], top.RowBytes) ==
+            0);
+      CHECK(dst[row * rowPitch + top.RowBytes] == 0xcd);
+    }
+  }
+
+  std::vector<std::vector<uint8_t>> MakeBuiltInFiles() {
+    return { MakeLegacyBc1(), MakeDx10Bc7Array(), MakeDx10Cube(), MakeLegacyBc3Cube(),
+             MakeDx10Volume(), MakeDx10Texture1DArray() };
+  }
+
+  bool EndsWith(const std::string& s, const char* suffix) {
+    const size_t length = strlen(suffix);
+    return s.size() >= length && s.compare(s.size() - length, length, suffix) == 0;
+  }
+
+  std::vector<std::string> ListDdsFiles(const std::string& directory) {
+    std::vector<std::string> paths;
+    DIR* dir = opendir(directory.c_str());
+    if (dir == nullptr)
+      return paths;
+    while (const dirent* entry = readdir(dir)) {
+      const std::string name = entry->d_name;
+      if (EndsWith(name, ".dds") || EndsWith(name, ".DDS"))
+        paths.push_back(directory + "/" + name);
+    }
+    closedir(dir);
+    std::sort(paths.begin(), paths.end());
+    return paths;
+  }
+
+  // A parsed file's subresources must follow each other from the end of the headers to the end
+  // of the file, each as big as its format and size make it.
+  void CheckFileFootprints(const std::string& path, const std::vector<uint8_t>& data) {
+    DdsTexture texture;
+    const DdsParseResult result = ParseDds(data.data(), data.size(), &texture);
+    if (result != DDS_OK) {
+      fprintf(stderr, "%s: %s\n", path.c_str(), DdsParseResultString(result));
+      CHECK(result == DDS_OK);
+      return;
+    }
+    CHECK(texture.Subresources.size() ==
+          static_cast<size_t>(texture.ArraySize) * texture.MipLevels);
+
+    const uint32_t bitsPerPixel = DdsBitsPerPixel(texture.Format);
+    const bool blockCompressed = (texture.Format >= 70 && texture.Format <= 84) ||
+                                 (texture.Format >= 94 && texture.Format <= 99);
+    size_t position = texture.Subresources.empty() ? 0 : texture.Subresources[0].Offset;
+    CHECK(position == LEGACY_HEADER_BYTES || position == DX10_HEADER_BYTES);
+    for (const DdsSubresource& subresource : texture.Subresources) {
+      CHECK(subresource.Offset == position);
+      CHECK(subresource.SliceBytes == subresource.RowBytes * subresource.NumRows);
+      if (blockCompressed) {
+        const uint32_t blocksWide = (subresource.Width + 3) / 4;
+        CHECK(subresource.NumRows == (subresource.Height + 3) / 4);
+        CHECK(subresource.RowBytes == blocksWide * bitsPerPixel * 2);
+      } else {
+        CHECK(subresource.NumRows == subresource.Height);
+        CHECK(subresource.RowBytes == (subresource.Width * bitsPerPixel + 7) / 8);
+      }
+      position += subresource.SliceBytes * subresource.Depth;
+    }
+    if (position != data.size()) {
+      printf("%s: %zu bytes after the last subresource\n", path.c_str(),
+             data.size() - position);
+    }
+    printf("%s: %ux%ux%u, format %u, %u mips, %u slices%s\n", path.c_str(), texture.Width,
+           texture.Height, texture.Depth, texture.Format, texture.MipLevels, texture.ArraySize,
+           texture.IsCubeMap ? " (cube)" : "");
+  }
+
+  void Benchmark(const std::vector<std::vector<uint8_t>>& files) {
+    size_t bytes = 0;
+    for (const std::vector<uint8_t>& file : files)
+      bytes += file.size();
+
+    DdsTexture texture;
+    size_t parses = 0;
+    size_t subresources = 0;
+    const auto start = std::chrono::steady_clock::now();
+    double seconds = 0.0;
+    do {
+      for (const std::vector<uint8_t>& file : files) {
+        if (ParseDds(file.data(), file.size(), &texture) == DDS_OK)
+          subresources += texture.Subresources.size();
+        ++parses;
+      }
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (seconds < BENCHMARK_SECONDS);
+
+    printf("DDS parsing: %zu files (%.1f MB), %.0f ns per file, %.1f M subresources/s\n",
+           files.size(), bytes / 1000000.0, seconds * 1e9 / parses,
+           subresources / seconds / 1000000.0);
+  }
+}
+
+int main(int argc, char** argv) {
+  bool benchmark = false;
+  const char* directory = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-benchmark") == 0)
+      benchmark = true;
+    else
+      directory = argv[i];
+  }
+
+  TestLegacyBc1();
+  TestDx10Bc7Array();
+  TestDx10Cube();
+  TestLegacyBc3Cube();
+  TestDx10Volume();
+  TestDx10Texture1DArray();
+  TestLegacyRgba();
+  TestErrors();
+  TestCopyIntoPitchedFootprint();
+
+  std::vector<std::vector<uint8_t>> files;
+  if (directory != nullptr) {
+    const std::vector<std::string> paths = ListDdsFiles(directory);
+    if (paths.empty())
+      fprintf(stderr, "No .dds files in %s\n", directory);
+    for (const std::string& path : paths) {
+      std::ifstream in(path, std::ifstream::binary);
+      files.emplace_back(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+      CheckFileFootprints(path, files.back());
+    }
+  } else {
+    files = MakeBuiltInFiles();
+  }
+
+  if (benchmark)
+    Benchmark(files);
+  return CheckResult("DdsParserTest");
+}
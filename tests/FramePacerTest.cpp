@@ -0,0 +1,175 @@
+#include "Check.h"
+#include "FramePacer.h"
+
+#include <vector>
+
+namespace {
+  // Each reading of the clock takes SpinTick seconds, so spin loops end; sleeps take Oversleep
+  // seconds longer than asked, like an OS scheduler's.
+  class FakeClock : public PacingClock {
+  public:
+    double Time = 100.0;
+    double SpinTick = 1e-6;
+    double Oversleep = 0.0;
+    std::vector<double> Sleeps;
+
+    double Now() override {
+      Time += SpinTick;
+      return Time;
+    }
+
+    void Sleep(double seconds) override {
+      Sleeps.push_back(seconds);
+      Time += seconds + Oversleep;
+    }
+  };
+
+  // Waiting takes GpuLatency seconds of the clock and completes the value waited for.
+  class FakeFence : public PacingFence {
+  public:
+    explicit FakeFence(FakeClock* clock) : mClock(clock) {}
+
+    uint64_t Completed = 0;
+    double GpuLatency = 0.004;
+
+    uint64_t GetCompletedValue() override { return Completed; }
+
+    void WaitForValue(uint64_t value) override {
+      mClock->Time += GpuLatency;
+      Completed = value;
+    }
+
+  private:
+    FakeClock* mClock;
+  };
+
+  const double FRAME_TIME = 1.0 / 60.0;
+  const double TOLERANCE = 1e-4;
+
+  void TestLimiterSleepsThenSpins() {
+    FakeClock clock;
+    FakeFence fence(&clock);
+    FramePacer pacer(&clock, &fence);
+    pacer.SetMinFrameTime(FRAME_TIME);
+    pacer.SetSpinThreshold(0.002);
+    clock.Oversleep = 0.0015;
+
+    double frameStart = clock.Time;
+    for (int frame = 0; frame < 10; ++frame) {
+      clock.Time += 0.005;     // The frame's work
+      clock.Sleeps.clear();
+      pacer.EndFrame();
+
+      // The wait sleeps once, leaving the spin threshold to spin through, and the oversleep
+      // doesn't push the frame past its target.
+      CHECK(clock.Sleeps.size() == 1);
+      CHECK_NEAR(clock.Time - frameStart, FRAME_TIME, TOLERANCE);
+      CHECK_NEAR(pacer.GetLastFrameStats().CpuWait, FRAME_TIME - 0.005, TOLERANCE);
+      frameStart = clock.Time;
+    }
+  }
+
+  void TestShortWaitOnlySpins() {
+    FakeClock clock;
+    FakeFence fence(&clock);
+    FramePacer pacer(&clock, &fence);
+    pacer.SetMinFrameTime(FRAME_TIME);
+    pacer.SetSpinThreshold(0.002);
+
+    const double frameStart = clock.Time;
+    clock.Time += FRAME_TIME - 0.001;
+    pacer.EndFrame();
+    CHECK(clock.Sleeps.empty());
+    CHECK_NEAR(clock.Time - frameStart, FRAME_TIME, TOLERANCE);
+  }
+
+  void TestLateFrameDoesNotCatchUp() {
+    FakeClock clock;
+    FakeFence fence(&clock);
+    FramePacer pacer(&clock, &fence);
+    pacer.SetMinFrameTime(FRAME_TIME);
+
+    clock.Time += 0.030;     // Twice the frame time
+    pacer.EndFrame();
+    CHECK(pacer.GetLastFrameStats().CpuWait == 0.0);
+
+    // The next frame still gets the whole minimum frame time.
+    const double frameStart = clock.Time;
+    clock.Time += 0.001;
+    pacer.EndFrame();
+    CHECK_NEAR(clock.Time - frameStart, FRAME_TIME, TOLERANCE);
+  }
+
+  void TestUnlimited() {
+    FakeClock clock;
+    FakeFence fence(&clock);
+    FramePacer pacer(&clock, &fence);
+    CHECK(pacer.GetMinFrameTime() == 0.0);
+    clock.Time += 0.001;
+    pacer.EndFrame();
+    CHECK(clock.Sleeps.empty());
+    CHECK(pacer.GetLastFrameStats().CpuWait == 0.0);
+  }
+
+  void TestGpuWait() {
+    FakeClock clock;
+    FakeFence fence(&clock);
+    FramePacer pacer(&clock, &fence);
+
+    // A completed fence doesn't wait at all.
+    fence.Completed = 5;
+    pacer.WaitForGpu(5);
+    pacer.EndFrame();
+    CHECK(pacer.GetLastFrameStats().GpuWait == 0.0);
+
+    pacer.WaitForGpu(6);
+    CHECK(fence.Completed == 6);
+    pacer.EndFrame();
+    CHECK_NEAR(pacer.GetLastFrameStats().GpuWait, fence.GpuLatency, TOLERANCE);
+  }
+
+  void TestInputToPresent() {
+    FakeClock clock;
+    FakeFence fence(&clock);
+    FramePacer pacer(&clock, &fence);
+
+    pacer.OnInputSampled();
+    clock.Time += 0.012;
+    pacer.OnPresent();
+    pacer.EndFrame();
+    CHECK_NEAR(pacer.GetLastFrameStats().InputToPresent, 0.012, TOLERANCE);
+
+    // Without a new input sample, a present has nothing to measure.
+    pacer.OnPresent();
+    pacer.EndFrame();
+    CHECK(pacer.GetLastFrameStats().InputToPresent == 0.0);
+  }
+
+  void TestAverageStats() {
+    FakeClock clock;
+    FakeFence fence(&clock);
+    FramePacer pacer(&clock, &fence);
+    fence.GpuLatency = 0.002;
+    pacer.WaitForGpu(1);
+    pacer.EndFrame();
+    fence.GpuLatency = 0.006;
+    pacer.WaitForGpu(2);
+    pacer.EndFrame();
+
+    const FramePacingStats average = pacer.TakeAverageStats();
+    CHECK_NEAR(average.GpuWait, 0.004, TOLERANCE);
+    // Taking the average starts a new one.
+    CHECK(pacer.TakeAverageStats().GpuWait == 0.0);
+  }
+}
+
+int main() {
+  TestLimiterSleepsThenSpins();
+  TestShortWaitOnlySpins();
+  TestLateFrameDoesNotCatchUp();
+  TestUnlimited();
+  TestGpuWait();
+  TestInputToPresent();
+  TestAverageStats();
+  return CheckResult("FramePacerTest");
+}
@@ -0,0 +1,111 @@
+#include "Check.h"
+#include "LinearRingAllocator.h"
+
+#include <deque>
+
+namespace {
+  const uint64_t INVALID = LinearRingAllocator::kInvalidOffset;
+
+  void TestAlignment() {
+    LinearRingAllocator ring(1000, 256);
+    CHECK(ring.GetCapacity() == 768);
+    CHECK(ring.Allocate(0) == INVALID);
+    CHECK(ring.Allocate(769) == INVALID);
+    CHECK(ring.Allocate(1) == 0);
+    CHECK(ring.Allocate(256) == 256);
+    CHECK(ring.GetUsedSize() == 512);
+  }
+
+  void TestWraparound() {
+    LinearRingAllocator ring(1024, 64);
+    CHECK(ring.Allocate(640) == 0);
+    ring.FinishFrame(1);
+    CHECK(ring.Allocate(256) == 640);
+    ring.FinishFrame(2);
+
+    // 128 bytes are left at the end, and frame 1 still holds the start.
+    CHECK(ring.Allocate(256) == INVALID);
+    ring.Reclaim(1);
+    CHECK(ring.GetUsedSize() == 256);
+
+    // A range never straddles the end: the 128 bytes there are skipped.
+    CHECK(ring.Allocate(256) == 0);
+    CHECK(ring.GetUsedSize() == 256 + 128 + 256);
+    ring.FinishFrame(3);
+
+    // The skipped bytes come back with the frame that skipped them.
+    ring.Reclaim(2);
+    CHECK(ring.GetUsedSize() == 128 + 256);
+    ring.Reclaim(3);
+    CHECK(ring.GetUsedSize() == 0);
+    // An empty ring carries on from where it was instead of starting over at 0.
+    CHECK(ring.Allocate(768) == 256);
+  }
+
+  void TestReclaimOnlyCompletedFrames() {
+    LinearRingAllocator ring(4096, 16);
+    for (uint64_t frame = 1; frame <= 4; ++frame) {
+      CHECK(ring.Allocate(1000) != INVALID);   // 1008 bytes once aligned
+      ring.FinishFrame(frame);
+    }
+    CHECK(ring.GetUsedSize() == 4032);
+    CHECK(ring.Allocate(100) == INVALID);
+
+    ring.Reclaim(0);
+    CHECK(ring.GetUsedSize() == 4032);
+    ring.Reclaim(2);
+    CHECK(ring.GetUsedSize() == 2016);
+    // Fences only move forward, so an older value frees nothing more.
+    ring.Reclaim(1);
+    CHECK(ring.GetUsedSize() == 2016);
+    ring.Reclaim(10);
+    CHECK(ring.GetUsedSize() == 0);
+  }
+
+  // A simulated GPU that runs framesInFlight frames behind: every frame allocates a few ranges,
+  // and none of them may overlap a range of a frame whose fence hasn't completed.
+  void TestSimulatedFrames() {
+    const uint64_t capacity = 64 * 1024;
+    const int framesInFlight = 3;
+    LinearRingAllocator ring(capacity, 256);
+
+    struct Range {
+      uint64_t Fence;
+      uint64_t Offset;
+      uint64_t Size;
+    };
+    std::deque<Range> live;
+    bool overlapped = false;
+    bool ranOut = false;
+    for (uint64_t frame = 1; frame <= 1000; ++frame) {
+      const uint64_t completed = frame > framesInFlight ? frame - framesInFlight : 0;
+      ring.Reclaim(completed);
+      while (!live.empty() && live.front().Fence <= completed)
+        live.pop_front();
+
+      for (int i = 0; i < 5; ++i) {
+        const uint64_t size = 256 * (1 + (frame * 7 + i * 13) % 9);
+        const uint64_t offset = ring.Allocate(size);
+        if (offset == INVALID) {
+          ranOut = true;
+          continue;
+        }
+        CHECK(offset % 256 == 0 && offset + size <= capacity);
+        for (const Range& other : live)
+          overlapped |= offset < other.Offset + other.Size && other.Offset < offset + size;
+        live.push_back({ frame, offset, size });
+      }
+      ring.FinishFrame(frame);
+    }
+    CHECK(!overlapped);
+    CHECK(!ranOut);
+  }
+}
+
+int main() {
+  TestAlignment();
+  TestWraparound();
+  TestReclaimOnlyCompletedFrames();
+  TestSimulatedFrames();
+  return CheckResult("LinearRingAllocatorTest");
+}
@@ -0,0 +1,256 @@
+#include "Check.h"
+#include "PolygonTriangulator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Checks that the triangles cover the polygons exactly, counterclockwise, with and without holes
+// and with more than one boundary:
+//
+//   PolygonTriangulatorTest [-benchmark]
+//
+// -benchmark also times large star-shaped polygons with holes.
+
+namespace {
+  typedef std::vector<std::vector<PolygonPoint>> Polygons;
+
+  const double PI = 3.14159265358979;
+  const double AREA_TOLERANCE = 1e-4;
+  const int POINT_SAMPLES = 2000;
+  const int BENCHMARK_HOLES = 64;
+
+  // A counterclockwise rectangle, or a clockwise one to use as a hole.
+  std::vector<PolygonPoint> Rectangle(float x0, float y0, float x1, float y1, bool hole = false) {
+    std::vector<PolygonPoint> ring = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 } };
+    if (hole)
+      std::reverse(ring.begin(), ring.end());
+    return ring;
+  }
+
+  // A star around (centerX, centerY) whose every other vertex is reflex, on the inner radius;
+  // clockwise for a hole.
+  std::vector<PolygonPoint> Star(float centerX, float centerY, float outerRadius,
+                                 float innerRadius, int vertexCount, bool hole = false) {
+    std::vector<PolygonPoint> ring;
+    for (int i = 0; i < vertexCount; ++i) {
+      const double angle = (hole ? -2.0 : 2.0) * PI * i / vertexCount;
+      const double r = i % 2 == 0 ? outerRadius : innerRadius;
+      ring.push_back({ static_cast<float>(centerX + r * std::cos(angle)),
+                       static_cast<float>(centerY + r * std::sin(angle)) });
+    }
+    return ring;
+  }
+
+  // A comb: a spine along the bottom with teeth pointing up, so most ears are deep in a notch.
+  std::vector<PolygonPoint> Comb(int teeth) {
+    std::vector<PolygonPoint> ring = { { 0.0f, 0.0f }, { 2.0f * teeth - 1.0f, 0.0f } };
+    for (int t = teeth - 1; t >= 0; --t) {
+      const float x = 2.0f * t;
+      ring.push_back({ x + 1.0f, 5.0f });
+      ring.push_back({ x, 5.0f });
+      if (t > 0) {
+        ring.push_back({ x, 1.0f });
+        ring.push_back({ x - 1.0f, 1.0f });
+      }
+    }
+    return ring;
+  }
+
+  double Cross(const PolygonPoint& a, const PolygonPoint& b, const PolygonPoint& c) {
+    return (static_cast<double>(b.x) - a.x) * (static_cast<double>(c.y) - a.y) -
+        (static_cast<double>(b.y) - a.y) * (static_cast<double>(c.x) - a.x);
+  }
+
+  double SignedArea(const std::vector<PolygonPoint>& ring) {
+    double area = 0.0;
+    for (size_t i = 0; i < ring.size(); ++i) {
+      const PolygonPoint& a = ring[i];
+      const PolygonPoint& b = ring[(i + 1) % ring.size()];
+      area += 0.5 * (static_cast<double>(a.x) * b.y - static_cast<double>(b.x) * a.y);
+    }
+    return area;
+  }
+
+  // Even-odd test against every polygon, so holes count as outside.
+  bool InsidePlan(const Polygons& polygons, const PolygonPoint& point) {
+    bool inside = false;
+    for (const std::vector<PolygonPoint>& polygon : polygons) {
+      for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+        const PolygonPoint& a = polygon[i];
+        const PolygonPoint& b = polygon[j];
+        if ((a.y > point.y) != (b.y > point.y) &&
+            point.x < (b.x - a.x) * (point.y - a.y) / (b.y - a.y) + a.x)
+          inside = !inside;
+      }
+    }
+    return inside;
+  }
+
+  // Triangulates polygons, which must be valid, and checks the triangles: counterclockwise, of
+  // the polygons' vertices, adding up to their area, and with every point of the polygons in
+  // exactly one of them and every other point in none.  holeCount is how many of the polygons are
+  // holes.
+  void CheckTriangulation(const Polygons& polygons, int holeCount) {
+    std::vector<uint32_t> indices;
+    CHECK(TriangulatePolygons(polygons, &indices));
+    CHECK(indices.size() % 3 == 0);
+
+    std::vector<PolygonPoint> points;
+    double polygonArea = 0.0;
+    for (const std::vector<PolygonPoint>& polygon : polygons) {
+      points.insert(points.end(), polygon.begin(), polygon.end());
+      polygonArea += SignedArea(polygon);
+    }
+    // Each bridge to a hole adds two vertices, and a ring of n makes n - 2 triangles, less any
+    // that would have had no area because three vertices ended up in a line.
+    const size_t boundaryCount = polygons.size() - holeCount;
+    CHECK(indices.size() / 3 <= points.size() + 2 * holeCount - 2 * boundaryCount);
+
+    bool inRange = true;
+    for (uint32_t index : indices)
+      inRange = inRange && index < points.size();
+    CHECK(inRange);
+    if (!inRange)
+      return;
+
+    double triangleArea = 0.0;
+    bool clockwise = false;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+      const double area = 0.5 * Cross(points[indices[t]], points[indices[t + 1]],
+                                       points[indices[t + 2]]);
+      clockwise |= area < 0.0;
+      triangleArea += area;
+    }
+    CHECK(!clockwise);
+    CHECK_NEAR(triangleArea, polygonArea, AREA_TOLERANCE * std::max(1.0, polygonArea));
+
+    PolygonPoint boundsMin = points[0];
+    PolygonPoint boundsMax = points[0];
+    for (const PolygonPoint& point : points) {
+      boundsMin = { std::min(boundsMin.x, point.x), std::min(boundsMin.y, point.y) };
+      boundsMax = { std::max(boundsMax.x, point.x), std::max(boundsMax.y, point.y) };
+    }
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> x(boundsMin.x, boundsMax.x);
+    std::uniform_real_distribution<float> y(boundsMin.y, boundsMax.y);
+    int wrongCoverage = 0;
+    for (int i = 0; i < POINT_SAMPLES; ++i) {
+      const PolygonPoint point = { x(random), y(random) };
+      int covering = 0;
+      for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        const PolygonPoint& a = points[indices[t]];
+        const PolygonPoint& b = points[indices[t + 1]];
+        const PolygonPoint& c = points[indices[t + 2]];
+        if (Cross(a, b, point) > 0.0 && Cross(b, c, point) > 0.0 && Cross(c, a, point) > 0.0)
+          ++covering;
+      }
+      wrongCoverage += covering != (InsidePlan(polygons, point) ? 1 : 0);
+    }
+    CHECK(wrongCoverage == 0);
+  }
+
+  void TestSimple() {
+    CheckTriangulation({ Rectangle(0.0f, 0.0f, 4.0f, 3.0f) }, 0);
+    CheckTriangulation({ Star(0.0f, 0.0f, 5.0f, 3.0f, 40) }, 0);
+    CheckTriangulation({ Comb(12) }, 0);
+
+    // Vertices along straight edges may go without a triangle, but the area is still covered.
+    CheckTriangulation({ { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 2.0f, 0.0f }, { 3.0f, 0.0f },
+                           { 3.0f, 2.0f }, { 1.5f, 2.0f }, { 0.0f, 2.0f }, { 0.0f, 1.0f } } },
+                       0);
+
+    // Fewer than three vertices make nothing.
+    std::vector<uint32_t> indices;
+    TriangulatePolygons({ { { 0.0f, 0.0f }, { 1.0f, 0.0f } } }, &indices);
+    CHECK(indices.empty());
+  }
+
+  void TestHoles() {
+    CheckTriangulation({ Rectangle(0.0f, 0.0f, 10.0f, 8.0f),
+                         Rectangle(4.0f, 3.0f, 6.0f, 5.0f, true) }, 1);
+
+    // Holes of every shape, some reflex, side by side so bridges pass between them.
+    Polygons polygons = { Rectangle(0.0f, 0.0f, 40.0f, 10.0f) };
+    for (int h = 0; h < 6; ++h) {
+      const float centerX = 3.5f + 6.5f * h;
+      if (h % 2 == 0)
+        polygons.push_back(Star(centerX, 5.0f, 2.5f, 1.5f, 10 + 2 * h, true));
+      else
+        polygons.push_back(Rectangle(centerX - 2.0f, 2.0f + 0.1f * h, centerX + 2.0f, 8.0f, true));
+    }
+    CheckTriangulation(polygons, 6);
+
+    // Holes inside a star, as the benchmark has them.
+    polygons = { Star(0.0f, 0.0f, 10.0f, 6.0f, 64) };
+    for (int h = 0; h < 9; ++h)
+      polygons.push_back(Star(-3.0f + 3.0f * (h % 3), -3.0f + 3.0f * (h / 3), 1.0f, 0.6f, 8,
+                              true));
+    CheckTriangulation(polygons, 9);
+
+    // The benchmark's own shape at its smallest size: a 1000-pointed star with an 8 by 8 grid of
+    // 16-sided holes in a row inside it, which puts many hole vertices in a line.
+    polygons = { Star(0.0f, 0.0f, 1.0f, 0.8f, 1000) };
+    for (int h = 0; h < BENCHMARK_HOLES; ++h) {
+      std::vector<PolygonPoint> hole;
+      for (int i = 0; i < 16; ++i) {
+        const double angle = -2.0 * PI * i / 16;
+        hole.push_back({ static_cast<float>(-0.5 + (h % 8 + 0.5) / 8 + 0.0375 * std::cos(angle)),
+                         static_cast<float>(-0.5 + (h / 8 + 0.5) / 8 + 0.0375 * std::sin(angle)) });
+      }
+      polygons.push_back(hole);
+    }
+    CheckTriangulation(polygons, BENCHMARK_HOLES);
+  }
+
+  void TestMultipleBoundaries() {
+    // Two rooms apart, each with a hole.
+    CheckTriangulation({ Rectangle(0.0f, 0.0f, 10.0f, 10.0f),
+                         Rectangle(4.0f, 4.0f, 6.0f, 6.0f, true),
+                         Rectangle(20.0f, 0.0f, 30.0f, 10.0f),
+                         Rectangle(22.0f, 2.0f, 28.0f, 8.0f, true) }, 2);
+
+    // An island with a hole of its own inside another boundary's hole.  Each hole goes with the
+    // smallest boundary around it.
+    CheckTriangulation({ Rectangle(0.0f, 0.0f, 20.0f, 20.0f),
+                         Rectangle(2.0f, 2.0f, 18.0f, 18.0f, true),
+                         Rectangle(5.0f, 5.0f, 15.0f, 15.0f),
+                         Rectangle(9.0f, 9.0f, 11.0f, 11.0f, true) }, 2);
+  }
+
+  void TestInvalid() {
+    // A hole outside every boundary.
+    std::vector<uint32_t> indices;
+    CHECK(!TriangulatePolygons({ Rectangle(0.0f, 0.0f, 4.0f, 4.0f),
+                                 Rectangle(10.0f, 10.0f, 11.0f, 11.0f, true) }, &indices));
+  }
+
+  void Benchmark() {
+    for (size_t boundaryVertexCount : { 1000, 10000, 100000 }) {
+      const TriangulationBenchmarkResult result = BenchmarkTriangulation(
+          boundaryVertexCount, BENCHMARK_HOLES, boundaryVertexCount >= 100000 ? 3 : 20);
+      printf("Triangulation: %zu vertices, %zu triangles in %.3f ms (%.2f M vertices/s)\n",
+             result.VertexCount, result.TriangleCount, result.SecondsPerRun * 1000.0,
+             result.VerticesPerSecond / 1000000.0);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  bool benchmark = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-benchmark") == 0)
+      benchmark = true;
+  }
+
+  TestSimple();
+  TestHoles();
+  TestMultipleBoundaries();
+  TestInvalid();
+
+  if (benchmark)
+    Benchmark();
+  return CheckResult("PolygonTriangulatorTest");
+}
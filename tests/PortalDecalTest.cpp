@@ -0,0 +1,174 @@
+#include "Check.h"
+#include "PortalDecal.h"
+
+#include <cmath>
+
+namespace {
+  const float PI = 3.1415926535f;
+  const float RATIO = 1.5f;
+  const int SEGMENTS = 8;
+  const double TOLERANCE = 1e-4;
+
+  // Portal space straight to world space, with the portal facing +Z.
+  const float IDENTITY[4][4] = {
+    { 1.0f, 0.0f, 0.0f, 0.0f },
+    { 0.0f, 1.0f, 0.0f, 0.0f },
+    { 0.0f, 0.0f, 1.0f, 0.0f },
+    { 0.0f, 0.0f, 0.0f, 1.0f },
+  };
+
+  // A square of the given half size around the origin of the Z = 0 plane, counterclockwise.
+  void MakeSquare(float halfSize, float square[4][3]) {
+    const float corners[4][2] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f },
+                                  { -1.0f, 1.0f } };
+    for (int i = 0; i < 4; ++i) {
+      square[i][0] = halfSize * corners[i][0];
+      square[i][1] = halfSize * corners[i][1];
+      square[i][2] = 0.0f;
+    }
+  }
+
+  // The area of a regular polygon with the given number of sides and circumradius.
+  double RegularPolygonArea(int sides, double radius) {
+    return 0.5 * sides * radius * radius * std::sin(2.0 * PI / sides);
+  }
+
+  // The area of the mesh's triangles projected onto the Z = 0 plane, with counterclockwise ones
+  // counting as positive.  Sets mixedWinding if some triangles go the other way.
+  double SignedArea(const PortalDecalMesh& mesh, bool* mixedWinding) {
+    double area = 0.0;
+    bool positive = false;
+    bool negative = false;
+    for (size_t i = 0; i + 2 < mesh.Indices.size(); i += 3) {
+      const float* a = mesh.Vertices[mesh.Indices[i]].Pos;
+      const float* b = mesh.Vertices[mesh.Indices[i + 1]].Pos;
+      const float* c = mesh.Vertices[mesh.Indices[i + 2]].Pos;
+      const double triangle =
+          0.5 * ((b[0] - a[0]) * (c[1] - a[1]) - (c[0] - a[0]) * (b[1] - a[1]));
+      positive |= triangle > 1e-9;
+      negative |= triangle < -1e-9;
+      area += triangle;
+    }
+    *mixedWinding = positive && negative;
+    return area;
+  }
+
+  void TestTexCoord() {
+    float texC[2];
+    GetPortalTexCoord(0.0f, 0.0f, RATIO, texC);
+    CHECK_NEAR(texC[0], 0.5, TOLERANCE);
+    CHECK_NEAR(texC[1], 0.5, TOLERANCE);
+    GetPortalTexCoord(RATIO, -RATIO, RATIO, texC);
+    CHECK_NEAR(texC[0], 0.0, TOLERANCE);
+    CHECK_NEAR(texC[1], 1.0, TOLERANCE);
+  }
+
+  void TestUnclipped() {
+    PortalDecalMesh mesh;
+    BuildPortalDecal(IDENTITY, RATIO, nullptr, 0, &mesh, SEGMENTS);
+    CHECK(mesh.Vertices.size() == 4 * SEGMENTS);
+    CHECK(mesh.Indices.size() == 6 * SEGMENTS);
+
+    // Every vertex is on the hole or on the polygon whose edges touch the texture's circle.
+    const double outerRadius = RATIO / std::cos(PI / SEGMENTS);
+    bool offRim = false;
+    for (const PortalDecalVertex& vertex : mesh.Vertices) {
+      const double radius = std::hypot(vertex.Pos[0], vertex.Pos[1]);
+      offRim |= std::fabs(radius - 1.0) > TOLERANCE && std::fabs(radius - outerRadius) > TOLERANCE;
+      CHECK(vertex.Pos[2] == 0.0f);
+      CHECK(vertex.Normal[0] == 0.0f && vertex.Normal[1] == 0.0f && vertex.Normal[2] == 1.0f);
+
+      float texC[2];
+      GetPortalTexCoord(vertex.Pos[0], vertex.Pos[1], RATIO, texC);
+      CHECK_NEAR(vertex.TexC[0], texC[0], TOLERANCE);
+      CHECK_NEAR(vertex.TexC[1], texC[1], TOLERANCE);
+    }
+    CHECK(!offRim);
+
+    // The ring covers the outer polygon less the inner one, without gaps or overlaps.
+    bool mixedWinding = false;
+    const double area = SignedArea(mesh, &mixedWinding);
+    CHECK(!mixedWinding);
+    CHECK_NEAR(area, RegularPolygonArea(SEGMENTS, outerRadius) - RegularPolygonArea(SEGMENTS, 1.0),
+               TOLERANCE);
+
+    // Too few segments to make a ring are raised to a triangle.
+    BuildPortalDecal(IDENTITY, RATIO, nullptr, 0, &mesh, 1);
+    CHECK(mesh.Vertices.size() == 4 * 3);
+  }
+
+  void TestClippedToSurface() {
+    // The wall ends short of the texture's circle all around, corners included, but not of the
+    // hole.
+    const float halfSize = 1.05f;
+    float square[4][3];
+    MakeSquare(halfSize, square);
+    PortalDecalMesh mesh;
+    BuildPortalDecal(IDENTITY, RATIO, square, 4, &mesh, SEGMENTS);
+
+    bool outside = false;
+    for (const PortalDecalVertex& vertex : mesh.Vertices) {
+      outside |= std::fabs(vertex.Pos[0]) > halfSize + TOLERANCE;
+      outside |= std::fabs(vertex.Pos[1]) > halfSize + TOLERANCE;
+    }
+    CHECK(!outside);
+    bool mixedWinding = false;
+    const double area = SignedArea(mesh, &mixedWinding);
+    CHECK(!mixedWinding);
+    CHECK_NEAR(std::fabs(area), 4.0 * halfSize * halfSize - RegularPolygonArea(SEGMENTS, 1.0),
+               TOLERANCE);
+
+    // The surface's winding doesn't matter, and neither do repeated vertices.
+    float reversed[5][3];
+    for (int i = 0; i < 4; ++i) {
+      for (int k = 0; k < 3; ++k)
+        reversed[i][k] = square[3 - i][k];
+    }
+    for (int k = 0; k < 3; ++k)
+      reversed[4][k] = reversed[3][k];
+    PortalDecalMesh reversedMesh;
+    BuildPortalDecal(IDENTITY, RATIO, reversed, 5, &reversedMesh, SEGMENTS);
+    CHECK(reversedMesh.Vertices.size() == mesh.Vertices.size());
+    CHECK(reversedMesh.Indices.size() == mesh.Indices.size());
+    CHECK_NEAR(SignedArea(reversedMesh, &mixedWinding), area, TOLERANCE);
+
+    // A surface the portal isn't on clips the whole rim away.
+    for (float(&corner)[3] : square)
+      corner[0] += 10.0f;
+    BuildPortalDecal(IDENTITY, RATIO, square, 4, &mesh, SEGMENTS);
+    CHECK(mesh.Vertices.empty() && mesh.Indices.empty());
+  }
+
+  void TestTransformed() {
+    // A portal on a wall facing -X, scaled and moved, with a normal row that isn't unit length.
+    const float portalToWorld[4][4] = {
+      { 0.0f, 0.0f, 2.0f, 0.0f },
+      { 0.0f, 3.0f, 0.0f, 0.0f },
+      { -5.0f, 0.0f, 0.0f, 0.0f },
+      { 10.0f, 20.0f, 30.0f, 1.0f },
+    };
+    PortalDecalMesh mesh;
+    BuildPortalDecal(portalToWorld, RATIO, nullptr, 0, &mesh, SEGMENTS);
+    CHECK(mesh.Vertices.size() == 4 * SEGMENTS);
+    for (const PortalDecalVertex& vertex : mesh.Vertices) {
+      CHECK_NEAR(vertex.Pos[0], 10.0, TOLERANCE);
+      CHECK_NEAR(vertex.Normal[0], -1.0, TOLERANCE);
+      CHECK(vertex.Normal[1] == 0.0f && vertex.Normal[2] == 0.0f);
+
+      // Texture coordinates come from where the vertex is in portal space.
+      float texC[2];
+      GetPortalTexCoord((vertex.Pos[2] - 30.0f) / 2.0f, (vertex.Pos[1] - 20.0f) / 3.0f, RATIO,
+                        texC);
+      CHECK_NEAR(vertex.TexC[0], texC[0], TOLERANCE);
+      CHECK_NEAR(vertex.TexC[1], texC[1], TOLERANCE);
+    }
+  }
+}
+
+int main() {
+  TestTexCoord();
+  TestUnclipped();
+  TestClippedToSurface();
+  TestTransformed();
+  return CheckResult("PortalDecalTest");
+}
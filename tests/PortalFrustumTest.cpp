@@ -0,0 +1,245 @@
+#include "Check.h"
+#include "PortalFrustum.h"
+
+#include <cmath>
+#include <vector>
+
+namespace {
+  const float NEAR_Z = 1.0f;
+  const float FAR_Z = 100.0f;
+  const double TOLERANCE = 1e-5;
+
+  // A left-handed perspective projection with a 90 degree field of view and a square aspect, for
+  // an eye at the origin looking along +z.
+  void MakeViewProj(float viewProj[4][4]) {
+    const float zScale = FAR_Z / (FAR_Z - NEAR_Z);
+    const float matrix[4][4] = {
+      { 1.0f, 0.0f, 0.0f, 0.0f },
+      { 0.0f, 1.0f, 0.0f, 0.0f },
+      { 0.0f, 0.0f, zScale, 1.0f },
+      { 0.0f, 0.0f, -NEAR_Z * zScale, 0.0f },
+    };
+    for (int r = 0; r < 4; ++r) {
+      for (int c = 0; c < 4; ++c)
+        viewProj[r][c] = matrix[r][c];
+    }
+  }
+
+  // The square from (-1, -1) to (1, 1) at z = 10, counterclockwise seen from the eye.
+  const float OPENING[4][3] = {
+    { -1.0f, -1.0f, 10.0f }, { 1.0f, -1.0f, 10.0f }, { 1.0f, 1.0f, 10.0f }, { -1.0f, 1.0f, 10.0f }
+  };
+  const float EYE[3] = { 0.0f, 0.0f, 0.0f };
+
+  bool Contains(const PortalFrustum& frustum, float x, float y, float z) {
+    const float point[3] = { x, y, z };
+    return frustum.IntersectsSphere(point, 0.0f);
+  }
+
+  bool ContainsBox(const PortalFrustum& frustum, float x0, float y0, float z0, float x1, float y1,
+                   float z1) {
+    const float boxMin[3] = { x0, y0, z0 };
+    const float boxMax[3] = { x1, y1, z1 };
+    return frustum.IntersectsBox(boxMin, boxMax);
+  }
+
+  void CheckPlane(const FrustumPlane& plane, float nx, float ny, float nz, float distance) {
+    CHECK_NEAR(plane.Normal[0], nx, TOLERANCE);
+    CHECK_NEAR(plane.Normal[1], ny, TOLERANCE);
+    CHECK_NEAR(plane.Normal[2], nz, TOLERANCE);
+    CHECK_NEAR(plane.Distance, distance, 1e-3);
+  }
+
+  // Points on a grid around the opening and the space beyond it.
+  std::vector<std::vector<float>> SamplePoints() {
+    std::vector<std::vector<float>> points;
+    for (float x = -4.0f; x <= 4.0f; x += 0.5f) {
+      for (float y = -4.0f; y <= 4.0f; y += 0.5f) {
+        for (float z = -5.0f; z <= 40.0f; z += 2.5f)
+          points.push_back({ x, y, z });
+      }
+    }
+    return points;
+  }
+
+  void TestSetViewProj() {
+    float viewProj[4][4];
+    MakeViewProj(viewProj);
+    const PortalFrustum frustum(viewProj);
+    const std::vector<FrustumPlane>& planes = frustum.GetPlanes();
+    CHECK(planes.size() == 6);
+    if (planes.size() != 6)
+      return;
+
+    const float s = std::sqrt(0.5f);
+    CheckPlane(planes[0], s, 0.0f, s, 0.0f);        // Left: x + z >= 0
+    CheckPlane(planes[1], -s, 0.0f, s, 0.0f);       // Right
+    CheckPlane(planes[2], 0.0f, s, s, 0.0f);        // Bottom
+    CheckPlane(planes[3], 0.0f, -s, s, 0.0f);       // Top
+    CheckPlane(planes[4], 0.0f, 0.0f, 1.0f, -NEAR_Z);
+    CheckPlane(planes[5], 0.0f, 0.0f, -1.0f, FAR_Z);
+
+    CHECK(Contains(frustum, 0.0f, 0.0f, 50.0f));
+    CHECK(Contains(frustum, 9.9f, -9.9f, 10.0f));
+    CHECK(!Contains(frustum, 10.1f, 0.0f, 10.0f));
+    CHECK(!Contains(frustum, 0.0f, 0.0f, 0.5f));
+    CHECK(!Contains(frustum, 0.0f, 0.0f, 101.0f));
+
+    // Setting it again replaces the planes rather than adding to them.
+    PortalFrustum reused(viewProj);
+    reused.ClipToOpening(EYE, OPENING, 4, 0.1f);
+    reused.SetViewProj(viewProj);
+    CHECK(reused.GetPlanes().size() == 6);
+  }
+
+  void TestClipToOpening() {
+    float viewProj[4][4];
+    MakeViewProj(viewProj);
+    PortalFrustum frustum(viewProj);
+    CHECK(frustum.ClipToOpening(EYE, OPENING, 4, 0.1f));
+    // The opening's plane and one plane per edge.
+    CHECK(frustum.GetPlanes().size() == 6 + 1 + 4);
+
+    // Beyond the opening, within the pyramid from the eye through its edges.
+    CHECK(Contains(frustum, 0.0f, 0.0f, 20.0f));
+    CHECK(Contains(frustum, 1.9f, 1.9f, 20.0f));
+    CHECK(!Contains(frustum, 2.1f, 0.0f, 20.0f));
+    CHECK(!Contains(frustum, 0.0f, -2.1f, 20.0f));
+    // Between the eye and the opening, only the opening's plane rules points out.
+    CHECK(!Contains(frustum, 0.0f, 0.0f, 9.0f));
+
+    // The winding of the opening's vertices doesn't matter.
+    float reversed[4][3];
+    for (int i = 0; i < 4; ++i) {
+      for (int k = 0; k < 3; ++k)
+        reversed[i][k] = OPENING[3 - i][k];
+    }
+    PortalFrustum reversedFrustum(viewProj);
+    CHECK(reversedFrustum.ClipToOpening(EYE, reversed, 4, 0.1f));
+    bool sameInside = true;
+    for (const std::vector<float>& p : SamplePoints()) {
+      sameInside &= Contains(frustum, p[0], p[1], p[2]) ==
+                    Contains(reversedFrustum, p[0], p[1], p[2]);
+    }
+    CHECK(sameInside);
+
+    // From the other side of the opening, what's seen through it is on this side.
+    PortalFrustum unbounded;
+    const float behind[3] = { 0.0f, 0.0f, 20.0f };
+    CHECK(unbounded.ClipToOpening(behind, OPENING, 4, 0.1f));
+    CHECK(Contains(unbounded, 0.0f, 0.0f, 0.0f));
+    CHECK(!Contains(unbounded, 0.0f, 0.0f, 15.0f));
+  }
+
+  void TestEyeTooClose() {
+    float viewProj[4][4];
+    MakeViewProj(viewProj);
+    PortalFrustum frustum(viewProj);
+    const std::vector<FrustumPlane> before = frustum.GetPlanes();
+
+    const float closeEyes[2][3] = { { 0.0f, 0.0f, 9.95f }, { 0.5f, 0.0f, 10.05f } };
+    for (const float(&eye)[3] : closeEyes) {
+      CHECK(!frustum.ClipToOpening(eye, OPENING, 4, 0.1f));
+      bool unchanged = frustum.GetPlanes().size() == before.size();
+      for (size_t i = 0; unchanged && i < before.size(); ++i) {
+        unchanged = frustum.GetPlanes()[i].Distance == before[i].Distance &&
+                    frustum.GetPlanes()[i].Normal[2] == before[i].Normal[2];
+      }
+      CHECK(unchanged);
+    }
+
+    // Degenerate openings are refused too.
+    CHECK(!frustum.ClipToOpening(EYE, OPENING, 2, 0.1f));
+    const float line[3][3] = {
+      { 0.0f, 0.0f, 10.0f }, { 1.0f, 0.0f, 10.0f }, { 2.0f, 0.0f, 10.0f }
+    };
+    CHECK(!frustum.ClipToOpening(EYE, line, 3, 0.1f));
+    CHECK(frustum.GetPlanes().size() == before.size());
+  }
+
+  void TestTransform() {
+    float viewProj[4][4];
+    MakeViewProj(viewProj);
+    PortalFrustum frustum(viewProj);
+    frustum.ClipToOpening(EYE, OPENING, 4, 0.1f);
+
+    // Points p in the new space are at p * toFrustumSpace: scaled by 2, turned a quarter around y
+    // and moved.
+    const float scale = 2.0f;
+    const float toFrustumSpace[4][4] = {
+      { 0.0f, 0.0f, -scale, 0.0f },
+      { 0.0f, scale, 0.0f, 0.0f },
+      { scale, 0.0f, 0.0f, 0.0f },
+      { -4.0f, 0.0f, 15.0f, 1.0f },
+    };
+    PortalFrustum transformed;
+    frustum.Transform(toFrustumSpace, &transformed);
+    CHECK(transformed.GetPlanes().size() == frustum.GetPlanes().size());
+    for (const FrustumPlane& plane : transformed.GetPlanes()) {
+      const float length = std::sqrt(plane.Normal[0] * plane.Normal[0] +
+                                     plane.Normal[1] * plane.Normal[1] +
+                                     plane.Normal[2] * plane.Normal[2]);
+      CHECK_NEAR(length, 1.0, TOLERANCE);
+    }
+
+    // Each point is inside the transformed frustum exactly when its image is inside the original,
+    // and distances shrink by the scale, so spheres keep matching too.
+    bool sameInside = true;
+    bool sameSpheres = true;
+    int inside = 0;
+    const std::vector<std::vector<float>> points = SamplePoints();
+    for (const std::vector<float>& p : points) {
+      const float q[3] = { p[0] * 0.25f, p[1] * 0.25f, p[2] * 0.25f };
+      float image[3];
+      for (int c = 0; c < 3; ++c) {
+        image[c] = q[0] * toFrustumSpace[0][c] + q[1] * toFrustumSpace[1][c] +
+                   q[2] * toFrustumSpace[2][c] + toFrustumSpace[3][c];
+      }
+      inside += transformed.IntersectsSphere(q, 0.0f) ? 1 : 0;
+      sameInside &= transformed.IntersectsSphere(q, 0.0f) == frustum.IntersectsSphere(image, 0.0f);
+      sameSpheres &= transformed.IntersectsSphere(q, 0.3f) ==
+                     frustum.IntersectsSphere(image, 0.3f * scale);
+    }
+    CHECK(sameInside);
+    CHECK(sameSpheres);
+    CHECK(inside > 0 && inside < static_cast<int>(points.size()));
+  }
+
+  // Boxes and spheres against the frustum through the opening.  Its edge planes meet z = 20 at
+  // x = +-2 and y = +-2.
+  void TestIntersects() {
+    float viewProj[4][4];
+    MakeViewProj(viewProj);
+    PortalFrustum frustum(viewProj);
+    frustum.ClipToOpening(EYE, OPENING, 4, 0.1f);
+
+    CHECK(ContainsBox(frustum, -0.5f, -0.5f, 19.5f, 0.5f, 0.5f, 20.5f));     // Inside
+    CHECK(!ContainsBox(frustum, 8.0f, -0.5f, 19.5f, 9.0f, 0.5f, 20.5f));     // Outside
+    CHECK(ContainsBox(frustum, 1.5f, -0.5f, 19.5f, 3.0f, 0.5f, 20.5f));      // Across the right
+    CHECK(!ContainsBox(frustum, 2.5f, -0.5f, 19.5f, 3.0f, 0.5f, 20.5f));     // Just past it
+    CHECK(ContainsBox(frustum, -0.5f, -3.0f, 19.5f, 0.5f, -1.5f, 20.5f));    // Across the bottom
+    CHECK(ContainsBox(frustum, -0.5f, -0.5f, 5.0f, 0.5f, 0.5f, 12.0f));      // Through the opening
+    CHECK(!ContainsBox(frustum, -0.5f, -0.5f, 2.0f, 0.5f, 0.5f, 8.0f));      // In front of it
+    CHECK(ContainsBox(frustum, -50.0f, -50.0f, 30.0f, 50.0f, 50.0f, 31.0f)); // Around it
+
+    // The right edge plane's normal is (-10, 0, 1) / sqrt(101), so (3, 0, 20) is about 0.995 past
+    // it.
+    const float right[3] = { 3.0f, 0.0f, 20.0f };
+    CHECK(!frustum.IntersectsSphere(right, 0.9f));
+    CHECK(frustum.IntersectsSphere(right, 1.1f));
+    const float center[3] = { 0.0f, 0.0f, 20.0f };
+    CHECK(frustum.IntersectsSphere(center, 0.0f));
+    const float nearOpening[3] = { 0.0f, 0.0f, 9.0f };
+    CHECK(!frustum.IntersectsSphere(nearOpening, 0.9f));
+    CHECK(frustum.IntersectsSphere(nearOpening, 1.1f));
+  }
+}
+
+int main() {
+  TestSetViewProj();
+  TestClipToOpening();
+  TestEyeTooClose();
+  TestTransform();
+  TestIntersects();
+  return CheckResult("PortalFrustumTest");
+}
@@ -0,0 +1,142 @@
+#include "Check.h"
+#include "RangeAllocator.h"
+
+#include <random>
+#include <vector>
+
+namespace {
+  const uint32_t INVALID = RangeAllocator::kInvalidOffset;
+
+  void TestFirstFit() {
+    RangeAllocator allocator(100);
+    CHECK(allocator.Allocate(0) == INVALID);
+    CHECK(allocator.Allocate(101) == INVALID);
+    CHECK(allocator.Allocate(10) == 0);
+    CHECK(allocator.Allocate(20) == 10);
+    CHECK(allocator.Allocate(30) == 30);
+    CHECK(allocator.GetAllocatedCount() == 60);
+
+    // The first free range that's big enough is used, not the best fitting one.
+    allocator.Free(0, 10);
+    CHECK(allocator.Allocate(5) == 0);
+    CHECK(allocator.Allocate(6) == 60);
+    CHECK(allocator.Allocate(5) == 5);
+  }
+
+  void TestCoalescing() {
+    RangeAllocator allocator(40);
+    const uint32_t a = allocator.Allocate(10);
+    const uint32_t b = allocator.Allocate(10);
+    const uint32_t c = allocator.Allocate(10);
+    const uint32_t d = allocator.Allocate(10);
+    CHECK(allocator.GetFreeRangeCount() == 0);
+
+    allocator.Free(a, 10);
+    allocator.Free(c, 10);
+    CHECK(allocator.GetFreeRangeCount() == 2);
+    CHECK(allocator.GetLargestFreeRange() == 10);
+    CHECK(allocator.Allocate(20) == INVALID);
+
+    // Freeing b joins it with both neighbours.
+    allocator.Free(b, 10);
+    CHECK(allocator.GetFreeRangeCount() == 1);
+    CHECK(allocator.GetLargestFreeRange() == 30);
+
+    // And d with the range before it, giving back the whole pool.
+    allocator.Free(d, 10);
+    CHECK(allocator.GetFreeRangeCount() == 1);
+    CHECK(allocator.GetLargestFreeRange() == 40);
+    CHECK(allocator.GetAllocatedCount() == 0);
+    CHECK(allocator.Allocate(40) == 0);
+  }
+
+  void TestGrow() {
+    RangeAllocator allocator(16);
+    const uint32_t a = allocator.Allocate(8);
+    const uint32_t b = allocator.Allocate(6);
+    CHECK(allocator.Allocate(4) == INVALID);
+
+    // The 2 free slots at the old end join the new ones, so the allocation fits straddling them.
+    allocator.Grow(32);
+    CHECK(allocator.GetCapacity() == 32);
+    CHECK(allocator.GetFreeRangeCount() == 1);
+    CHECK(allocator.GetLargestFreeRange() == 18);
+    CHECK(allocator.Allocate(4) == 14);
+
+    // Growing keeps the offsets already handed out, and they can still be freed and merged.
+    allocator.Free(a, 8);
+    allocator.Free(b, 6);
+    CHECK(allocator.GetFreeRangeCount() == 2);
+    CHECK(allocator.GetLargestFreeRange() == 14);
+
+    // With the old end in use, the new slots make a range of their own.
+    RangeAllocator full(8);
+    CHECK(full.Allocate(8) == 0);
+    full.Grow(8);
+    CHECK(full.GetFreeRangeCount() == 0);
+    full.Grow(12);
+    CHECK(full.GetFreeRangeCount() == 1);
+    CHECK(full.Allocate(4) == 8);
+
+    // An empty pool can be grown too.
+    RangeAllocator empty(0);
+    CHECK(empty.Allocate(1) == INVALID);
+    empty.Grow(4);
+    CHECK(empty.Allocate(4) == 0);
+  }
+
+  // Random allocations and frees, checked against a map of which slots are in use.
+  void TestRandomAgainstSlotMap() {
+    RangeAllocator allocator(256);
+    std::vector<bool> used(256, false);
+    struct Range {
+      uint32_t Offset;
+      uint32_t Count;
+    };
+    std::vector<Range> live;
+    std::mt19937 random(3);
+    bool overlapped = false;
+    bool freeRangesAdjacent = false;
+    for (int step = 0; step < 20000; ++step) {
+      if (live.empty() || random() % 3 != 0) {
+        const uint32_t count = 1 + random() % 16;
+        const uint32_t offset = allocator.Allocate(count);
+        if (offset == INVALID)
+          continue;
+        for (uint32_t i = offset; i < offset + count; ++i) {
+          overlapped |= used[i];
+          used[i] = true;
+        }
+        live.push_back({ offset, count });
+      } else {
+        const size_t index = random() % live.size();
+        const Range range = live[index];
+        live[index] = live.back();
+        live.pop_back();
+        allocator.Free(range.Offset, range.Count);
+        for (uint32_t i = range.Offset; i < range.Offset + range.Count; ++i)
+          used[i] = false;
+      }
+
+      // Free ranges are always fully merged: as many as there are runs of free slots.
+      size_t freeRuns = 0;
+      uint32_t usedSlots = 0;
+      for (size_t i = 0; i < used.size(); ++i) {
+        usedSlots += used[i] ? 1 : 0;
+        freeRuns += !used[i] && (i == 0 || used[i - 1]) ? 1 : 0;
+      }
+      freeRangesAdjacent |= allocator.GetFreeRangeCount() != freeRuns;
+      CHECK(allocator.GetAllocatedCount() == usedSlots);
+    }
+    CHECK(!overlapped);
+    CHECK(!freeRangesAdjacent);
+  }
+}
+
+int main() {
+  TestFirstFit();
+  TestCoalescing();
+  TestGrow();
+  TestRandomAgainstSlotMap();
+  return CheckResult("RangeAllocatorTest");
+}
@@ -0,0 +1,341 @@
+#include "Check.h"
+#include "RoomBinary.h"
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+  std::string gPath;
+
+  // File contents at the 16-byte alignment ParseRoomBinary needs.
+  class AlignedFile {
+  public:
+    explicit AlignedFile(const std::vector<uint8_t>& bytes)
+        : mBlocks((bytes.size() + sizeof(Block) - 1) / sizeof(Block)), mSize(bytes.size()) {
+      if (!bytes.empty())
+        memcpy(mBlocks.data(), bytes.data(), bytes.size());
+    }
+
+    uint8_t* Data() { return reinterpret_cast<uint8_t*>(mBlocks.data()); }
+    size_t Size() const { return mSize; }
+    RoomBinaryHeader* Header() { return reinterpret_cast<RoomBinaryHeader*>(Data()); }
+
+    RoomBinaryParseResult Parse(RoomBinaryView* view) {
+      return ParseRoomBinary(Data(), mSize, view);
+    }
+    // Parses just the first size bytes.
+    RoomBinaryParseResult ParsePrefix(size_t size) {
+      RoomBinaryView view;
+      return ParseRoomBinary(Data(), size, &view);
+    }
+    RoomBinaryParseResult Parse() { return ParsePrefix(mSize); }
+
+  private:
+    struct alignas(16) Block {
+      uint8_t Bytes[16];
+    };
+    std::vector<Block> mBlocks;
+    size_t mSize;
+  };
+
+  std::vector<uint8_t> ReadFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in),
+                                std::istreambuf_iterator<char>());
+  }
+
+  RoomFileData MakeRoom() {
+    RoomFileData room;
+    room.CameraPosition[0] = 1.0f;
+    room.CameraPosition[1] = 2.0f;
+    room.CameraPosition[2] = -3.0f;
+    room.PlayerRadius = 0.75f;
+    room.PlayerPosition[2] = 4.5f;
+    room.PortalA.Radius = 1.25f;
+    room.PortalA.Position[0] = -5.0f;
+    room.PortalA.Normal[0] = 1.0f;
+    room.PortalA.Up[1] = 1.0f;
+    room.PortalB.Radius = 0.5f;
+    room.PortalB.Position[1] = 3.0f;
+    room.PortalB.Normal[1] = -1.0f;
+    room.PortalB.Up[2] = 1.0f;
+    room.FloorHeight = -1.0f;
+    room.CeilingHeight = 6.0f;
+    room.Polygons = { { { 0.0f, 0.0f }, { 10.0f, 0.0f }, { 10.0f, 8.0f }, { 0.0f, 8.0f } },
+                      { { 4.0f, 3.0f }, { 4.0f, 5.0f }, { 6.0f, 5.0f } } };
+    return room;
+  }
+
+  struct Mesh {
+    std::vector<RoomBinaryVertex> Vertices;
+    std::vector<uint32_t> Indices;
+  };
+
+  // A strip of quads, one chunk per two quads.
+  Mesh MakeMesh(RoomBinaryContents* contents) {
+    Mesh mesh;
+    for (int i = 0; i < 10; ++i) {
+      RoomBinaryVertex vertex = {};
+      vertex.Position[0] = static_cast<float>(i / 2);
+      vertex.Position[2] = static_cast<float>(i % 2);
+      vertex.Normal[1] = 1.0f;
+      vertex.Tangent[0] = 1.0f;
+      vertex.TexCoord[0] = 0.1f * i;
+      mesh.Vertices.push_back(vertex);
+    }
+    for (uint32_t quad = 0; quad < 4; ++quad) {
+      const uint32_t v = 2 * quad;
+      mesh.Indices.insert(mesh.Indices.end(), { v, v + 1, v + 2, v + 2, v + 1, v + 3 });
+    }
+    contents->MeshVertices = mesh.Vertices.data();
+    contents->MeshVertexCount = mesh.Vertices.size();
+    contents->MeshIndices = mesh.Indices.data();
+    contents->MeshIndexCount = mesh.Indices.size();
+    for (uint32_t chunk = 0; chunk < 2; ++chunk) {
+      const RoomBinaryChunk bounds = { 12 * chunk, 12, { 2.0f * chunk, 0.0f, 0.0f },
+                                       { 2.0f * chunk + 2.0f, 0.0f, 1.0f } };
+      contents->MeshChunks.push_back(bounds);
+    }
+    return mesh;
+  }
+
+  // The file WriteRoomBinary makes of contents.
+  std::vector<uint8_t> WriteRoom(const RoomBinaryContents& contents) {
+    std::string error;
+    CHECK(WriteRoomBinary(gPath, contents, &error));
+    CHECK(error.empty());
+    return ReadFile(gPath);
+  }
+
+  // An odd size, so the mesh after the cells needs padding.
+  const std::vector<uint8_t> CELLS = { 1, 2, 3, 4, 5, 6, 7 };
+
+  // The file of a room with every section.
+  std::vector<uint8_t> WriteFullRoom() {
+    const RoomFileData room = MakeRoom();
+    RoomBinaryContents contents;
+    contents.Room = &room;
+    contents.Cells = CELLS;
+    const Mesh mesh = MakeMesh(&contents);
+    return WriteRoom(contents);
+  }
+
+  void TestRoundTrip() {
+    const RoomFileData room = MakeRoom();
+    RoomBinaryContents contents;
+    contents.Room = &room;
+    contents.Cells = CELLS;
+    const Mesh mesh = MakeMesh(&contents);
+    AlignedFile file(WriteRoom(contents));
+
+    RoomBinaryView view;
+    CHECK(file.Parse(&view) == ROOM_BINARY_OK);
+    const RoomBinaryHeader* header = view.Header;
+    CHECK(header == file.Header());
+    CHECK(memcmp(header->CameraPosition, room.CameraPosition, sizeof(room.CameraPosition)) == 0);
+    CHECK(header->PlayerRadius == room.PlayerRadius);
+    CHECK(memcmp(header->PlayerPosition, room.PlayerPosition, sizeof(room.PlayerPosition)) == 0);
+    CHECK(header->FloorHeight == room.FloorHeight && header->CeilingHeight == room.CeilingHeight);
+    CHECK(memcmp(&header->PortalA, &room.PortalA, sizeof(PortalPlacement)) == 0);
+    CHECK(memcmp(&header->PortalB, &room.PortalB, sizeof(PortalPlacement)) == 0);
+    CHECK(header->Reserved == 0);
+    for (const RoomBinarySectionEntry& entry : header->Sections)
+      CHECK(entry.Offset % 16 == 0);
+
+    CHECK(view.PolygonCount == 2 && view.PolygonPointCount == 7);
+    CHECK(view.PolygonSizes[0] == 4 && view.PolygonSizes[1] == 3);
+    bool samePoints = true;
+    size_t point = 0;
+    for (const std::vector<PolygonPoint>& polygon : room.Polygons) {
+      for (const PolygonPoint& p : polygon) {
+        samePoints = samePoints && view.PolygonPoints[point].x == p.x &&
+                     view.PolygonPoints[point].y == p.y;
+        ++point;
+      }
+    }
+    CHECK(samePoints);
+    CHECK(view.CellsSize == contents.Cells.size());
+    CHECK(memcmp(view.Cells, contents.Cells.data(), contents.Cells.size()) == 0);
+    CHECK(view.MeshVertexCount == mesh.Vertices.size());
+    CHECK(memcmp(view.MeshVertices, mesh.Vertices.data(),
+                 mesh.Vertices.size() * sizeof(RoomBinaryVertex)) == 0);
+    CHECK(view.MeshIndexCount == mesh.Indices.size());
+    CHECK(memcmp(view.MeshIndices, mesh.Indices.data(),
+                 mesh.Indices.size() * sizeof(uint32_t)) == 0);
+    CHECK(view.MeshChunkCount == contents.MeshChunks.size());
+    CHECK(memcmp(view.MeshChunks, contents.MeshChunks.data(),
+                 contents.MeshChunks.size() * sizeof(RoomBinaryChunk)) == 0);
+  }
+
+  void TestLeftOut() {
+    // Just the floor plan; the rest reads back as null and empty.
+    const RoomFileData room = MakeRoom();
+    RoomBinaryContents contents;
+    contents.Room = &room;
+    AlignedFile file(WriteRoom(contents));
+    RoomBinaryView view;
+    CHECK(file.Parse(&view) == ROOM_BINARY_OK);
+    CHECK(view.PolygonCount == 2);
+    CHECK(view.Cells == nullptr && view.CellsSize == 0);
+    CHECK(view.MeshVertices == nullptr && view.MeshVertexCount == 0);
+    CHECK(view.MeshIndices == nullptr && view.MeshIndexCount == 0);
+    CHECK(view.MeshChunks == nullptr && view.MeshChunkCount == 0);
+
+    std::string error;
+    CHECK(!WriteRoomBinary(gPath + ".missing/room.bin", contents, &error));
+    CHECK(!error.empty());
+  }
+
+  void TestHeader() {
+    AlignedFile file(WriteFullRoom());
+    CHECK(file.ParsePrefix(0) == ROOM_BINARY_TOO_SMALL);
+    CHECK(file.ParsePrefix(sizeof(RoomBinaryHeader) - 1) == ROOM_BINARY_TOO_SMALL);
+
+    file.Header()->Magic ^= 1;
+    CHECK(file.Parse() == ROOM_BINARY_BAD_MAGIC);
+    file.Header()->Magic ^= 1;
+    file.Header()->Version = ROOM_BINARY_VERSION + 1;
+    CHECK(file.Parse() == ROOM_BINARY_UNSUPPORTED_VERSION);
+    file.Header()->Version = ROOM_BINARY_VERSION;
+    CHECK(file.Parse() == ROOM_BINARY_OK);
+    CHECK(strcmp(RoomBinaryParseResultString(ROOM_BINARY_BAD_SECTION), "OK") != 0);
+  }
+
+  // Each damage to a well-formed file, undone before the next.
+  void TestBadSections() {
+    const std::vector<uint8_t> bytes = WriteFullRoom();
+
+    // Cut off anywhere in the sections.
+    {
+      AlignedFile file(bytes);
+      for (size_t size = sizeof(RoomBinaryHeader); size < bytes.size(); ++size)
+        CHECK(file.ParsePrefix(size) == ROOM_BINARY_BAD_SECTION);
+    }
+
+    // Offsets off the alignment, into the header, past the end, or onto another section.
+    {
+      AlignedFile file(bytes);
+      RoomBinarySectionEntry* sections = file.Header()->Sections;
+      sections[ROOM_SECTION_MESH_VERTICES].Offset += 4;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+    }
+    {
+      AlignedFile file(bytes);
+      file.Header()->Sections[ROOM_SECTION_POLYGON_SIZES].Offset = 0;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+    }
+    {
+      AlignedFile file(bytes);
+      file.Header()->Sections[ROOM_SECTION_CELLS].Offset = UINT64_MAX - 15;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+    }
+    {
+      AlignedFile file(bytes);
+      file.Header()->Sections[ROOM_SECTION_MESH_CHUNKS].Count = UINT64_MAX / 2;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+    }
+    {
+      // The cells moved onto the start of the mesh's vertices; as bytes, any offset fits.
+      AlignedFile file(bytes);
+      RoomBinarySectionEntry* sections = file.Header()->Sections;
+      sections[ROOM_SECTION_CELLS].Offset = sections[ROOM_SECTION_MESH_VERTICES].Offset;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+    }
+    {
+      // Two sections in the same place.
+      AlignedFile file(bytes);
+      RoomBinarySectionEntry* sections = file.Header()->Sections;
+      sections[ROOM_SECTION_POLYGON_POINTS].Offset = sections[ROOM_SECTION_POLYGON_SIZES].Offset;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+    }
+
+    // Polygon sizes that don't add up to the points, or a polygon too small to have an area.
+    {
+      AlignedFile file(bytes);
+      uint32_t* sizes = reinterpret_cast<uint32_t*>(
+          file.Data() + file.Header()->Sections[ROOM_SECTION_POLYGON_SIZES].Offset);
+      ++sizes[1];
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+      sizes[1] -= 2;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+      sizes[0] = 5;
+      sizes[1] = 2;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+      sizes[0] = 4;
+      sizes[1] = 3;
+      CHECK(file.Parse() == ROOM_BINARY_OK);
+      --file.Header()->Sections[ROOM_SECTION_POLYGON_SIZES].Count;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+    }
+
+    // An index past the last vertex, or a part of a triangle.
+    {
+      AlignedFile file(bytes);
+      RoomBinarySectionEntry* sections = file.Header()->Sections;
+      uint32_t* indices = reinterpret_cast<uint32_t*>(
+          file.Data() + sections[ROOM_SECTION_MESH_INDICES].Offset);
+      const uint32_t last = indices[sections[ROOM_SECTION_MESH_INDICES].Count - 1];
+      indices[sections[ROOM_SECTION_MESH_INDICES].Count - 1] =
+          static_cast<uint32_t>(sections[ROOM_SECTION_MESH_VERTICES].Count);
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+      indices[sections[ROOM_SECTION_MESH_INDICES].Count - 1] = last;
+      CHECK(file.Parse() == ROOM_BINARY_OK);
+      --sections[ROOM_SECTION_MESH_INDICES].Count;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+    }
+
+    // Chunks with a gap or an overlap between them, or that stop short of the last index.
+    {
+      AlignedFile file(bytes);
+      RoomBinaryChunk* chunks = reinterpret_cast<RoomBinaryChunk*>(
+          file.Data() + file.Header()->Sections[ROOM_SECTION_MESH_CHUNKS].Offset);
+      chunks[1].StartIndex += 3;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+      chunks[1].StartIndex -= 6;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+      chunks[1].StartIndex += 3;
+      chunks[1].IndexCount -= 3;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+      chunks[1].IndexCount += 3;
+      CHECK(file.Parse() == ROOM_BINARY_OK);
+    }
+
+    // A mesh without vertices or chunks.
+    {
+      AlignedFile file(bytes);
+      file.Header()->Sections[ROOM_SECTION_MESH_VERTICES].Count = 0;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+    }
+    {
+      AlignedFile file(bytes);
+      file.Header()->Sections[ROOM_SECTION_MESH_CHUNKS].Count = 0;
+      CHECK(file.Parse() == ROOM_BINARY_BAD_SECTION);
+    }
+  }
+}
+
+int main() {
+  char path[] = "/tmp/RoomBinaryTestXXXXXX";
+  const int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  close(fd);
+  gPath = path;
+
+  TestRoundTrip();
+  TestLeftOut();
+  TestHeader();
+  TestBadSections();
+
+  remove(path);
+  return CheckResult("RoomBinaryTest");
+}
@@ -0,0 +1,316 @@
+#include "Check.h"
+#include "RoomFile.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Checks that room files read every number exactly as strtof does, report errors by line and
+// column, and read back what they write:
+//
+//   RoomFileTest [-benchmark]
+//
+// -benchmark also times writing and reading large generated room files.
+
+namespace {
+  // Numbers the strtof comparison parses, two to a floor plan vertex.
+  const size_t RANDOM_NUMBER_COUNT = 2000000;
+
+  // The first lines of a room file, up to its floor plan.
+  const char* ROOM_START =
+      "0 1 2\n"
+      "0.5\n"
+      "0 0 0\n"
+      "1\n0 0 -5\n0 0 1\n0 1 0\n"
+      "1\n0 0 5\n0 0 -1\n0 1 0\n"
+      "0 3\n";
+
+  uint32_t FloatBits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+
+  // A finite float of normal magnitude with random bits, which strtof reads without ERANGE.
+  float RandomNormalFloat(std::mt19937* random) {
+    for (;;) {
+      const uint32_t bits = (*random)();
+      float value;
+      memcpy(&value, &bits, sizeof(value));
+      if (std::isnormal(value))
+        return value;
+    }
+  }
+
+  // A number written the ways room files are: %g and fixed point at any precision, long and
+  // short strings of digits with and without exponents, and decimals exactly or nearly halfway
+  // between two floats.
+  std::string RandomNumber(std::mt19937* random) {
+    char text[128];
+    std::uniform_int_distribution<int> kind(0, 4);
+    std::uniform_int_distribution<int> precision(1, 12);
+    switch (kind(*random)) {
+      case 0:
+        snprintf(text, sizeof(text), "%.*g", precision(*random), RandomNormalFloat(random));
+        break;
+      case 1: {
+        std::uniform_real_distribution<float> value(-1e6f, 1e6f);
+        snprintf(text, sizeof(text), "%.*f", precision(*random), value(*random));
+        break;
+      }
+      case 2: {
+        // Up to 25 digits with a point somewhere, a sign and an exponent that keep it in range.
+        std::uniform_int_distribution<int> digitCount(1, 25);
+        std::uniform_int_distribution<int> firstDigit(1, 9);
+        std::uniform_int_distribution<int> digit(0, 9);
+        std::uniform_int_distribution<int> exponent(-20, 10);
+        const int count = digitCount(*random);
+        std::uniform_int_distribution<int> point(0, count);
+        const int pointAt = point(*random);
+        std::string number = (*random)() % 3 == 0 ? "-" : ((*random)() % 5 == 0 ? "+" : "");
+        for (int i = 0; i < count; ++i) {
+          if (i == pointAt && i > 0)
+            number.push_back('.');
+          number.push_back(static_cast<char>('0' + (i == 0 ? firstDigit : digit)(*random)));
+        }
+        if ((*random)() % 2 == 0)
+          number += "e" + std::to_string(exponent(*random));
+        return number;
+      }
+      case 3: {
+        // Halfway between a float and the next, which a double holds exactly, in full or cut to
+        // 15 to 17 digits, which lands just either side.  Some of those are short enough for the
+        // fast path but still round to the halfway double.
+        const float low = std::fabs(RandomNormalFloat(random));
+        const float high = std::nextafter(low, FLT_MAX);
+        if (!std::isnormal(high))
+          return "1";
+        std::uniform_int_distribution<int> digits(15, 18);
+        const int count = digits(*random);
+        snprintf(text, sizeof(text), "%.*g", count == 18 ? 60 : count,
+                 (static_cast<double>(low) + high) / 2.0);
+        break;
+      }
+      default: {
+        // Integers halfway between two floats, which the fast path holds exactly.
+        std::uniform_int_distribution<uint64_t> odd(1 << 23, (1 << 24) - 1);
+        std::uniform_int_distribution<int> shift(0, 28);
+        snprintf(text, sizeof(text), "%llu",
+                 static_cast<unsigned long long>((2 * odd(*random) + 1) << shift(*random)));
+        break;
+      }
+    }
+    return text;
+  }
+
+  RoomFileData MakeRoom() {
+    RoomFileData room;
+    const float camera[3] = { 1.5f, -0.0f, 1e-7f };
+    memcpy(room.CameraPosition, camera, sizeof(camera));
+    room.PlayerRadius = 0.1f;
+    room.PlayerPosition[0] = 123456.789f;
+    room.PlayerPosition[1] = -3.4e38f;
+    room.PlayerPosition[2] = FLT_MIN;
+    room.PortalA.Radius = 1.0f / 3.0f;
+    room.PortalA.Position[2] = -5.0f;
+    room.PortalA.Normal[2] = 1.0f;
+    room.PortalA.Up[1] = 1.0f;
+    room.PortalB.Radius = 2.0f;
+    room.PortalB.Position[0] = 16777217.0f;
+    room.PortalB.Normal[0] = -0.70710677f;
+    room.PortalB.Normal[2] = 0.70710677f;
+    room.PortalB.Up[1] = 1.0f;
+    room.FloorHeight = -1.0f;
+    room.CeilingHeight = 2.75f;
+    room.Polygons = { { { 0.0f, 0.0f }, { 10.0f, 0.0f }, { 10.0f, 8.0f }, { 0.0f, 8.0f } },
+                      { { 4.0f, 3.0f }, { 4.0f, 5.0f }, { 6.0f, 5.0f } } };
+    return room;
+  }
+
+  bool SameRoom(const RoomFileData& a, const RoomFileData& b) {
+    bool same = memcmp(a.CameraPosition, b.CameraPosition, sizeof(a.CameraPosition)) == 0 &&
+                FloatBits(a.PlayerRadius) == FloatBits(b.PlayerRadius) &&
+                memcmp(a.PlayerPosition, b.PlayerPosition, sizeof(a.PlayerPosition)) == 0 &&
+                memcmp(&a.PortalA, &b.PortalA, sizeof(PortalPlacement)) == 0 &&
+                memcmp(&a.PortalB, &b.PortalB, sizeof(PortalPlacement)) == 0 &&
+                FloatBits(a.FloorHeight) == FloatBits(b.FloorHeight) &&
+                FloatBits(a.CeilingHeight) == FloatBits(b.CeilingHeight) &&
+                a.Polygons.size() == b.Polygons.size();
+    for (size_t i = 0; i < a.Polygons.size() && same; ++i) {
+      same = a.Polygons[i].size() == b.Polygons[i].size() &&
+             memcmp(a.Polygons[i].data(), b.Polygons[i].data(),
+                    a.Polygons[i].size() * sizeof(PolygonPoint)) == 0;
+    }
+    return same;
+  }
+
+  bool Parse(const std::string& text, RoomFileData* room, std::string* error) {
+    return ParseRoomText(text.data(), text.size(), "room.txt", room, error);
+  }
+
+  // The error for text, which must fail to parse.
+  std::string ParseError(const std::string& text) {
+    RoomFileData room;
+    std::string error;
+    CHECK(!Parse(text, &room, &error));
+    return error;
+  }
+
+  void TestMatchesStrtof() {
+    // Every number as a vertex coordinate of one big polygon, so ParseRoomText reads them all.
+    std::mt19937 random(1);
+    std::vector<std::string> numbers(RANDOM_NUMBER_COUNT);
+    std::string text = ROOM_START + std::to_string(RANDOM_NUMBER_COUNT / 2) + "\n";
+    for (size_t i = 0; i < numbers.size(); ++i) {
+      // Few digits can round a float near the smallest normal one down past it, which both
+      // refuse as out of range.
+      do {
+        numbers[i] = RandomNumber(&random);
+        errno = 0;
+        std::strtof(numbers[i].c_str(), nullptr);
+      } while (errno == ERANGE);
+      text += numbers[i];
+      text.push_back(i % 2 == 0 ? ' ' : '\n');
+    }
+
+    RoomFileData room;
+    std::string error;
+    CHECK(Parse(text, &room, &error));
+    CHECK(error.empty());
+    CHECK(room.Polygons.size() == 1);
+    if (room.Polygons.size() != 1 || room.Polygons[0].size() != numbers.size() / 2)
+      return;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < numbers.size(); ++i) {
+      const PolygonPoint& point = room.Polygons[0][i / 2];
+      const float parsed = i % 2 == 0 ? point.x : point.y;
+      const float expected = std::strtof(numbers[i].c_str(), nullptr);
+      if (FloatBits(parsed) != FloatBits(expected) && mismatches++ < 10) {
+        fprintf(stderr, "%s read as %.9g, strtof reads %.9g\n", numbers[i].c_str(), parsed,
+                expected);
+      }
+    }
+    CHECK(mismatches == 0);
+  }
+
+  void TestErrors() {
+    CHECK(ParseError("0 1 x\n") == "room.txt:1:5: expected the camera's position");
+    // Comments and blank lines count, and columns are from the line's start.
+    CHECK(ParseError("# camera\n\n  0 1 2\n1.5e\n") ==
+          "room.txt:4:1: expected the player's radius");
+    CHECK(ParseError("0 1 2\n0.5 # radius\n0 0 1e39\n") ==
+          "room.txt:3:5: expected the player's position");
+    CHECK(ParseError("0 1 2\n0.5 # radius\n0 1e-39 0\n") ==
+          "room.txt:3:3: expected the player's position");
+    CHECK(ParseError("0 1 2\n0.5\n0 0\n") == "room.txt:3:4: expected the player's position");
+    CHECK(ParseError("0 1 2\n0.5\n0 0 0\n1\n0 0 -5\n0 0 1\n") ==
+          "room.txt:6: ended before portal A's up");
+    CHECK(ParseError(std::string(ROOM_START) + "2\n0 0\n1 0\n") ==
+          "room.txt:13:1: expected a polygon of at least 3 vertices");
+    CHECK(ParseError(std::string(ROOM_START) + "3\n0 0\n1 0\n") ==
+          "room.txt:15: ended before a polygon vertex");
+    CHECK(ParseError(std::string(ROOM_START) + "1000000\n0 0\n1 0\n") ==
+          "room.txt:13:1: expected a polygon's vertex count no more than the lines left in the "
+          "file");
+    CHECK(ParseError(std::string(ROOM_START) + "3\n0 0\n1 0\n1 1z\n") ==
+          "room.txt:16:3: expected a polygon vertex");
+    CHECK(ParseError(std::string(ROOM_START) + "3.5\n") ==
+          "room.txt:13:1: expected a polygon's vertex count");
+
+    // Windows line endings and trailing comments read the same.
+    std::string text = std::string(ROOM_START) + "3 # triangle\n0 0\n1 0\n1 1\n";
+    RoomFileData lineFeeds;
+    std::string error;
+    CHECK(Parse(text, &lineFeeds, &error));
+    std::string windows;
+    for (char c : text) {
+      if (c == '\n')
+        windows.push_back('\r');
+      windows.push_back(c);
+    }
+    RoomFileData converted;
+    CHECK(Parse(windows, &converted, &error));
+    CHECK(SameRoom(lineFeeds, converted));
+
+    CHECK(!ReadRoomFile("/nonexistent/room.txt", &converted, &error));
+    CHECK(error == "Could not open room file /nonexistent/room.txt");
+  }
+
+  void TestRoundTrip() {
+    // Awkward numbers, then random ones over every exponent.
+    RoomFileData room = MakeRoom();
+    std::mt19937 random(2);
+    std::vector<PolygonPoint> polygon(10000);
+    for (PolygonPoint& point : polygon)
+      point = { RandomNormalFloat(&random), RandomNormalFloat(&random) };
+    room.Polygons.push_back(polygon);
+
+    std::string text;
+    FormatRoomText(room, &text);
+    RoomFileData parsed;
+    std::string error;
+    CHECK(Parse(text, &parsed, &error));
+    CHECK(SameRoom(room, parsed));
+
+    // Writing it again doesn't change it.
+    std::string again;
+    FormatRoomText(parsed, &again);
+    CHECK(again == text);
+
+    // Coordinates an editor would write stay as short.
+    RoomFileData simple;
+    simple.Polygons = { { { 0.1f, 2.5f }, { -3.0f, 0.125f }, { 100.0f, 1e-3f } } };
+    text.clear();
+    FormatRoomText(simple, &text);
+    CHECK(text.find("0.1 2.5\n-3 0.125\n100 0.001\n") != std::string::npos);
+
+    // Through a file too.
+    char path[] = "/tmp/RoomFileTestXXXXXX";
+    const int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0)
+      return;
+    close(fd);
+    CHECK(WriteRoomFile(path, room, &error));
+    CHECK(ReadRoomFile(path, &parsed, &error));
+    CHECK(SameRoom(room, parsed));
+    remove(path);
+  }
+
+  void Benchmark() {
+    for (size_t vertexCount : { 10000, 100000, 1000000 }) {
+      const RoomParsingBenchmarkResult result =
+          BenchmarkRoomParsing(vertexCount, vertexCount >= 1000000 ? 3 : 20);
+      CHECK(result.Parsed);
+      printf("Room parsing: %zu vertices (%.1f MB), written in %.3f ms, read in %.3f ms "
+             "(%.1f MB/s, %.2f M vertices/s)\n", result.VertexCount, result.Bytes / 1000000.0,
+             result.FormatSecondsPerRun * 1000.0, result.ParseSecondsPerRun * 1000.0,
+             result.ParseBytesPerSecond / 1000000.0, result.ParseVerticesPerSecond / 1000000.0);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  bool benchmark = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-benchmark") == 0)
+      benchmark = true;
+  }
+
+  TestMatchesStrtof();
+  TestErrors();
+  TestRoundTrip();
+
+  if (benchmark)
+    Benchmark();
+  return CheckResult("RoomFileTest");
+}
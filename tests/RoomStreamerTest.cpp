@@ -0,0 +1,175 @@
+#include "Check.h"
+#include "RoomStreamer.h"
+
+#include <vector>
+
+namespace {
+  const uint64_t ROOM_BYTES = 10;
+
+  struct UpdateResult {
+    std::vector<int> Loads;
+    std::vector<int> Evictions;
+  };
+
+  // Rooms 0-1-2-...-(count - 1) in a row.
+  void AddCorridor(RoomStreamer* streamer, int count) {
+    for (int i = 0; i < count; ++i)
+      streamer->AddRoom(ROOM_BYTES);
+    for (int i = 1; i < count; ++i)
+      streamer->AddLink(i - 1, i);
+  }
+
+  // Runs one update with the player in currentRoom.  Loads finish right away, at their estimated
+  // size, unless completeLoads is false.
+  UpdateResult RunUpdate(RoomStreamer* streamer, uint64_t frame, int currentRoom,
+                         bool completeLoads = true) {
+    UpdateResult result;
+    streamer->Update(frame, currentRoom, &result.Loads, &result.Evictions);
+    for (int room : result.Evictions)
+      CHECK(!streamer->IsResident(room));
+    if (completeLoads) {
+      for (int room : result.Loads)
+        streamer->OnLoadComplete(room, ROOM_BYTES);
+    }
+    return result;
+  }
+
+  void TestNearestFirst() {
+    RoomStreamer streamer(1000, 2, 8);
+    AddCorridor(&streamer, 5);
+    UpdateResult result = RunUpdate(&streamer, 1, 0);
+    CHECK((result.Loads == std::vector<int>{ 0, 1, 2 }));
+    CHECK(streamer.GetHops(2) == 2 && streamer.GetHops(3) == -1);
+    CHECK(streamer.GetStats().ResidentRooms == 3);
+
+    // Moving along loads the next room, and with room to spare nothing is evicted.
+    result = RunUpdate(&streamer, 2, 1);
+    CHECK((result.Loads == std::vector<int>{ 3 }));
+    CHECK(result.Evictions.empty());
+    CHECK(streamer.IsResident(0));
+  }
+
+  void TestUnwantedRoomsEvictedFirst() {
+    RoomStreamer streamer(3 * ROOM_BYTES, 1, 8);
+    AddCorridor(&streamer, 5);
+    RunUpdate(&streamer, 1, 0);
+    RunUpdate(&streamer, 2, 1);
+    CHECK(streamer.GetStats().ResidentBytes == 3 * ROOM_BYTES);
+
+    // Room 0 is two links behind now, so it makes way for room 3.
+    UpdateResult result = RunUpdate(&streamer, 3, 2);
+    CHECK((result.Loads == std::vector<int>{ 3 }));
+    CHECK((result.Evictions == std::vector<int>{ 0 }));
+    CHECK(streamer.GetStats().ResidentBytes == 3 * ROOM_BYTES);
+    CHECK(streamer.GetStats().RoomsEvicted == 1);
+  }
+
+  void TestLeastRecentlyWantedFirst() {
+    // A hub with three rooms off it.  Going from one to another leaves the others unwanted; the
+    // one left longest ago goes first.
+    RoomStreamer streamer(3 * ROOM_BYTES, 1, 8);
+    const int hub = streamer.AddRoom(ROOM_BYTES);
+    int spokes[3];
+    for (int& spoke : spokes) {
+      spoke = streamer.AddRoom(ROOM_BYTES);
+      streamer.AddLink(hub, spoke);
+    }
+    // Only the hub and two spokes fit.
+    RunUpdate(&streamer, 1, spokes[0]);
+    UpdateResult result = RunUpdate(&streamer, 2, spokes[1]);
+    CHECK((result.Loads == std::vector<int>{ spokes[1] }));
+    result = RunUpdate(&streamer, 3, hub);
+    CHECK(streamer.GetStats().LoadsDeferred == 1);
+    CHECK(result.Loads.empty());
+
+    result = RunUpdate(&streamer, 4, spokes[2]);
+    CHECK((result.Loads == std::vector<int>{ spokes[2] }));
+    CHECK((result.Evictions == std::vector<int>{ spokes[0] }));
+    result = RunUpdate(&streamer, 5, spokes[0]);
+    CHECK((result.Evictions == std::vector<int>{ spokes[1] }));
+  }
+
+  void TestFartherWantedRoomsGiveWay() {
+    // Rooms 0-1-2 in a row, and room 3 off room 0.
+    RoomStreamer streamer(3 * ROOM_BYTES, 2, 8);
+    AddCorridor(&streamer, 3);
+    const int side = streamer.AddRoom(ROOM_BYTES);
+    streamer.AddLink(0, side);
+
+    // Room 2 is as far as allowed but nothing farther can make way for it.
+    UpdateResult result = RunUpdate(&streamer, 1, 0);
+    CHECK((result.Loads == std::vector<int>{ 0, 1, side }));
+    CHECK(streamer.GetStats().LoadsDeferred == 1);
+    CHECK(!streamer.IsResident(2));
+
+    // From room 1, room 2 is nearer than the side room, which is still wanted but gives way.
+    result = RunUpdate(&streamer, 2, 1);
+    CHECK(streamer.GetHops(side) == 2);
+    CHECK((result.Loads == std::vector<int>{ 2 }));
+    CHECK((result.Evictions == std::vector<int>{ side }));
+  }
+
+  void TestCurrentRoomAlwaysLoads() {
+    RoomStreamer streamer(ROOM_BYTES / 2, 1, 8);
+    AddCorridor(&streamer, 2);
+    UpdateResult result = RunUpdate(&streamer, 1, 0);
+    CHECK((result.Loads == std::vector<int>{ 0 }));
+    CHECK(streamer.GetStats().ResidentBytes > streamer.GetStats().BudgetBytes);
+
+    // And is never evicted, even for the room the player moves into.
+    result = RunUpdate(&streamer, 2, 1);
+    CHECK((result.Loads == std::vector<int>{ 1 }));
+    CHECK((result.Evictions == std::vector<int>{ 0 }));
+    result = RunUpdate(&streamer, 3, 1);
+    CHECK(result.Evictions.empty());
+    CHECK(streamer.IsResident(1));
+  }
+
+  void TestRealSizeOverBudget() {
+    RoomStreamer streamer(3 * ROOM_BYTES, 1, 8);
+    AddCorridor(&streamer, 4);
+    RunUpdate(&streamer, 1, 0);
+    RunUpdate(&streamer, 2, 1);
+
+    // Room 3 was estimated at ROOM_BYTES but turns out twice that.
+    UpdateResult result = RunUpdate(&streamer, 3, 2, false);
+    CHECK((result.Loads == std::vector<int>{ 3 }));
+    CHECK((result.Evictions == std::vector<int>{ 0 }));
+    streamer.OnLoadComplete(3, 2 * ROOM_BYTES);
+    CHECK(streamer.GetStats().ResidentBytes == 4 * ROOM_BYTES);
+
+    // Rooms that are still wanted stay, even over the budget.
+    result = RunUpdate(&streamer, 4, 2);
+    CHECK(result.Loads.empty() && result.Evictions.empty());
+
+    // Once room 1 isn't wanted any more, it goes without anything else needing a load.
+    result = RunUpdate(&streamer, 5, 3);
+    CHECK(result.Loads.empty());
+    CHECK((result.Evictions == std::vector<int>{ 1 }));
+    CHECK(streamer.GetStats().ResidentBytes == 3 * ROOM_BYTES);
+  }
+
+  void TestLoadsInFlightLimit() {
+    RoomStreamer streamer(1000, 2, 1);
+    AddCorridor(&streamer, 3);
+    UpdateResult result = RunUpdate(&streamer, 1, 1, false);
+    CHECK((result.Loads == std::vector<int>{ 1 }));
+    result = RunUpdate(&streamer, 2, 1, false);
+    CHECK(result.Loads.empty());
+    streamer.OnLoadComplete(1, ROOM_BYTES);
+    result = RunUpdate(&streamer, 3, 1, false);
+    CHECK((result.Loads == std::vector<int>{ 0 }));
+    CHECK(streamer.IsLoading(0));
+  }
+}
+
+int main() {
+  TestNearestFirst();
+  TestUnwantedRoomsEvictedFirst();
+  TestLeastRecentlyWantedFirst();
+  TestFartherWantedRoomsGiveWay();
+  TestCurrentRoomAlwaysLoads();
+  TestRealSizeOverBudget();
+  TestLoadsInFlightLimit();
+  return CheckResult("RoomStreamerTest");
+}
@@ -0,0 +1,178 @@
+#include "Check.h"
+#include "ShaderCache.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+namespace {
+  std::string gDirectory;
+
+  void WriteFile(const std::string& name, const std::string& contents) {
+    std::ofstream(gDirectory + name, std::ios::binary | std::ios::trunc) << contents;
+  }
+
+  ShaderCompileDesc MakeDesc() {
+    ShaderCompileDesc desc;
+    desc.Path = gDirectory + "Main.hlsl";
+    desc.Defines = { { "ALPHA_TEST", "1" }, { "FOG", "" } };
+    desc.EntryPoint = "PS";
+    desc.Target = "ps_5_1";
+    desc.Flags = 0x1;
+    return desc;
+  }
+
+  uint64_t Key(const ShaderCompileDesc& desc) {
+    uint64_t key = 0;
+    CHECK(ShaderCache::ComputeKey(desc, &key));
+    return key;
+  }
+
+  // Main.hlsl includes Common.hlsl, which includes lighting/Lights.hlsl relative to itself.
+  void WriteShaders() {
+    mkdir((gDirectory + "lighting").c_str(), 0755);
+    WriteFile("Main.hlsl", "#include \"Common.hlsl\"\nfloat4 PS() : SV_Target { return 1; }\n");
+    WriteFile("Common.hlsl", "  #  include \"lighting/Lights.hlsl\"\nfloat gCommon;\n");
+    WriteFile("lighting/Lights.hlsl", "float gLight;\n");
+    WriteFile("Unrelated.hlsl", "float gUnrelated;\n");
+  }
+
+  void TestSourceChanges() {
+    WriteShaders();
+    const uint64_t base = Key(MakeDesc());
+    CHECK(Key(MakeDesc()) == base);
+
+    WriteFile("Unrelated.hlsl", "float gUnrelated2;\n");
+    CHECK(Key(MakeDesc()) == base);
+
+    WriteFile("Main.hlsl", "#include \"Common.hlsl\"\nfloat4 PS() : SV_Target { return 0; }\n");
+    CHECK(Key(MakeDesc()) != base);
+    WriteShaders();
+    CHECK(Key(MakeDesc()) == base);
+
+    WriteFile("Common.hlsl", "  #  include \"lighting/Lights.hlsl\"\nfloat gCommon2;\n");
+    CHECK(Key(MakeDesc()) != base);
+    WriteShaders();
+
+    // An include of an include, found relative to the file that includes it.
+    WriteFile("lighting/Lights.hlsl", "float gLight2;\n");
+    CHECK(Key(MakeDesc()) != base);
+    WriteShaders();
+
+    // A missing include is hashed by name, so it differs from an empty file with that name.
+    remove((gDirectory + "lighting/Lights.hlsl").c_str());
+    const uint64_t missing = Key(MakeDesc());
+    CHECK(missing != base);
+    WriteFile("lighting/Lights.hlsl", "");
+    CHECK(Key(MakeDesc()) != base);
+    WriteShaders();
+    CHECK(Key(MakeDesc()) == base);
+  }
+
+  void TestIncludeCycle() {
+    WriteFile("CycleA.hlsl", "#include \"CycleB.hlsl\"\n");
+    WriteFile("CycleB.hlsl", "#include \"CycleA.hlsl\"\n");
+    ShaderCompileDesc desc = MakeDesc();
+    desc.Path = gDirectory + "CycleA.hlsl";
+    const uint64_t key = Key(desc);
+    WriteFile("CycleB.hlsl", "#include \"CycleA.hlsl\"\n// changed\n");
+    CHECK(Key(desc) != key);
+  }
+
+  void TestDescChanges() {
+    WriteShaders();
+    const uint64_t base = Key(MakeDesc());
+
+    ShaderCompileDesc desc = MakeDesc();
+    desc.Defines[0].Definition = "0";
+    CHECK(Key(desc) != base);
+
+    desc = MakeDesc();
+    desc.Defines[1].Name = "FOG2";
+    CHECK(Key(desc) != base);
+
+    desc = MakeDesc();
+    desc.Defines[1].Definition = "1";
+    CHECK(Key(desc) != base);
+
+    desc = MakeDesc();
+    desc.Defines.pop_back();
+    CHECK(Key(desc) != base);
+
+    desc = MakeDesc();
+    desc.Defines.push_back({ "SHADOWS", "" });
+    CHECK(Key(desc) != base);
+
+    // Names and values can't run into each other: A=BC is not AB=C.
+    desc = MakeDesc();
+    desc.Defines = { { "A", "BC" } };
+    const uint64_t abc = Key(desc);
+    desc.Defines = { { "AB", "C" } };
+    CHECK(Key(desc) != abc);
+
+    desc = MakeDesc();
+    desc.EntryPoint = "PS2";
+    CHECK(Key(desc) != base);
+
+    desc = MakeDesc();
+    desc.Target = "ps_5_0";
+    CHECK(Key(desc) != base);
+
+    for (uint32_t bit = 0; bit < 32; ++bit) {
+      desc = MakeDesc();
+      desc.Flags ^= 1u << bit;
+      CHECK(Key(desc) != base);
+    }
+
+    desc = MakeDesc();
+    desc.Path = gDirectory + "Missing.hlsl";
+    uint64_t key = 0;
+    CHECK(!ShaderCache::ComputeKey(desc, &key));
+  }
+
+  void TestStore() {
+    ShaderCache cache(gDirectory);
+    const uint64_t key = Key(MakeDesc());
+    CHECK(!cache.Contains(key));
+    const char bytecode[] = "DXBC";
+    CHECK(cache.Store(key, bytecode, sizeof(bytecode)));
+    CHECK(cache.Contains(key));
+    CHECK(cache.Store(key, bytecode, sizeof(bytecode)));
+
+    std::ifstream stored(cache.GetBinaryPath(key), std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(stored)),
+                         std::istreambuf_iterator<char>());
+    CHECK(contents == std::string(bytecode, sizeof(bytecode)));
+
+    const ShaderCache::Stats& stats = cache.GetStats();
+    CHECK(stats.Hits == 1 && stats.Misses == 1 && stats.Stores == 2 && stats.StoreFailures == 0);
+
+    ShaderCache missingDirectory(gDirectory + "missing");
+    CHECK(!missingDirectory.Store(key, bytecode, sizeof(bytecode)));
+    CHECK(missingDirectory.GetStats().StoreFailures == 1);
+  }
+}
+
+int main() {
+  char directory[] = "/tmp/ShaderCacheTestXXXXXX";
+  if (mkdtemp(directory) == nullptr) {
+    perror("mkdtemp");
+    return 1;
+  }
+  gDirectory = std::string(directory) + "/";
+
+  TestSourceChanges();
+  TestIncludeCycle();
+  TestDescChanges();
+  TestStore();
+
+  std::string command = "rm -rf '" + std::string(directory) + "'";
+  if (system(command.c_str()) != 0)
+    fprintf(stderr, "Could not remove %s\n", directory);
+  return CheckResult("ShaderCacheTest");
+}
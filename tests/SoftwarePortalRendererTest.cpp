@@ -0,0 +1,406 @@
+#include "Check.h"
+#include "SoftwarePortalRenderer.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+// Renders a small scene through SoftwarePortalRenderer and checks the stencil and depth its passes
+// leave behind, then compares a low-resolution stencil image against a checked-in one:
+//
+//   SoftwarePortalRendererTest [-benchmark]
+//
+// The room is a box with portal A in the wall at x = -ROOM_HALF_X, facing +x, and portal B in the
+// wall at x = +ROOM_HALF_X, facing -x, both centered on the x axis.  The eye is on the axis,
+// PORTAL_DISTANCE from the portal it looks straight at, so the portal's nested images are
+// concentric and the pixel at the center of the screen is inside all of them.  -benchmark times
+// rendering the scene at a window-like size with as many iterations as the app uses.
+
+namespace {
+  const float ROOM_HALF_X = 4.0f;
+  const float ROOM_HALF_Y = 3.0f;
+  const float ROOM_HALF_Z = 4.0f;
+  const float PORTAL_RADIUS = 2.5f;
+  const float PORTAL_BOX_DEPTH = 0.5f;
+  const float PORTAL_DISTANCE = 3.0f;
+
+  // Going into one portal comes out of the other, ROOM_SPAN along x.
+  const float ROOM_SPAN = 2.0f * ROOM_HALF_X;
+
+  const float NEAR_Z = 0.5f;
+  const float FAR_Z = 200.0f;
+
+  enum Material {
+    MATERIAL_ROOM,
+    MATERIAL_PLAYER,
+    NUM_MATERIALS
+  };
+
+  const int BENCHMARK_SECONDS = 1;
+
+  SwVec3 Sub(const SwVec3& a, const SwVec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+
+  float Dot(const SwVec3& a, const SwVec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+  SwVec3 Cross(const SwVec3& a, const SwVec3& b) {
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+  }
+
+  SwMatrix Translation(float x, float y, float z) {
+    SwMatrix matrix = SwMatrix::Identity();
+    matrix.m[0][3] = x;
+    matrix.m[1][3] = y;
+    matrix.m[2][3] = z;
+    return matrix;
+  }
+
+  // A left-handed perspective camera at (eyeX, 0, 0) looking along +x if direction is 1, or -x if
+  // it's -1, with +y up and a 90 degree vertical field of view.
+  SwMatrix MakeViewProj(float eyeX, float direction, float aspect) {
+    const float yScale = 1.0f;
+    const float xScale = yScale / aspect;
+    const float zScale = FAR_Z / (FAR_Z - NEAR_Z);
+    // View space x is -direction * z, y is y and z is direction * (x - eyeX).
+    SwMatrix matrix = {};
+    matrix.m[0][2] = -direction * xScale;
+    matrix.m[1][1] = yScale;
+    matrix.m[2][0] = direction * zScale;
+    matrix.m[2][3] = -direction * eyeX * zScale - NEAR_Z * zScale;
+    matrix.m[3][0] = direction;
+    matrix.m[3][3] = -direction * eyeX;
+    return matrix;
+  }
+
+  // The depth buffer value of a point at the given distance in front of one of those cameras.
+  float DepthAtDistance(float distance) {
+    const float zScale = FAR_Z / (FAR_Z - NEAR_Z);
+    return (distance * zScale - NEAR_Z * zScale) / distance;
+  }
+
+  struct Pixel {
+    int X;
+    int Y;
+  };
+
+  Pixel Project(const SwMatrix& viewProj, const SwVec3& point, const SwRenderTarget& target) {
+    const SwVec4 clip = viewProj.MulPoint(point);
+    const float x = (clip.x / clip.w + 1.0f) * 0.5f * target.GetWidth();
+    const float y = (1.0f - clip.y / clip.w) * 0.5f * target.GetHeight();
+    return { static_cast<int>(std::floor(x)), static_cast<int>(std::floor(y)) };
+  }
+
+  uint8_t StencilAt(const SwRenderTarget& target, const Pixel& pixel) {
+    return target.Stencil()[static_cast<size_t>(pixel.Y) * target.GetWidth() + pixel.X];
+  }
+
+  float DepthAt(const SwRenderTarget& target, const Pixel& pixel) {
+    return target.Depth()[static_cast<size_t>(pixel.Y) * target.GetWidth() + pixel.X];
+  }
+
+  // Appends a quad whose corners go around it in order, wound so it's front facing from the side
+  // facing points to.
+  void AddQuad(SoftwarePortalScene* scene, const SwVec3 (&corners)[4], const SwVec3& facing) {
+    const uint32_t first = static_cast<uint32_t>(scene->Vertices.size());
+    for (const SwVec3& corner : corners) {
+      SwVertex vertex = {};
+      vertex.Pos = corner;
+      vertex.Normal = facing;
+      scene->Vertices.push_back(vertex);
+    }
+    // In left-handed coordinates, a front face's (b - a) x (c - a) points toward the viewer.
+    const SwVec3 normal = Cross(Sub(corners[1], corners[0]), Sub(corners[2], corners[0]));
+    const bool flip = Dot(normal, facing) < 0.0f;
+    const uint32_t order[6] = { 0, 1, 2, 0, 2, 3 };
+    const uint32_t flippedOrder[6] = { 0, 2, 1, 0, 3, 2 };
+    for (uint32_t index : flip ? flippedOrder : order)
+      scene->Indices.push_back(first + index);
+  }
+
+  // The faces of an axis-aligned box, 0 to 5 being -x, +x, -y, +y, -z and +z, facing into it if
+  // inward is set.  skipFace is left out unless it's -1.
+  void AddBox(SoftwarePortalScene* scene, const SwVec3& min, const SwVec3& max, bool inward,
+              int skipFace = -1) {
+    const float lo[3] = { min.x, min.y, min.z };
+    const float hi[3] = { max.x, max.y, max.z };
+    for (int face = 0; face < 6; ++face) {
+      if (face == skipFace)
+        continue;
+      const int axis = face / 2;
+      const int u = (axis + 1) % 3;
+      const int v = (axis + 2) % 3;
+      const float side = face % 2 == 0 ? lo[axis] : hi[axis];
+      const float us[4] = { lo[u], hi[u], hi[u], lo[u] };
+      const float vs[4] = { lo[v], lo[v], hi[v], hi[v] };
+      SwVec3 corners[4];
+      for (int i = 0; i < 4; ++i) {
+        float* corner = &corners[i].x;
+        corner[axis] = side;
+        corner[u] = us[i];
+        corner[v] = vs[i];
+      }
+      SwVec3 facing = { 0.0f, 0.0f, 0.0f };
+      (&facing.x)[axis] = (face % 2 == 0) == inward ? 1.0f : -1.0f;
+      AddQuad(scene, corners, facing);
+    }
+  }
+
+  SwRenderItem MakeRenderItem(const SoftwarePortalScene& scene, uint32_t startIndexLocation,
+                              Material material) {
+    SwRenderItem ri;
+    ri.Object.World = SwMatrix::Identity();
+    ri.Object.WorldInvTranspose = SwMatrix::Identity();
+    ri.Object.TexTransform = SwMatrix::Identity();
+    ri.Object.MaterialIndex = material;
+    ri.IndexCount = static_cast<uint32_t>(scene.Indices.size()) - startIndexLocation;
+    ri.StartIndexLocation = startIndexLocation;
+    return ri;
+  }
+
+  // The room, its portals and a player standing off the axis, seen looking along direction (1 for
+  // portal B, -1 for portal A).  Each pass inside a portal looks from one more
+  // ROOM_SPAN behind the eye, where the camera seen through the portal would be.
+  void BuildScene(float direction, int iterations, float aspect, SoftwarePortalScene* scene) {
+    uint32_t start = 0;
+    AddBox(scene, { -ROOM_HALF_X, -ROOM_HALF_Y, -ROOM_HALF_Z },
+           { ROOM_HALF_X, ROOM_HALF_Y, ROOM_HALF_Z }, true);
+    scene->Room = MakeRenderItem(*scene, start, MATERIAL_ROOM);
+
+    start = static_cast<uint32_t>(scene->Indices.size());
+    AddBox(scene, { 2.0f, -ROOM_HALF_Y, 1.5f }, { 2.8f, -1.5f, 2.5f }, false);
+    scene->Player = MakeRenderItem(*scene, start, MATERIAL_PLAYER);
+
+    // Open on the wall's side, so they're only seen through the holes.
+    start = static_cast<uint32_t>(scene->Indices.size());
+    AddBox(scene, { -ROOM_HALF_X - PORTAL_BOX_DEPTH, -PORTAL_RADIUS, -PORTAL_RADIUS },
+           { -ROOM_HALF_X, PORTAL_RADIUS, PORTAL_RADIUS }, true, 1);
+    scene->PortalBoxA = MakeRenderItem(*scene, start, MATERIAL_ROOM);
+    start = static_cast<uint32_t>(scene->Indices.size());
+    AddBox(scene, { ROOM_HALF_X, -PORTAL_RADIUS, -PORTAL_RADIUS },
+           { ROOM_HALF_X + PORTAL_BOX_DEPTH, PORTAL_RADIUS, PORTAL_RADIUS }, true, 0);
+    scene->PortalBoxB = MakeRenderItem(*scene, start, MATERIAL_ROOM);
+    scene->PortalDecalA = MakeRenderItem(*scene, start, MATERIAL_ROOM);
+    scene->PortalDecalA.IndexCount = 0;
+    scene->PortalDecalB = scene->PortalDecalA;
+
+    scene->Materials.resize(NUM_MATERIALS);
+    scene->Materials[MATERIAL_ROOM] = { { 0.8f, 0.8f, 0.8f, 1.0f }, { 0.1f, 0.1f, 0.1f, 8.0f } };
+    scene->Materials[MATERIAL_PLAYER] = { { 0.9f, 0.2f, 0.1f, 1.0f }, { 0.1f, 0.1f, 0.1f, 8.0f } };
+
+    scene->Frame = SwFrameConstants();
+    scene->Frame.PortalAHole = { -ROOM_HALF_X, 0.0f, 0.0f, PORTAL_RADIUS };
+    scene->Frame.PortalANormal = { 1.0f, 0.0f, 0.0f };
+    scene->Frame.PortalBHole = { ROOM_HALF_X, 0.0f, 0.0f, PORTAL_RADIUS };
+    scene->Frame.PortalBNormal = { -1.0f, 0.0f, 0.0f };
+    scene->Frame.AmbientLight = { 0.3f, 0.3f, 0.3f };
+    scene->Frame.Lights[0].Strength = { 0.6f, 0.6f, 0.6f };
+    scene->Frame.Lights[0].Direction = { 0.48f, -0.8f, 0.36f };
+
+    // Clip planes keep what's in front of each portal.
+    scene->ClipPlanes[SoftwarePortalScene::CLIP_PLANE_DUMMY] = SwClipPlaneConstants();
+    scene->ClipPlanes[SoftwarePortalScene::CLIP_PLANE_PORTAL_A_B] =
+        { { 1.0f, 0.0f, 0.0f }, -ROOM_HALF_X, { -1.0f, 0.0f, 0.0f }, -ROOM_HALF_X };
+    scene->ClipPlanes[SoftwarePortalScene::CLIP_PLANE_PORTAL_B_A] =
+        { { -1.0f, 0.0f, 0.0f }, -ROOM_HALF_X, { 1.0f, 0.0f, 0.0f }, -ROOM_HALF_X };
+    const SwMatrix world2s[SoftwarePortalScene::NUM_WORLD2S] = {
+      SwMatrix::Identity(), Translation(ROOM_SPAN, 0.0f, 0.0f),
+      Translation(-ROOM_SPAN, 0.0f, 0.0f)
+    };
+    for (int i = 0; i < SoftwarePortalScene::NUM_WORLD2S; ++i)
+      scene->World2s[i] = { world2s[i], SwMatrix::Identity() };
+
+    scene->PortalAIterations = direction < 0.0f ? iterations : 0;
+    scene->PortalBIterations = direction > 0.0f ? iterations : 0;
+    scene->Passes.clear();
+    for (int k = 0; k <= iterations; ++k) {
+      const float eyeX = direction * (ROOM_HALF_X - PORTAL_DISTANCE - ROOM_SPAN * k);
+      scene->Passes.push_back({ MakeViewProj(eyeX, direction, aspect), { eyeX, 0.0f, 0.0f },
+                                1.0f });
+    }
+  }
+
+  SwRenderTarget Render(float direction, int iterations, int width, int height) {
+    SoftwarePortalScene scene;
+    BuildScene(direction, iterations, static_cast<float>(width) / height, &scene);
+    SwRenderTarget target(width, height);
+    SoftwarePortalRenderer renderer;
+    renderer.Render(scene, &target);
+    return target;
+  }
+
+  const int WIDTH = 128;
+  const int HEIGHT = 96;
+
+  SwMatrix MainViewProj(float direction) {
+    return MakeViewProj(direction * (ROOM_HALF_X - PORTAL_DISTANCE), direction,
+                        static_cast<float>(WIDTH) / HEIGHT);
+  }
+
+  // With no iterations, portal B's box is all that's drawn into its hole, setting the stencil to
+  // B's ref.
+  void TestStencilSet() {
+    const SwRenderTarget target = Render(1.0f, 0, WIDTH, HEIGHT);
+    const SwMatrix viewProj = MainViewProj(1.0f);
+
+    const Pixel center = Project(viewProj, { ROOM_HALF_X, 0.0f, 0.0f }, target);
+    CHECK(StencilAt(target, center) == 1);
+    CHECK_NEAR(DepthAt(target, center), DepthAtDistance(PORTAL_DISTANCE + PORTAL_BOX_DEPTH),
+               1e-6);
+
+    // Next to the hole, the wall.
+    const Pixel wall = Project(viewProj, { ROOM_HALF_X, 0.0f, 3.5f }, target);
+    CHECK(StencilAt(target, wall) == 0);
+    CHECK_NEAR(DepthAt(target, wall), DepthAtDistance(PORTAL_DISTANCE), 1e-6);
+  }
+
+  // Each iteration clears the depth in what's left of the hole, draws the room seen through it and
+  // increments the stencil where the next hole is.
+  void TestClearDepthAndIncrement() {
+    const int iterations = 3;
+    const SwRenderTarget target = Render(1.0f, iterations, WIDTH, HEIGHT);
+    const SwMatrix viewProj = MainViewProj(1.0f);
+
+    // The center is in every nested hole; the last iteration's box is the nearest thing there.
+    const Pixel center = Project(viewProj, { ROOM_HALF_X, 0.0f, 0.0f }, target);
+    CHECK(StencilAt(target, center) == 1 + iterations);
+    CHECK_NEAR(DepthAt(target, center),
+               DepthAtDistance(PORTAL_DISTANCE + PORTAL_BOX_DEPTH + ROOM_SPAN * iterations),
+               1e-6);
+
+    // Inside the first hole but outside the second, the far wall of the room seen through the
+    // portal, which is only drawn because the depth in the hole was cleared first.
+    const Pixel ring = Project(viewProj, { ROOM_HALF_X, 0.0f, 0.9f }, target);
+    CHECK(StencilAt(target, ring) == 1);
+    CHECK_NEAR(DepthAt(target, ring), DepthAtDistance(PORTAL_DISTANCE + ROOM_SPAN), 1e-6);
+
+    const Pixel wall = Project(viewProj, { ROOM_HALF_X, 0.0f, 3.5f }, target);
+    CHECK(StencilAt(target, wall) == 0);
+    CHECK_NEAR(DepthAt(target, wall), DepthAtDistance(PORTAL_DISTANCE), 1e-6);
+  }
+
+  // After its iterations, portal A's box zeroes the stencil in its hole and puts back the depth of
+  // the hole, so portal B's iterations don't draw into it.
+  void TestStencilZero() {
+    const SwRenderTarget target = Render(-1.0f, 3, WIDTH, HEIGHT);
+    const SwMatrix viewProj = MainViewProj(-1.0f);
+
+    const Pixel center = Project(viewProj, { -ROOM_HALF_X, 0.0f, 0.0f }, target);
+    CHECK(StencilAt(target, center) == 0);
+    CHECK_NEAR(DepthAt(target, center), DepthAtDistance(PORTAL_DISTANCE + PORTAL_BOX_DEPTH),
+               1e-6);
+
+    const Pixel ring = Project(viewProj, { -ROOM_HALF_X, 0.0f, 0.9f }, target);
+    CHECK(StencilAt(target, ring) == 0);
+    CHECK_NEAR(DepthAt(target, ring), DepthAtDistance(PORTAL_DISTANCE + PORTAL_BOX_DEPTH), 1e-6);
+
+    bool anyStencil = false;
+    for (int i = 0; i < WIDTH * HEIGHT; ++i)
+      anyStencil |= target.Stencil()[i] != 0;
+    CHECK(!anyStencil);
+  }
+
+  // The stencil looking at portal B with three iterations, one digit per pixel: each nested hole
+  // is one more than the hole around it.
+  const char* const GOLDEN_STENCIL[] = {
+    "................................................",
+    "................................................",
+    "................................................",
+    "....................11111111....................",
+    ".................11111111111111.................",
+    "................1111111111111111................",
+    "..............11111111111111111111..............",
+    ".............1111111111111111111111.............",
+    "............111111111111111111111111............",
+    "............111111111111111111111111............",
+    "...........11111111111111111111111111...........",
+    "..........1111111111111111111111111111..........",
+    "..........1111111111111111111111111111..........",
+    "..........1111111111111111111111111111..........",
+    ".........111111111111122221111111111111.........",
+    ".........111111111111222222111111111111.........",
+    ".........111111111112234432211111111111.........",
+    ".........111111111112244442211111111111.........",
+    ".........111111111112244442211111111111.........",
+    ".........111111111112234432211111111111.........",
+    ".........111111111111222222111111111111.........",
+    ".........111111111111122221111111111111.........",
+    "..........1111111111111111111111111111..........",
+    "..........1111111111111111111111111111..........",
+    "..........1111111111111111111111111111..........",
+    "...........11111111111111111111111111...........",
+    "............111111111111111111111111............",
+    "............111111111111111111111111............",
+    ".............1111111111111111111111.............",
+    "..............11111111111111111111..............",
+    "................1111111111111111................",
+    ".................11111111111111.................",
+    "....................11111111....................",
+    "................................................",
+    "................................................",
+    "................................................",
+  };
+
+  void TestGoldenStencil() {
+    const int width = 48;
+    const int height = 36;
+    const SwRenderTarget target = Render(1.0f, 3, width, height);
+
+    bool matches = sizeof(GOLDEN_STENCIL) / sizeof(GOLDEN_STENCIL[0]) == height;
+    std::string image;
+    for (int y = 0; y < height; ++y) {
+      std::string row;
+      for (int x = 0; x < width; ++x) {
+        const uint8_t stencil = target.Stencil()[y * width + x];
+        row += stencil == 0 ? '.' : static_cast<char>('0' + stencil);
+      }
+      matches = matches && row == GOLDEN_STENCIL[y];
+      image += "    \"" + row + "\",\n";
+    }
+    CHECK(matches);
+    if (!matches)
+      fprintf(stderr, "Stencil was:\n%s", image.c_str());
+  }
+
+  void Benchmark() {
+    const int width = 1280;
+    const int height = 720;
+    const int iterations = 8;
+    SoftwarePortalScene scene;
+    BuildScene(1.0f, iterations, static_cast<float>(width) / height, &scene);
+    SwRenderTarget target(width, height);
+    SoftwarePortalRenderer renderer;
+
+    int frames = 0;
+    uint64_t pixels = 0;
+    const auto start = std::chrono::steady_clock::now();
+    double seconds = 0.0;
+    do {
+      renderer.Render(scene, &target);
+      pixels += renderer.GetStats().PixelsShaded;
+      ++frames;
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (seconds < BENCHMARK_SECONDS);
+
+    const SoftwareRasterizer::Stats& stats = renderer.GetStats();
+    printf("Software portal rendering: %dx%d, %d iterations, %.2f ms per frame, %u draws, "
+           "%.1f M pixels shaded/s\n", width, height, iterations, seconds * 1000.0 / frames,
+           stats.Draws, pixels / seconds / 1000000.0);
+  }
+}
+
+int main(int argc, char** argv) {
+  bool benchmark = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "-benchmark") == 0)
+      benchmark = true;
+  }
+
+  TestStencilSet();
+  TestClearDepthAndIncrement();
+  TestStencilZero();
+  TestGoldenStencil();
+
+  if (benchmark)
+    Benchmark();
+  return CheckResult("SoftwarePortalRendererTest");
+}
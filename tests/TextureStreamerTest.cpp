@@ -0,0 +1,196 @@
+#include "Check.h"
+#include "TextureStreamer.h"
+
+#include <vector>
+
+namespace {
+  // Every test texture has these mips, with the last two pinned: 5 bytes are always resident, the
+  // second mip takes 16 more and the most detailed 64 more.
+  const std::vector<uint64_t> MIP_BYTES = { 64, 16, 4, 1 };
+  const int FIRST_PINNED_MIP = 2;
+  const uint64_t PINNED_BYTES = 5;
+
+  struct Request {
+    int Texture;
+    int Mip;
+    float Priority;
+  };
+
+  struct FrameResult {
+    std::vector<TextureStreamer::LoadRequest> Loads;
+    std::vector<TextureStreamer::Eviction> Evictions;
+  };
+
+  // Adds up what should be resident from the streamer's own view of each texture.
+  uint64_t CountResidentBytes(const TextureStreamer& streamer, int textureCount) {
+    uint64_t bytes = 0;
+    for (int i = 0; i < textureCount; ++i) {
+      for (int mip = streamer.GetResidentMip(i); mip < streamer.GetMipLevels(i); ++mip)
+        bytes += MIP_BYTES[mip];
+    }
+    return bytes;
+  }
+
+  // Runs one frame with the given requests.  Loads finish right away unless completeLoads is
+  // false.
+  FrameResult RunFrame(TextureStreamer* streamer, int textureCount, uint64_t frame,
+                       const std::vector<Request>& requests, bool completeLoads = true) {
+    for (const Request& request : requests)
+      streamer->RequestMip(request.Texture, request.Mip, request.Priority);
+    FrameResult result;
+    streamer->Update(frame, &result.Loads, &result.Evictions);
+
+    const TextureStreamer::Stats& stats = streamer->GetStats();
+    CHECK(stats.ResidentBytes + stats.LoadingBytes <= stats.BudgetBytes);
+    CHECK(stats.ResidentBytes == CountResidentBytes(*streamer, textureCount));
+
+    if (completeLoads) {
+      for (const TextureStreamer::LoadRequest& load : result.Loads)
+        streamer->OnLoadComplete(load.Texture, load.Mip);
+    }
+    return result;
+  }
+
+  bool HasEviction(const FrameResult& result, int texture, int residentMip) {
+    for (const TextureStreamer::Eviction& eviction : result.Evictions) {
+      if (eviction.Texture == texture && eviction.ResidentMip == residentMip)
+        return true;
+    }
+    return false;
+  }
+
+  bool HasLoad(const FrameResult& result, int texture, int mip) {
+    for (const TextureStreamer::LoadRequest& load : result.Loads) {
+      if (load.Texture == texture && load.Mip == mip)
+        return true;
+    }
+    return false;
+  }
+
+  void TestStreamsOneMipAtATime() {
+    TextureStreamer streamer(1000, 4);
+    const int a = streamer.AddTexture(MIP_BYTES, FIRST_PINNED_MIP);
+    CHECK(streamer.GetResidentMip(a) == FIRST_PINNED_MIP);
+    CHECK(streamer.GetStats().ResidentBytes == PINNED_BYTES);
+
+    FrameResult result = RunFrame(&streamer, 1, 1, { { a, 0, 1.0f } });
+    CHECK(result.Loads.size() == 1 && HasLoad(result, a, 1));
+    result = RunFrame(&streamer, 1, 2, { { a, 0, 1.0f } });
+    CHECK(result.Loads.size() == 1 && HasLoad(result, a, 0));
+    result = RunFrame(&streamer, 1, 3, { { a, 0, 1.0f } });
+    CHECK(result.Loads.empty() && result.Evictions.empty());
+    CHECK(streamer.GetResidentMip(a) == 0);
+    CHECK(streamer.GetStats().LoadsCompleted == 2);
+  }
+
+  void TestLoadsInFlightLimit() {
+    TextureStreamer streamer(1000, 1);
+    const int a = streamer.AddTexture(MIP_BYTES, FIRST_PINNED_MIP);
+    const int b = streamer.AddTexture(MIP_BYTES, FIRST_PINNED_MIP);
+
+    // The more important texture goes first, and nothing more starts until it's done.
+    FrameResult result = RunFrame(&streamer, 2, 1, { { a, 0, 1.0f }, { b, 0, 2.0f } }, false);
+    CHECK(result.Loads.size() == 1 && HasLoad(result, b, 1));
+    CHECK(streamer.IsLoading(b));
+    CHECK(streamer.GetStats().LoadingBytes == 16);
+    result = RunFrame(&streamer, 2, 2, { { a, 0, 1.0f }, { b, 0, 2.0f } }, false);
+    CHECK(result.Loads.empty());
+
+    streamer.OnLoadComplete(b, 1);
+    result = RunFrame(&streamer, 2, 3, { { a, 0, 1.0f }, { b, 0, 2.0f } }, false);
+    CHECK(result.Loads.size() == 1 && HasLoad(result, b, 0));
+  }
+
+  // Two textures with room for one fully detailed and the other one level short.
+  void TestBudgetEviction() {
+    const uint64_t budget = 2 * PINNED_BYTES + 64 + 16 + 16;
+    TextureStreamer streamer(budget, 4);
+    const int a = streamer.AddTexture(MIP_BYTES, FIRST_PINNED_MIP);
+    const int b = streamer.AddTexture(MIP_BYTES, FIRST_PINNED_MIP);
+
+    RunFrame(&streamer, 2, 1, { { a, 0, 1.0f } });
+    RunFrame(&streamer, 2, 2, { { a, 0, 1.0f } });
+    CHECK(streamer.GetResidentMip(a) == 0);
+
+    // B's second mip still fits without touching A.
+    FrameResult result = RunFrame(&streamer, 2, 3, { { b, 0, 1.0f } });
+    CHECK(HasLoad(result, b, 1) && result.Evictions.empty());
+
+    // B's most detailed mip doesn't: A wasn't drawn this frame, so its most detailed mip goes.
+    result = RunFrame(&streamer, 2, 4, { { b, 0, 1.0f } });
+    CHECK(HasLoad(result, b, 0));
+    CHECK(result.Evictions.size() == 1 && HasEviction(result, a, 1));
+    CHECK(streamer.GetResidentMip(a) == 1);
+    CHECK(streamer.GetStats().MipsEvicted == 1);
+
+    // A mip its texture no longer wants goes first, even if the texture was drawn this frame.
+    result = RunFrame(&streamer, 2, 5, { { a, 0, 1.0f }, { b, 2, 1.0f } });
+    CHECK(HasLoad(result, a, 0));
+    CHECK(result.Evictions.size() == 1 && HasEviction(result, b, 1));
+
+    // Both drawn, equally important and wanted: nothing gives way, and the load waits.
+    const uint32_t deferred = streamer.GetStats().LoadsDeferred;
+    result = RunFrame(&streamer, 2, 6, { { a, 0, 1.0f }, { b, 0, 1.0f } });
+    CHECK(result.Loads.empty() && result.Evictions.empty());
+    CHECK(streamer.GetStats().LoadsDeferred == deferred + 1);
+    CHECK(streamer.GetResidentMip(a) == 0 && streamer.GetResidentMip(b) == 1);
+
+    // Unless the load is more important.
+    result = RunFrame(&streamer, 2, 7, { { a, 0, 1.0f }, { b, 0, 2.0f } });
+    CHECK(HasLoad(result, b, 0) && HasEviction(result, a, 1));
+  }
+
+  // Among textures not drawn this frame, the least recently drawn gives way first.
+  void TestLeastRecentlyUsedFirst() {
+    TextureStreamer streamer(3 * PINNED_BYTES + 2 * 16, 4);
+    const int a = streamer.AddTexture(MIP_BYTES, FIRST_PINNED_MIP);
+    const int b = streamer.AddTexture(MIP_BYTES, FIRST_PINNED_MIP);
+    const int c = streamer.AddTexture(MIP_BYTES, FIRST_PINNED_MIP);
+    RunFrame(&streamer, 3, 1, { { b, 1, 1.0f } });
+    RunFrame(&streamer, 3, 2, { { a, 1, 1.0f } });
+    FrameResult result = RunFrame(&streamer, 3, 3, { { c, 1, 1.0f } });
+    CHECK(HasLoad(result, c, 1));
+    CHECK(result.Evictions.size() == 1 && HasEviction(result, b, 2));
+    CHECK(streamer.GetResidentMip(a) == 1);
+
+    // Evictions that still wouldn't make enough room are undone.
+    result = RunFrame(&streamer, 3, 4, { { c, 0, 1.0f } });
+    CHECK(result.Loads.empty() && result.Evictions.empty());
+    CHECK(streamer.GetResidentMip(a) == 1 && streamer.GetResidentMip(c) == 1);
+  }
+
+  void TestPinnedMipsStay() {
+    TextureStreamer streamer(0, 4);
+    const int a = streamer.AddTexture(MIP_BYTES, FIRST_PINNED_MIP);
+    const int b = streamer.AddTexture(MIP_BYTES, FIRST_PINNED_MIP);
+    CHECK(streamer.GetStats().ResidentBytes == 2 * PINNED_BYTES);
+
+    std::vector<TextureStreamer::LoadRequest> loads;
+    std::vector<TextureStreamer::Eviction> evictions;
+    streamer.RequestMip(a, 0, 1.0f);
+    streamer.Update(1, &loads, &evictions);
+    CHECK(loads.empty() && evictions.empty());
+    CHECK(streamer.GetResidentMip(a) == FIRST_PINNED_MIP);
+    CHECK(streamer.GetResidentMip(b) == FIRST_PINNED_MIP);
+  }
+
+  void TestChooseMip() {
+    CHECK(TextureStreamer::ChooseMip(1024, 1024.0f, 11) == 0);
+    CHECK(TextureStreamer::ChooseMip(1024, 2048.0f, 11) == 0);
+    CHECK(TextureStreamer::ChooseMip(1024, 512.0f, 11) == 1);
+    CHECK(TextureStreamer::ChooseMip(1024, 300.0f, 11) == 1);
+    CHECK(TextureStreamer::ChooseMip(1024, 1.0f, 11) == 10);
+    CHECK(TextureStreamer::ChooseMip(1024, 1.0f, 4) == 3);
+    CHECK(TextureStreamer::ChooseMip(1024, 0.0f, 11) == 10);
+  }
+}
+
+int main() {
+  TestStreamsOneMipAtATime();
+  TestLoadsInFlightLimit();
+  TestBudgetEviction();
+  TestLeastRecentlyUsedFirst();
+  TestPinnedMipsStay();
+  TestChooseMip();
+  return CheckResult("TextureStreamerTest");
+}
@@ -0,0 +1,282 @@
+#include "Check.h"
+#include "VertexCompression.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+  // Largest angle between a unit normal and its decoded snorm16 octahedral encoding, with margin
+  // over the ~0.0074 degrees seen on millions of random normals.
+  const float MAX_NORMAL_ERROR_DEGREES = 0.01f;
+
+  // Decoding is offset + scale * unorm / 65535 in floats, which adds a little to the half-step
+  // rounding error.
+  float Unorm16ErrorBound(float offset, float scale) {
+    return 0.5f * scale / 65535.0f + 4e-7f * (std::fabs(offset) + std::fabs(scale));
+  }
+
+  float AngleDegrees(const float a[3], const float b[3]) {
+    const double cross[3] = {
+      a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]
+    };
+    const double sine =
+        std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+    const double cosine = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    return static_cast<float>(std::atan2(sine, cosine) * (180.0 / 3.14159265358979));
+  }
+
+  void Normalize(float v[3]) {
+    const float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    for (int i = 0; i < 3; ++i)
+      v[i] /= length;
+  }
+
+  float RoundTripNormalError(const float normal[3]) {
+    int16_t encoded[2];
+    EncodeOctahedral(normal, encoded);
+    float decoded[3];
+    DecodeOctahedral(encoded, decoded);
+    return AngleDegrees(normal, decoded);
+  }
+
+  void TestAxisNormals() {
+    for (int axis = 0; axis < 3; ++axis) {
+      for (float sign : { 1.0f, -1.0f }) {
+        float normal[3] = { 0.0f, 0.0f, 0.0f };
+        normal[axis] = sign;
+        int16_t encoded[2];
+        EncodeOctahedral(normal, encoded);
+        float decoded[3];
+        DecodeOctahedral(encoded, decoded);
+        // The octahedron's corners are exactly representable.
+        for (int i = 0; i < 3; ++i)
+          CHECK(decoded[i] == normal[i]);
+      }
+    }
+  }
+
+  void TestFoldSeams() {
+    // The equator, where the lower hemisphere starts being folded, approached from both sides.
+    for (int step = 0; step < 3600; ++step) {
+      const float angle = step * (2.0f * 3.14159265f / 3600.0f);
+      for (float z : { 0.0f, 1e-4f, -1e-4f, 1e-2f, -1e-2f }) {
+        float normal[3] = { std::cos(angle), std::sin(angle), z };
+        Normalize(normal);
+        CHECK(RoundTripNormalError(normal) <= MAX_NORMAL_ERROR_DEGREES);
+      }
+    }
+
+    // The folded lower hemisphere's x = 0 and y = 0 planes, where the sign of the other
+    // coordinate flips the fold to the opposite edge of the square.
+    for (int step = 1; step < 1000; ++step) {
+      const float z = -step / 1000.0f;
+      const float r = std::sqrt(1.0f - z * z);
+      for (float offset : { 0.0f, 1e-5f, -1e-5f, 1e-3f, -1e-3f }) {
+        for (float sign : { 1.0f, -1.0f }) {
+          float alongY[3] = { offset, sign * r, z };
+          Normalize(alongY);
+          CHECK(RoundTripNormalError(alongY) <= MAX_NORMAL_ERROR_DEGREES);
+          float alongX[3] = { sign * r, offset, z };
+          Normalize(alongX);
+          CHECK(RoundTripNormalError(alongX) <= MAX_NORMAL_ERROR_DEGREES);
+        }
+      }
+    }
+  }
+
+  void TestRandomNormals() {
+    std::mt19937 random(1);
+    std::normal_distribution<float> gaussian;
+    float worst = 0.0f;
+    for (int i = 0; i < 200000; ++i) {
+      float normal[3] = { gaussian(random), gaussian(random), gaussian(random) };
+      Normalize(normal);
+      const float error = RoundTripNormalError(normal);
+      worst = error > worst ? error : worst;
+    }
+    CHECK(worst <= MAX_NORMAL_ERROR_DEGREES);
+  }
+
+  void TestZeroNormal() {
+    const float zero[3] = { 0.0f, 0.0f, 0.0f };
+    int16_t encoded[2] = { 1, 1 };
+    EncodeOctahedral(zero, encoded);
+    CHECK(encoded[0] == 0 && encoded[1] == 0);
+  }
+
+  FloatVertex MakeVertex(float x, float y, float z, float u, float v) {
+    FloatVertex vertex = { { x, y, z }, { 0.0f, 1.0f, 0.0f }, { u, v } };
+    return vertex;
+  }
+
+  void TestPositionsAndTexCoords() {
+    std::mt19937 random(2);
+    std::uniform_real_distribution<float> position(-37.5f, 120.0f);
+    std::uniform_real_distribution<float> texC(-2.0f, 6.0f);
+    std::vector<FloatVertex> vertices;
+    // The range endpoints on every axis.
+    vertices.push_back(MakeVertex(-37.5f, -37.5f, -37.5f, -2.0f, -2.0f));
+    vertices.push_back(MakeVertex(120.0f, 120.0f, 120.0f, 6.0f, 6.0f));
+    for (int i = 0; i < 10000; ++i) {
+      vertices.push_back(
+          MakeVertex(position(random), position(random), position(random), texC(random),
+                     texC(random)));
+    }
+
+    const VertexQuantization quantization =
+        ComputeVertexQuantization(vertices.data(), vertices.size());
+    for (int i = 0; i < 3; ++i) {
+      CHECK(quantization.PosOffset[i] == -37.5f);
+      CHECK(quantization.PosScale[i] == 157.5f);
+    }
+    for (int i = 0; i < 2; ++i) {
+      CHECK(quantization.TexCOffset[i] == -2.0f);
+      CHECK(quantization.TexCScale[i] == 8.0f);
+    }
+
+    std::vector<CompressedVertex> compressed(vertices.size());
+    CompressVertices(vertices.data(), vertices.size(), quantization, compressed.data());
+
+    // The endpoints map to the ends of the unorm range and decode back exactly.
+    for (int i = 0; i < 3; ++i) {
+      CHECK(compressed[0].Pos[i] == 0);
+      CHECK(compressed[1].Pos[i] == 65535);
+    }
+    for (int i = 0; i < 2; ++i) {
+      CHECK(compressed[0].TexC[i] == 0);
+      CHECK(compressed[1].TexC[i] == 65535);
+    }
+    const FloatVertex low = DecompressVertex(compressed[0], quantization);
+    const FloatVertex high = DecompressVertex(compressed[1], quantization);
+    for (int i = 0; i < 3; ++i) {
+      CHECK(low.Pos[i] == -37.5f);
+      CHECK(high.Pos[i] == 120.0f);
+    }
+    for (int i = 0; i < 2; ++i) {
+      CHECK(low.TexC[i] == -2.0f);
+      CHECK(high.TexC[i] == 6.0f);
+    }
+
+    const float positionBound = Unorm16ErrorBound(-37.5f, 157.5f);
+    const float texCBound = Unorm16ErrorBound(-2.0f, 8.0f);
+    for (size_t v = 0; v < vertices.size(); ++v) {
+      const FloatVertex decoded = DecompressVertex(compressed[v], quantization);
+      for (int i = 0; i < 3; ++i)
+        CHECK_NEAR(decoded.Pos[i], vertices[v].Pos[i], positionBound);
+      for (int i = 0; i < 2; ++i)
+        CHECK_NEAR(decoded.TexC[i], vertices[v].TexC[i], texCBound);
+    }
+
+    const VertexCompressionError error = MeasureCompressionError(
+        vertices.data(), compressed.data(), vertices.size(), quantization);
+    CHECK(error.MaxPositionError <= std::sqrt(3.0f) * positionBound);
+    CHECK(error.MaxTexCError <= texCBound);
+    CHECK(error.MaxNormalErrorDegrees <= MAX_NORMAL_ERROR_DEGREES);
+  }
+
+  void TestDegenerateRanges() {
+    // A flat mesh: every vertex shares y and v, so those ranges have zero extent.
+    std::vector<FloatVertex> vertices;
+    vertices.push_back(MakeVertex(0.0f, 2.5f, -1.0f, 0.0f, 0.75f));
+    vertices.push_back(MakeVertex(4.0f, 2.5f, -1.0f, 1.0f, 0.75f));
+    vertices.push_back(MakeVertex(4.0f, 2.5f, 3.0f, 0.5f, 0.75f));
+
+    const VertexQuantization quantization =
+        ComputeVertexQuantization(vertices.data(), vertices.size());
+    CHECK(quantization.PosScale[1] == 0.0f);
+    CHECK(quantization.TexCScale[1] == 0.0f);
+
+    std::vector<CompressedVertex> compressed(vertices.size());
+    CompressVertices(vertices.data(), vertices.size(), quantization, compressed.data());
+    for (size_t v = 0; v < vertices.size(); ++v) {
+      CHECK(compressed[v].Pos[1] == 0);
+      CHECK(compressed[v].TexC[1] == 0);
+      const FloatVertex decoded = DecompressVertex(compressed[v], quantization);
+      CHECK(decoded.Pos[1] == 2.5f);
+      CHECK(decoded.TexC[1] == 0.75f);
+    }
+
+    // A single vertex has no extent at all and comes back exactly.
+    const FloatVertex single = MakeVertex(-3.25f, 8.0f, 0.125f, 0.5f, -0.5f);
+    const VertexQuantization point = ComputeVertexQuantization(&single, 1);
+    CompressedVertex packed;
+    CompressVertices(&single, 1, point, &packed);
+    const FloatVertex unpacked = DecompressVertex(packed, point);
+    for (int i = 0; i < 3; ++i)
+      CHECK(unpacked.Pos[i] == single.Pos[i]);
+    for (int i = 0; i < 2; ++i)
+      CHECK(unpacked.TexC[i] == single.TexC[i]);
+
+    // No vertices at all gives an empty range instead of FLT_MAX.
+    const VertexQuantization empty = ComputeVertexQuantization(&single, 0);
+    CHECK(empty.PosOffset[0] == 0.0f && empty.PosScale[0] == 0.0f);
+  }
+
+  void TestOutOfRangeClamps() {
+    FloatVertex vertices[2] = {
+      MakeVertex(0.0f, 0.0f, 0.0f, 0.0f, 0.0f), MakeVertex(1.0f, 1.0f, 1.0f, 1.0f, 1.0f)
+    };
+    const VertexQuantization quantization = ComputeVertexQuantization(vertices, 2);
+    const FloatVertex outside[2] = {
+      MakeVertex(-5.0f, -5.0f, -5.0f, -5.0f, -5.0f), MakeVertex(5.0f, 5.0f, 5.0f, 5.0f, 5.0f)
+    };
+    CompressedVertex compressed[2];
+    CompressVertices(outside, 2, quantization, compressed);
+    for (int i = 0; i < 3; ++i) {
+      CHECK(compressed[0].Pos[i] == 0);
+      CHECK(compressed[1].Pos[i] == 65535);
+    }
+    for (int i = 0; i < 2; ++i) {
+      CHECK(compressed[0].TexC[i] == 0);
+      CHECK(compressed[1].TexC[i] == 65535);
+    }
+  }
+
+  void TestFloatPositions() {
+    // Far enough out that unorm16s over the range would be off by several hundredths.
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> position(-2000.0f, 3000.0f);
+    std::uniform_real_distribution<float> texC(0.0f, 40.0f);
+    std::vector<FloatVertex> vertices;
+    for (int i = 0; i < 1000; ++i) {
+      vertices.push_back(
+          MakeVertex(position(random), position(random), position(random), texC(random),
+                     texC(random)));
+    }
+    VertexQuantization quantization = ComputeVertexQuantization(vertices.data(), vertices.size());
+    std::vector<CompressedVertex> compressed(vertices.size());
+    CompressVertices(vertices.data(), vertices.size(), quantization, compressed.data());
+    CHECK(MeasureCompressionError(vertices.data(), compressed.data(), vertices.size(),
+                                  quantization).MaxPositionError > 0.01f);
+
+    // Positions come through untouched; the rest is encoded exactly as in the 16-byte vertex.
+    KeepFloatPositions(&quantization);
+    std::vector<FloatPositionVertex> floatPositions(vertices.size());
+    CompressVertices(vertices.data(), vertices.size(), quantization, floatPositions.data());
+    for (size_t v = 0; v < vertices.size(); ++v) {
+      for (int i = 0; i < 3; ++i) {
+        CHECK(floatPositions[v].Pos[i] == vertices[v].Pos[i]);
+        // What the shader's DecodePosition does with them.
+        CHECK(quantization.PosOffset[i] + quantization.PosScale[i] * floatPositions[v].Pos[i] ==
+              vertices[v].Pos[i]);
+      }
+      for (int i = 0; i < 2; ++i) {
+        CHECK(floatPositions[v].Normal[i] == compressed[v].Normal[i]);
+        CHECK(floatPositions[v].TexC[i] == compressed[v].TexC[i]);
+      }
+    }
+  }
+}
+
+int main() {
+  TestAxisNormals();
+  TestFoldSeams();
+  TestRandomNormals();
+  TestZeroNormal();
+  TestPositionsAndTexCoords();
+  TestDegenerateRanges();
+  TestOutOfRangeClamps();
+  TestFloatPositions();
+  return CheckResult("VertexCompressionTest");
+}
@@ -0,0 +1,673 @@
+#include "CellGraph.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <thread>
+#include <unordered_set>
+
+#include "WorkerThreads.h"
+
+namespace {
+  // Lines that only graze an opening's end still count as going through it, within this much of
+  // the (unit) ray and plane.
+  const double STAB_EPSILON = 1e-7;
+
+  // Vertices this close to a triangle's edge, relative to its squared length, are on it.
+  const double COLLINEAR_EPSILON = 1e-9;
+
+  // How far outside a cell FindCell still finds a point, in the floor plan's units.
+  const double FIND_CELL_TOLERANCE = 1e-4;
+
+  // Buckets per cell in the lookup grid, and the most buckets along either side.
+  const float GRID_BUCKETS_PER_CELL = 2.0f;
+  const int MAX_GRID_SIDE = 1024;
+
+  uint64_t EdgeKey(uint32_t a, uint32_t b) {
+    return (static_cast<uint64_t>(a) << 32) | b;
+  }
+
+  // Twice the signed area of abc; positive if counterclockwise.
+  double Cross(const PolygonPoint& a, const PolygonPoint& b, const PolygonPoint& c) {
+    return (static_cast<double>(b.x) - a.x) * (static_cast<double>(c.y) - a.y) -
+        (static_cast<double>(b.y) - a.y) * (static_cast<double>(c.x) - a.x);
+  }
+
+  void AppendWords(std::vector<uint8_t>* out, const void* words, size_t bytes) {
+    const uint8_t* begin = static_cast<const uint8_t*>(words);
+    out->insert(out->end(), begin, begin + bytes);
+  }
+
+  // Reads what AppendWords wrote, failing rather than reading past the end.
+  class WordReader {
+  public:
+    WordReader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+    bool Read(void* words, size_t bytes) {
+      if (bytes > mSize - mOffset)
+        return false;
+      memcpy(words, mData + mOffset, bytes);
+      mOffset += bytes;
+      return true;
+    }
+
+    template <typename T>
+    bool ReadArray(std::vector<T>* values, uint32_t count) {
+      if (count > (mSize - mOffset) / sizeof(T))
+        return false;
+      values->resize(count);
+      return Read(values->data(), count * sizeof(T));
+    }
+
+    bool AtEnd() const { return mOffset == mSize; }
+
+  private:
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mOffset = 0;
+  };
+
+  struct Vec3 {
+    double x, y, z;
+  };
+
+  Vec3 Cross3(const Vec3& a, const Vec3& b) {
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+  }
+
+  double Dot3(const Vec3& a, const Vec3& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+  }
+
+  double Length3(const Vec3& a) {
+    return std::sqrt(Dot3(a, a));
+  }
+
+  Vec3 Normalize3(const Vec3& a) {
+    const double length = Length3(a);
+    return Vec3{ a.x / length, a.y / length, a.z / length };
+  }
+
+  // Follows chains of openings out of one cell, keeping those a single line can go through.
+  //
+  // A line is w = (nx, ny, c), with the points p where (p, 1) . w > 0 on its left.  Going through
+  // an opening from A to B (counterclockwise around the cell being left), B must be on the left
+  // and A on the right: (B, 1) . w >= 0 and -(A, 1) . w >= 0.  The lines through a chain are a
+  // convex cone of w, kept as the unit rays along its edges, in order around it.  Each opening
+  // clips the cone by its two planes, like Sutherland-Hodgman clips a polygon, and the chain is
+  // over when nothing is left.
+  //
+  // The first opening's two planes alone make a wedge around the line along the opening, which
+  // has no edge rays, so it's cut in two along that line and the halves are clipped separately.
+  class VisibilitySearch {
+  public:
+    VisibilitySearch(const std::vector<CellGraph::Cell>& cells, int source, size_t maxChains)
+        : mCells(cells), mSource(source), mMaxChains(maxChains), mOnChain(cells.size(), false),
+          mVisible(cells.size(), false) {
+      // Work relative to the source cell so the planes aren't dominated by where the level is in
+      // the world.
+      const std::vector<PolygonPoint>& ring = cells[source].Ring;
+      for (const PolygonPoint& point : ring) {
+        mOriginX += static_cast<double>(point.x) / ring.size();
+        mOriginY += static_cast<double>(point.y) / ring.size();
+      }
+      mVisible[source] = true;
+      mOnChain[source] = true;
+      Visit(source, 0);
+    }
+
+    bool GaveUp() const { return mGaveUp; }
+    size_t GetChains() const { return mChains; }
+    const std::vector<bool>& GetVisible() const { return mVisible; }
+
+  private:
+    struct Cone {
+      std::vector<Vec3> Halves[2];
+    };
+
+    // mCones[depth] is the cone of lines through the chain that reached cell.
+    void Visit(int cell, size_t depth) {
+      if (mCones.size() < depth + 2)
+        mCones.resize(depth + 2);
+      for (const CellGraph::Opening& opening : mCells[cell].Openings) {
+        if (mOnChain[opening.Neighbor])
+          continue;
+        if (mChains >= mMaxChains) {
+          mGaveUp = true;
+          return;
+        }
+        ++mChains;
+
+        const Vec3 left = { opening.B.x - mOriginX, opening.B.y - mOriginY, 1.0 };
+        const Vec3 right = { mOriginX - opening.A.x, mOriginY - opening.A.y, -1.0 };
+        Cone& cone = mCones[depth + 1];
+        if (cell == mSource) {
+          if (!GetFirstCone(left, right, &cone))
+            continue;
+        } else {
+          for (int half = 0; half < 2; ++half) {
+            ClipCone(mCones[depth].Halves[half], Normalize3(left), &mScratch);
+            ClipCone(mScratch, Normalize3(right), &cone.Halves[half]);
+          }
+        }
+        if (cone.Halves[0].empty() && cone.Halves[1].empty())
+          continue;
+
+        mVisible[opening.Neighbor] = true;
+        mOnChain[opening.Neighbor] = true;
+        Visit(opening.Neighbor, depth + 1);
+        mOnChain[opening.Neighbor] = false;
+        if (mGaveUp)
+          return;
+      }
+    }
+
+    // The wedge of the planes left and right, as the two halves either side of the plane at
+    // right angles to its edge; three rays each.  False if the opening has no length.
+    static bool GetFirstCone(const Vec3& left, const Vec3& right, Cone* cone) {
+      const Vec3 edge = Cross3(left, right);
+      if (Length3(edge) == 0.0)
+        return false;
+      for (int half = 0; half < 2; ++half) {
+        const double sign = (half == 0 ? 1.0 : -1.0);
+        const Vec3 planes[3] = { left, right, Vec3{ sign * edge.x, sign * edge.y, sign * edge.z } };
+        std::vector<Vec3>& rays = cone->Halves[half];
+        rays.clear();
+        for (int i = 0; i < 3; ++i) {
+          Vec3 ray = Cross3(planes[(i + 1) % 3], planes[(i + 2) % 3]);
+          if (Dot3(ray, planes[i]) < 0.0)
+            ray = Vec3{ -ray.x, -ray.y, -ray.z };
+          rays.push_back(Normalize3(ray));
+        }
+      }
+      return true;
+    }
+
+    // The part of in on the positive side of plane, within STAB_EPSILON; plane is unit length.
+    static void ClipCone(const std::vector<Vec3>& in, const Vec3& plane, std::vector<Vec3>* out) {
+      out->clear();
+      for (size_t i = 0; i < in.size(); ++i) {
+        const Vec3& a = in[i];
+        const Vec3& b = in[(i + 1) % in.size()];
+        const double da = Dot3(plane, a);
+        const double db = Dot3(plane, b);
+        if (da >= -STAB_EPSILON)
+          out->push_back(a);
+        if ((da >= -STAB_EPSILON) != (db >= -STAB_EPSILON)) {
+          const double t = da / (da - db);
+          out->push_back(Normalize3(Vec3{ a.x + t * (b.x - a.x), a.y + t * (b.y - a.y),
+                                          a.z + t * (b.z - a.z) }));
+        }
+      }
+    }
+
+    const std::vector<CellGraph::Cell>& mCells;
+    const int mSource;
+    const size_t mMaxChains;
+    double mOriginX = 0.0;
+    double mOriginY = 0.0;
+    std::vector<Cone> mCones;
+    std::vector<Vec3> mScratch;
+    std::vector<bool> mOnChain;
+    std::vector<bool> mVisible;
+    size_t mChains = 0;
+    bool mGaveUp = false;
+  };
+}
+
+bool CellGraph::Build(const std::vector<std::vector<PolygonPoint>>& polygons) {
+  const auto start = std::chrono::steady_clock::now();
+  Clear();
+
+  std::vector<uint32_t> indices;
+  if (!TriangulatePolygons(polygons, &indices))
+    return false;
+  mStats.Triangles = indices.size() / 3;
+
+  BuildCells(polygons, indices);
+  BuildGrid();
+
+  // Each cell's search only reads the others and writes its own VisibleCells, so the cells are
+  // shared out among threads.
+  int threadCount = static_cast<int>(std::thread::hardware_concurrency());
+  threadCount = std::max(1, std::min(threadCount, GetCellCount()));
+  std::vector<Stats> threadStats(threadCount);
+  WorkerThreads threads(threadCount);
+  threads.Run([&](int threadIndex) {
+    for (int cell = threadIndex; cell < GetCellCount(); cell += threadCount)
+      BuildVisibleCells(cell, &threadStats[threadIndex]);
+  });
+  for (const Stats& stats : threadStats) {
+    mStats.VisiblePairs += stats.VisiblePairs;
+    mStats.Chains += stats.Chains;
+    mStats.CellsGivenUp += stats.CellsGivenUp;
+  }
+
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  mStats.BuildSeconds = elapsed.count();
+  return true;
+}
+
+void CellGraph::Clear() {
+  mCells.clear();
+  mGridWidth = 0;
+  mGridHeight = 0;
+  mGridStart.clear();
+  mGridCells.clear();
+  mStats = Stats();
+}
+
+// A header of counts, then for each cell the sizes of its arrays, its bounds and the arrays.
+void CellGraph::Save(std::vector<uint8_t>* out) const {
+  const uint64_t header[4] = { mCells.size(), mStats.Triangles, mStats.Chains,
+                               mStats.CellsGivenUp };
+  AppendWords(out, header, sizeof(header));
+  for (const Cell& cell : mCells) {
+    const uint32_t sizes[4] = {
+        static_cast<uint32_t>(cell.Ring.size()), static_cast<uint32_t>(cell.Openings.size()),
+        static_cast<uint32_t>(cell.Walls.size()), static_cast<uint32_t>(cell.VisibleCells.size()) };
+    AppendWords(out, sizes, sizeof(sizes));
+    AppendWords(out, &cell.BoundsMin, sizeof(PolygonPoint));
+    AppendWords(out, &cell.BoundsMax, sizeof(PolygonPoint));
+    AppendWords(out, cell.Ring.data(), cell.Ring.size() * sizeof(PolygonPoint));
+    AppendWords(out, cell.Openings.data(), cell.Openings.size() * sizeof(Opening));
+    AppendWords(out, cell.Walls.data(), cell.Walls.size() * sizeof(Wall));
+    AppendWords(out, cell.VisibleCells.data(), cell.VisibleCells.size() * sizeof(int));
+  }
+}
+
+bool CellGraph::Load(const uint8_t* data, size_t size) {
+  static_assert(sizeof(Opening) == sizeof(int) + 4 * sizeof(float), "Opening must be packed.");
+  const auto start = std::chrono::steady_clock::now();
+  Clear();
+
+  WordReader reader(data, size);
+  uint64_t header[4];
+  // Every cell takes at least its sizes and bounds.
+  const size_t minCellBytes = 4 * sizeof(uint32_t) + 2 * sizeof(PolygonPoint);
+  if (!reader.Read(header, sizeof(header)) || header[0] > size / minCellBytes)
+    return false;
+  mCells.resize(static_cast<size_t>(header[0]));
+  bool valid = true;
+  for (Cell& cell : mCells) {
+    uint32_t sizes[4];
+    valid = reader.Read(sizes, sizeof(sizes)) &&
+            reader.Read(&cell.BoundsMin, sizeof(PolygonPoint)) &&
+            reader.Read(&cell.BoundsMax, sizeof(PolygonPoint)) &&
+            reader.ReadArray(&cell.Ring, sizes[0]) && reader.ReadArray(&cell.Openings, sizes[1]) &&
+            reader.ReadArray(&cell.Walls, sizes[2]) &&
+            reader.ReadArray(&cell.VisibleCells, sizes[3]);
+    if (!valid)
+      break;
+    for (const Opening& opening : cell.Openings)
+      valid = valid && opening.Neighbor >= 0 && opening.Neighbor < GetCellCount();
+    for (int visible : cell.VisibleCells)
+      valid = valid && visible >= 0 && visible < GetCellCount();
+    if (!valid)
+      break;
+    mStats.Openings += cell.Openings.size();
+    mStats.VisiblePairs += cell.VisibleCells.size();
+  }
+  if (!valid || !reader.AtEnd()) {
+    Clear();
+    return false;
+  }
+
+  mStats.Triangles = static_cast<size_t>(header[1]);
+  mStats.Cells = mCells.size();
+  mStats.Openings /= 2;
+  mStats.Chains = static_cast<size_t>(header[2]);
+  mStats.CellsGivenUp = static_cast<size_t>(header[3]);
+  BuildGrid();
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  mStats.BuildSeconds = elapsed.count();
+  return true;
+}
+
+// Hertel-Mehlhorn.  Pieces start as the triangles and are found by their directed edges; the
+// diagonal a-b is the edge a->b of one piece and b->a of the other.
+void CellGraph::BuildCells(const std::vector<std::vector<PolygonPoint>>& polygons,
+                           const std::vector<uint32_t>& indices) {
+  std::vector<PolygonPoint> points;
+  std::unordered_set<uint64_t> polygonEdges;
+  for (const std::vector<PolygonPoint>& polygon : polygons) {
+    const uint32_t first = static_cast<uint32_t>(points.size());
+    const uint32_t count = static_cast<uint32_t>(polygon.size());
+    for (uint32_t i = 0; i < count; ++i)
+      polygonEdges.insert(EdgeKey(first + i, first + (i + 1) % count));
+    points.insert(points.end(), polygon.begin(), polygon.end());
+  }
+
+  std::unordered_set<uint64_t> triangleEdges;
+  for (size_t t = 0; t < indices.size(); t += 3) {
+    for (int k = 0; k < 3; ++k)
+      triangleEdges.insert(EdgeKey(indices[t + k], indices[t + (k + 1) % 3]));
+  }
+
+  // The triangulator drops vertices that end up on a straight line without a triangle of their
+  // own, so a triangle's edge can run past one, against two edges on the other side.  Such edges
+  // get those vertices back, so both sides match up.
+  std::vector<uint32_t> pointsByX(points.size());
+  for (uint32_t i = 0; i < points.size(); ++i)
+    pointsByX[i] = i;
+  std::sort(pointsByX.begin(), pointsByX.end(),
+            [&](uint32_t l, uint32_t r) { return points[l].x < points[r].x; });
+
+  std::vector<std::vector<uint32_t>> pieces(indices.size() / 3);
+  std::vector<std::pair<double, uint32_t>> between;
+  for (size_t t = 0; t < pieces.size(); ++t) {
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t u = indices[3 * t + k];
+      const uint32_t v = indices[3 * t + (k + 1) % 3];
+      pieces[t].push_back(u);
+      if (triangleEdges.count(EdgeKey(v, u)) || polygonEdges.count(EdgeKey(u, v)))
+        continue;
+
+      const PolygonPoint& pu = points[u];
+      const PolygonPoint& pv = points[v];
+      const double dx = static_cast<double>(pv.x) - pu.x;
+      const double dy = static_cast<double>(pv.y) - pu.y;
+      const double lengthSq = dx * dx + dy * dy;
+      const PolygonPoint lowX = { std::min(pu.x, pv.x), 0.0f };
+      const PolygonPoint highX = { std::max(pu.x, pv.x), 0.0f };
+      const auto byX = [&](uint32_t l, const PolygonPoint& r) { return points[l].x < r.x; };
+      auto w = std::lower_bound(pointsByX.begin(), pointsByX.end(), lowX, byX);
+      between.clear();
+      for (; w != pointsByX.end() && points[*w].x <= highX.x; ++w) {
+        const PolygonPoint& pw = points[*w];
+        if (std::fabs(Cross(pu, pv, pw)) > COLLINEAR_EPSILON * lengthSq)
+          continue;
+        const double along = ((pw.x - pu.x) * dx + (pw.y - pu.y) * dy) / lengthSq;
+        if (along > 0.0 && along < 1.0)
+          between.push_back(std::make_pair(along, *w));
+      }
+      std::sort(between.begin(), between.end());
+      for (const auto& vertex : between)
+        pieces[t].push_back(vertex.second);
+    }
+  }
+
+  std::unordered_map<uint64_t, int> edgePieces;
+  for (size_t t = 0; t < pieces.size(); ++t) {
+    const std::vector<uint32_t>& ring = pieces[t];
+    for (size_t k = 0; k < ring.size(); ++k)
+      edgePieces.emplace(EdgeKey(ring[k], ring[(k + 1) % ring.size()]), static_cast<int>(t));
+  }
+
+  struct Diagonal {
+    uint32_t A, B;
+    double LengthSq;
+  };
+  std::vector<Diagonal> diagonals;
+  for (const auto& edge : edgePieces) {
+    const uint32_t a = static_cast<uint32_t>(edge.first >> 32);
+    const uint32_t b = static_cast<uint32_t>(edge.first);
+    if (a < b && edgePieces.count(EdgeKey(b, a))) {
+      const double dx = static_cast<double>(points[b].x) - points[a].x;
+      const double dy = static_cast<double>(points[b].y) - points[a].y;
+      diagonals.push_back({ a, b, dx * dx + dy * dy });
+    }
+  }
+  // Longest first, so the openings left over tend to be the short ones; ties by index so the
+  // cells don't depend on the hash map's order.
+  std::sort(diagonals.begin(), diagonals.end(), [](const Diagonal& l, const Diagonal& r) {
+    if (l.LengthSq != r.LengthSq)
+      return l.LengthSq > r.LengthSq;
+    return l.A != r.A ? l.A < r.A : l.B < r.B;
+  });
+
+  std::vector<int> vertexStamps(points.size(), -1);
+  std::vector<uint32_t> merged;
+  int stamp = 0;
+  for (const Diagonal& diagonal : diagonals) {
+    const uint32_t a = diagonal.A;
+    const uint32_t b = diagonal.B;
+    const int p = edgePieces[EdgeKey(a, b)];
+    const int q = edgePieces[EdgeKey(b, a)];
+    if (p == q)
+      continue;
+    const std::vector<uint32_t>& ringP = pieces[p];
+    const std::vector<uint32_t>& ringQ = pieces[q];
+    const size_t sizeP = ringP.size();
+    const size_t sizeQ = ringQ.size();
+    size_t i = 0;
+    while (!(ringP[i] == a && ringP[(i + 1) % sizeP] == b))
+      ++i;
+    size_t j = 0;
+    while (!(ringQ[j] == b && ringQ[(j + 1) % sizeQ] == a))
+      ++j;
+
+    // Both ends must stay convex.
+    const PolygonPoint& pa = points[a];
+    const PolygonPoint& pb = points[b];
+    if (Cross(points[ringP[(i + sizeP - 1) % sizeP]], pa, points[ringQ[(j + 2) % sizeQ]]) < 0.0 ||
+        Cross(points[ringQ[(j + sizeQ - 1) % sizeQ]], pb, points[ringP[(i + 2) % sizeP]]) < 0.0)
+      continue;
+
+    // b, around P to a, then around Q back to just before b.  Bridges to holes reuse a vertex,
+    // and a piece that went around one twice wouldn't be a simple polygon.
+    ++stamp;
+    merged.clear();
+    bool repeats = false;
+    for (size_t k = 0; k < sizeP; ++k) {
+      const uint32_t v = ringP[(i + 1 + k) % sizeP];
+      vertexStamps[v] = stamp;
+      merged.push_back(v);
+    }
+    for (size_t k = 2; k < sizeQ; ++k) {
+      const uint32_t v = ringQ[(j + k) % sizeQ];
+      if (vertexStamps[v] == stamp)
+        repeats = true;
+      vertexStamps[v] = stamp;
+      merged.push_back(v);
+    }
+    if (repeats)
+      continue;
+
+    edgePieces.erase(EdgeKey(a, b));
+    edgePieces.erase(EdgeKey(b, a));
+    for (size_t k = 0; k < sizeQ; ++k) {
+      const uint64_t key = EdgeKey(ringQ[k], ringQ[(k + 1) % sizeQ]);
+      auto edge = edgePieces.find(key);
+      if (edge != edgePieces.end())
+        edge->second = p;
+    }
+    pieces[p].swap(merged);
+    pieces[q].clear();
+  }
+
+  // The pieces left are the cells.
+  std::vector<int> pieceCells(pieces.size(), -1);
+  for (size_t p = 0; p < pieces.size(); ++p) {
+    if (!pieces[p].empty()) {
+      pieceCells[p] = static_cast<int>(mCells.size());
+      mCells.push_back(Cell());
+    }
+  }
+  for (size_t p = 0; p < pieces.size(); ++p) {
+    const std::vector<uint32_t>& ring = pieces[p];
+    if (ring.empty())
+      continue;
+    Cell& cell = mCells[pieceCells[p]];
+    cell.BoundsMin = points[ring[0]];
+    cell.BoundsMax = points[ring[0]];
+    for (size_t k = 0; k < ring.size(); ++k) {
+      const PolygonPoint& u = points[ring[k]];
+      const PolygonPoint& v = points[ring[(k + 1) % ring.size()]];
+      cell.Ring.push_back(u);
+      cell.BoundsMin.x = std::min(cell.BoundsMin.x, u.x);
+      cell.BoundsMin.y = std::min(cell.BoundsMin.y, u.y);
+      cell.BoundsMax.x = std::max(cell.BoundsMax.x, u.x);
+      cell.BoundsMax.y = std::max(cell.BoundsMax.y, u.y);
+
+      auto neighbor = edgePieces.find(EdgeKey(ring[(k + 1) % ring.size()], ring[k]));
+      if (neighbor != edgePieces.end()) {
+        cell.Openings.push_back({ pieceCells[neighbor->second], u, v });
+        ++mStats.Openings;
+      } else {
+        cell.Walls.push_back({ u, v });
+      }
+    }
+  }
+  mStats.Openings /= 2;
+  mStats.Cells = mCells.size();
+}
+
+void CellGraph::BuildGrid() {
+  if (mCells.empty())
+    return;
+
+  PolygonPoint gridMax = mCells[0].BoundsMax;
+  mGridMin = mCells[0].BoundsMin;
+  for (const Cell& cell : mCells) {
+    mGridMin.x = std::min(mGridMin.x, cell.BoundsMin.x);
+    mGridMin.y = std::min(mGridMin.y, cell.BoundsMin.y);
+    gridMax.x = std::max(gridMax.x, cell.BoundsMax.x);
+    gridMax.y = std::max(gridMax.y, cell.BoundsMax.y);
+  }
+  const float width = gridMax.x - mGridMin.x;
+  const float height = gridMax.y - mGridMin.y;
+  const float buckets = GRID_BUCKETS_PER_CELL * mCells.size();
+  mGridCellSize = std::sqrt(std::max(width * height, 1e-12f) / buckets);
+  mGridCellSize = std::max(mGridCellSize, std::max(width, height) / MAX_GRID_SIDE);
+  if (!(mGridCellSize > 0.0f))
+    mGridCellSize = 1.0f;
+  mGridWidth = std::min(MAX_GRID_SIDE, static_cast<int>(width / mGridCellSize) + 1);
+  mGridHeight = std::min(MAX_GRID_SIDE, static_cast<int>(height / mGridCellSize) + 1);
+
+  // Count the cells in each bucket, then fill the buckets in.
+  mGridStart.assign(mGridWidth * mGridHeight + 1, 0);
+  for (int pass = 0; pass < 2; ++pass) {
+    std::vector<uint32_t> cursors;
+    if (pass == 1) {
+      for (size_t b = 1; b < mGridStart.size(); ++b)
+        mGridStart[b] += mGridStart[b - 1];
+      mGridCells.resize(mGridStart.back());
+      cursors.assign(mGridStart.begin(), mGridStart.end() - 1);
+    }
+    for (int c = 0; c < GetCellCount(); ++c) {
+      int x0, y0, x1, y1;
+      GetBucketRange(mCells[c].BoundsMin, mCells[c].BoundsMax, &x0, &y0, &x1, &y1);
+      for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+          const int bucket = y * mGridWidth + x;
+          if (pass == 0)
+            ++mGridStart[bucket + 1];
+          else
+            mGridCells[cursors[bucket]++] = c;
+        }
+      }
+    }
+  }
+}
+
+// The buckets the box overlaps, clamped to the grid; empty (x0 > x1 or y0 > y1) if it misses.
+void CellGraph::GetBucketRange(PolygonPoint boundsMin, PolygonPoint boundsMax, int* x0, int* y0,
+                               int* x1, int* y1) const {
+  *x0 = std::max(0, static_cast<int>(std::floor((boundsMin.x - mGridMin.x) / mGridCellSize)));
+  *y0 = std::max(0, static_cast<int>(std::floor((boundsMin.y - mGridMin.y) / mGridCellSize)));
+  *x1 = std::min(mGridWidth - 1,
+                 static_cast<int>(std::floor((boundsMax.x - mGridMin.x) / mGridCellSize)));
+  *y1 = std::min(mGridHeight - 1,
+                 static_cast<int>(std::floor((boundsMax.y - mGridMin.y) / mGridCellSize)));
+}
+
+void CellGraph::BuildVisibleCells(int source, Stats* stats) {
+  const VisibilitySearch search(mCells, source, MAX_PVS_CHAINS_PER_CELL);
+  stats->Chains += search.GetChains();
+
+  std::vector<bool> visible = search.GetVisible();
+  if (search.GaveUp()) {
+    // Everything connected to the source, which is at least as much as it could see.
+    ++stats->CellsGivenUp;
+    std::vector<int> stack(1, source);
+    while (!stack.empty()) {
+      const int cell = stack.back();
+      stack.pop_back();
+      for (const Opening& opening : mCells[cell].Openings) {
+        if (!visible[opening.Neighbor]) {
+          visible[opening.Neighbor] = true;
+          stack.push_back(opening.Neighbor);
+        }
+      }
+    }
+  }
+
+  std::vector<int>& cells = mCells[source].VisibleCells;
+  cells.clear();
+  for (int cell = 0; cell < GetCellCount(); ++cell) {
+    if (visible[cell])
+      cells.push_back(cell);
+  }
+  stats->VisiblePairs += cells.size();
+}
+
+int CellGraph::FindCell(float x, float y) const {
+  if (mCells.empty())
+    return -1;
+  const PolygonPoint point = { x, y };
+  int x0, y0, x1, y1;
+  GetBucketRange(point, point, &x0, &y0, &x1, &y1);
+  if (x0 > x1 || y0 > y1)
+    return -1;
+
+  const int bucket = y0 * mGridWidth + x0;
+  for (uint32_t k = mGridStart[bucket]; k < mGridStart[bucket + 1]; ++k) {
+    const Cell& cell = mCells[mGridCells[k]];
+    if (x < cell.BoundsMin.x || x > cell.BoundsMax.x || y < cell.BoundsMin.y ||
+        y > cell.BoundsMax.y)
+      continue;
+    bool inside = true;
+    for (size_t i = 0; i < cell.Ring.size() && inside; ++i) {
+      const PolygonPoint& u = cell.Ring[i];
+      const PolygonPoint& v = cell.Ring[(i + 1) % cell.Ring.size()];
+      const double length = std::hypot(static_cast<double>(v.x) - u.x,
+                                       static_cast<double>(v.y) - u.y);
+      inside = Cross(u, v, point) >= -FIND_CELL_TOLERANCE * length;
+    }
+    if (inside)
+      return mGridCells[k];
+  }
+  return -1;
+}
+
+void CellGraph::GatherCellsInBounds(PolygonPoint boundsMin, PolygonPoint boundsMax,
+                                    std::vector<int>* cells) const {
+  if (mCells.empty())
+    return;
+  int x0, y0, x1, y1;
+  GetBucketRange(boundsMin, boundsMax, &x0, &y0, &x1, &y1);
+
+  const size_t first = cells->size();
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      const int bucket = y * mGridWidth + x;
+      for (uint32_t k = mGridStart[bucket]; k < mGridStart[bucket + 1]; ++k) {
+        const Cell& cell = mCells[mGridCells[k]];
+        if (cell.BoundsMax.x < boundsMin.x || cell.BoundsMin.x > boundsMax.x ||
+            cell.BoundsMax.y < boundsMin.y || cell.BoundsMin.y > boundsMax.y)
+          continue;
+        cells->push_back(mGridCells[k]);
+      }
+    }
+  }
+  std::sort(cells->begin() + first, cells->end());
+  cells->erase(std::unique(cells->begin() + first, cells->end()), cells->end());
+}
+
+void CellGraph::MarkVisibleFromBounds(PolygonPoint boundsMin, PolygonPoint boundsMax,
+                                      std::vector<bool>* visible) const {
+  visible->assign(mCells.size(), false);
+  std::vector<int> cells;
+  GatherCellsInBounds(boundsMin, boundsMax, &cells);
+  if (cells.empty()) {
+    visible->assign(mCells.size(), true);
+    return;
+  }
+  for (int cell : cells) {
+    for (int seen : mCells[cell].VisibleCells)
+      (*visible)[seen] = true;
+  }
+}
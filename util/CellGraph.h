@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PolygonTriangulator.h"
+
+// Splits a floor plan into convex cells joined by openings, and precomputes which cells can see
+// which (the potentially visible set, PVS), so drawing and collision can skip the parts of a large
+// level that can't matter from where the camera or a moving sphere is.
+//
+// Cells come from the floor plan's triangulation with Hertel-Mehlhorn: diagonals are removed,
+// longest first, wherever the two pieces they separate still make a convex polygon.  Each
+// remaining diagonal is an opening between two cells; every other edge of a cell is a wall of the
+// floor plan.
+//
+// The floor plan has one floor and one ceiling height, so whatever can be seen in 3D can be seen
+// in its XZ projection, and visibility is worked out in 2D.  A cell can see another if a line
+// crosses every opening of some chain of cells from one to the other (Teller's stabbing-line
+// test).  Chains are followed depth first from each cell, on as many threads as there are cores;
+// a cell with more than MAX_PVS_CHAINS_PER_CELL chains to follow gives up and sees every cell
+// it's connected to.
+
+const size_t MAX_PVS_CHAINS_PER_CELL = 1 << 16;
+
+class CellGraph {
+public:
+  // An edge shared with Neighbor; A to B goes counterclockwise around this cell.
+  struct Opening {
+    int Neighbor;
+    PolygonPoint A;
+    PolygonPoint B;
+  };
+
+  // An edge of the floor plan's polygons, with the floor on its left.
+  struct Wall {
+    PolygonPoint A;
+    PolygonPoint B;
+  };
+
+  struct Cell {
+    std::vector<PolygonPoint> Ring;         // Convex, counterclockwise
+    std::vector<Opening> Openings;
+    std::vector<Wall> Walls;
+    PolygonPoint BoundsMin;
+    PolygonPoint BoundsMax;
+    std::vector<int> VisibleCells;          // Ascending; includes the cell itself
+  };
+
+  struct Stats {
+    size_t Triangles = 0;
+    size_t Cells = 0;
+    size_t Openings = 0;                    // Each counted once, not once per side
+    size_t VisiblePairs = 0;                // Sum of all cells' VisibleCells sizes
+    size_t Chains = 0;                      // Stabbing-line tests made
+    size_t CellsGivenUp = 0;                // Ran out of chains; see everything connected
+    double BuildSeconds = 0.0;
+  };
+
+  // Replaces the cells with polygons', which use Room's and TriangulatePolygons' convention: the
+  // floor is on the left of every edge.  Returns false, leaving no cells, if the polygons couldn't
+  // be triangulated cleanly.
+  bool Build(const std::vector<std::vector<PolygonPoint>>& polygons);
+  void Clear();
+
+  bool Empty() const { return mCells.empty(); }
+  int GetCellCount() const { return static_cast<int>(mCells.size()); }
+  const Cell& GetCell(int cell) const { return mCells[cell]; }
+
+  // The cell (x, y) is in or on the edge of, or -1 if it's outside all of them.
+  int FindCell(float x, float y) const;
+
+  // Appends, once each, the cells whose bounds overlap the box [boundsMin, boundsMax].
+  void GatherCellsInBounds(PolygonPoint boundsMin, PolygonPoint boundsMax,
+                           std::vector<int>* cells) const;
+
+  // Sets (*visible)[c] for every cell c that might be seen from somewhere in the box
+  // [boundsMin, boundsMax], resizing visible to GetCellCount() first.  Sets them all if the box
+  // touches no cell.
+  void MarkVisibleFromBounds(PolygonPoint boundsMin, PolygonPoint boundsMax,
+                             std::vector<bool>* visible) const;
+
+  const Stats& GetStats() const { return mStats; }
+
+  // Appends the cells to out in a flat form Load reads back, so they can be built once and stored
+  // with the floor plan (see RoomBinary.h).  The layout is the machine's own, in 4-byte words.
+  void Save(std::vector<uint8_t>* out) const;
+  // Replaces the cells with ones Save wrote.  Returns false, leaving no cells, if data isn't
+  // something Save could have written.
+  bool Load(const uint8_t* data, size_t size);
+
+private:
+  void BuildCells(const std::vector<std::vector<PolygonPoint>>& polygons,
+                  const std::vector<uint32_t>& indices);
+  void BuildGrid();
+  void GetBucketRange(PolygonPoint boundsMin, PolygonPoint boundsMax, int* x0, int* y0, int* x1,
+                      int* y1) const;
+  void BuildVisibleCells(int source, Stats* stats);
+
+  std::vector<Cell> mCells;
+
+  // Uniform grid over the cells' bounds, for FindCell and GatherCellsInBounds.  Each bucket lists
+  // the cells whose bounds overlap it.
+  PolygonPoint mGridMin = { 0.0f, 0.0f };
+  float mGridCellSize = 1.0f;
+  int mGridWidth = 0;
+  int mGridHeight = 0;
+  std::vector<uint32_t> mGridStart;          // mGridWidth * mGridHeight + 1 offsets into mGridCells
+  std::vector<int> mGridCells;
+
+  Stats mStats;
+};
@@ -0,0 +1,305 @@
+#include "D3D12TextureStreamer.h"
+
+#include <algorithm>
+
+using Microsoft::WRL::ComPtr;
+
+namespace {
+  // Width or height of a mip.  (windows.h's max macro gets in the way of std::max here.)
+  uint32_t MipSize(uint32_t size, int mip) {
+    size >>= mip;
+    return size > 0 ? size : 1;
+  }
+}
+
+D3D12TextureStreamer::D3D12TextureStreamer(
+    ID3D12Device* device, uint64_t budgetBytes, int maxLoadsInFlight)
+  : mDevice(device),
+    mStreamer(budgetBytes, maxLoadsInFlight) {
+  mLoadThread = std::thread(&D3D12TextureStreamer::LoadThreadMain, this);
+}
+
+D3D12TextureStreamer::~D3D12TextureStreamer() {
+  {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    mQuit = true;
+  }
+  mLoadCondition.notify_all();
+  mLoadThread.join();
+}
+
+int D3D12TextureStreamer::AddTexture(const std::wstring& path, uint32_t minResidentSize) {
+  std::unique_ptr<StreamedTexture> texture = std::make_unique<StreamedTexture>();
+  texture->File = std::make_unique<MappedFile>(path);
+  const DdsTexture& dds = texture->Dds;
+  ThrowIfFailed(DdsParseResultToHresult(
+      ParseDds(texture->File->GetData(), texture->File->GetSize(), &texture->Dds)));
+  if (dds.Dimension != DDS_DIMENSION_TEXTURE2D)
+    ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED));
+
+  // The most detailed mip no larger than minResidentSize is the first one pinned.
+  const int mipLevels = static_cast<int>(dds.MipLevels);
+  int firstPinnedMip = 0;
+  while (firstPinnedMip < mipLevels - 1 &&
+         (MipSize(dds.Width, firstPinnedMip) > minResidentSize ||
+          MipSize(dds.Height, firstPinnedMip) > minResidentSize))
+    ++firstPinnedMip;
+
+  // Every texture created has one of these mips as its mip 0, which must be a whole number of
+  // blocks for block-compressed formats (whose rows are fewer than their texel rows).  Textures
+  // that don't halve evenly that far are kept fully resident instead.
+  const bool blockCompressed = dds.Subresources[0].NumRows < dds.Height;
+  for (int mip = 1; blockCompressed && mip <= firstPinnedMip; ++mip) {
+    if ((dds.Width >> mip) % 4 != 0 || (dds.Height >> mip) % 4 != 0) {
+      firstPinnedMip = 0;
+      break;
+    }
+  }
+
+  std::vector<uint64_t> mipBytes(mipLevels, 0);
+  for (size_t i = 0; i < dds.Subresources.size(); ++i) {
+    const DdsSubresource& subresource = dds.Subresources[i];
+    mipBytes[i % mipLevels] += static_cast<uint64_t>(subresource.SliceBytes) * subresource.Depth;
+  }
+
+  // Reading the file and creating the resources doesn't need the lock.
+  PendingCopy copy;
+  copy.OldResidentMip = mipLevels;
+  copy.NewResource = CreateTexture(dds, firstPinnedMip);
+  copy.NewResidentMip = firstPinnedMip;
+  copy.Data = CreateUpload(*texture, firstPinnedMip, mipLevels - firstPinnedMip);
+  texture->Resource = copy.NewResource;
+  texture->ResidentMip = firstPinnedMip;
+
+  std::lock_guard<std::mutex> lock(mMutex);
+  const int index = mStreamer.AddTexture(mipBytes, firstPinnedMip);
+  assert(index == static_cast<int>(mTextures.size()));
+  mTextures.push_back(std::move(texture));
+  copy.Texture = index;
+  mPendingCopies.push_back(std::move(copy));
+  return index;
+}
+
+void D3D12TextureStreamer::RequestSize(int texture, float screenPixels, float priority) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  const DdsTexture& dds = mTextures[texture]->Dds;
+  const uint32_t size = dds.Width > dds.Height ? dds.Width : dds.Height;
+  const int mip = TextureStreamer::ChooseMip(size, screenPixels, static_cast<int>(dds.MipLevels));
+  mStreamer.RequestMip(texture, mip, priority);
+}
+
+void D3D12TextureStreamer::Update(uint64_t frame, uint64_t completedFenceValue) {
+  std::vector<CompletedLoad> completedLoads;
+  std::vector<TextureStreamer::LoadRequest> loads;
+  {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    if (mLoadException != nullptr)
+      std::rethrow_exception(mLoadException);
+    completedLoads.swap(mCompletedLoads);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(), [=](const Retired& retired) {
+      return retired.FenceValue <= completedFenceValue;
+    }), mRetired.end());
+
+    for (CompletedLoad& load : completedLoads) {
+      Replace(load.Texture, load.Mip, std::move(load.Data));
+      mStreamer.OnLoadComplete(load.Texture, load.Mip);
+    }
+
+    std::vector<TextureStreamer::Eviction> evictions;
+    mStreamer.Update(frame, &loads, &evictions);
+    for (const TextureStreamer::Eviction& eviction : evictions)
+      Replace(eviction.Texture, eviction.ResidentMip, Upload());
+  }
+
+  if (!loads.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(mLoadMutex);
+      mLoadQueue.insert(mLoadQueue.end(), loads.begin(), loads.end());
+    }
+    mLoadCondition.notify_one();
+  }
+}
+
+void D3D12TextureStreamer::RecordCopies(ID3D12GraphicsCommandList* cmdList, uint64_t fenceValue) {
+  std::lock_guard<std::mutex> lock(mMutex);
+  if (mPendingCopies.empty())
+    return;
+
+  // Old textures are PIXEL_SHADER_RESOURCE (they were the new ones of an earlier call) and new
+  // ones COPY_DEST, so all the barriers of each kind can go in one call.
+  std::vector<D3D12_RESOURCE_BARRIER> barriers;
+  for (const PendingCopy& copy : mPendingCopies) {
+    if (copy.OldResource != nullptr) {
+      barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(copy.OldResource.Get(),
+          D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_SOURCE));
+    }
+  }
+  if (!barriers.empty())
+    cmdList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+
+  barriers.clear();
+  for (PendingCopy& copy : mPendingCopies) {
+    const DdsTexture& dds = mTextures[copy.Texture]->Dds;
+    const int mipLevels = static_cast<int>(dds.MipLevels);
+    const int newMipLevels = mipLevels - copy.NewResidentMip;
+    const int oldMipLevels = mipLevels - copy.OldResidentMip;
+    for (UINT slice = 0; slice < dds.ArraySize; ++slice) {
+      for (int mip = copy.NewResidentMip; mip < mipLevels; ++mip) {
+        CD3DX12_TEXTURE_COPY_LOCATION dst(copy.NewResource.Get(),
+                                          (mip - copy.NewResidentMip) + slice * newMipLevels);
+        if (copy.OldResource != nullptr && mip >= copy.OldResidentMip) {
+          CD3DX12_TEXTURE_COPY_LOCATION src(copy.OldResource.Get(),
+                                            (mip - copy.OldResidentMip) + slice * oldMipLevels);
+          cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+        } else {
+          const Upload& data = copy.Data;
+          assert(mip >= data.FirstMip && mip < data.FirstMip + data.MipCount);
+          CD3DX12_TEXTURE_COPY_LOCATION src(data.Buffer.Get(),
+              data.Footprints[(mip - data.FirstMip) + slice * data.MipCount]);
+          cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+        }
+      }
+    }
+    barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(copy.NewResource.Get(),
+        D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+
+    if (copy.OldResource != nullptr)
+      mRetired.push_back({ copy.OldResource, fenceValue });
+    if (copy.Data.Buffer != nullptr)
+      mRetired.push_back({ copy.Data.Buffer, fenceValue });
+  }
+  cmdList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+  mPendingCopies.clear();
+}
+
+ID3D12Resource* D3D12TextureStreamer::GetResource(int texture) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  return mTextures[texture]->Resource.Get();
+}
+
+void D3D12TextureStreamer::CreateSrv(int texture, D3D12_CPU_DESCRIPTOR_HANDLE handle) const {
+  std::lock_guard<std::mutex> lock(mMutex);
+  const StreamedTexture& streamed = *mTextures[texture];
+  D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+  srvDesc.Format = static_cast<DXGI_FORMAT>(streamed.Dds.Format);
+  srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+  srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+  srvDesc.Texture2D.MostDetailedMip = 0;
+  srvDesc.Texture2D.MipLevels = streamed.Dds.MipLevels - streamed.ResidentMip;
+  srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+  mDevice->CreateShaderResourceView(streamed.Resource.Get(), &srvDesc, handle);
+}
+
+ComPtr<ID3D12Resource> D3D12TextureStreamer::CreateTexture(const DdsTexture& dds, int residentMip) {
+  D3D12_RESOURCE_DESC texDesc = CD3DX12_RESOURCE_DESC::Tex2D(
+      static_cast<DXGI_FORMAT>(dds.Format), MipSize(dds.Width, residentMip),
+      MipSize(dds.Height, residentMip), static_cast<UINT16>(dds.ArraySize),
+      static_cast<UINT16>(dds.MipLevels - residentMip));
+  ComPtr<ID3D12Resource> texture;
+  ThrowIfFailed(mDevice->CreateCommittedResource(
+      &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE, &texDesc,
+      D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&texture)));
+  return texture;
+}
+
+D3D12TextureStreamer::Upload D3D12TextureStreamer::CreateUpload(
+    const StreamedTexture& texture, int firstMip, int mipCount) {
+  const DdsTexture& dds = texture.Dds;
+  D3D12_RESOURCE_DESC texDesc = CD3DX12_RESOURCE_DESC::Tex2D(
+      static_cast<DXGI_FORMAT>(dds.Format), MipSize(dds.Width, firstMip),
+      MipSize(dds.Height, firstMip), static_cast<UINT16>(dds.ArraySize),
+      static_cast<UINT16>(mipCount));
+
+  Upload upload;
+  upload.FirstMip = firstMip;
+  upload.MipCount = mipCount;
+  const UINT numSubresources = mipCount * dds.ArraySize;
+  upload.Footprints.resize(numSubresources);
+  std::vector<UINT> numRows(numSubresources);
+  UINT64 uploadSize = 0;
+  mDevice->GetCopyableFootprints(&texDesc, 0, numSubresources, 0, upload.Footprints.data(),
+                                 numRows.data(), nullptr, &uploadSize);
+
+  ThrowIfFailed(mDevice->CreateCommittedResource(
+      &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
+      &CD3DX12_RESOURCE_DESC::Buffer(uploadSize), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+      IID_PPV_ARGS(&upload.Buffer)));
+
+  uint8_t* mapped = nullptr;
+  CD3DX12_RANGE readRange(0, 0);
+  ThrowIfFailed(upload.Buffer->Map(0, &readRange, reinterpret_cast<void**>(&mapped)));
+  for (UINT slice = 0; slice < dds.ArraySize; ++slice) {
+    for (int mip = 0; mip < mipCount; ++mip) {
+      const UINT i = mip + slice * mipCount;
+      const DdsSubresource& subresource = dds.Subresources[firstMip + mip + slice * dds.MipLevels];
+      const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = upload.Footprints[i];
+      const size_t rowPitch = footprint.Footprint.RowPitch;
+      CopyDdsSubresource(texture.File->GetData(), subresource, mapped + footprint.Offset,
+                         rowPitch, rowPitch * numRows[i]);
+    }
+  }
+  upload.Buffer->Unmap(0, nullptr);
+  return upload;
+}
+
+// Called with mMutex held.
+void D3D12TextureStreamer::Replace(int texture, int residentMip, Upload data) {
+  StreamedTexture& streamed = *mTextures[texture];
+  ComPtr<ID3D12Resource> resource = CreateTexture(streamed.Dds, residentMip);
+
+  // If the texture was already replaced since the last RecordCopies, the texture in between was
+  // never used, so copy straight from the one before it.
+  auto pending = std::find_if(mPendingCopies.begin(), mPendingCopies.end(),
+      [=](const PendingCopy& copy) { return copy.Texture == texture; });
+  if (pending != mPendingCopies.end()) {
+    pending->NewResource = resource;
+    pending->NewResidentMip = residentMip;
+    if (data.Buffer != nullptr)
+      pending->Data = std::move(data);
+  } else {
+    PendingCopy copy;
+    copy.Texture = texture;
+    copy.OldResource = streamed.Resource;
+    copy.OldResidentMip = streamed.ResidentMip;
+    copy.NewResource = resource;
+    copy.NewResidentMip = residentMip;
+    copy.Data = std::move(data);
+    mPendingCopies.push_back(std::move(copy));
+  }
+  streamed.Resource = resource;
+  streamed.ResidentMip = residentMip;
+}
+
+void D3D12TextureStreamer::LoadThreadMain() {
+  for (;;) {
+    TextureStreamer::LoadRequest request;
+    {
+      std::unique_lock<std::mutex> lock(mLoadMutex);
+      mLoadCondition.wait(lock, [this] { return mQuit || !mLoadQueue.empty(); });
+      if (mQuit)
+        return;
+      request = mLoadQueue.front();
+      mLoadQueue.pop_front();
+    }
+
+    // The file and its layout never change once added, so they're read without any lock.
+    const StreamedTexture* texture;
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      texture = mTextures[request.Texture].get();
+    }
+    try {
+      Upload data = CreateUpload(*texture, request.Mip, 1);
+      std::lock_guard<std::mutex> lock(mLoadMutex);
+      mCompletedLoads.push_back({ request.Texture, request.Mip, std::move(data) });
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mLoadMutex);
+      mLoadException = std::current_exception();
+      return;
+    }
+  }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "d3dUtil.h"
+#include "MappedDdsTexture.h"
+#include "TextureStreamer.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Streams the mips of DDS textures in and out of GPU memory as a TextureStreamer decides.  Each
+// file stays mapped; AddTexture uploads only its smallest mips, and higher mips are copied out of
+// the mapping into upload buffers by a background thread, one mip (of every array slice) per load.
+//
+// Residency changes by recreating the texture with a different number of mips and copying the
+// mips it keeps from the old one, so views must be recreated (with CreateSrv) whenever
+// GetResource changes.  Old textures and upload buffers are released once the GPU has passed the
+// fence value given to RecordCopies.
+//
+// AddTexture may be called from several threads at once; everything else must be called from the
+// thread that renders.
+class D3D12TextureStreamer {
+public:
+  D3D12TextureStreamer(ID3D12Device* device, uint64_t budgetBytes, int maxLoadsInFlight);
+  ~D3D12TextureStreamer();
+
+  D3D12TextureStreamer(const D3D12TextureStreamer&) = delete;
+  D3D12TextureStreamer& operator=(const D3D12TextureStreamer&) = delete;
+
+  // Maps the file and creates its texture with the mips no larger than minResidentSize texels
+  // across resident; they stay resident.  The copies are recorded by the next RecordCopies.
+  // Throws a DxException if the file can't be read or isn't a 2D DDS texture.
+  int AddTexture(const std::wstring& path, uint32_t minResidentSize);
+
+  // Asks for the texture to be sharp when drawn screenPixels pixels across, with the given
+  // priority.  Lasts for the current frame only.
+  void RequestSize(int texture, float screenPixels, float priority);
+
+  // Ends the frame's requests.  Releases what the GPU is done with, turns finished loads and the
+  // scheduler's evictions into new textures, and starts the next loads.
+  void Update(uint64_t frame, uint64_t completedFenceValue);
+
+  // Records the copies into textures created since the last call and their transitions to
+  // PIXEL_SHADER_RESOURCE.  fenceValue must be signaled after cmdList has executed.
+  void RecordCopies(ID3D12GraphicsCommandList* cmdList, uint64_t fenceValue);
+
+  ID3D12Resource* GetResource(int texture) const;
+  void CreateSrv(int texture, D3D12_CPU_DESCRIPTOR_HANDLE handle) const;
+
+  const TextureStreamer::Stats& GetStats() const { return mStreamer.GetStats(); }
+
+private:
+  struct StreamedTexture {
+    std::unique_ptr<MappedFile> File;
+    DdsTexture Dds;
+    Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+    int ResidentMip;        // Mip 0 of Resource
+  };
+
+  // Texels for mips [FirstMip, FirstMip + MipCount) of every array slice, laid out for
+  // CopyTextureRegion.
+  struct Upload {
+    Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+    int FirstMip = 0;
+    int MipCount = 0;
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> Footprints;
+  };
+
+  struct CompletedLoad {
+    int Texture;
+    int Mip;
+    Upload Data;
+  };
+
+  // A texture replaced by one holding mips [NewResidentMip..]: mips the old one has are copied from
+  // it, the rest from the upload.
+  struct PendingCopy {
+    int Texture;
+    Microsoft::WRL::ComPtr<ID3D12Resource> OldResource;
+    int OldResidentMip;
+    Microsoft::WRL::ComPtr<ID3D12Resource> NewResource;
+    int NewResidentMip;
+    Upload Data;
+  };
+
+  struct Retired {
+    Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+    uint64_t FenceValue;
+  };
+
+  Microsoft::WRL::ComPtr<ID3D12Resource> CreateTexture(const DdsTexture& dds, int residentMip);
+  Upload CreateUpload(const StreamedTexture& texture, int firstMip, int mipCount);
+  void Replace(int texture, int residentMip, Upload data);
+  void LoadThreadMain();
+
+  ID3D12Device* mDevice;
+
+  // Guards mTextures' size, mStreamer, mPendingCopies and mRetired while AddTexture may be
+  // running.
+  mutable std::mutex mMutex;
+  std::vector<std::unique_ptr<StreamedTexture>> mTextures;
+  TextureStreamer mStreamer;
+  std::vector<PendingCopy> mPendingCopies;
+  std::vector<Retired> mRetired;
+
+  std::thread mLoadThread;
+  std::mutex mLoadMutex;
+  std::condition_variable mLoadCondition;
+  std::deque<TextureStreamer::LoadRequest> mLoadQueue;
+  std::vector<CompletedLoad> mCompletedLoads;
+  std::exception_ptr mLoadException;    // Rethrown by Update
+  bool mQuit = false;
+};
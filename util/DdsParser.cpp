@@ -0,0 +1,411 @@
+#include "DdsParser.h"
+
+#include <cstring>
+
+namespace {
+  const uint32_t DDS_MAGIC = 0x20534444;   // "DDS "
+
+  // Pixel format flags.
+  const uint32_t DDS_ALPHA = 0x00000002;
+  const uint32_t DDS_FOURCC = 0x00000004;
+  const uint32_t DDS_RGB = 0x00000040;
+  const uint32_t DDS_LUMINANCE = 0x00020000;
+
+  // Header flags and caps.
+  const uint32_t DDS_HEIGHT = 0x00000002;
+  const uint32_t DDS_HEADER_FLAGS_VOLUME = 0x00800000;
+  const uint32_t DDS_CUBEMAP = 0x00000200;
+  const uint32_t DDS_CUBEMAP_ALLFACES = 0x0000fe00;
+
+  // DDS_HEADER_DXT10 values.
+  const uint32_t DDS_RESOURCE_DIMENSION_TEXTURE1D = 2;
+  const uint32_t DDS_RESOURCE_DIMENSION_TEXTURE2D = 3;
+  const uint32_t DDS_RESOURCE_DIMENSION_TEXTURE3D = 4;
+  const uint32_t DDS_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+  // D3D12 resource limits; files claiming more than the hardware allows are rejected.
+  const uint32_t MAX_MIP_LEVELS = 15;
+  const uint32_t MAX_TEXTURE1D_SIZE = 16384;
+  const uint32_t MAX_TEXTURE2D_SIZE = 16384;
+  const uint32_t MAX_TEXTURE3D_SIZE = 2048;
+  const uint32_t MAX_ARRAY_SIZE = 2048;
+
+  struct DdsPixelFormat {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t RGBBitCount;
+    uint32_t RBitMask;
+    uint32_t GBitMask;
+    uint32_t BBitMask;
+    uint32_t ABitMask;
+  };
+
+  struct DdsHeader {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    DdsPixelFormat ddspf;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+  };
+  static_assert(sizeof(DdsHeader) == 124, "DDS_HEADER is 124 bytes.");
+
+  struct DdsHeaderDxt10 {
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+  };
+  static_assert(sizeof(DdsHeaderDxt10) == 20, "DDS_HEADER_DXT10 is 20 bytes.");
+
+  uint32_t MakeFourCC(char a, char b, char c, char d) {
+    return static_cast<uint32_t>(static_cast<uint8_t>(a)) |
+        (static_cast<uint32_t>(static_cast<uint8_t>(b)) << 8) |
+        (static_cast<uint32_t>(static_cast<uint8_t>(c)) << 16) |
+        (static_cast<uint32_t>(static_cast<uint8_t>(d)) << 24);
+  }
+
+  // DXGI_FORMAT values used below.
+  enum : uint32_t {
+    FORMAT_UNKNOWN = 0,
+    FORMAT_R32G32B32A32_FLOAT = 2,
+    FORMAT_R16G16B16A16_FLOAT = 10,
+    FORMAT_R16G16B16A16_UNORM = 11,
+    FORMAT_R16G16B16A16_SNORM = 13,
+    FORMAT_R32G32_FLOAT = 16,
+    FORMAT_R10G10B10A2_UNORM = 24,
+    FORMAT_R8G8B8A8_UNORM = 28,
+    FORMAT_R16G16_FLOAT = 34,
+    FORMAT_R16G16_UNORM = 35,
+    FORMAT_R32_FLOAT = 41,
+    FORMAT_R8G8_UNORM = 49,
+    FORMAT_R16_FLOAT = 54,
+    FORMAT_R16_UNORM = 56,
+    FORMAT_R8_UNORM = 61,
+    FORMAT_A8_UNORM = 65,
+    FORMAT_BC1_UNORM = 71,
+    FORMAT_BC2_UNORM = 74,
+    FORMAT_BC3_UNORM = 77,
+    FORMAT_BC4_UNORM = 80,
+    FORMAT_BC4_SNORM = 81,
+    FORMAT_BC5_UNORM = 83,
+    FORMAT_BC5_SNORM = 84,
+    FORMAT_B5G6R5_UNORM = 85,
+    FORMAT_B5G5R5A1_UNORM = 86,
+    FORMAT_B8G8R8A8_UNORM = 87,
+    FORMAT_B8G8R8X8_UNORM = 88,
+    FORMAT_B4G4R4A4_UNORM = 115
+  };
+
+  // Bytes per 4x4 block for block-compressed formats, 0 for everything else.
+  uint32_t BytesPerBlock(uint32_t format) {
+    if ((format >= 70 && format <= 72) || (format >= 79 && format <= 81))
+      return 8;     // BC1, BC4
+    if ((format >= 73 && format <= 78) || (format >= 82 && format <= 84) ||
+        (format >= 94 && format <= 99))
+      return 16;    // BC2, BC3, BC5, BC6H, BC7
+    return 0;
+  }
+
+  bool IsBitMask(const DdsPixelFormat& ddpf, uint32_t r, uint32_t g, uint32_t b, uint32_t a) {
+    return ddpf.RBitMask == r && ddpf.GBitMask == g && ddpf.BBitMask == b && ddpf.ABitMask == a;
+  }
+
+  // The legacy pixel formats DDSTextureLoader's GetDXGIFormat recognizes, minus the packed YUV
+  // and palettized ones.
+  uint32_t GetLegacyFormat(const DdsPixelFormat& ddpf) {
+    if (ddpf.flags & DDS_RGB) {
+      switch (ddpf.RGBBitCount) {
+      case 32:
+        if (IsBitMask(ddpf, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000))
+          return FORMAT_R8G8B8A8_UNORM;
+        if (IsBitMask(ddpf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000))
+          return FORMAT_B8G8R8A8_UNORM;
+        if (IsBitMask(ddpf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000))
+          return FORMAT_B8G8R8X8_UNORM;
+        if (IsBitMask(ddpf, 0x3ff00000, 0x000ffc00, 0x000003ff, 0xc0000000))
+          return FORMAT_R10G10B10A2_UNORM;   // D3DX writes this with R and B swapped
+        if (IsBitMask(ddpf, 0x0000ffff, 0xffff0000, 0x00000000, 0x00000000))
+          return FORMAT_R16G16_UNORM;
+        if (IsBitMask(ddpf, 0xffffffff, 0x00000000, 0x00000000, 0x00000000))
+          return FORMAT_R32_FLOAT;
+        break;
+      case 16:
+        if (IsBitMask(ddpf, 0x7c00, 0x03e0, 0x001f, 0x8000))
+          return FORMAT_B5G5R5A1_UNORM;
+        if (IsBitMask(ddpf, 0xf800, 0x07e0, 0x001f, 0x0000))
+          return FORMAT_B5G6R5_UNORM;
+        if (IsBitMask(ddpf, 0x0f00, 0x00f0, 0x000f, 0xf000))
+          return FORMAT_B4G4R4A4_UNORM;
+        break;
+      }
+    } else if (ddpf.flags & DDS_LUMINANCE) {
+      if (ddpf.RGBBitCount == 8 && IsBitMask(ddpf, 0x000000ff, 0, 0, 0))
+        return FORMAT_R8_UNORM;
+      if (ddpf.RGBBitCount == 16 && IsBitMask(ddpf, 0x0000ffff, 0, 0, 0))
+        return FORMAT_R16_UNORM;
+      if (ddpf.RGBBitCount == 16 && IsBitMask(ddpf, 0x000000ff, 0, 0, 0x0000ff00))
+        return FORMAT_R8G8_UNORM;
+    } else if (ddpf.flags & DDS_ALPHA) {
+      if (ddpf.RGBBitCount == 8)
+        return FORMAT_A8_UNORM;
+    } else if (ddpf.flags & DDS_FOURCC) {
+      const uint32_t fourCC = ddpf.fourCC;
+      if (fourCC == MakeFourCC('D', 'X', 'T', '1'))
+        return FORMAT_BC1_UNORM;
+      if (fourCC == MakeFourCC('D', 'X', 'T', '2') || fourCC == MakeFourCC('D', 'X', 'T', '3'))
+        return FORMAT_BC2_UNORM;
+      if (fourCC == MakeFourCC('D', 'X', 'T', '4') || fourCC == MakeFourCC('D', 'X', 'T', '5'))
+        return FORMAT_BC3_UNORM;
+      if (fourCC == MakeFourCC('A', 'T', 'I', '1') || fourCC == MakeFourCC('B', 'C', '4', 'U'))
+        return FORMAT_BC4_UNORM;
+      if (fourCC == MakeFourCC('B', 'C', '4', 'S'))
+        return FORMAT_BC4_SNORM;
+      if (fourCC == MakeFourCC('A', 'T', 'I', '2') || fourCC == MakeFourCC('B', 'C', '5', 'U'))
+        return FORMAT_BC5_UNORM;
+      if (fourCC == MakeFourCC('B', 'C', '5', 'S'))
+        return FORMAT_BC5_SNORM;
+
+      // D3DFORMAT values stored as the FourCC.
+      switch (fourCC) {
+      case 36:  return FORMAT_R16G16B16A16_UNORM;
+      case 110: return FORMAT_R16G16B16A16_SNORM;
+      case 111: return FORMAT_R16_FLOAT;
+      case 112: return FORMAT_R16G16_FLOAT;
+      case 113: return FORMAT_R16G16B16A16_FLOAT;
+      case 114: return FORMAT_R32_FLOAT;
+      case 115: return FORMAT_R32G32_FLOAT;
+      case 116: return FORMAT_R32G32B32A32_FLOAT;
+      }
+    }
+    return FORMAT_UNKNOWN;
+  }
+
+  void GetSurfaceInfo(uint32_t width, uint32_t height, uint32_t format, uint64_t* rowBytes,
+                      uint32_t* numRows) {
+    const uint32_t bytesPerBlock = BytesPerBlock(format);
+    if (bytesPerBlock != 0) {
+      uint64_t blocksWide = width > 0 ? (static_cast<uint64_t>(width) + 3) / 4 : 0;
+      *rowBytes = (blocksWide > 1 ? blocksWide : 1) * bytesPerBlock;
+      uint32_t blocksHigh = height > 0 ? (height + 3) / 4 : 0;
+      *numRows = blocksHigh > 1 ? blocksHigh : 1;
+    } else {
+      *rowBytes = (static_cast<uint64_t>(width) * DdsBitsPerPixel(format) + 7) / 8;
+      *numRows = height;
+    }
+  }
+}
+
+const char* DdsParseResultString(DdsParseResult result) {
+  switch (result) {
+  case DDS_OK:                return "ok";
+  case DDS_ERROR_TOO_SMALL:   return "file too small for the DDS headers";
+  case DDS_ERROR_BAD_MAGIC:   return "not a DDS file";
+  case DDS_ERROR_BAD_HEADER:  return "invalid DDS header";
+  case DDS_ERROR_UNSUPPORTED: return "unsupported DDS format or layout";
+  case DDS_ERROR_TRUNCATED:   return "DDS texel data is truncated";
+  }
+  return "unknown error";
+}
+
+uint32_t DdsBitsPerPixel(uint32_t format) {
+  switch (format) {
+  case 1: case 2: case 3: case 4:
+    return 128;
+  case 5: case 6: case 7: case 8:
+    return 96;
+  case 9: case 10: case 11: case 12: case 13: case 14:
+  case 15: case 16: case 17: case 18:
+    return 64;
+  case 23: case 24: case 25: case 26:
+  case 27: case 28: case 29: case 30: case 31: case 32:
+  case 33: case 34: case 35: case 36: case 37: case 38:
+  case 39: case 40: case 41: case 42: case 43:
+  case 67:
+  case 87: case 88: case 90: case 91: case 92: case 93:
+    return 32;
+  case 48: case 49: case 50: case 51: case 52:
+  case 53: case 54: case 55: case 56: case 57: case 58: case 59:
+  case 85: case 86: case 115:
+    return 16;
+  case 60: case 61: case 62: case 63: case 64: case 65:
+    return 8;
+  case 70: case 71: case 72: case 79: case 80: case 81:
+    return 4;
+  case 73: case 74: case 75: case 76: case 77: case 78:
+  case 82: case 83: case 84: case 94: case 95: case 96: case 97: case 98: case 99:
+    return 8;
+  }
+  return 0;
+}
+
+DdsParseResult ParseDds(const uint8_t* data, size_t size, DdsTexture* desc) {
+  if (size < sizeof(uint32_t) + sizeof(DdsHeader))
+    return DDS_ERROR_TOO_SMALL;
+
+  uint32_t magic;
+  memcpy(&magic, data, sizeof(magic));
+  if (magic != DDS_MAGIC)
+    return DDS_ERROR_BAD_MAGIC;
+
+  DdsHeader header;
+  memcpy(&header, data + sizeof(uint32_t), sizeof(header));
+  if (header.size != sizeof(DdsHeader) || header.ddspf.size != sizeof(DdsPixelFormat))
+    return DDS_ERROR_BAD_HEADER;
+
+  size_t offset = sizeof(uint32_t) + sizeof(DdsHeader);
+  uint32_t width = header.width;
+  uint32_t height = header.height;
+  uint32_t depth = header.depth;
+  uint32_t arraySize = 1;
+  uint32_t format = FORMAT_UNKNOWN;
+  bool isCubeMap = false;
+  DdsDimension dimension = DDS_DIMENSION_TEXTURE2D;
+
+  if ((header.ddspf.flags & DDS_FOURCC) && header.ddspf.fourCC == MakeFourCC('D', 'X', '1', '0')) {
+    if (size < offset + sizeof(DdsHeaderDxt10))
+      return DDS_ERROR_TOO_SMALL;
+    DdsHeaderDxt10 dxt10;
+    memcpy(&dxt10, data + offset, sizeof(dxt10));
+    offset += sizeof(DdsHeaderDxt10);
+
+    arraySize = dxt10.arraySize;
+    if (arraySize == 0)
+      return DDS_ERROR_BAD_HEADER;
+    format = dxt10.dxgiFormat;
+    if (DdsBitsPerPixel(format) == 0)
+      return DDS_ERROR_UNSUPPORTED;
+
+    switch (dxt10.resourceDimension) {
+    case DDS_RESOURCE_DIMENSION_TEXTURE1D:
+      if ((header.flags & DDS_HEIGHT) && height != 1)
+        return DDS_ERROR_BAD_HEADER;
+      height = depth = 1;
+      dimension = DDS_DIMENSION_TEXTURE1D;
+      break;
+    case DDS_RESOURCE_DIMENSION_TEXTURE2D:
+      if (dxt10.miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE) {
+        arraySize *= 6;
+        isCubeMap = true;
+      }
+      depth = 1;
+      dimension = DDS_DIMENSION_TEXTURE2D;
+      break;
+    case DDS_RESOURCE_DIMENSION_TEXTURE3D:
+      if (!(header.flags & DDS_HEADER_FLAGS_VOLUME))
+        return DDS_ERROR_BAD_HEADER;
+      if (arraySize > 1)
+        return DDS_ERROR_UNSUPPORTED;
+      dimension = DDS_DIMENSION_TEXTURE3D;
+      break;
+    default:
+      return DDS_ERROR_UNSUPPORTED;
+    }
+  } else {
+    format = GetLegacyFormat(header.ddspf);
+    if (format == FORMAT_UNKNOWN)
+      return DDS_ERROR_UNSUPPORTED;
+
+    if (header.flags & DDS_HEADER_FLAGS_VOLUME) {
+      dimension = DDS_DIMENSION_TEXTURE3D;
+    } else {
+      if (header.caps2 & DDS_CUBEMAP) {
+        if ((header.caps2 & DDS_CUBEMAP_ALLFACES) != DDS_CUBEMAP_ALLFACES)
+          return DDS_ERROR_UNSUPPORTED;
+        arraySize = 6;
+        isCubeMap = true;
+      }
+      depth = 1;
+      dimension = DDS_DIMENSION_TEXTURE2D;
+    }
+  }
+
+  uint32_t mipLevels = header.mipMapCount == 0 ? 1 : header.mipMapCount;
+  if (width == 0 || height == 0 || depth == 0 || mipLevels > MAX_MIP_LEVELS)
+    return DDS_ERROR_UNSUPPORTED;
+  switch (dimension) {
+  case DDS_DIMENSION_TEXTURE1D:
+    if (width > MAX_TEXTURE1D_SIZE || arraySize > MAX_ARRAY_SIZE)
+      return DDS_ERROR_UNSUPPORTED;
+    break;
+  case DDS_DIMENSION_TEXTURE2D:
+    if (width > MAX_TEXTURE2D_SIZE || height > MAX_TEXTURE2D_SIZE || arraySize > MAX_ARRAY_SIZE)
+      return DDS_ERROR_UNSUPPORTED;
+    break;
+  case DDS_DIMENSION_TEXTURE3D:
+    if (width > MAX_TEXTURE3D_SIZE || height > MAX_TEXTURE3D_SIZE || depth > MAX_TEXTURE3D_SIZE)
+      return DDS_ERROR_UNSUPPORTED;
+    break;
+  }
+
+  desc->Dimension = dimension;
+  desc->Format = format;
+  desc->Width = width;
+  desc->Height = height;
+  desc->Depth = depth;
+  desc->ArraySize = arraySize;
+  desc->MipLevels = mipLevels;
+  desc->IsCubeMap = isCubeMap;
+  desc->Subresources.clear();
+  desc->Subresources.reserve(static_cast<size_t>(arraySize) * mipLevels);
+
+  // Each array slice holds its whole mip chain, largest first.  Sizes are added up in 64 bits so
+  // a hostile header can't wrap them around.
+  uint64_t position = offset;
+  for (uint32_t slice = 0; slice < arraySize; ++slice) {
+    uint32_t w = width;
+    uint32_t h = height;
+    uint32_t d = depth;
+    for (uint32_t mip = 0; mip < mipLevels; ++mip) {
+      uint64_t rowBytes;
+      uint32_t numRows;
+      GetSurfaceInfo(w, h, format, &rowBytes, &numRows);
+      uint64_t sliceBytes = rowBytes * numRows;
+      uint64_t end = position + sliceBytes * d;
+      if (end > size)
+        return DDS_ERROR_TRUNCATED;
+
+      DdsSubresource subresource;
+      subresource.Offset = static_cast<size_t>(position);
+      subresource.Width = w;
+      subresource.Height = h;
+      subresource.Depth = d;
+      subresource.NumRows = numRows;
+      subresource.RowBytes = static_cast<size_t>(rowBytes);
+      subresource.SliceBytes = static_cast<size_t>(sliceBytes);
+      desc->Subresources.push_back(subresource);
+
+      position = end;
+      w = w > 1 ? w / 2 : 1;
+      h = h > 1 ? h / 2 : 1;
+      d = d > 1 ? d / 2 : 1;
+    }
+  }
+  return DDS_OK;
+}
+
+void CopyDdsSubresource(const uint8_t* fileData, const DdsSubresource& subresource,
+                        uint8_t* dst, size_t dstRowPitch, size_t dstSlicePitch) {
+  const uint8_t* src = fileData + subresource.Offset;
+  if (dstRowPitch == subresource.RowBytes && dstSlicePitch == subresource.SliceBytes) {
+    memcpy(dst, src, subresource.SliceBytes * subresource.Depth);
+    return;
+  }
+  for (uint32_t z = 0; z < subresource.Depth; ++z) {
+    const uint8_t* srcSlice = src + z * subresource.SliceBytes;
+    uint8_t* dstSlice = dst + z * dstSlicePitch;
+    for (uint32_t row = 0; row < subresource.NumRows; ++row)
+      memcpy(dstSlice + row * dstRowPitch, srcSlice + row * subresource.RowBytes,
+             subresource.RowBytes);
+  }
+}
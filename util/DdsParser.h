@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Parses a DDS file's headers in place and works out where each subresource's texels are, so the
+// texels can be copied straight out of the file (typically a memory mapping) into upload memory.
+// Formats are DXGI_FORMAT values; legacy (pre-DX10) pixel formats are translated to the DXGI
+// format DDSTextureLoader would pick, for the common uncompressed and BC formats.
+
+enum DdsParseResult {
+  DDS_OK,
+  DDS_ERROR_TOO_SMALL,           // Shorter than the magic number and headers
+  DDS_ERROR_BAD_MAGIC,           // Doesn't start with "DDS "
+  DDS_ERROR_BAD_HEADER,          // Header sizes or flags are inconsistent
+  DDS_ERROR_UNSUPPORTED,         // Valid, but a format or layout this parser doesn't handle
+  DDS_ERROR_TRUNCATED            // The texel data is shorter than the headers say
+};
+
+const char* DdsParseResultString(DdsParseResult result);
+
+// Values match D3D12_RESOURCE_DIMENSION.
+enum DdsDimension {
+  DDS_DIMENSION_TEXTURE1D = 2,
+  DDS_DIMENSION_TEXTURE2D = 3,
+  DDS_DIMENSION_TEXTURE3D = 4
+};
+
+// Where one subresource's texels are in the file, and how they're laid out.  Rows are tightly
+// packed: a row of texels (or of 4x4 blocks, for block-compressed formats) is RowBytes long and
+// the next row starts right after it.
+struct DdsSubresource {
+  size_t Offset;          // From the start of the file
+  uint32_t Width;
+  uint32_t Height;
+  uint32_t Depth;         // Slices; 1 unless the texture is 3D
+  uint32_t NumRows;       // Per slice; Height / 4 rounded up for block-compressed formats
+  size_t RowBytes;
+  size_t SliceBytes;      // RowBytes * NumRows
+};
+
+struct DdsTexture {
+  DdsDimension Dimension;
+  uint32_t Format;        // DXGI_FORMAT
+  uint32_t Width;
+  uint32_t Height;
+  uint32_t Depth;
+  uint32_t ArraySize;     // Includes the 6 faces of each cube
+  uint32_t MipLevels;
+  bool IsCubeMap;
+
+  // In D3D12 subresource order, mip + arraySlice * MipLevels, which is also the file's order.
+  std::vector<DdsSubresource> Subresources;
+};
+
+// Parses the size bytes at data.  On success, desc describes the texture and every subresource
+// lies within the data.
+DdsParseResult ParseDds(const uint8_t* data, size_t size, DdsTexture* desc);
+
+// Bits per texel of a DXGI_FORMAT this parser supports (for block-compressed formats, the
+// average), or 0 if it isn't supported.
+uint32_t DdsBitsPerPixel(uint32_t format);
+
+// Copies a subresource out of the file into a destination laid out with the given row and slice
+// pitches, as a D3D12 placed footprint in an upload buffer is.
+void CopyDdsSubresource(const uint8_t* fileData, const DdsSubresource& subresource,
+                        uint8_t* dst, size_t dstRowPitch, size_t dstSlicePitch);
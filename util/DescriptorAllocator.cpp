@@ -0,0 +1,107 @@
+#include "DescriptorAllocator.h"
+
+#include <stdexcept>
+
+namespace {
+  Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> CreateHeap(
+      ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type, UINT numDescriptors,
+      D3D12_DESCRIPTOR_HEAP_FLAGS flags) {
+    D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+    heapDesc.NumDescriptors = numDescriptors;
+    heapDesc.Type = type;
+    heapDesc.Flags = flags;
+    Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> heap;
+    ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&heap)));
+    return heap;
+  }
+}
+
+DescriptorAllocator::DescriptorAllocator(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type,
+                                         UINT persistentCapacity, UINT transientCapacity)
+  : mDevice(device),
+    mType(type),
+    mDescriptorSize(device->GetDescriptorHandleIncrementSize(type)),
+    mPersistentAllocator(persistentCapacity),
+    mPersistentGrowCount(0),
+    mTransientAllocator(transientCapacity, 1) {
+  mPersistentHeap = CreateHeap(device, type, persistentCapacity, D3D12_DESCRIPTOR_HEAP_FLAG_NONE);
+  mShaderVisibleHeap = CreateHeap(
+      device, type, transientCapacity, D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE);
+}
+
+DescriptorRange DescriptorAllocator::AllocatePersistent(UINT count) {
+  UINT offset = mPersistentAllocator.Allocate(count);
+  if (offset == RangeAllocator::kInvalidOffset) {
+    GrowPersistent(mPersistentAllocator.GetCapacity() + count);
+    offset = mPersistentAllocator.Allocate(count);
+  }
+  assert(offset != RangeAllocator::kInvalidOffset);
+
+  DescriptorRange range;
+  range.Offset = offset;
+  range.Count = count;
+  return range;
+}
+
+void DescriptorAllocator::FreePersistent(const DescriptorRange& range) {
+  // The GPU never reads the CPU-only heap, so a range can be reused as soon as it's freed.
+  mPersistentAllocator.Free(range.Offset, range.Count);
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::GetPersistentHandle(UINT offset) const {
+  return CD3DX12_CPU_DESCRIPTOR_HANDLE(
+      mPersistentHeap->GetCPUDescriptorHandleForHeapStart(), offset, mDescriptorSize);
+}
+
+DescriptorRange DescriptorAllocator::AllocateTransient(UINT count) {
+  const uint64_t offset = mTransientAllocator.Allocate(count);
+  if (offset == LinearRingAllocator::kInvalidOffset)
+    throw std::runtime_error("Transient descriptor ring is out of space.");
+
+  DescriptorRange range;
+  range.Offset = static_cast<UINT>(offset);
+  range.Count = count;
+  return range;
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE DescriptorAllocator::GetTransientGpuHandle(UINT offset) const {
+  return CD3DX12_GPU_DESCRIPTOR_HANDLE(
+      mShaderVisibleHeap->GetGPUDescriptorHandleForHeapStart(), offset, mDescriptorSize);
+}
+
+DescriptorRange DescriptorAllocator::CopyToTransient(const UINT* persistentOffsets, UINT count) {
+  DescriptorRange table = AllocateTransient(count);
+  CD3DX12_CPU_DESCRIPTOR_HANDLE dst(
+      mShaderVisibleHeap->GetCPUDescriptorHandleForHeapStart(), table.Offset, mDescriptorSize);
+  for (UINT i = 0; i < count; ++i) {
+    mDevice->CopyDescriptorsSimple(1, dst, GetPersistentHandle(persistentOffsets[i]), mType);
+    dst.Offset(1, mDescriptorSize);
+  }
+  return table;
+}
+
+void DescriptorAllocator::FinishFrame(UINT64 fenceValue) {
+  mTransientAllocator.FinishFrame(fenceValue);
+}
+
+void DescriptorAllocator::Reclaim(UINT64 completedFenceValue) {
+  mTransientAllocator.Reclaim(completedFenceValue);
+}
+
+void DescriptorAllocator::GrowPersistent(UINT minCapacity) {
+  const UINT oldCapacity = mPersistentAllocator.GetCapacity();
+  UINT capacity = oldCapacity * 2;
+  if (capacity < minCapacity)
+    capacity = minCapacity;
+
+  // Copy everything, free slots included, so the offsets of live descriptors don't change.
+  Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> heap =
+      CreateHeap(mDevice, mType, capacity, D3D12_DESCRIPTOR_HEAP_FLAG_NONE);
+  if (oldCapacity > 0) {
+    mDevice->CopyDescriptorsSimple(oldCapacity, heap->GetCPUDescriptorHandleForHeapStart(),
+                                   mPersistentHeap->GetCPUDescriptorHandleForHeapStart(), mType);
+  }
+  mPersistentHeap = heap;
+  mPersistentAllocator.Grow(capacity);
+  ++mPersistentGrowCount;
+}
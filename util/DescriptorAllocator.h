@@ -0,0 +1,66 @@
+#pragma once
+
+#include "d3dUtil.h"
+#include "LinearRingAllocator.h"
+#include "RangeAllocator.h"
+
+struct DescriptorRange {
+  UINT Offset = 0;
+  UINT Count = 0;
+};
+
+// Descriptors of one heap type, in two regions:
+//
+// Persistent descriptors live in a CPU-only heap, suballocated from a free list (RangeAllocator),
+// and are written whenever the thing they describe changes.  When the heap is full it's replaced
+// by one twice as big and the descriptors are copied over, so offsets stay valid but CPU handles
+// have to be looked up again with GetPersistentHandle.
+//
+// Transient descriptors live in a fixed-size shader-visible heap used as a ring
+// (LinearRingAllocator).  Each frame copies the persistent descriptors it binds into contiguous
+// transient tables; a frame's tables are recycled once the fence passed to FinishFrame has
+// completed.  Since the shader-visible heap never changes, nothing has to be rebuilt when
+// descriptors are added at run time.
+class DescriptorAllocator {
+public:
+  DescriptorAllocator(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type,
+                      UINT persistentCapacity, UINT transientCapacity);
+  DescriptorAllocator(const DescriptorAllocator& rhs) = delete;
+  DescriptorAllocator& operator=(const DescriptorAllocator& rhs) = delete;
+
+  // Never fails for lack of space; the persistent heap grows instead.
+  DescriptorRange AllocatePersistent(UINT count);
+  void FreePersistent(const DescriptorRange& range);
+  D3D12_CPU_DESCRIPTOR_HANDLE GetPersistentHandle(UINT offset) const;
+
+  // Throws if the ring is full, i.e. the GPU is too far behind for its size.
+  DescriptorRange AllocateTransient(UINT count);
+  D3D12_GPU_DESCRIPTOR_HANDLE GetTransientGpuHandle(UINT offset) const;
+
+  // Allocates a transient table and copies the persistent descriptors at the given offsets into
+  // it, in order.
+  DescriptorRange CopyToTransient(const UINT* persistentOffsets, UINT count);
+
+  // Everything allocated from the ring since the last call is in use until fenceValue completes.
+  void FinishFrame(UINT64 fenceValue);
+  void Reclaim(UINT64 completedFenceValue);
+
+  ID3D12DescriptorHeap* GetShaderVisibleHeap() const { return mShaderVisibleHeap.Get(); }
+  UINT GetPersistentCapacity() const { return mPersistentAllocator.GetCapacity(); }
+  UINT GetPersistentCount() const { return mPersistentAllocator.GetAllocatedCount(); }
+  UINT GetPersistentGrowCount() const { return mPersistentGrowCount; }
+
+private:
+  void GrowPersistent(UINT minCapacity);
+
+  ID3D12Device* mDevice;
+  D3D12_DESCRIPTOR_HEAP_TYPE mType;
+  UINT mDescriptorSize;
+
+  Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mPersistentHeap;
+  RangeAllocator mPersistentAllocator;
+  UINT mPersistentGrowCount;
+
+  Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mShaderVisibleHeap;
+  LinearRingAllocator mTransientAllocator;
+};
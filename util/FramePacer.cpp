@@ -0,0 +1,83 @@
+#include "FramePacer.h"
+
+FramePacer::FramePacer(PacingClock* clock, PacingFence* fence)
+  : mClock(clock),
+  mFence(fence) {
+  mFrameEndTime = mClock->Now();
+}
+
+void FramePacer::SetMinFrameTime(double seconds) {
+  mMinFrameTime = seconds;
+}
+
+double FramePacer::GetMinFrameTime() const {
+  return mMinFrameTime;
+}
+
+void FramePacer::SetSpinThreshold(double seconds) {
+  mSpinThreshold = seconds;
+}
+
+void FramePacer::WaitForGpu(uint64_t fenceValue) {
+  if (mFence->GetCompletedValue() >= fenceValue)
+    return;
+
+  double start = mClock->Now();
+  mFence->WaitForValue(fenceValue);
+  mCurrentFrame.GpuWait += mClock->Now() - start;
+}
+
+void FramePacer::OnInputSampled() {
+  mInputTime = mClock->Now();
+}
+
+void FramePacer::OnPresent() {
+  if (mInputTime >= 0.0)
+    mCurrentFrame.InputToPresent = mClock->Now() - mInputTime;
+  mInputTime = -1.0;
+}
+
+void FramePacer::EndFrame() {
+  double start = mClock->Now();
+  double target = mFrameEndTime + mMinFrameTime;
+  if (start < target) {
+    WaitUntil(target);
+    mCurrentFrame.CpuWait = mClock->Now() - start;
+  }
+
+  // Measure the next frame from now rather than from target, so a late frame doesn't make the
+  // following frames run early to catch up.
+  mFrameEndTime = mClock->Now();
+
+  mLastFrame = mCurrentFrame;
+  mStatsSum.CpuWait += mCurrentFrame.CpuWait;
+  mStatsSum.GpuWait += mCurrentFrame.GpuWait;
+  mStatsSum.InputToPresent += mCurrentFrame.InputToPresent;
+  ++mStatsCount;
+  mCurrentFrame = FramePacingStats();
+}
+
+const FramePacingStats& FramePacer::GetLastFrameStats() const {
+  return mLastFrame;
+}
+
+FramePacingStats FramePacer::TakeAverageStats() {
+  FramePacingStats average;
+  if (mStatsCount > 0) {
+    average.CpuWait = mStatsSum.CpuWait / mStatsCount;
+    average.GpuWait = mStatsSum.GpuWait / mStatsCount;
+    average.InputToPresent = mStatsSum.InputToPresent / mStatsCount;
+  }
+  mStatsSum = FramePacingStats();
+  mStatsCount = 0;
+  return average;
+}
+
+void FramePacer::WaitUntil(double time) {
+  // Sleep through most of the wait, then spin for the rest.
+  double remaining = time - mClock->Now();
+  if (remaining > mSpinThreshold)
+    mClock->Sleep(remaining - mSpinThreshold);
+  while (mClock->Now() < time) {
+  }
+}
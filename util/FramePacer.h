@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+
+// Time source used by FramePacer.  All times are in seconds.
+class PacingClock {
+public:
+  virtual ~PacingClock() = default;
+
+  virtual double Now() = 0;
+
+  // Gives up the CPU for about the given time.  May wake up late by up to the OS scheduler's
+  // granularity, which is why FramePacer spins for the last part of a wait.
+  virtual void Sleep(double seconds) = 0;
+};
+
+// GPU fence that FramePacer waits on.
+class PacingFence {
+public:
+  virtual ~PacingFence() = default;
+
+  virtual uint64_t GetCompletedValue() = 0;
+
+  // Blocks until the completed value is at least value.
+  virtual void WaitForValue(uint64_t value) = 0;
+};
+
+// Where one frame's time went, in seconds.
+struct FramePacingStats {
+  double CpuWait = 0.0;          // held back by the frame rate limiter
+  double GpuWait = 0.0;          // blocked until the GPU freed the frame resource to reuse
+  double InputToPresent = 0.0;   // from sampling input to Present returning
+};
+
+// Paces frames against the GPU and against a minimum frame time.  The frame rate limiter sleeps
+// for most of the remaining time and spins for the last SpinThreshold seconds, so frame times are
+// accurate to well under the OS sleep granularity.  All timing goes through the PacingClock and
+// PacingFence interfaces, so the policy can be exercised with a fake clock and fence.
+class FramePacer {
+public:
+  FramePacer(PacingClock* clock, PacingFence* fence);
+
+  void SetMinFrameTime(double seconds);
+  double GetMinFrameTime() const;
+
+  // Waits shorter than this are spun instead of slept.
+  void SetSpinThreshold(double seconds);
+
+  // Blocks until the GPU has finished the frame that last used the frame resource about to be
+  // reused, i.e. until the fence reaches fenceValue.
+  void WaitForGpu(uint64_t fenceValue);
+
+  // Marks the point in the frame where input is read.
+  void OnInputSampled();
+
+  // Marks the point where Present returned.
+  void OnPresent();
+
+  // Waits until at least the minimum frame time has passed since the previous EndFrame, then
+  // records the frame's stats.
+  void EndFrame();
+
+  const FramePacingStats& GetLastFrameStats() const;
+
+  // Average of the frames ended since the previous call, which starts a new average.
+  FramePacingStats TakeAverageStats();
+
+private:
+  void WaitUntil(double time);
+
+  PacingClock* mClock;
+  PacingFence* mFence;
+
+  double mMinFrameTime = 0.0;
+  double mSpinThreshold = 0.002;
+
+  double mFrameEndTime;
+  double mInputTime = -1.0;
+
+  FramePacingStats mCurrentFrame;
+  FramePacingStats mLastFrame;
+  FramePacingStats mStatsSum;
+  int mStatsCount = 0;
+};
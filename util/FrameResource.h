@@ -14,6 +14,13 @@ struct ObjectConstants
   UINT     ObjPad0;
   UINT     ObjPad1;
   UINT     ObjPad2;
+  // The mesh's VertexQuantization, for decoding its compressed vertices.
+  DirectX::XMFLOAT3 PosScale = { 1.0f, 1.0f, 1.0f };
+  float    ObjPad3;
+  DirectX::XMFLOAT3 PosOffset = { 0.0f, 0.0f, 0.0f };
+  float    ObjPad4;
+  DirectX::XMFLOAT2 TexCScale = { 1.0f, 1.0f };
+  DirectX::XMFLOAT2 TexCOffset = { 0.0f, 0.0f };
 };
 
 struct ClipPlaneConstants {
@@ -43,10 +50,14 @@ struct DirectionalLightData {
 
 struct FrameConstants
 {
-  DirectX::XMFLOAT4X4 PortalA = MathHelper::Identity4x4();
-  DirectX::XMFLOAT4X4 PortalB = MathHelper::Identity4x4();
-  DirectX::XMFLOAT3 AmbientLight = { 0.0f, 0.0f, 0.0f };
+  DirectX::XMFLOAT4 PortalAHole = { 0.0f, 0.0f, 0.0f, 0.0f };   // Center in xyz, radius in w
+  DirectX::XMFLOAT3 PortalANormal = { 0.0f, 0.0f, 1.0f };
   float FramePad0;
+  DirectX::XMFLOAT4 PortalBHole = { 0.0f, 0.0f, 0.0f, 0.0f };
+  DirectX::XMFLOAT3 PortalBNormal = { 0.0f, 0.0f, 1.0f };
+  float FramePad1;
+  DirectX::XMFLOAT3 AmbientLight = { 0.0f, 0.0f, 0.0f };
+  float FramePad2;
   DirectionalLightData Lights[NUM_LIGHTS];
 };
 
@@ -60,6 +71,7 @@ struct PhongMaterialData
   UINT MatPad2;
 };
 
+// The CPU copy of the vertices; the GPU gets them as CompressedVertex or FloatPositionVertex.
 struct Vertex
 {
   DirectX::XMFLOAT3 Pos;
@@ -74,23 +86,21 @@ struct FrameResource
 public:
 
   FrameResource(
-      ID3D12Device* device, UINT objectCount, UINT clipPlaneCount, UINT lightWorldCount,
-      UINT passCount, UINT materialCount);
+      ID3D12Device* device, UINT recordThreadCount, UINT objectCount, UINT materialCount);
   FrameResource(const FrameResource& rhs) = delete;
   FrameResource& operator=(const FrameResource& rhs) = delete;
   ~FrameResource();
 
   // We cannot reset the allocator until the GPU is done processing the commands.
-  // So each frame needs their own allocator.
-  Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+  // So each frame needs their own allocator.  Command lists are recorded on several threads at
+  // once and an allocator can only be used by one thread at a time, so there's one per thread.
+  std::vector<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> CmdListAllocs;
 
   // We cannot update a cbuffer until the GPU is done processing the commands
-  // that reference it.  So each frame needs their own cbuffers.
+  // that reference it.  So each frame needs their own cbuffers.  Only constants that are kept
+  // across frames and updated when dirty live here; constants written every frame are allocated
+  // from PortalsApp's UploadRing instead.
   UploadBuffer<ObjectConstants> ObjectCB;
-  UploadBuffer<ClipPlaneConstants> ClipPlaneCB;
-  UploadBuffer<World2Constants> World2CB;
-  UploadBuffer<PassConstants> PassCB;
-  UploadBuffer<FrameConstants> FrameCB;
   
   UploadBuffer<PhongMaterialData> MaterialBuffer;
 
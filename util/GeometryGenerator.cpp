@@ -1,16 +1,92 @@
 #include "GeometryGenerator.h"
 
+#include <unordered_map>
+
 using namespace DirectX;
 
-// Mesh only needs Position data.  
+namespace
+{
+	// Returns the index of the midpoint of edge Ai-Bi, adding it to Positions the first time the
+	// edge is seen so that the two triangles sharing it also share the vertex.
+	UINT GetMidpoint(std::vector<XMFLOAT3> &Positions, std::unordered_map<uint64_t, UINT> &Midpoints,
+		UINT Ai, UINT Bi)
+	{
+		const uint64_t Key = Ai < Bi ? (static_cast<uint64_t>(Ai) << 32) | Bi
+			: (static_cast<uint64_t>(Bi) << 32) | Ai;
+		auto It = Midpoints.find(Key);
+		if (It != Midpoints.end())
+			return It->second;
+
+		const UINT Mi = static_cast<UINT>(Positions.size());
+		Positions.push_back(0.5f * (Positions[Ai] + Positions[Bi]));
+		Midpoints.emplace(Key, Mi);
+		return Mi;
+	}
+
+	// The 12 vertices and 20 triangles of an icosahedron.
+	void GetIcosahedron(std::vector<XMFLOAT3> &Positions, std::vector<UINT> &Indices)
+	{
+		const float X = 0.525731f; 
+		const float Z = 0.850651f;
+
+		Positions.resize(12);
+		Positions[0] = XMFLOAT3(-X, 0.0f, Z);
+		Positions[1] = XMFLOAT3(X, 0.0f, Z);
+		Positions[2] = XMFLOAT3(-X, 0.0f, -Z);
+		Positions[3] = XMFLOAT3(X, 0.0f, -Z);
+		Positions[4] = XMFLOAT3(0.0f, Z, X);
+		Positions[5] = XMFLOAT3(0.0f, Z, -X);
+		Positions[6] = XMFLOAT3(0.0f, -Z, X);
+		Positions[7] = XMFLOAT3(0.0f, -Z, -X);
+		Positions[8] = XMFLOAT3(Z, X, 0.0f);
+		Positions[9] = XMFLOAT3(-Z, X, 0.0f);
+		Positions[10] = XMFLOAT3(Z, -X, 0.0f);
+		Positions[11] = XMFLOAT3(-Z, -X, 0.0f);
+
+		const UINT IndicesArray[60] = 
+		{
+			1,4,0,  4,9,0,  4,5,9,  8,5,4,  1,8,4,    
+			1,10,8, 10,3,8, 8,3,5,  3,2,5,  3,7,2,    
+			3,10,7, 10,6,7, 6,11,7, 6,0,11, 6,1,0, 
+			10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7 
+		};
+		Indices.assign(IndicesArray, IndicesArray + 60);
+	}
+
+	// Fills in Mesh's vertices from positions on the sphere of the given radius.
+	void BuildSphereVertices(GeometryGenerator::MeshData &Mesh, const std::vector<XMFLOAT3> &Positions,
+		float Radius)
+	{
+		Mesh.Vertices.resize(Positions.size());
+		for (unsigned int i=0; i<Positions.size(); ++i)
+		{
+			XMFLOAT3 PDir = XMFloat3Normalize(Positions[i]);
+
+			Mesh.Vertices[i].Position = Radius * PDir;
+			Mesh.Vertices[i].Normal = PDir;
+			
+			XMFLOAT2 TanXZ = XMFloat2Normalize(XMFloat2Left90(XMFLOAT2(PDir.x, PDir.z)));
+			Mesh.Vertices[i].Tangent = XMFLOAT3(TanXZ.x, 0.0f, TanXZ.y);
+
+			XMFLOAT2 PDirXZ = XMFLOAT2(PDir.x, PDir.z);
+			float Theta = acosf(PDir.x / XMFloat2Length(PDirXZ));
+			float Phi = acosf(PDir.y);
+			Mesh.Vertices[i].TexCoord = XMFLOAT2(Theta/(2.0f*PI), Phi/PI);
+		}
+	}
+}
+
+// Mesh only needs Position data.  Midpoints of edges shared by two triangles are added once.
 void GeometryGenerator::Tessellate(std::vector<XMFLOAT3> &Positions, std::vector<UINT> &Indices)
 {
 	size_t OldIndicesCount = Indices.size();
 
+	// Each edge of a closed mesh is shared by two triangles.
+	std::unordered_map<uint64_t, UINT> Midpoints;
+	Midpoints.reserve(OldIndicesCount / 2);
+
 	// for each triangle in the mesh, replace it with 4 triangles
-	XMFLOAT3 A, B, C;
 	UINT Ai, Bi, Ci;
-	XMFLOAT3 AB, BC, CA;
 	UINT ABi, BCi, CAi;
 	for (size_t i=0; i<OldIndicesCount; i+=3)
 	{
@@ -18,23 +94,11 @@ void GeometryGenerator::Tessellate(std::vector<XMFLOAT3> &Positions, std::vector
 		Ai = Indices[i];
 		Bi = Indices[i+1];
 		Ci = Indices[i+2];
-		A = Positions[Ai];
-		B = Positions[Bi];
-		C = Positions[Ci];
 
 		// find midpoints of each side
-		UINT CurrentVerticesCount = static_cast<UINT>(Positions.size());
-		ABi = CurrentVerticesCount;
-		BCi = CurrentVerticesCount+1;
-		CAi = CurrentVerticesCount+2;
-
-		AB = 0.5f * (A + B);
-		BC = 0.5f * (B + C);
-		CA = 0.5f * (C + A);
-		Positions.push_back(AB);
-		Positions.push_back(BC);
-		Positions.push_back(CA);
-		
+		ABi = GetMidpoint(Positions, Midpoints, Ai, Bi);
+		BCi = GetMidpoint(Positions, Midpoints, Bi, Ci);
+		CAi = GetMidpoint(Positions, Midpoints, Ci, Ai);
 
 		// update original triagle A-B-C in the indices array to A-AB-CA
 		Indices[i+1] = ABi;
@@ -61,56 +125,35 @@ void GeometryGenerator::GenerateSphere(MeshData &Mesh, float Radius, unsigned in
 	Mesh.Vertices.clear();
 	Mesh.Indices.clear();
 
-	// vertices list for an icosahedron
-	const float X = 0.525731f; 
-	const float Z = 0.850651f;
-
-	std::vector<XMFLOAT3> Positions(12);
-	Positions[0] = XMFLOAT3(-X, 0.0f, Z);
-	Positions[1] = XMFLOAT3(X, 0.0f, Z);
-	Positions[2] = XMFLOAT3(-X, 0.0f, -Z);
-	Positions[3] = XMFLOAT3(X, 0.0f, -Z);
-	Positions[4] = XMFLOAT3(0.0f, Z, X);
-	Positions[5] = XMFLOAT3(0.0f, Z, -X);
-	Positions[6] = XMFLOAT3(0.0f, -Z, X);
-	Positions[7] = XMFLOAT3(0.0f, -Z, -X);
-	Positions[8] = XMFLOAT3(Z, X, 0.0f);
-	Positions[9] = XMFLOAT3(-Z, X, 0.0f);
-	Positions[10] = XMFLOAT3(Z, -X, 0.0f);
-	Positions[11] = XMFLOAT3(-Z, -X, 0.0f);
-
-	// indices list for an icosahedron
-	UINT IndicesArray[60] = 
-	{
-		1,4,0,  4,9,0,  4,5,9,  8,5,4,  1,8,4,    
-		1,10,8, 10,3,8, 8,3,5,  3,2,5,  3,7,2,    
-		3,10,7, 10,6,7, 6,11,7, 6,0,11, 6,1,0, 
-		10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7 
-	};
-	Mesh.Indices.resize(60);
-	for (unsigned int i=0; i<60; ++i)
-		Mesh.Indices[i] = IndicesArray[i];
+	// vertices and indices for an icosahedron
+	std::vector<XMFLOAT3> Positions;
+	GetIcosahedron(Positions, Mesh.Indices);
 
 	// tesselate the triangles in Positions vector
 	for (unsigned int i=0; i<Tessellations; ++i)
 		Tessellate(Positions, Mesh.Indices);
 
-
 	// generate mesh vertices from Positions
-	Mesh.Vertices.resize(Positions.size());
-	for (unsigned int i=0; i<Positions.size(); ++i)
+	BuildSphereVertices(Mesh, Positions, Radius);
+}
+
+void GeometryGenerator::GenerateSphereLods(std::vector<MeshData> &Lods, float Radius,
+	unsigned int MaxTessellations)
+{
+	Lods.resize(MaxTessellations + 1);
+
+	// Each level is tessellated from the one before, so its first vertices are the coarser level's.
+	std::vector<XMFLOAT3> Positions;
+	std::vector<UINT> Indices;
+	GetIcosahedron(Positions, Indices);
+	for (unsigned int Tessellations=0; ; ++Tessellations)
 	{
-		XMFLOAT3 PDir = XMFloat3Normalize(Positions[i]);
-
-		Mesh.Vertices[i].Position = Radius * PDir;
-		Mesh.Vertices[i].Normal = PDir;
-		
-		XMFLOAT2 TanXZ = XMFloat2Normalize(XMFloat2Left90(XMFLOAT2(PDir.x, PDir.z)));
-		Mesh.Vertices[i].Tangent = XMFLOAT3(TanXZ.x, 0.0f, TanXZ.y);
-
-		XMFLOAT2 PDirXZ = XMFLOAT2(PDir.x, PDir.z);
-		float Theta = acosf(PDir.x / XMFloat2Length(PDirXZ));
-		float Phi = acosf(PDir.y);
-		Mesh.Vertices[i].TexCoord = XMFLOAT2(Theta/(2.0f*PI), Phi/PI);
+		MeshData &Mesh = Lods[MaxTessellations - Tessellations];
+		Mesh.Indices = Indices;
+		BuildSphereVertices(Mesh, Positions, Radius);
+
+		if (Tessellations == MaxTessellations)
+			break;
+		Tessellate(Positions, Indices);
 	}
-}
\ No newline at end of file
+}
@@ -26,6 +26,11 @@ public:
 
 	static void Tessellate(std::vector<XMFLOAT3> &Positions, std::vector<UINT> &Indices);
 	static void GenerateSphere(MeshData &Mesh, float Radius, unsigned int Tessellations);
+
+	// Spheres with MaxTessellations tessellations in Lods[0] down to the icosahedron in
+	// Lods[MaxTessellations].
+	static void GenerateSphereLods(std::vector<MeshData> &Lods, float Radius,
+		unsigned int MaxTessellations);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "LinearRingAllocator.h"
+
+#include <cassert>
+
+LinearRingAllocator::LinearRingAllocator(uint64_t capacity, uint64_t alignment)
+  : mCapacity(capacity & ~(alignment - 1)),
+  mAlignment(alignment) {
+  assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+}
+
+uint64_t LinearRingAllocator::Allocate(uint64_t size) {
+  const uint64_t alignedSize = (size + mAlignment - 1) & ~(mAlignment - 1);
+  if (alignedSize == 0 || alignedSize > mCapacity)
+    return kInvalidOffset;
+
+  // If the range would run past the end of the ring, skip the rest of the ring and start over at
+  // offset 0.  The skipped bytes are reclaimed along with the rest of the frame.
+  uint64_t offset = mHead % mCapacity;
+  const uint64_t padding = (offset + alignedSize > mCapacity) ? mCapacity - offset : 0;
+  if (GetUsedSize() + padding + alignedSize > mCapacity)
+    return kInvalidOffset;
+
+  mHead += padding;
+  offset = mHead % mCapacity;
+  mHead += alignedSize;
+  return offset;
+}
+
+void LinearRingAllocator::FinishFrame(uint64_t fenceValue) {
+  assert(mFinishedFrames.empty() || mFinishedFrames.back().FenceValue <= fenceValue);
+  mFinishedFrames.push_back({ fenceValue, mHead });
+}
+
+void LinearRingAllocator::Reclaim(uint64_t completedFenceValue) {
+  while (!mFinishedFrames.empty() && mFinishedFrames.front().FenceValue <= completedFenceValue) {
+    mTail = mFinishedFrames.front().End;
+    mFinishedFrames.pop_front();
+  }
+}
+
+uint64_t LinearRingAllocator::GetCapacity() const {
+  return mCapacity;
+}
+
+uint64_t LinearRingAllocator::GetUsedSize() const {
+  return mHead - mTail;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+// Hands out aligned ranges of a fixed-size ring buffer.  Allocations are grouped into frames: all
+// ranges allocated since the previous FinishFrame stay in use until the fence value passed to
+// FinishFrame has completed, and Reclaim then makes them available again.  This class only does
+// the bookkeeping, so it can be driven by a simulated fence as easily as by an ID3D12Fence.
+class LinearRingAllocator {
+public:
+  static const uint64_t kInvalidOffset = ~0ull;
+
+  // capacity is rounded down to a multiple of alignment, which must be a power of 2.
+  LinearRingAllocator(uint64_t capacity, uint64_t alignment);
+
+  // Returns the offset of size bytes aligned to the alignment, or kInvalidOffset if there isn't
+  // enough free contiguous space.  A range never wraps around the end of the ring.
+  uint64_t Allocate(uint64_t size);
+
+  // Ends the current frame.  Its ranges are reclaimed once fenceValue has completed.
+  void FinishFrame(uint64_t fenceValue);
+
+  // Frees the ranges of all finished frames whose fence value is <= completedFenceValue.
+  void Reclaim(uint64_t completedFenceValue);
+
+  uint64_t GetCapacity() const;
+  uint64_t GetUsedSize() const;
+
+private:
+  struct FinishedFrame {
+    uint64_t FenceValue;
+    uint64_t End;         // mHead when the frame finished
+  };
+
+  uint64_t mCapacity;
+  uint64_t mAlignment;
+
+  // Total bytes ever allocated and ever reclaimed, including padding skipped at the end of the
+  // ring.  The offset of the next allocation is mHead % mCapacity.
+  uint64_t mHead = 0;
+  uint64_t mTail = 0;
+
+  std::deque<FinishedFrame> mFinishedFrames;
+};
@@ -29,6 +29,12 @@
 #define PORTAL_BOX_DEPTH 0.02f			// the depth of the portalbox used in place of the disc when camera is too close for disc to render
 #define PORTAL_BOX_N_SIDES 16			// the portalbox will be an N-gon prism
 
+// sphere path
+#define ADAPTIVE_SUBSTEP_FEATURE_RATIO 0.5f	// a substep may sweep at most this fraction of the smallest feature near the path
+#define ADAPTIVE_SUBSTEP_MAX 16				// upper bound on the substeps a single move is split into
+#define SWEEP_BATCH_CELL_SIZE 4.0f			// batched room sweeps starting in the same cell of this size share a wall broadphase
+#define SWEEP_BATCH_CLUSTER_SIZE 32			// most sweeps that share one wall broadphase
+
 #define ITERATIVE_THRESHOLD 0.00005f		// stop solving for t when accuracy of t reaches this threshold
 #define SPHERE_INTERSECT_RING_THRESHOLD 0.001f	// used in SpherePathCollision when checking if a larger sphere already intersects the ring
 
@@ -0,0 +1,106 @@
+#include "MappedDdsTexture.h"
+
+using Microsoft::WRL::ComPtr;
+
+HRESULT DdsParseResultToHresult(DdsParseResult result) {
+  switch (result) {
+  case DDS_OK:
+    return S_OK;
+  case DDS_ERROR_UNSUPPORTED:
+    return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+  case DDS_ERROR_TOO_SMALL:
+  case DDS_ERROR_TRUNCATED:
+    return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+  default:
+    return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+  }
+}
+
+MappedFile::MappedFile(const std::wstring& path) {
+  mFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                      FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (mFile == INVALID_HANDLE_VALUE)
+    ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(mFile, &fileSize)) {
+    DWORD error = GetLastError();
+    CloseHandle(mFile);
+    ThrowIfFailed(HRESULT_FROM_WIN32(error));
+  }
+  mSize = static_cast<size_t>(fileSize.QuadPart);
+  if (mSize == 0)
+    return;   // Empty files can't be mapped; GetData stays null and ParseDds rejects them.
+
+  mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mMapping != nullptr)
+    mData = static_cast<const uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+  if (mData == nullptr) {
+    DWORD error = GetLastError();
+    if (mMapping != nullptr)
+      CloseHandle(mMapping);
+    CloseHandle(mFile);
+    ThrowIfFailed(HRESULT_FROM_WIN32(error));
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (mData != nullptr)
+    UnmapViewOfFile(mData);
+  if (mMapping != nullptr)
+    CloseHandle(mMapping);
+  CloseHandle(mFile);
+}
+
+MappedDdsTexture::MappedDdsTexture(ID3D12Device* device, const std::wstring& path) {
+  MappedFile file(path);
+  DdsTexture dds;
+  ThrowIfFailed(DdsParseResultToHresult(ParseDds(file.GetData(), file.GetSize(), &dds)));
+  if (dds.Dimension != DDS_DIMENSION_TEXTURE2D)
+    ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED));
+
+  D3D12_RESOURCE_DESC texDesc = CD3DX12_RESOURCE_DESC::Tex2D(
+      static_cast<DXGI_FORMAT>(dds.Format), dds.Width, dds.Height,
+      static_cast<UINT16>(dds.ArraySize), static_cast<UINT16>(dds.MipLevels));
+  ThrowIfFailed(device->CreateCommittedResource(
+      &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE, &texDesc,
+      D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&mTexture)));
+
+  // Lay out the upload buffer the way CopyTextureRegion wants it.
+  const UINT numSubresources = static_cast<UINT>(dds.Subresources.size());
+  mFootprints.resize(numSubresources);
+  std::vector<UINT> numRows(numSubresources);
+  std::vector<UINT64> rowBytes(numSubresources);
+  UINT64 uploadSize = 0;
+  device->GetCopyableFootprints(&texDesc, 0, numSubresources, 0, mFootprints.data(),
+                                numRows.data(), rowBytes.data(), &uploadSize);
+
+  ThrowIfFailed(device->CreateCommittedResource(
+      &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
+      &CD3DX12_RESOURCE_DESC::Buffer(uploadSize), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+      IID_PPV_ARGS(&mUploadHeap)));
+
+  // Copy each subresource from the mapping into its footprint; the GPU reads nothing back.
+  uint8_t* upload = nullptr;
+  CD3DX12_RANGE readRange(0, 0);
+  ThrowIfFailed(mUploadHeap->Map(0, &readRange, reinterpret_cast<void**>(&upload)));
+  for (UINT i = 0; i < numSubresources; ++i) {
+    const DdsSubresource& subresource = dds.Subresources[i];
+    const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = mFootprints[i];
+    assert(numRows[i] == subresource.NumRows && rowBytes[i] == subresource.RowBytes);
+    const size_t rowPitch = footprint.Footprint.RowPitch;
+    CopyDdsSubresource(file.GetData(), subresource, upload + footprint.Offset, rowPitch,
+                       rowPitch * numRows[i]);
+  }
+  mUploadHeap->Unmap(0, nullptr);
+}
+
+void MappedDdsTexture::RecordUpload(ID3D12GraphicsCommandList* cmdList) const {
+  for (UINT i = 0; i < static_cast<UINT>(mFootprints.size()); ++i) {
+    CD3DX12_TEXTURE_COPY_LOCATION dst(mTexture.Get(), i);
+    CD3DX12_TEXTURE_COPY_LOCATION src(mUploadHeap.Get(), mFootprints[i]);
+    cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+  }
+  cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(mTexture.Get(),
+      D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "d3dUtil.h"
+#include "DdsParser.h"
+
+// The HRESULT ThrowIfFailed reports for a ParseDds failure.
+HRESULT DdsParseResultToHresult(DdsParseResult result);
+
+// A whole file mapped read-only into memory.  Throws a DxException if it can't be opened or
+// mapped.
+class MappedFile {
+public:
+  explicit MappedFile(const std::wstring& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const uint8_t* GetData() const { return mData; }
+  size_t GetSize() const { return mSize; }
+
+private:
+  HANDLE mFile = INVALID_HANDLE_VALUE;
+  HANDLE mMapping = nullptr;
+  const uint8_t* mData = nullptr;
+  size_t mSize = 0;
+};
+
+// Loads a 2D (or cube) DDS texture by memory-mapping the file, parsing its headers in place with
+// ParseDds, and copying each subresource from the mapping straight into an upload buffer laid out
+// by GetCopyableFootprints.  Unlike CreateDDSTextureFromFile12, the file is never read into an
+// intermediate heap buffer, and the command list is only needed for RecordUpload, so the rest
+// can run on any thread.
+class MappedDdsTexture {
+public:
+  // Creates the texture in the COPY_DEST state and fills its upload buffer.  Throws a
+  // DxException if the file can't be read or isn't a DDS file this loader supports.
+  MappedDdsTexture(ID3D12Device* device, const std::wstring& path);
+
+  // Records copies from the upload buffer into every subresource and a transition to
+  // PIXEL_SHADER_RESOURCE.  The upload buffer must be kept alive until they have executed.
+  void RecordUpload(ID3D12GraphicsCommandList* cmdList) const;
+
+  Microsoft::WRL::ComPtr<ID3D12Resource> GetTexture() const { return mTexture; }
+  Microsoft::WRL::ComPtr<ID3D12Resource> GetUploadHeap() const { return mUploadHeap; }
+
+private:
+  Microsoft::WRL::ComPtr<ID3D12Resource> mTexture;
+  Microsoft::WRL::ComPtr<ID3D12Resource> mUploadHeap;
+  std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> mFootprints;
+};
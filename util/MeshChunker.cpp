@@ -0,0 +1,112 @@
+#include "MeshChunker.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace {
+  struct ChunkTriangle {
+    uint32_t Triangle;
+    float Centroid[3];
+  };
+
+  class Chunker {
+  public:
+    Chunker(std::vector<ChunkTriangle>* triangles, size_t maxChunkTriangles)
+        : mTriangles(*triangles), mMaxChunkTriangles(std::max<size_t>(maxChunkTriangles, 1)) {}
+
+    // Splits [begin, end) until each part fits in a chunk, appending the parts' triangle ranges
+    // to chunks in order.
+    void Split(size_t begin, size_t end, std::vector<MeshChunk>* chunks) {
+      if (end - begin <= mMaxChunkTriangles) {
+        MeshChunk chunk;
+        chunk.StartIndex = 3 * begin;
+        chunk.IndexCount = 3 * (end - begin);
+        chunks->push_back(chunk);
+        return;
+      }
+
+      float minCentroid[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+      float maxCentroid[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+      for (size_t t = begin; t < end; ++t) {
+        for (int i = 0; i < 3; ++i) {
+          minCentroid[i] = std::min(minCentroid[i], mTriangles[t].Centroid[i]);
+          maxCentroid[i] = std::max(maxCentroid[i], mTriangles[t].Centroid[i]);
+        }
+      }
+      int axis = 0;
+      for (int i = 1; i < 3; ++i) {
+        if (maxCentroid[i] - minCentroid[i] > maxCentroid[axis] - minCentroid[axis])
+          axis = i;
+      }
+
+      // Put a whole number of full chunks on one side, so only one chunk comes out part-full.
+      const size_t chunkCount = (end - begin + mMaxChunkTriangles - 1) / mMaxChunkTriangles;
+      const size_t mid = begin + (chunkCount / 2) * mMaxChunkTriangles;
+      std::nth_element(mTriangles.begin() + begin, mTriangles.begin() + mid,
+                       mTriangles.begin() + end,
+                       [axis](const ChunkTriangle& a, const ChunkTriangle& b) {
+                         return a.Centroid[axis] < b.Centroid[axis];
+                       });
+      Split(begin, mid, chunks);
+      Split(mid, end, chunks);
+    }
+
+  private:
+    std::vector<ChunkTriangle>& mTriangles;
+    size_t mMaxChunkTriangles;
+  };
+}
+
+std::vector<MeshChunk> BuildMeshChunks(uint32_t* indices, size_t indexCount,
+                                       const float* positions, size_t positionStride,
+                                       size_t maxChunkTriangles) {
+  auto position = [&](uint32_t v) {
+    return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) +
+        v * positionStride);
+  };
+
+  const size_t triangleCount = indexCount / 3;
+  std::vector<ChunkTriangle> triangles(triangleCount);
+  for (size_t t = 0; t < triangleCount; ++t) {
+    triangles[t].Triangle = static_cast<uint32_t>(t);
+    for (int i = 0; i < 3; ++i) {
+      triangles[t].Centroid[i] = (position(indices[3 * t])[i] + position(indices[3 * t + 1])[i] +
+          position(indices[3 * t + 2])[i]) / 3.0f;
+    }
+  }
+
+  std::vector<MeshChunk> chunks;
+  if (triangleCount == 0)
+    return chunks;
+  Chunker chunker(&triangles, maxChunkTriangles);
+  chunker.Split(0, triangleCount, &chunks);
+
+  std::vector<uint32_t> sorted(3 * triangleCount);
+  for (size_t t = 0; t < triangleCount; ++t) {
+    for (int k = 0; k < 3; ++k)
+      sorted[3 * t + k] = indices[3 * triangles[t].Triangle + k];
+  }
+  std::copy(sorted.begin(), sorted.end(), indices);
+
+  for (MeshChunk& chunk : chunks) {
+    for (int i = 0; i < 3; ++i) {
+      chunk.BoundsMin[i] = FLT_MAX;
+      chunk.BoundsMax[i] = -FLT_MAX;
+    }
+    for (size_t k = chunk.StartIndex; k < chunk.StartIndex + chunk.IndexCount; ++k) {
+      const float* p = position(indices[k]);
+      for (int i = 0; i < 3; ++i) {
+        chunk.BoundsMin[i] = std::min(chunk.BoundsMin[i], p[i]);
+        chunk.BoundsMax[i] = std::max(chunk.BoundsMax[i], p[i]);
+      }
+    }
+  }
+  return chunks;
+}
+
+uint32_t GetMaxIndex(const uint32_t* indices, size_t indexCount) {
+  uint32_t maxIndex = 0;
+  for (size_t i = 0; i < indexCount; ++i)
+    maxIndex = std::max(maxIndex, indices[i]);
+  return maxIndex;
+}
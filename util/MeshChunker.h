@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Splits a triangle list into spatially coherent chunks with bounding boxes, so a large mesh can
+// be culled a piece at a time instead of drawn whole.  Triangles are split recursively at the
+// median of their centroids along the longest axis, like building a bounding volume hierarchy
+// whose leaves are the chunks.  Indices are 32-bit.
+
+struct MeshChunk {
+  size_t StartIndex = 0;
+  size_t IndexCount = 0;
+  float BoundsMin[3] = { 0.0f, 0.0f, 0.0f };
+  float BoundsMax[3] = { 0.0f, 0.0f, 0.0f };
+};
+
+const size_t DEFAULT_CHUNK_TRIANGLES = 512;
+
+// Reorders the triangles of indices so each chunk's are contiguous, and returns the chunks in
+// order; together they cover all of indices.  No chunk has more than maxChunkTriangles
+// triangles.  positions are float triples positionStride bytes apart.
+std::vector<MeshChunk> BuildMeshChunks(uint32_t* indices, size_t indexCount,
+                                       const float* positions, size_t positionStride,
+                                       size_t maxChunkTriangles = DEFAULT_CHUNK_TRIANGLES);
+
+// Largest index in indices, or 0 if there are none: whether 16-bit indices will do.
+uint32_t GetMaxIndex(const uint32_t* indices, size_t indexCount);
@@ -0,0 +1,292 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+  // Forsyth's scoring, for an LRU cache of FORSYTH_CACHE_SIZE.
+  const int FORSYTH_CACHE_SIZE = 32;
+  const float CACHE_DECAY_POWER = 1.5f;
+  const float LAST_TRIANGLE_SCORE = 0.75f;
+  const float VALENCE_BOOST_SCALE = 2.0f;
+  const float VALENCE_BOOST_POWER = 0.5f;
+
+  float ScoreVertex(int cachePosition, uint32_t remainingTriangles) {
+    if (remainingTriangles == 0)
+      return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+      if (cachePosition < 3) {
+        // The last triangle's vertices get a fixed score, so the next one isn't chosen just for
+        // sharing an edge with it.
+        score = LAST_TRIANGLE_SCORE;
+      } else {
+        const float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+        score = std::pow(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+      }
+    }
+    // Finish off vertices with few triangles left, so they don't linger.
+    score += VALENCE_BOOST_SCALE *
+        std::pow(static_cast<float>(remainingTriangles), -VALENCE_BOOST_POWER);
+    return score;
+  }
+
+  // A FIFO post-transform cache, like the GPU's.
+  class FifoCache {
+  public:
+    FifoCache(size_t vertexCount, int size) : mTimestamps(vertexCount, 0), mSize(size) {}
+
+    // Returns whether vertex had to be transformed.
+    bool Use(uint32_t vertex) {
+      if (mTimestamps[vertex] != 0 && mTime - mTimestamps[vertex] < static_cast<uint32_t>(mSize))
+        return false;
+      mTimestamps[vertex] = ++mTime;
+      return true;
+    }
+
+  private:
+    std::vector<uint32_t> mTimestamps;    // 0 if never transformed
+    uint32_t mTime = 0;
+    int mSize;
+  };
+}
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+                                    int cacheSize) {
+  VertexCacheStats stats;
+  if (indexCount == 0)
+    return stats;
+
+  FifoCache cache(vertexCount, cacheSize);
+  std::vector<bool> used(vertexCount, false);
+  size_t transformed = 0;
+  size_t usedCount = 0;
+  for (size_t i = 0; i < indexCount; ++i) {
+    if (cache.Use(indices[i]))
+      ++transformed;
+    if (!used[indices[i]]) {
+      used[indices[i]] = true;
+      ++usedCount;
+    }
+  }
+  stats.Acmr = static_cast<float>(transformed) / (indexCount / 3);
+  stats.Atvr = static_cast<float>(transformed) / usedCount;
+  return stats;
+}
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount) {
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount == 0)
+    return;
+
+  // Each vertex's triangles, as ranges of vertexTriangles.
+  std::vector<uint32_t> remaining(vertexCount, 0);
+  for (size_t i = 0; i < indexCount; ++i)
+    ++remaining[indices[i]];
+  std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; ++v)
+    firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+  std::vector<uint32_t> vertexTriangles(indexCount);
+  {
+    std::vector<uint32_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+    for (size_t i = 0; i < indexCount; ++i)
+      vertexTriangles[filled[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  std::vector<float> vertexScores(vertexCount);
+  for (size_t v = 0; v < vertexCount; ++v)
+    vertexScores[v] = ScoreVertex(-1, remaining[v]);
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<uint32_t> output;
+  output.reserve(indexCount);
+
+  // LRU, most recent first; 3 extra slots for the vertices pushed out by the newest triangle.
+  std::vector<uint32_t> cache;
+  cache.reserve(FORSYTH_CACHE_SIZE + 3);
+  std::vector<int> cachePositions(vertexCount, -1);
+
+  size_t nextUnemitted = 0;
+  uint32_t best = 0;
+  bool haveBest = false;
+  for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+    if (!haveBest) {
+      // Nothing in the cache is worth drawing, which only happens between disconnected parts, so
+      // the first triangle left is as good as any.
+      while (emitted[nextUnemitted])
+        ++nextUnemitted;
+      best = static_cast<uint32_t>(nextUnemitted);
+    }
+
+    emitted[best] = true;
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t v = indices[3 * best + k];
+      output.push_back(v);
+
+      // Move v to the front of the cache and take the triangle off its list.
+      if (cachePositions[v] >= 0)
+        cache.erase(cache.begin() + cachePositions[v]);
+      cache.insert(cache.begin(), v);
+      uint32_t* triangles = &vertexTriangles[firstTriangle[v]];
+      uint32_t* last = triangles + remaining[v] - 1;
+      *std::find(triangles, last + 1, best) = *last;
+      --remaining[v];
+      for (size_t c = 0; c < cache.size(); ++c)
+        cachePositions[cache[c]] = static_cast<int>(c);
+    }
+
+    // Rescore what's in the cache and what just fell out of it.  Only triangles using a cached
+    // vertex can have gone up, so the next one is picked from those.
+    while (cache.size() > FORSYTH_CACHE_SIZE) {
+      const uint32_t evicted = cache.back();
+      cache.pop_back();
+      cachePositions[evicted] = -1;
+      vertexScores[evicted] = ScoreVertex(-1, remaining[evicted]);
+    }
+    for (uint32_t v : cache)
+      vertexScores[v] = ScoreVertex(cachePositions[v], remaining[v]);
+
+    haveBest = false;
+    float bestScore = -1.0f;
+    for (uint32_t v : cache) {
+      for (uint32_t i = 0; i < remaining[v]; ++i) {
+        const uint32_t t = vertexTriangles[firstTriangle[v] + i];
+        const float score = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] +
+            vertexScores[indices[3 * t + 2]];
+        if (score > bestScore) {
+          bestScore = score;
+          best = t;
+          haveBest = true;
+        }
+      }
+    }
+  }
+
+  std::copy(output.begin(), output.end(), indices);
+}
+
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions,
+                      size_t positionStride, size_t vertexCount, int cacheSize) {
+  const size_t triangleCount = indexCount / 3;
+  if (triangleCount < 2)
+    return;
+
+  auto position = [&](uint32_t v) {
+    return reinterpret_cast<const float*>(reinterpret_cast<const char*>(positions) +
+        v * positionStride);
+  };
+
+  // A cluster starts wherever a triangle has to transform all three of its vertices: drawing it
+  // somewhere else costs nothing extra.
+  std::vector<size_t> clusterStarts;
+  FifoCache cache(vertexCount, cacheSize);
+  for (size_t t = 0; t < triangleCount; ++t) {
+    int misses = 0;
+    for (int k = 0; k < 3; ++k)
+      misses += cache.Use(indices[3 * t + k]) ? 1 : 0;
+    if (misses == 3)
+      clusterStarts.push_back(t);
+  }
+  clusterStarts.push_back(triangleCount);
+  if (clusterStarts.size() <= 2)
+    return;
+
+  // Each cluster's area-weighted centroid and normal, and the mesh's centroid.
+  struct Cluster {
+    size_t FirstTriangle;
+    size_t TriangleCount;
+    float Centroid[3];
+    float Normal[3];
+    float SortKey;
+  };
+  std::vector<Cluster> clusters(clusterStarts.size() - 1);
+  float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+  float meshArea = 0.0f;
+  for (size_t n = 0; n < clusters.size(); ++n) {
+    Cluster& cluster = clusters[n];
+    cluster.FirstTriangle = clusterStarts[n];
+    cluster.TriangleCount = clusterStarts[n + 1] - clusterStarts[n];
+    float area = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+      cluster.Centroid[i] = 0.0f;
+      cluster.Normal[i] = 0.0f;
+    }
+    for (size_t t = cluster.FirstTriangle; t < clusterStarts[n + 1]; ++t) {
+      const float* a = position(indices[3 * t]);
+      const float* b = position(indices[3 * t + 1]);
+      const float* c = position(indices[3 * t + 2]);
+      const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+      const float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+      // With clockwise front faces in left-handed coordinates, ab x ac points out of the front.
+      const float normal[3] = {
+        ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0]
+      };
+      const float doubleArea =
+          std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+      for (int i = 0; i < 3; ++i) {
+        cluster.Centroid[i] += doubleArea * (a[i] + b[i] + c[i]) / 3.0f;
+        cluster.Normal[i] += normal[i];
+      }
+      area += doubleArea;
+    }
+    for (int i = 0; i < 3; ++i)
+      meshCentroid[i] += cluster.Centroid[i];
+    meshArea += area;
+    if (area > 0.0f) {
+      for (int i = 0; i < 3; ++i)
+        cluster.Centroid[i] /= area;
+    }
+  }
+  if (meshArea > 0.0f) {
+    for (int i = 0; i < 3; ++i)
+      meshCentroid[i] /= meshArea;
+  }
+
+  // Clusters whose fronts face away from the center are the most likely to be in front.
+  for (Cluster& cluster : clusters) {
+    const float length = std::sqrt(cluster.Normal[0] * cluster.Normal[0] +
+        cluster.Normal[1] * cluster.Normal[1] + cluster.Normal[2] * cluster.Normal[2]);
+    cluster.SortKey = 0.0f;
+    if (length > 0.0f) {
+      for (int i = 0; i < 3; ++i)
+        cluster.SortKey += (cluster.Centroid[i] - meshCentroid[i]) * cluster.Normal[i] / length;
+    }
+  }
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) {
+    return a.SortKey > b.SortKey;
+  });
+
+  std::vector<uint32_t> sorted;
+  sorted.reserve(indexCount);
+  for (const Cluster& cluster : clusters) {
+    sorted.insert(sorted.end(), indices + 3 * cluster.FirstTriangle,
+                  indices + 3 * (cluster.FirstTriangle + cluster.TriangleCount));
+  }
+  std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+std::vector<uint32_t> ComputeVertexFetchOrder(const uint32_t* indices, size_t indexCount,
+                                              size_t vertexCount) {
+  std::vector<uint32_t> order;
+  order.reserve(vertexCount);
+  std::vector<bool> placed(vertexCount, false);
+  for (size_t i = 0; i < indexCount; ++i) {
+    if (!placed[indices[i]]) {
+      placed[indices[i]] = true;
+      order.push_back(indices[i]);
+    }
+  }
+  for (size_t v = 0; v < vertexCount; ++v) {
+    if (!placed[v])
+      order.push_back(static_cast<uint32_t>(v));
+  }
+  return order;
+}
+
+void RemapIndices(uint32_t* indices, size_t indexCount, const std::vector<uint32_t>& order) {
+  std::vector<uint32_t> newIndex(order.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    newIndex[order[i]] = static_cast<uint32_t>(i);
+  for (size_t i = 0; i < indexCount; ++i)
+    indices[i] = newIndex[indices[i]];
+}
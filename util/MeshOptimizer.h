@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reorders triangle lists so the GPU does less work drawing them:
+//   - OptimizeVertexCache orders triangles so recently transformed vertices are reused (Tom
+//     Forsyth's "Linear-Speed Vertex Cache Optimisation").
+//   - OptimizeOverdraw then moves runs of triangles that tend to hide others to the front, without
+//     giving up much of the cache reuse (the cluster sort from Sander et al.'s Tipsify).
+//   - ComputeVertexFetchOrder numbers vertices in the order they're first used, so fetches walk
+//     the vertex buffer forwards.
+// Indices are 32-bit.
+
+// Post-transform cache behavior of a triangle list, simulated with a FIFO cache.
+struct VertexCacheStats {
+  float Acmr = 0.0f;      // Vertices transformed per triangle; 3 at worst, near 0.5 at best
+  float Atvr = 0.0f;      // Vertices transformed per vertex used; 1 at best
+};
+
+const int DEFAULT_VERTEX_CACHE_SIZE = 16;
+
+VertexCacheStats AnalyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+                                    int cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+// Splits the (cache-optimized) triangles into clusters wherever the simulated cache has to start
+// over, and sorts the clusters so those facing away from the mesh's center come first: from most
+// viewpoints they're in front of the rest.  positions are float triples positionStride bytes
+// apart.
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions,
+                      size_t positionStride, size_t vertexCount,
+                      int cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+// The old index of each vertex, in the order indices first use them; unused vertices go last.
+std::vector<uint32_t> ComputeVertexFetchOrder(const uint32_t* indices, size_t indexCount,
+                                              size_t vertexCount);
+
+// Rewrites indices for vertices rearranged into order.
+void RemapIndices(uint32_t* indices, size_t indexCount, const std::vector<uint32_t>& order);
@@ -0,0 +1,250 @@
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include <emmintrin.h>
+
+namespace {
+  // out = a * b for row-major 4x4 matrices.
+  void Multiply(const float a[4][4], const float b[4][4], float out[4][4]) {
+    for (int r = 0; r < 4; ++r) {
+      for (int c = 0; c < 4; ++c) {
+        out[r][c] = a[r][0] * b[0][c] + a[r][1] * b[1][c] + a[r][2] * b[2][c] +
+            a[r][3] * b[3][c];
+      }
+    }
+  }
+}
+
+OcclusionBuffer::OcclusionBuffer(int width, int height)
+  : mWidth(width),
+    mHeight(height),
+    mDepth(static_cast<size_t>(width) * height, 1.0f) {
+  assert(width % 4 == 0);
+  memset(mViewProj, 0, sizeof(mViewProj));
+}
+
+void OcclusionBuffer::Begin(const float viewProj[4][4]) {
+  memcpy(mViewProj, viewProj, sizeof(mViewProj));
+  std::fill(mDepth.begin(), mDepth.end(), 1.0f);
+  mStats = Stats();
+}
+
+template <typename Index>
+void OcclusionBuffer::AddIndexedOccluder(const void* positions, size_t stride,
+                                         const Index* indices, uint32_t indexCount,
+                                         int baseVertexLocation, const float world[4][4]) {
+  float worldViewProj[4][4];
+  Multiply(world, mViewProj, worldViewProj);
+
+  const uint8_t* vertexBytes = static_cast<const uint8_t*>(positions);
+  for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+    ++mStats.OccluderTriangles;
+
+    ClipVertex v[3];
+    int numInFront = 0;
+    for (int k = 0; k < 3; ++k) {
+      const float* p = reinterpret_cast<const float*>(
+          vertexBytes + (indices[i + k] + baseVertexLocation) * stride);
+      float* out = &v[k].x;
+      for (int c = 0; c < 4; ++c) {
+        out[c] = p[0] * worldViewProj[0][c] + p[1] * worldViewProj[1][c] +
+            p[2] * worldViewProj[2][c] + worldViewProj[3][c];
+      }
+      if (v[k].z >= 0.0f)
+        ++numInFront;
+    }
+
+    if (numInFront == 3) {
+      RasterizeTriangle(v[0], v[1], v[2]);
+      continue;
+    }
+    if (numInFront == 0) {
+      ++mStats.OccluderTrianglesCulled;
+      continue;
+    }
+
+    // Clip against the near plane (z >= 0); the result is a triangle or a quad.
+    mClipIn.assign(v, v + 3);
+    mClipOut.clear();
+    for (size_t k = 0; k < 3; ++k) {
+      const ClipVertex& a = mClipIn[k];
+      const ClipVertex& b = mClipIn[(k + 1) % 3];
+      if (a.z >= 0.0f)
+        mClipOut.push_back(a);
+      if ((a.z >= 0.0f) != (b.z >= 0.0f)) {
+        float t = a.z / (a.z - b.z);
+        mClipOut.push_back({ a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, 0.0f,
+                             a.w + (b.w - a.w) * t });
+      }
+    }
+    for (size_t k = 1; k + 1 < mClipOut.size(); ++k)
+      RasterizeTriangle(mClipOut[0], mClipOut[k], mClipOut[k + 1]);
+  }
+}
+
+void OcclusionBuffer::AddOccluder(const void* positions, size_t stride, const uint16_t* indices,
+                                  uint32_t indexCount, int baseVertexLocation,
+                                  const float world[4][4]) {
+  AddIndexedOccluder(positions, stride, indices, indexCount, baseVertexLocation, world);
+}
+
+void OcclusionBuffer::AddOccluder(const void* positions, size_t stride, const uint32_t* indices,
+                                  uint32_t indexCount, int baseVertexLocation,
+                                  const float world[4][4]) {
+  AddIndexedOccluder(positions, stride, indices, indexCount, baseVertexLocation, world);
+}
+
+void OcclusionBuffer::RasterizeTriangle(
+    const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2) {
+  const ClipVertex* v[3] = { &v0, &v1, &v2 };
+  float sx[3], sy[3], sz[3];
+  for (int k = 0; k < 3; ++k) {
+    if (v[k]->w <= 0.0f) {
+      ++mStats.OccluderTrianglesCulled;
+      return;
+    }
+    float invW = 1.0f / v[k]->w;
+    sx[k] = (v[k]->x * invW + 1.0f) * 0.5f * mWidth;
+    sy[k] = (1.0f - v[k]->y * invW) * 0.5f * mHeight;
+    sz[k] = std::min(v[k]->z * invW, 1.0f);
+  }
+
+  // Clockwise on screen (y down) is front facing.
+  float area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+  int minX = std::max(0, static_cast<int>(std::floor(std::min({ sx[0], sx[1], sx[2] }))));
+  int maxX = std::min(mWidth - 1,
+                      static_cast<int>(std::floor(std::max({ sx[0], sx[1], sx[2] }))));
+  int minY = std::max(0, static_cast<int>(std::floor(std::min({ sy[0], sy[1], sy[2] }))));
+  int maxY = std::min(mHeight - 1,
+                      static_cast<int>(std::floor(std::max({ sy[0], sy[1], sy[2] }))));
+  if (!(area > 0.0f) || minX > maxX || minY > maxY) {
+    ++mStats.OccluderTrianglesCulled;
+    return;
+  }
+
+  // Edge k is opposite vertex k, as a plane e = a*x + b*y + c that is positive inside.  Depth is
+  // the barycentric blend of the vertex depths, which is also a plane in screen space.
+  float edgeA[3], edgeB[3], edgeC[3];
+  float depthA = 0.0f, depthB = 0.0f, depthC = 0.0f;
+  float invArea = 1.0f / area;
+  for (int k = 0; k < 3; ++k) {
+    int a = (k + 1) % 3;
+    int b = (k + 2) % 3;
+    edgeA[k] = -(sy[b] - sy[a]);
+    edgeB[k] = sx[b] - sx[a];
+    edgeC[k] = (sy[b] - sy[a]) * sx[a] - (sx[b] - sx[a]) * sy[a];
+    depthA += edgeA[k] * sz[k] * invArea;
+    depthB += edgeB[k] * sz[k] * invArea;
+    depthC += edgeC[k] * sz[k] * invArea;
+  }
+
+  // Four pixels at a time along each row.  Groups start at multiples of 4; columns outside the
+  // triangle fail the edge tests, and mWidth is a multiple of 4 so no group runs past a row.
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 columnOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 e0A = _mm_set1_ps(edgeA[0]);
+  const __m128 e1A = _mm_set1_ps(edgeA[1]);
+  const __m128 e2A = _mm_set1_ps(edgeA[2]);
+  const __m128 zA = _mm_set1_ps(depthA);
+
+  for (int y = minY; y <= maxY; ++y) {
+    float py = y + 0.5f;
+    __m128 e0Row = _mm_set1_ps(edgeB[0] * py + edgeC[0]);
+    __m128 e1Row = _mm_set1_ps(edgeB[1] * py + edgeC[1]);
+    __m128 e2Row = _mm_set1_ps(edgeB[2] * py + edgeC[2]);
+    __m128 zRow = _mm_set1_ps(depthB * py + depthC);
+    float* row = mDepth.data() + static_cast<size_t>(y) * mWidth;
+
+    for (int x = minX & ~3; x <= maxX; x += 4) {
+      __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), columnOffsets);
+      __m128 e0 = _mm_add_ps(_mm_mul_ps(e0A, px), e0Row);
+      __m128 e1 = _mm_add_ps(_mm_mul_ps(e1A, px), e1Row);
+      __m128 e2 = _mm_add_ps(_mm_mul_ps(e2A, px), e2Row);
+      __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                                 _mm_cmpge_ps(e2, zero));
+      if (_mm_movemask_ps(inside) == 0)
+        continue;
+
+      __m128 z = _mm_add_ps(_mm_mul_ps(zA, px), zRow);
+      __m128 stored = _mm_loadu_ps(row + x);
+      __m128 closer = _mm_min_ps(stored, z);
+      _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, stored)));
+    }
+  }
+}
+
+bool OcclusionBuffer::IsOccluded(const float (*pointsW)[3], int count) {
+  ++mStats.Queries;
+
+  float minX = static_cast<float>(mWidth);
+  float maxX = 0.0f;
+  float minY = static_cast<float>(mHeight);
+  float maxY = 0.0f;
+  float minDepth = 1.0f;
+  int numBehindNear = 0;
+  for (int i = 0; i < count; ++i) {
+    const float* p = pointsW[i];
+    float clip[4];
+    for (int c = 0; c < 4; ++c) {
+      clip[c] = p[0] * mViewProj[0][c] + p[1] * mViewProj[1][c] + p[2] * mViewProj[2][c] +
+          mViewProj[3][c];
+    }
+    if (clip[2] < 0.0f || clip[3] <= 0.0f) {
+      ++numBehindNear;
+      continue;
+    }
+
+    float invW = 1.0f / clip[3];
+    float sx = (clip[0] * invW + 1.0f) * 0.5f * mWidth;
+    float sy = (1.0f - clip[1] * invW) * 0.5f * mHeight;
+    minX = std::min(minX, sx);
+    maxX = std::max(maxX, sx);
+    minY = std::min(minY, sy);
+    maxY = std::max(maxY, sy);
+    minDepth = std::min(minDepth, clip[2] * invW);
+  }
+
+  // Entirely behind the near plane can't be seen; partly behind may cover any part of the screen.
+  if (numBehindNear == count) {
+    ++mStats.QueriesOutsideView;
+    ++mStats.QueriesOccluded;
+    return true;
+  }
+  if (numBehindNear > 0)
+    return false;
+
+  // Every pixel the rectangle touches, not just those whose centers it covers.
+  int x0 = std::max(0, static_cast<int>(std::floor(minX)));
+  int x1 = std::min(mWidth - 1, static_cast<int>(std::floor(maxX)));
+  int y0 = std::max(0, static_cast<int>(std::floor(minY)));
+  int y1 = std::min(mHeight - 1, static_cast<int>(std::floor(maxY)));
+  if (x0 > x1 || y0 > y1) {
+    ++mStats.QueriesOutsideView;
+    ++mStats.QueriesOccluded;
+    return true;
+  }
+
+  // Visible if any pixel's occluder depth is not closer than the nearest point.
+  const __m128 depth = _mm_set1_ps(minDepth);
+  const __m128i columnIndices = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128i firstColumn = _mm_set1_epi32(x0 - 1);
+  const __m128i lastColumn = _mm_set1_epi32(x1 + 1);
+  for (int y = y0; y <= y1; ++y) {
+    const float* row = mDepth.data() + static_cast<size_t>(y) * mWidth;
+    for (int x = x0 & ~3; x <= x1; x += 4) {
+      __m128i columns = _mm_add_epi32(_mm_set1_epi32(x), columnIndices);
+      __m128 inRect = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(columns, firstColumn),
+                                                     _mm_cmplt_epi32(columns, lastColumn)));
+      __m128 notCloser = _mm_cmpge_ps(_mm_loadu_ps(row + x), depth);
+      if (_mm_movemask_ps(_mm_and_ps(inRect, notCloser)) != 0)
+        return false;
+    }
+  }
+
+  ++mStats.QueriesOccluded;
+  return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A small depth buffer rasterized on the CPU with SSE, used to find out whether something is
+// hidden behind occluders before any GPU work is recorded for it.  Occluders are triangle meshes
+// rasterized at pixel centers with back faces culled; queries test the screen rectangle and
+// nearest depth of a set of points against it.
+//
+// Matrices are row-major and transform row vectors, the layout XMStoreFloat4x4 produces, and depth
+// follows D3D's convention of 0 at the near plane and 1 at the far plane.
+class OcclusionBuffer {
+public:
+  struct Stats {
+    uint32_t OccluderTriangles = 0;          // Submitted
+    uint32_t OccluderTrianglesCulled = 0;    // Back-facing, behind the near plane or off screen
+    uint32_t Queries = 0;
+    uint32_t QueriesOccluded = 0;            // Entirely behind occluders
+    uint32_t QueriesOutsideView = 0;         // Off screen or behind the near plane; also occluded
+  };
+
+  // width must be a multiple of 4.
+  OcclusionBuffer(int width, int height);
+
+  // Clears the buffer to the far plane and starts a new view.  Resets the stats.
+  void Begin(const float viewProj[4][4]);
+
+  // Rasterizes an indexed triangle list.  positions points at the first vertex's x, y, z and
+  // consecutive vertices are stride bytes apart.  Indices are 16 or 32 bits, like the index
+  // buffer they come from.
+  void AddOccluder(const void* positions, size_t stride, const uint16_t* indices,
+                   uint32_t indexCount, int baseVertexLocation, const float world[4][4]);
+  void AddOccluder(const void* positions, size_t stride, const uint32_t* indices,
+                   uint32_t indexCount, int baseVertexLocation, const float world[4][4]);
+
+  // True if every pixel the points' screen rectangle touches already has an occluder closer than
+  // the nearest point.  Points entirely behind the near plane count as off screen; points that
+  // straddle it are never occluded.
+  bool IsOccluded(const float (*pointsW)[3], int count);
+
+  int GetWidth() const { return mWidth; }
+  int GetHeight() const { return mHeight; }
+  const float* Depth() const { return mDepth.data(); }
+
+  const Stats& GetStats() const { return mStats; }
+
+private:
+  struct ClipVertex {
+    float x, y, z, w;
+  };
+
+  template <typename Index>
+  void AddIndexedOccluder(const void* positions, size_t stride, const Index* indices,
+                          uint32_t indexCount, int baseVertexLocation, const float world[4][4]);
+  void RasterizeTriangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
+
+  int mWidth;
+  int mHeight;
+  std::vector<float> mDepth;
+  float mViewProj[4][4];
+
+  // Scratch for clipping against the near plane.
+  std::vector<ClipVertex> mClipIn;
+  std::vector<ClipVertex> mClipOut;
+
+  Stats mStats;
+};
@@ -0,0 +1,430 @@
+#include "PolygonTriangulator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+  // A vertex of the ring being clipped.  Bridges visit a vertex twice, so several nodes can share
+  // one Index.
+  struct Node {
+    uint32_t Index;
+    double X, Y;
+    int Prev, Next;
+    bool Reflex;      // Kept up to date while clipping; removed nodes aren't
+  };
+
+  // Twice the signed area of abc; positive if counterclockwise.
+  double Cross(const Node& a, const Node& b, const Node& c) {
+    return (b.X - a.X) * (c.Y - a.Y) - (b.Y - a.Y) * (c.X - a.X);
+  }
+
+  bool SamePosition(const Node& a, const Node& b) {
+    return a.X == b.X && a.Y == b.Y;
+  }
+
+  // Inside or on the boundary of triangle abc, either orientation.
+  bool InTriangle(const Node& a, const Node& b, const Node& c, const Node& p) {
+    const double ab = Cross(a, b, p);
+    const double bc = Cross(b, c, p);
+    const double ca = Cross(c, a, p);
+    return (ab >= 0.0 && bc >= 0.0 && ca >= 0.0) || (ab <= 0.0 && bc <= 0.0 && ca <= 0.0);
+  }
+
+  double SignedArea(const std::vector<PolygonPoint>& polygon) {
+    double area = 0.0;
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+      area += static_cast<double>(polygon[j].x) * polygon[i].y -
+          static_cast<double>(polygon[i].x) * polygon[j].y;
+    return 0.5 * area;
+  }
+
+  bool ContainsPoint(const std::vector<PolygonPoint>& polygon, const PolygonPoint& point) {
+    bool inside = false;
+    for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++) {
+      const PolygonPoint& a = polygon[i];
+      const PolygonPoint& b = polygon[j];
+      if ((a.y > point.y) != (b.y > point.y) &&
+          point.x < a.x + (point.y - a.y) * (b.x - a.x) / (b.y - a.y)) {
+        inside = !inside;
+      }
+    }
+    return inside;
+  }
+
+  class EarClipper {
+  public:
+    EarClipper(const std::vector<std::vector<PolygonPoint>>& polygons) {
+      uint32_t index = 0;
+      for (const std::vector<PolygonPoint>& polygon : polygons) {
+        mFirstNodes.push_back(static_cast<int>(mNodes.size()));
+        const int first = static_cast<int>(mNodes.size());
+        const int count = static_cast<int>(polygon.size());
+        for (int i = 0; i < count; ++i) {
+          Node node;
+          node.Index = index++;
+          node.X = polygon[i].x;
+          node.Y = polygon[i].y;
+          node.Prev = first + (i + count - 1) % count;
+          node.Next = first + (i + 1) % count;
+          node.Reflex = false;
+          mNodes.push_back(node);
+        }
+      }
+    }
+
+    // The node that polygon's vertices start at.
+    int GetFirstNode(size_t polygon) const { return mFirstNodes[polygon]; }
+
+    // Joins the hole ring starting at hole into the ring through outer.  Returns false if no
+    // edge of that ring is to the right of the hole.
+    bool AddHole(int outer, int hole) {
+      // Bridge from the hole's rightmost vertex to a vertex of the ring it can see.
+      int m = hole;
+      for (int n = mNodes[hole].Next; n != hole; n = mNodes[n].Next) {
+        if (mNodes[n].X > mNodes[m].X)
+          m = n;
+      }
+      const int p = FindBridge(outer, m);
+      if (p == -1)
+        return false;
+
+      // p -> m -> ...hole... -> m' -> p' -> (p's old next)
+      const int m2 = static_cast<int>(mNodes.size());
+      mNodes.push_back(mNodes[m]);
+      const int p2 = static_cast<int>(mNodes.size());
+      mNodes.push_back(mNodes[p]);
+      const int pNext = mNodes[p].Next;
+      const int mPrev = mNodes[m].Prev;
+      Link(p, m);
+      Link(mPrev, m2);
+      Link(m2, p2);
+      Link(p2, pNext);
+      return true;
+    }
+
+    // Clips the ring through start into triangles.  Returns false if it ever had to clip a
+    // vertex that wasn't an ear.
+    bool Clip(int start, std::vector<uint32_t>* indices) {
+      int count = 0;
+      int n = start;
+      do {
+        ++count;
+        n = mNodes[n].Next;
+      } while (n != start);
+      BuildReflexGrid(start, count);
+
+      bool valid = true;
+      int node = start;
+      int stop = node;
+      while (count > 3) {
+        const int prev = mNodes[node].Prev;
+        const int next = mNodes[node].Next;
+        const double area = Cross(mNodes[prev], mNodes[node], mNodes[next]);
+        if (area == 0.0 || IsEar(node)) {
+          // Vertices on a straight line (or a zero-width spike) are dropped without a triangle.
+          if (area != 0.0)
+            EmitTriangle(prev, node, next, indices);
+          Remove(node);
+          --count;
+          // Skipping a vertex spreads the ears around the ring; always clipping the next one
+          // would fan out from prev, with triangles as big as the polygon.
+          node = mNodes[next].Next;
+          stop = node;
+          continue;
+        }
+
+        node = next;
+        if (node == stop) {
+          // Nothing left is an ear, so the input wasn't simple.  Clip anyway so every vertex is
+          // still covered.
+          valid = false;
+          EmitTriangle(mNodes[node].Prev, node, mNodes[node].Next, indices);
+          const int after = mNodes[node].Next;
+          Remove(node);
+          --count;
+          node = after;
+          stop = node;
+        }
+      }
+      const int prev = mNodes[node].Prev;
+      const int next = mNodes[node].Next;
+      if (Cross(mNodes[prev], mNodes[node], mNodes[next]) > 0.0)
+        EmitTriangle(prev, node, next, indices);
+      return valid;
+    }
+
+  private:
+    void Link(int a, int b) {
+      mNodes[a].Next = b;
+      mNodes[b].Prev = a;
+    }
+
+    void Remove(int n) {
+      Link(mNodes[n].Prev, mNodes[n].Next);
+      if (mNodes[n].Reflex) {
+        mNodes[n].Reflex = false;
+        --mReflexCount;
+      }
+      UpdateReflex(mNodes[n].Prev);
+      UpdateReflex(mNodes[n].Next);
+    }
+
+    // Reflex vertices only ever become convex as the ring is clipped.
+    void UpdateReflex(int n) {
+      if (mNodes[n].Reflex && !IsReflex(n)) {
+        mNodes[n].Reflex = false;
+        --mReflexCount;
+      }
+    }
+
+    bool IsReflex(int n) const {
+      return Cross(mNodes[mNodes[n].Prev], mNodes[n], mNodes[mNodes[n].Next]) <= 0.0;
+    }
+
+    void EmitTriangle(int a, int b, int c, std::vector<uint32_t>* indices) const {
+      indices->push_back(mNodes[a].Index);
+      indices->push_back(mNodes[b].Index);
+      indices->push_back(mNodes[c].Index);
+    }
+
+    // Whether the diagonal from a to b starts out inside the ring, between a's two edges.
+    bool LocallyInside(int a, int b) const {
+      const Node& prev = mNodes[mNodes[a].Prev];
+      const Node& next = mNodes[mNodes[a].Next];
+      if (Cross(prev, mNodes[a], next) > 0.0)
+        return Cross(mNodes[a], next, mNodes[b]) >= 0.0 && Cross(prev, mNodes[a], mNodes[b]) >= 0.0;
+      return Cross(mNodes[a], next, mNodes[b]) > 0.0 || Cross(prev, mNodes[a], mNodes[b]) > 0.0;
+    }
+
+    // For two nodes at the same position, whether p's corner lies within m's.
+    bool SectorContainsSector(int m, int p) const {
+      return Cross(mNodes[mNodes[m].Prev], mNodes[m], mNodes[mNodes[p].Prev]) > 0.0 &&
+          Cross(mNodes[mNodes[p].Next], mNodes[m], mNodes[mNodes[m].Next]) > 0.0;
+    }
+
+    // Finds a ring vertex that the hole vertex m can be joined to without crossing an edge: the
+    // right end of the first edge hit by a ray from m in +x, unless a vertex inside the triangle
+    // between m, the hit point and that end is closer in angle to the ray (after Mapbox's earcut).
+    int FindBridge(int outer, int m) const {
+      const Node& hole = mNodes[m];
+      int p = -1;
+      double hitX = 0.0;
+      int a = outer;
+      do {
+        // Only edges going up face the hole; a bridge can't end on the back of an edge.
+        const Node& u = mNodes[a];
+        const Node& v = mNodes[u.Next];
+        if (u.Y <= hole.Y && hole.Y <= v.Y && u.Y != v.Y) {
+          const double x = u.X + (hole.Y - u.Y) * (v.X - u.X) / (v.Y - u.Y);
+          if (x >= hole.X && (p == -1 || x < hitX)) {
+            hitX = x;
+            p = u.X > v.X ? a : u.Next;
+            if (x == hole.X)
+              return p;     // The hole touches the edge
+          }
+        }
+        a = u.Next;
+      } while (a != outer);
+      if (p == -1)
+        return -1;
+
+      Node hit = hole;
+      hit.X = hitX;
+      const Node end = mNodes[p];
+      int best = p;
+      double bestTangent = -1.0;
+      a = outer;
+      do {
+        const Node& r = mNodes[a];
+        if (r.X > hole.X && r.X <= end.X && InTriangle(hole, hit, end, r) && LocallyInside(a, m)) {
+          const double tangent = std::fabs(r.Y - hole.Y) / (r.X - hole.X);
+          const Node& b = mNodes[best];
+          if (bestTangent < 0.0 || tangent < bestTangent ||
+              (tangent == bestTangent &&
+               (r.X < b.X || (r.X == b.X && SectorContainsSector(best, a))))) {
+            best = a;
+            bestTangent = tangent;
+          }
+        }
+        a = r.Next;
+      } while (a != outer);
+      return best;
+    }
+
+    // Clipping an ear only makes its neighbors more convex, so the reflex vertices found now are
+    // the only ones that can ever block an ear.
+    void BuildReflexGrid(int start, int count) {
+      mReflexCount = 0;
+      mMinX = mMaxX = mNodes[start].X;
+      mMinY = mMaxY = mNodes[start].Y;
+      int n = start;
+      do {
+        mMinX = std::min(mMinX, mNodes[n].X);
+        mMaxX = std::max(mMaxX, mNodes[n].X);
+        mMinY = std::min(mMinY, mNodes[n].Y);
+        mMaxY = std::max(mMaxY, mNodes[n].Y);
+        n = mNodes[n].Next;
+      } while (n != start);
+
+      mGridSize = std::max(1, static_cast<int>(std::sqrt(static_cast<double>(count))));
+      mCellWidth = std::max(mMaxX - mMinX, 1e-30) / mGridSize;
+      mCellHeight = std::max(mMaxY - mMinY, 1e-30) / mGridSize;
+      mCells.assign(mGridSize * mGridSize, std::vector<int>());
+      n = start;
+      do {
+        mNodes[n].Reflex = IsReflex(n);
+        if (mNodes[n].Reflex) {
+          ++mReflexCount;
+          mCells[CellY(mNodes[n].Y) * mGridSize + CellX(mNodes[n].X)].push_back(n);
+        }
+        n = mNodes[n].Next;
+      } while (n != start);
+    }
+
+    int CellX(double x) const {
+      return std::min(mGridSize - 1, std::max(0, static_cast<int>((x - mMinX) / mCellWidth)));
+    }
+
+    int CellY(double y) const {
+      return std::min(mGridSize - 1, std::max(0, static_cast<int>((y - mMinY) / mCellHeight)));
+    }
+
+    // Whether node is convex with no reflex vertex in or on the triangle it makes with its
+    // neighbors.
+    bool IsEar(int node) const {
+      const Node& a = mNodes[mNodes[node].Prev];
+      const Node& b = mNodes[node];
+      const Node& c = mNodes[b.Next];
+      if (Cross(a, b, c) <= 0.0)
+        return false;
+      if (mReflexCount == 0)
+        return true;
+
+      const int x0 = CellX(std::min(a.X, std::min(b.X, c.X)));
+      const int x1 = CellX(std::max(a.X, std::max(b.X, c.X)));
+      const int y0 = CellY(std::min(a.Y, std::min(b.Y, c.Y)));
+      const int y1 = CellY(std::max(a.Y, std::max(b.Y, c.Y)));
+      for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+          for (int r : mCells[y * mGridSize + x]) {
+            const Node& p = mNodes[r];
+            if (!p.Reflex || r == node || r == b.Prev || r == b.Next)
+              continue;
+            if (SamePosition(p, a) || SamePosition(p, b) || SamePosition(p, c))
+              continue;
+            if (InTriangle(a, b, c, p))
+              return false;
+          }
+        }
+      }
+      return true;
+    }
+
+    std::vector<Node> mNodes;
+    std::vector<int> mFirstNodes;
+
+    std::vector<std::vector<int>> mCells;     // Reflex nodes, by cell
+    int mReflexCount = 0;
+    int mGridSize = 1;
+    double mMinX = 0.0, mMaxX = 0.0, mMinY = 0.0, mMaxY = 0.0;
+    double mCellWidth = 1.0, mCellHeight = 1.0;
+  };
+}
+
+bool TriangulatePolygons(const std::vector<std::vector<PolygonPoint>>& polygons,
+                         std::vector<uint32_t>* indices) {
+  bool valid = true;
+  EarClipper clipper(polygons);
+
+  std::vector<double> areas(polygons.size());
+  for (size_t i = 0; i < polygons.size(); ++i)
+    areas[i] = polygons[i].size() >= 3 ? SignedArea(polygons[i]) : 0.0;
+
+  // Each hole goes with the smallest boundary around it.
+  std::vector<std::vector<size_t>> holes(polygons.size());
+  for (size_t h = 0; h < polygons.size(); ++h) {
+    if (areas[h] >= 0.0)
+      continue;
+    size_t outer = polygons.size();
+    for (size_t o = 0; o < polygons.size(); ++o) {
+      if (areas[o] > 0.0 && ContainsPoint(polygons[o], polygons[h][0]) &&
+          (outer == polygons.size() || areas[o] < areas[outer])) {
+        outer = o;
+      }
+    }
+    if (outer == polygons.size())
+      valid = false;
+    else
+      holes[outer].push_back(h);
+  }
+
+  for (size_t o = 0; o < polygons.size(); ++o) {
+    if (areas[o] <= 0.0)
+      continue;
+
+    // Rightmost holes first, so each bridge is made before anything further left can block it.
+    auto maxX = [&](size_t polygon) {
+      float x = polygons[polygon][0].x;
+      for (const PolygonPoint& point : polygons[polygon])
+        x = std::max(x, point.x);
+      return x;
+    };
+    std::sort(holes[o].begin(), holes[o].end(), [&](size_t a, size_t b) {
+      return maxX(a) > maxX(b);
+    });
+    const int outer = clipper.GetFirstNode(o);
+    for (size_t h : holes[o]) {
+      if (!clipper.AddHole(outer, clipper.GetFirstNode(h)))
+        valid = false;
+    }
+    if (!clipper.Clip(outer, indices))
+      valid = false;
+  }
+  return valid;
+}
+
+TriangulationBenchmarkResult BenchmarkTriangulation(size_t boundaryVertexCount, int holeCount,
+                                                    int runs) {
+  const double PI = 3.14159265358979;
+  std::vector<std::vector<PolygonPoint>> polygons(1);
+  for (size_t i = 0; i < boundaryVertexCount; ++i) {
+    const double angle = 2.0 * PI * i / boundaryVertexCount;
+    const double radius = i % 2 == 0 ? 1.0 : 0.8;
+    polygons[0].push_back({ static_cast<float>(radius * std::cos(angle)),
+                            static_cast<float>(radius * std::sin(angle)) });
+  }
+
+  // Holes on a grid inside the star's inner circle, clockwise.
+  const int holesPerRow = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(holeCount))));
+  const double spacing = 1.0 / std::max(holesPerRow, 1);
+  for (int h = 0; h < holeCount; ++h) {
+    const double centerX = -0.5 + (h % holesPerRow + 0.5) * spacing;
+    const double centerY = -0.5 + (h / holesPerRow + 0.5) * spacing;
+    std::vector<PolygonPoint> hole;
+    for (int i = 0; i < 16; ++i) {
+      const double angle = -2.0 * PI * i / 16;
+      hole.push_back({ static_cast<float>(centerX + 0.3 * spacing * std::cos(angle)),
+                       static_cast<float>(centerY + 0.3 * spacing * std::sin(angle)) });
+    }
+    polygons.push_back(hole);
+  }
+
+  TriangulationBenchmarkResult result;
+  for (const std::vector<PolygonPoint>& polygon : polygons)
+    result.VertexCount += polygon.size();
+
+  std::vector<uint32_t> indices;
+  const auto start = std::chrono::steady_clock::now();
+  for (int run = 0; run < runs; ++run) {
+    indices.clear();
+    TriangulatePolygons(polygons, &indices);
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  result.TriangleCount = indices.size() / 3;
+  result.SecondsPerRun = elapsed.count() / std::max(runs, 1);
+  if (result.SecondsPerRun > 0.0)
+    result.VerticesPerSecond = result.VertexCount / result.SecondsPerRun;
+  return result;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Triangulates polygons with holes by ear clipping.  Holes are first joined to the boundary
+// around them with a pair of bridge edges (Eberly, "Triangulation by Ear Clipping"), then ears
+// are clipped from the single remaining ring.  Reflex vertices, the only ones that can make a
+// vertex not an ear, are kept in a uniform grid so large polygons stay close to linear time.
+
+struct PolygonPoint {
+  float x, y;
+};
+
+// polygons uses Room's convention: the area to fill is on the left of every edge, so boundaries
+// are counterclockwise and holes clockwise (x right, y up).  Each hole is matched to the smallest
+// boundary around it.  Vertices are numbered consecutively across polygons, in order, and indices
+// gets three per triangle, counterclockwise.
+//
+// Returns false if the input wasn't a valid set of simple polygons (a hole outside every
+// boundary, or self-intersections that leave no ear to clip); the triangles appended then still
+// cover the polygons, but some may overlap or lie outside.
+bool TriangulatePolygons(const std::vector<std::vector<PolygonPoint>>& polygons,
+                         std::vector<uint32_t>* indices);
+
+struct TriangulationBenchmarkResult {
+  size_t VertexCount = 0;
+  size_t TriangleCount = 0;
+  double SecondsPerRun = 0.0;
+  double VerticesPerSecond = 0.0;
+};
+
+// Times TriangulatePolygons on a star-shaped boundary of boundaryVertexCount vertices (every
+// other one reflex) with holeCount 16-sided holes inside it, averaged over runs.
+TriangulationBenchmarkResult BenchmarkTriangulation(size_t boundaryVertexCount, int holeCount,
+                                                    int runs);
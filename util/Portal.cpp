@@ -202,6 +202,13 @@ bool Portal::IntersectSphereFromFront(XMFLOAT3 Center, float Radius)const
 
 XMFLOAT3 Portal::SpherePathCollision(float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist,
 									float *XDist_ptr, float *RedirectRatio_ptr, XMFLOAT3 *RedirectDir_ptr)const
+{
+	return SpherePathCollision(GetWorldToPortalMatrix(), SphereRadius, S, Dir, MoveDist,
+									XDist_ptr, RedirectRatio_ptr, RedirectDir_ptr);
+}
+
+XMFLOAT3 Portal::SpherePathCollision(const XMMATRIX &WorldToPortal, float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist,
+									float *XDist_ptr, float *RedirectRatio_ptr, XMFLOAT3 *RedirectDir_ptr)const
 {
 	// defaults
 	*XDist_ptr = MoveDist;
@@ -212,9 +219,8 @@ XMFLOAT3 Portal::SpherePathCollision(float SphereRadius, XMFLOAT3 S, XMFLOAT3 Di
 	XMFLOAT3 Sp;
 	XMFLOAT3 Dirp;
 	
-	XMMATRIX M = GetWorldToPortalMatrix();
-	XMStoreFloat3(&Sp, XMVector3TransformCoord(XMLoadFloat3(&S), M));
-	XMStoreFloat3(&Dirp, XMVector3TransformNormal(XMLoadFloat3(&Dir), M));
+	XMStoreFloat3(&Sp, XMVector3TransformCoord(XMLoadFloat3(&S), WorldToPortal));
+	XMStoreFloat3(&Dirp, XMVector3TransformNormal(XMLoadFloat3(&Dir), WorldToPortal));
 
 
 	// NOTE: IN PORTAL SPACE, THE PORTAL IS IN THE XY-PLANE.
@@ -78,6 +78,9 @@ public:
 	
 	XMFLOAT3 SpherePathCollision(float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist,
 									float *XDist_ptr, float *RedirectRatio_ptr, XMFLOAT3 *RedirectDir_ptr)const;
+	// same as above, with GetWorldToPortalMatrix() already computed by the caller
+	XMFLOAT3 SpherePathCollision(const XMMATRIX &WorldToPortal, float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist,
+									float *XDist_ptr, float *RedirectRatio_ptr, XMFLOAT3 *RedirectDir_ptr)const;
 	
 	bool PathCrossesPortal(XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist)const;
 
@@ -0,0 +1,160 @@
+#include "PortalDecal.h"
+
+#include <cmath>
+
+namespace {
+  const float PI = 3.1415926535f;
+
+  // A point of the rim in world space, with where it is in the portal's XY-scaled space.
+  struct RimPoint {
+    float World[3];
+    float Local[2];
+  };
+
+  // Points p with Normal . p + Distance >= 0 are kept.
+  struct ClipPlane {
+    float Normal[3];
+    float Distance;
+  };
+
+  float Dot(const float a[3], const float b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  }
+
+  void Cross(const float a[3], const float b[3], float out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+  }
+
+  RimPoint MakeRimPoint(const float portalToWorld[4][4], float x, float y) {
+    RimPoint point;
+    for (int i = 0; i < 3; ++i)
+      point.World[i] = x * portalToWorld[0][i] + y * portalToWorld[1][i] + portalToWorld[3][i];
+    point.Local[0] = x;
+    point.Local[1] = y;
+    return point;
+  }
+
+  // The inward planes through the edges of a convex polygon, perpendicular to it.
+  std::vector<ClipPlane> GetEdgePlanes(const float (*polygon)[3], int count) {
+    std::vector<ClipPlane> planes;
+    float normal[3] = { 0.0f, 0.0f, 0.0f };
+    float center[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < count; ++i) {
+      const float* a = polygon[i];
+      const float* b = polygon[(i + 1) % count];
+      normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+      normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+      normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+      for (int k = 0; k < 3; ++k)
+        center[k] += a[k] / count;
+    }
+    for (int i = 0; i < count; ++i) {
+      const float* a = polygon[i];
+      const float* b = polygon[(i + 1) % count];
+      const float edge[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+      const float toCenter[3] = { center[0] - a[0], center[1] - a[1], center[2] - a[2] };
+      ClipPlane plane;
+      Cross(normal, edge, plane.Normal);
+      if (Dot(plane.Normal, toCenter) < 0.0f) {
+        for (int k = 0; k < 3; ++k)
+          plane.Normal[k] = -plane.Normal[k];
+      }
+      if (Dot(plane.Normal, plane.Normal) <= 0.0f)
+        continue;   // Repeated vertex
+      plane.Distance = -Dot(plane.Normal, a);
+      planes.push_back(plane);
+    }
+    return planes;
+  }
+
+  // Sutherland-Hodgman: keeps the part of the convex polygon in on the inside of plane.
+  void ClipPolygon(const ClipPlane& plane, const std::vector<RimPoint>& in,
+                   std::vector<RimPoint>* out) {
+    out->clear();
+    for (size_t i = 0; i < in.size(); ++i) {
+      const RimPoint& a = in[i];
+      const RimPoint& b = in[(i + 1) % in.size()];
+      const float da = Dot(plane.Normal, a.World) + plane.Distance;
+      const float db = Dot(plane.Normal, b.World) + plane.Distance;
+      if (da >= 0.0f)
+        out->push_back(a);
+      if ((da >= 0.0f) != (db >= 0.0f)) {
+        const float t = da / (da - db);
+        RimPoint p;
+        for (int k = 0; k < 3; ++k)
+          p.World[k] = a.World[k] + t * (b.World[k] - a.World[k]);
+        for (int k = 0; k < 2; ++k)
+          p.Local[k] = a.Local[k] + t * (b.Local[k] - a.Local[k]);
+        out->push_back(p);
+      }
+    }
+  }
+}
+
+void BuildPortalDecal(const float portalToWorld[4][4], float textureRadiusRatio,
+                      const float (*surface)[3], int surfaceCount, PortalDecalMesh* mesh,
+                      int segments) {
+  mesh->Vertices.clear();
+  mesh->Indices.clear();
+  if (segments < 3)
+    segments = 3;
+
+  float normal[3] = { portalToWorld[2][0], portalToWorld[2][1], portalToWorld[2][2] };
+  const float normalLength = std::sqrt(Dot(normal, normal));
+  if (normalLength > 0.0f) {
+    for (int k = 0; k < 3; ++k)
+      normal[k] /= normalLength;
+  }
+
+  std::vector<ClipPlane> planes;
+  if (surfaceCount >= 3)
+    planes = GetEdgePlanes(surface, surfaceCount);
+
+  // The outer edges are tangent to the texture's circle, so nothing of it is left out.
+  const float radiansPerSegment = 2.0f * PI / segments;
+  const float outerRadius = textureRadiusRatio / std::cos(radiansPerSegment / 2.0f);
+  std::vector<RimPoint> polygon;
+  std::vector<RimPoint> clipped;
+  for (int i = 0; i < segments; ++i) {
+    const float c0 = std::cos(i * radiansPerSegment);
+    const float s0 = std::sin(i * radiansPerSegment);
+    const float c1 = std::cos((i + 1) * radiansPerSegment);
+    const float s1 = std::sin((i + 1) * radiansPerSegment);
+
+    // Counterclockwise in portal space, which is clockwise seen from in front of the portal.
+    polygon.clear();
+    polygon.push_back(MakeRimPoint(portalToWorld, c0, s0));
+    polygon.push_back(MakeRimPoint(portalToWorld, outerRadius * c0, outerRadius * s0));
+    polygon.push_back(MakeRimPoint(portalToWorld, outerRadius * c1, outerRadius * s1));
+    polygon.push_back(MakeRimPoint(portalToWorld, c1, s1));
+    for (const ClipPlane& plane : planes) {
+      ClipPolygon(plane, polygon, &clipped);
+      polygon.swap(clipped);
+    }
+    if (polygon.size() < 3)
+      continue;
+
+    const uint32_t first = static_cast<uint32_t>(mesh->Vertices.size());
+    for (const RimPoint& point : polygon) {
+      PortalDecalVertex vertex;
+      for (int k = 0; k < 3; ++k) {
+        vertex.Pos[k] = point.World[k];
+        vertex.Normal[k] = normal[k];
+      }
+      GetPortalTexCoord(point.Local[0], point.Local[1], textureRadiusRatio, vertex.TexC);
+      mesh->Vertices.push_back(vertex);
+    }
+    for (uint32_t k = 1; k + 1 < polygon.size(); ++k) {
+      mesh->Indices.push_back(first);
+      mesh->Indices.push_back(first + k);
+      mesh->Indices.push_back(first + k + 1);
+    }
+  }
+}
+
+void GetPortalTexCoord(float x, float y, float textureRadiusRatio, float texC[2]) {
+  texC[0] = 0.5f * (1.0f - x / textureRadiusRatio);
+  texC[1] = 0.5f * (1.0f - y / textureRadiusRatio);
+}
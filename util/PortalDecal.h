@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// The textured rim around a portal's hole as a mesh of its own, so the room's pixels don't each
+// have to find out whether they're on a portal.  The rim is a ring of quads from the hole (radius
+// 1 in the portal's XY-scaled space) out to a polygon around the texture's circle, each quad
+// clipped to the convex polygon of the wall (or floor, or ceiling) the portal sits on.  It only
+// changes when the portal moves or resizes.
+//
+// Texture coordinates are the ones Default.hlsl used to compute per pixel:
+// x in [-textureRadiusRatio, textureRadiusRatio] maps to u in [1, 0], and likewise y to v.  The
+// quads' inner edges are chords of the hole, so the pixels between them and the hole are drawn
+// too; the pixel shader drops them, as it drops everything inside the hole.
+//
+// Like PortalFrustum, matrices are row-major and transform row vectors.
+
+// Same layout as the app's Vertex.
+struct PortalDecalVertex {
+  float Pos[3];
+  float Normal[3];
+  float TexC[2];
+};
+
+struct PortalDecalMesh {
+  std::vector<PortalDecalVertex> Vertices;
+  std::vector<uint32_t> Indices;          // Triangle list, clockwise seen from the front
+};
+
+const int DEFAULT_PORTAL_DECAL_SEGMENTS = 48;
+
+// Builds the rim of the portal whose XY-scaled portal space goes to world space by
+// portalToWorld, replacing what's in mesh.  surface is the convex polygon the portal sits on, in
+// world space, in either winding; with surfaceCount < 3 the rim isn't clipped.
+void BuildPortalDecal(const float portalToWorld[4][4], float textureRadiusRatio,
+                      const float (*surface)[3], int surfaceCount, PortalDecalMesh* mesh,
+                      int segments = DEFAULT_PORTAL_DECAL_SEGMENTS);
+
+// Where a point of the portal's XY-scaled space lands in its texture.
+void GetPortalTexCoord(float x, float y, float textureRadiusRatio, float texC[2]);
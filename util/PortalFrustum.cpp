@@ -0,0 +1,141 @@
+#include "PortalFrustum.h"
+
+#include <cassert>
+#include <cmath>
+
+namespace {
+  void Subtract(const float a[3], const float b[3], float out[3]) {
+    for (int i = 0; i < 3; ++i)
+      out[i] = a[i] - b[i];
+  }
+
+  void Cross(const float a[3], const float b[3], float out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+  }
+
+  float Dot(const float a[3], const float b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  }
+}
+
+PortalFrustum::PortalFrustum(const float viewProj[4][4]) {
+  SetViewProj(viewProj);
+}
+
+void PortalFrustum::SetViewProj(const float viewProj[4][4]) {
+  mPlanes.clear();
+  // Gribb and Hartmann: each plane is a sum or difference of the matrix's columns.
+  float column[4][4];
+  for (int c = 0; c < 4; ++c) {
+    for (int r = 0; r < 4; ++r)
+      column[c][r] = viewProj[r][c];
+  }
+  const float* x = column[0];
+  const float* y = column[1];
+  const float* z = column[2];
+  const float* w = column[3];
+  AddPlane(w[0] + x[0], w[1] + x[1], w[2] + x[2], w[3] + x[3]);   // Left
+  AddPlane(w[0] - x[0], w[1] - x[1], w[2] - x[2], w[3] - x[3]);   // Right
+  AddPlane(w[0] + y[0], w[1] + y[1], w[2] + y[2], w[3] + y[3]);   // Bottom
+  AddPlane(w[0] - y[0], w[1] - y[1], w[2] - y[2], w[3] - y[3]);   // Top
+  AddPlane(z[0], z[1], z[2], z[3]);                               // Near
+  AddPlane(w[0] - z[0], w[1] - z[1], w[2] - z[2], w[3] - z[3]);   // Far
+}
+
+bool PortalFrustum::ClipToOpening(const float eye[3], const float (*vertices)[3], int count,
+                                  float minEyeDistance) {
+  if (count < 3)
+    return false;
+
+  // Newell's method, so slightly nonplanar polygons still get a sensible normal.
+  float center[3] = { 0.0f, 0.0f, 0.0f };
+  float normal[3] = { 0.0f, 0.0f, 0.0f };
+  for (int i = 0; i < count; ++i) {
+    const float* a = vertices[i];
+    const float* b = vertices[(i + 1) % count];
+    normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+    normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+    normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+    for (int k = 0; k < 3; ++k)
+      center[k] += a[k] / count;
+  }
+  const float length = std::sqrt(Dot(normal, normal));
+  if (length <= 0.0f)
+    return false;
+  float toEye[3];
+  Subtract(eye, center, toEye);
+  const float eyeDistance = Dot(normal, toEye) / length;
+  if (std::fabs(eyeDistance) < minEyeDistance)
+    return false;
+
+  // Only what's on the far side of the opening from the eye is seen through it.
+  const float side = eyeDistance > 0.0f ? -1.0f : 1.0f;
+  AddPlane(side * normal[0], side * normal[1], side * normal[2],
+           -side * Dot(normal, center));
+
+  // A plane through the eye and each edge, facing the center.
+  float eyeToCenter[3];
+  Subtract(center, eye, eyeToCenter);
+  for (int i = 0; i < count; ++i) {
+    float a[3], b[3], edgeNormal[3];
+    Subtract(vertices[i], eye, a);
+    Subtract(vertices[(i + 1) % count], eye, b);
+    Cross(a, b, edgeNormal);
+    const float facing = Dot(edgeNormal, eyeToCenter) < 0.0f ? -1.0f : 1.0f;
+    AddPlane(facing * edgeNormal[0], facing * edgeNormal[1], facing * edgeNormal[2],
+             -facing * Dot(edgeNormal, eye));
+  }
+  return true;
+}
+
+void PortalFrustum::Transform(const float toFrustumSpace[4][4], PortalFrustum* out) const {
+  assert(out != this);
+  // (p, 1) * toFrustumSpace . (n, d) = (p, 1) . (toFrustumSpace * (n, d)).
+  out->mPlanes.clear();
+  for (const FrustumPlane& plane : mPlanes) {
+    const float coefficients[4] = {
+      plane.Normal[0], plane.Normal[1], plane.Normal[2], plane.Distance
+    };
+    float transformed[4];
+    for (int r = 0; r < 4; ++r) {
+      transformed[r] = 0.0f;
+      for (int c = 0; c < 4; ++c)
+        transformed[r] += toFrustumSpace[r][c] * coefficients[c];
+    }
+    out->AddPlane(transformed[0], transformed[1], transformed[2], transformed[3]);
+  }
+}
+
+bool PortalFrustum::IntersectsBox(const float boxMin[3], const float boxMax[3]) const {
+  for (const FrustumPlane& plane : mPlanes) {
+    // The corner furthest along the normal is the last one to leave the plane's inside.
+    float corner[3];
+    for (int i = 0; i < 3; ++i)
+      corner[i] = plane.Normal[i] >= 0.0f ? boxMax[i] : boxMin[i];
+    if (Dot(plane.Normal, corner) + plane.Distance < 0.0f)
+      return false;
+  }
+  return true;
+}
+
+bool PortalFrustum::IntersectsSphere(const float center[3], float radius) const {
+  for (const FrustumPlane& plane : mPlanes) {
+    if (Dot(plane.Normal, center) + plane.Distance < -radius)
+      return false;
+  }
+  return true;
+}
+
+void PortalFrustum::AddPlane(float a, float b, float c, float d) {
+  const float length = std::sqrt(a * a + b * b + c * c);
+  if (length <= 0.0f)
+    return;
+  FrustumPlane plane;
+  plane.Normal[0] = a / length;
+  plane.Normal[1] = b / length;
+  plane.Normal[2] = c / length;
+  plane.Distance = d / length;
+  mPlanes.push_back(plane);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+// The part of space a portal recursion level can see: the camera's view frustum, narrowed by the
+// portal opening each level is seen through.  The volume is convex, bounded by the view frustum's
+// six planes, a plane through the eye and each edge of every opening, and the plane of each
+// opening (only what's beyond it is seen through it).  Objects entirely outside it can be culled
+// from the level.
+//
+// Like OcclusionBuffer, matrices are row-major and transform row vectors, the layout
+// XMStoreFloat4x4 produces, and clip-space depth runs from 0 to 1.
+
+// Points p with Normal . p + Distance >= 0 are inside.  Normal has unit length.
+struct FrustumPlane {
+  float Normal[3];
+  float Distance;
+};
+
+class PortalFrustum {
+public:
+  PortalFrustum() {}
+
+  // The view frustum of viewProj.
+  explicit PortalFrustum(const float viewProj[4][4]);
+
+  // Replaces the planes with viewProj's view frustum's.  Like the other changes below, this
+  // reuses the planes' storage, so a frustum kept from frame to frame stops allocating once it
+  // has held the most planes it will.
+  void SetViewProj(const float viewProj[4][4]);
+
+  // Narrows the frustum to what eye sees through the convex polygon of count vertices, in order
+  // (either winding), and beyond its plane.  Returns false, leaving the frustum as it was, if eye
+  // is within minEyeDistance of the polygon's plane: that close, the near plane can cut into the
+  // wall around an opening, and more than the opening shows what's behind it.
+  bool ClipToOpening(const float eye[3], const float (*vertices)[3], int count,
+                     float minEyeDistance);
+
+  // Sets out to the frustum moved into another space, where points p are at p * toFrustumSpace
+  // in the frustum's current space.  toFrustumSpace may scale, as long as it scales uniformly.
+  // out must be another frustum.
+  void Transform(const float toFrustumSpace[4][4], PortalFrustum* out) const;
+
+  // Conservative: true for some boxes and spheres just outside the corners.
+  bool IntersectsBox(const float boxMin[3], const float boxMax[3]) const;
+  bool IntersectsSphere(const float center[3], float radius) const;
+
+  const std::vector<FrustumPlane>& GetPlanes() const { return mPlanes; }
+
+private:
+  // Adds the plane a x + b y + c z + d >= 0, normalized; ignored if (a, b, c) is zero.
+  void AddPlane(float a, float b, float c, float d);
+
+  std::vector<FrustumPlane> mPlanes;
+};
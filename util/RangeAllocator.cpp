@@ -0,0 +1,85 @@
+#include "RangeAllocator.h"
+
+#include <cassert>
+#include <iterator>
+
+RangeAllocator::RangeAllocator(uint32_t capacity)
+  : mCapacity(capacity) {
+  if (capacity > 0)
+    mFreeRanges[0] = capacity;
+}
+
+uint32_t RangeAllocator::Allocate(uint32_t count) {
+  if (count == 0)
+    return kInvalidOffset;
+
+  for (auto it = mFreeRanges.begin(); it != mFreeRanges.end(); ++it) {
+    if (it->second < count)
+      continue;
+
+    // Take the front of the free range and keep the rest free.
+    const uint32_t offset = it->first;
+    const uint32_t remaining = it->second - count;
+    mFreeRanges.erase(it);
+    if (remaining > 0)
+      mFreeRanges[offset + count] = remaining;
+    mAllocatedCount += count;
+    return offset;
+  }
+  return kInvalidOffset;
+}
+
+void RangeAllocator::Free(uint32_t offset, uint32_t count) {
+  assert(count > 0 && offset + count <= mCapacity);
+  assert(mAllocatedCount >= count);
+  mAllocatedCount -= count;
+
+  auto next = mFreeRanges.lower_bound(offset);
+  assert(next == mFreeRanges.end() || offset + count <= next->first);
+
+  // Merge with the free range that ends where this one starts.
+  if (next != mFreeRanges.begin()) {
+    auto previous = std::prev(next);
+    assert(previous->first + previous->second <= offset);
+    if (previous->first + previous->second == offset) {
+      offset = previous->first;
+      count += previous->second;
+      mFreeRanges.erase(previous);
+    }
+  }
+
+  // And with the one that starts where this one ends.
+  if (next != mFreeRanges.end() && offset + count == next->first) {
+    count += next->second;
+    mFreeRanges.erase(next);
+  }
+  mFreeRanges[offset] = count;
+}
+
+void RangeAllocator::Grow(uint32_t capacity) {
+  assert(capacity >= mCapacity);
+  if (capacity == mCapacity)
+    return;
+
+  // The new slots are one free range, merged with a free range at the old end.
+  uint32_t offset = mCapacity;
+  uint32_t count = capacity - mCapacity;
+  if (!mFreeRanges.empty()) {
+    auto last = std::prev(mFreeRanges.end());
+    if (last->first + last->second == offset) {
+      offset = last->first;
+      count += last->second;
+    }
+  }
+  mFreeRanges[offset] = count;
+  mCapacity = capacity;
+}
+
+uint32_t RangeAllocator::GetLargestFreeRange() const {
+  uint32_t largest = 0;
+  for (const auto& range : mFreeRanges) {
+    if (range.second > largest)
+      largest = range.second;
+  }
+  return largest;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+// Hands out contiguous ranges of a pool of slots (such as the descriptors of a descriptor heap)
+// from a free list.  Freed ranges are merged with free neighbours, and allocations take the
+// first free range that's big enough.  The pool can be grown, which only adds free slots at the
+// end, so offsets already handed out stay valid.  This class only does the bookkeeping, so it can
+// be tested without a device.
+class RangeAllocator {
+public:
+  static const uint32_t kInvalidOffset = ~0u;
+
+  explicit RangeAllocator(uint32_t capacity);
+
+  // Returns the offset of count contiguous slots, or kInvalidOffset if no free range is that big.
+  uint32_t Allocate(uint32_t count);
+
+  // Returns a range given out by Allocate.
+  void Free(uint32_t offset, uint32_t count);
+
+  // Makes the pool capacity slots big.  capacity must be at least the current capacity.
+  void Grow(uint32_t capacity);
+
+  uint32_t GetCapacity() const { return mCapacity; }
+  uint32_t GetAllocatedCount() const { return mAllocatedCount; }
+  uint32_t GetLargestFreeRange() const;
+  size_t GetFreeRangeCount() const { return mFreeRanges.size(); }
+
+private:
+  uint32_t mCapacity;
+  uint32_t mAllocatedCount = 0;
+  std::map<uint32_t, uint32_t> mFreeRanges;   // Offset -> count; never adjacent to each other
+};
@@ -1,4 +1,5 @@
 #include "Room.h"
+#include "PolygonTriangulator.h"
 
 
 
@@ -174,6 +175,12 @@ void Room::SetFloorAndCeiling(float FloorHeight, float CeilingHeight)
 }
 
 void Room::SetTopography(const std::vector<std::vector<XMFLOAT2>> &Polygons)
+{
+	SetTopography(Polygons, nullptr);
+}
+
+void Room::SetTopography(const std::vector<std::vector<XMFLOAT2>> &Polygons,
+	CellGraph *PrebuiltCells)
 {
 	BoundaryPolygons.resize(Polygons.size());
 	for (unsigned int i=0; i<Polygons.size(); ++i)
@@ -188,6 +195,38 @@ void Room::SetTopography(const std::vector<std::vector<XMFLOAT2>> &Polygons)
 			MaxZ = max(MaxZ, Polygons[i][j].y);
 		}
 	}
+
+	if (PrebuiltCells != nullptr)
+	{
+		Cells = std::move(*PrebuiltCells);
+		PrebuiltCells->Clear();
+		return;
+	}
+
+	// split the floor plan into cells and work out what each can see
+	std::vector<std::vector<PolygonPoint>> FloorPlan(Polygons.size());
+	for (unsigned int i=0; i<Polygons.size(); ++i)
+	{
+		for (unsigned int j=0; j<Polygons[i].size(); ++j)
+		{
+			PolygonPoint Point = { Polygons[i][j].x, Polygons[i][j].y };
+			FloorPlan[i].push_back(Point);
+		}
+	}
+	if (Cells.Build(FloorPlan))
+	{
+		const CellGraph::Stats &CellStats = Cells.GetStats();
+		dprintf("Room: %zu cells, %zu openings, %zu of %zu cell pairs visible (%.1f ms)\n",
+			CellStats.Cells, CellStats.Openings, CellStats.VisiblePairs,
+			CellStats.Cells * CellStats.Cells, CellStats.BuildSeconds * 1000.0);
+		if (CellStats.CellsGivenUp > 0)
+			dprintf("Room: %zu cells had too many chains to follow; they see everything they connect to\n",
+				CellStats.CellsGivenUp);
+	}
+	else
+	{
+		dprintf("Room::SetTopography: boundary polygons aren't simple; not split into cells\n");
+	}
 }
 
 
@@ -246,7 +285,8 @@ XMFLOAT3 Room::SpherePathVirtualCollision(const XMMATRIX &Virtualize, const XMMA
 
 XMFLOAT3 Room::SpherePathCollision(float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist,
 									float *XDist_ptr, float *RedirectRatio_ptr, XMFLOAT3 *RedirectDir_ptr,
-									XMFLOAT3 *T_ptr, XMFLOAT3 *TNormal_ptr)const
+									XMFLOAT3 *T_ptr, XMFLOAT3 *TNormal_ptr,
+									const WallEdgeList *CandidateWalls)const
 {
 	// find path collision with floor or ceiling
 	XMFLOAT3 FloorCeilingX;
@@ -266,7 +306,7 @@ XMFLOAT3 Room::SpherePathCollision(float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir,
 	XMFLOAT3 WallT;
 	XMFLOAT3 WallTNormal;
 	WallX = SpherePathWallCollision(SphereRadius, S, Dir, MoveDist, 
-			&WallXDist, &WallRedirectRatio, &WallRedirectDir, &WallT, &WallTNormal);
+			&WallXDist, &WallRedirectRatio, &WallRedirectDir, &WallT, &WallTNormal, CandidateWalls);
 
 	// return the collision that's closer. if both equally close, then return the one that's more restrictive
 	XMFLOAT3 X;
@@ -351,7 +391,8 @@ XMFLOAT3 Room::SpherePathFloorCeilingCollision(float SphereRadius, XMFLOAT3 S, X
 
 XMFLOAT3 Room::SpherePathWallCollision(float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist,
 									float *XDist_ptr, float *RedirectRatio_ptr, XMFLOAT3 *RedirectDir_ptr,
-									XMFLOAT3 *T_ptr, XMFLOAT3 *TNormal_ptr)const
+									XMFLOAT3 *T_ptr, XMFLOAT3 *TNormal_ptr,
+									const WallEdgeList *CandidateWalls)const
 {
 	// defaults
 	*XDist_ptr = MoveDist;
@@ -374,36 +415,18 @@ XMFLOAT3 Room::SpherePathWallCollision(float SphereRadius, XMFLOAT3 S, XMFLOAT3
 	BoundaryElementsList DiscCenterBoundaryElements;
 	
 	float SumDist = MoveDistXZ + SphereRadius;
-	for (unsigned int PolygonIndex=0; PolygonIndex<BoundaryPolygons.size(); ++PolygonIndex)
+	WallEdgeList NearbyWalls;
+	if (!CandidateWalls)
 	{
-		const std::vector<XMFLOAT2> &Vertices = BoundaryPolygons[PolygonIndex];
-		for (unsigned int i=0; i<Vertices.size(); ++i)
-		{
-			// get edge at this index: UV
-			XMFLOAT2 U = Vertices[i];
-			XMFLOAT2 V = (i==Vertices.size()-1) ? Vertices[0] : Vertices[i+1];
-
-			// can U be reached from S?
-			if (SumDist >= XMFloat2Length(U-StartXZ))
-			{
-				//dprintf("	Vertex (%f, %f)\n",U.x,U.y);
-				DiscCenterBoundaryElements.AddVertex(U);
-			}
-
-			// can UV be reached from S?
-			XMFLOAT2 UVDir = XMFloat2Normalize(V-U);
-			if (SumDist >= abs(XMFloat2Cross(StartXZ-U, UVDir)))	// S close enough to line UV
-			{
-				XMFLOAT2 US = StartXZ-U;
-				XMFLOAT2 VS = StartXZ-V;
-				if (XMFloat2Dot(VS, UVDir)<=SumDist			// S not too far to the side of U or V
-					&& XMFloat2Dot(US, UVDir)>=-SumDist)
-				{
-					//dprintf("	Edge (%f, %f)--(%f, %f)\n", U.x,U.y,V.x,V.y);
-					DiscCenterBoundaryElements.AddEdge(U, V);
-				}
-			}
-		}
+		// nothing out of the disc's reach can be hit
+		XMFLOAT2 Reach = XMFLOAT2(SumDist, SumDist);
+		GatherWallsInBounds(StartXZ - Reach, StartXZ + Reach, &NearbyWalls);
+		CandidateWalls = &NearbyWalls;
+	}
+	for (size_t i=0; i<CandidateWalls->size(); ++i)
+	{
+		const WallEdge &Wall = (*CandidateWalls)[i];
+		AddReachableBoundaryElements(StartXZ, SumDist, Wall.U, Wall.V, &DiscCenterBoundaryElements);
 	}
 
 	// find where the XZ disc of the sphere will exit the room in the XZ plane
@@ -457,6 +480,35 @@ XMFLOAT3 Room::SpherePathWallCollision(float SphereRadius, XMFLOAT3 S, XMFLOAT3
 
 
 
+// adds vertex U and edge UV to Elements if the disc center can reach them from StartXZ
+void Room::AddReachableBoundaryElements(XMFLOAT2 StartXZ, float SumDist, XMFLOAT2 U, XMFLOAT2 V,
+									BoundaryElementsList *Elements)
+{
+	// can U be reached from S?
+	if (SumDist >= XMFloat2Length(U-StartXZ))
+	{
+		//dprintf("	Vertex (%f, %f)\n",U.x,U.y);
+		Elements->AddVertex(U);
+	}
+
+	// can UV be reached from S?
+	XMFLOAT2 UVDir = XMFloat2Normalize(V-U);
+	if (SumDist >= abs(XMFloat2Cross(StartXZ-U, UVDir)))	// S close enough to line UV
+	{
+		XMFLOAT2 US = StartXZ-U;
+		XMFLOAT2 VS = StartXZ-V;
+		if (XMFloat2Dot(VS, UVDir)<=SumDist			// S not too far to the side of U or V
+			&& XMFloat2Dot(US, UVDir)>=-SumDist)
+		{
+			//dprintf("	Edge (%f, %f)--(%f, %f)\n", U.x,U.y,V.x,V.y);
+			Elements->AddEdge(U, V);
+		}
+	}
+}
+
+
+
+
 XMFLOAT2 Room::FindFirstExit(float DiscRadius, XMFLOAT2 S, XMFLOAT2 Dir, float MoveDist, 
 							const BoundaryElementsList &DiscCenterBoundaryElements,
 							float *XDist_ptr, float *RedirectRatio_ptr, XMFLOAT2 *RedirectDir_ptr,
@@ -706,6 +758,144 @@ void Room::PortalRelocate(XMFLOAT3 S, XMFLOAT3 Dir, Portal *ThisPortal, const Po
 }
 
 
+void Room::GatherWallsInBounds(XMFLOAT2 BoundsMin, XMFLOAT2 BoundsMax, WallEdgeList *Walls)const
+{
+	if (!Cells.Empty())
+	{
+		// each wall is in exactly one cell, and that cell's bounds contain it
+		PolygonPoint CellBoundsMin = { BoundsMin.x, BoundsMin.y };
+		PolygonPoint CellBoundsMax = { BoundsMax.x, BoundsMax.y };
+		std::vector<int> NearbyCells;
+		Cells.GatherCellsInBounds(CellBoundsMin, CellBoundsMax, &NearbyCells);
+		for (size_t c=0; c<NearbyCells.size(); ++c)
+		{
+			const std::vector<CellGraph::Wall> &CellWalls = Cells.GetCell(NearbyCells[c]).Walls;
+			for (size_t i=0; i<CellWalls.size(); ++i)
+			{
+				XMFLOAT2 U = XMFLOAT2(CellWalls[i].A.x, CellWalls[i].A.y);
+				XMFLOAT2 V = XMFLOAT2(CellWalls[i].B.x, CellWalls[i].B.y);
+				if (max(U.x, V.x) < BoundsMin.x || min(U.x, V.x) > BoundsMax.x ||
+					max(U.y, V.y) < BoundsMin.y || min(U.y, V.y) > BoundsMax.y)
+					continue;
+
+				WallEdge Wall;
+				Wall.U = U;
+				Wall.V = V;
+				Walls->push_back(Wall);
+			}
+		}
+		return;
+	}
+
+	for (unsigned int PolygonIndex=0; PolygonIndex<BoundaryPolygons.size(); ++PolygonIndex)
+	{
+		const std::vector<XMFLOAT2> &Vertices = BoundaryPolygons[PolygonIndex];
+		for (unsigned int i=0; i<Vertices.size(); ++i)
+		{
+			XMFLOAT2 U = Vertices[i];
+			XMFLOAT2 V = (i==Vertices.size()-1) ? Vertices[0] : Vertices[i+1];
+
+			// reject walls whose bounding box doesn't overlap the bounds
+			if (max(U.x, V.x) < BoundsMin.x || min(U.x, V.x) > BoundsMax.x ||
+				max(U.y, V.y) < BoundsMin.y || min(U.y, V.y) > BoundsMax.y)
+				continue;
+
+			WallEdge Wall;
+			Wall.U = U;
+			Wall.V = V;
+			Walls->push_back(Wall);
+		}
+	}
+}
+
+
+const CellGraph& Room::GetCells()const
+{
+	return Cells;
+}
+
+
+bool Room::GetSurfacePolygon(XMFLOAT3 Point, XMFLOAT3 Normal, std::vector<XMFLOAT3> *Polygon)const
+{
+	Polygon->clear();
+
+	// floor or ceiling
+	if (abs(Normal.y) > 0.5f)
+	{
+		float Y = (Normal.y > 0.0f ? FloorY : CeilingY);
+		if (abs(Point.y - Y) > PORTALS_SAME_PLANE_THRESHOLD)
+			return false;
+		Polygon->push_back(XMFLOAT3(MinX, Y, MinZ));
+		Polygon->push_back(XMFLOAT3(MaxX, Y, MinZ));
+		Polygon->push_back(XMFLOAT3(MaxX, Y, MaxZ));
+		Polygon->push_back(XMFLOAT3(MinX, Y, MaxZ));
+		return true;
+	}
+
+	// the wall whose edge Point is on, facing the same way
+	XMFLOAT2 PointXZ = XMFLOAT2(Point.x, Point.z);
+	for (unsigned int PolygonIndex=0; PolygonIndex<BoundaryPolygons.size(); ++PolygonIndex)
+	{
+		const std::vector<XMFLOAT2> &Vertices = BoundaryPolygons[PolygonIndex];
+		for (unsigned int i=0; i<Vertices.size(); ++i)
+		{
+			XMFLOAT2 U = Vertices[i];
+			XMFLOAT2 V = (i==Vertices.size()-1) ? Vertices[0] : Vertices[i+1];
+			float UVLength = XMFloat2Length(V-U);
+			if (UVLength == 0.0f)
+				continue;
+
+			XMFLOAT2 UVDir = (V-U) / UVLength;
+			XMFLOAT2 WallNormal = XMFloat2Left90(UVDir);
+			if (WallNormal.x*Normal.x + WallNormal.y*Normal.z < 0.99f)
+				continue;
+			if (abs(XMFloat2Cross(UVDir, PointXZ-U)) > PORTALS_SAME_PLANE_THRESHOLD)
+				continue;
+			float u = XMFloat2Dot(PointXZ-U, UVDir);
+			if (u < 0.0f || u > UVLength)
+				continue;
+
+			Polygon->push_back(XMFLOAT3(U.x, FloorY, U.y));
+			Polygon->push_back(XMFLOAT3(V.x, FloorY, V.y));
+			Polygon->push_back(XMFLOAT3(V.x, CeilingY, V.y));
+			Polygon->push_back(XMFLOAT3(U.x, CeilingY, U.y));
+			return true;
+		}
+	}
+	return false;
+}
+
+
+float Room::MinFeatureSizeNearPath(float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist)const
+{
+	float MinSize = std::numeric_limits<float>::infinity();
+
+	// uses the same reachability test as SpherePathWallCollision, on the XZ projection of the path
+	XMFLOAT2 StartXZ = XMFLOAT2(S.x, S.z);
+	float SumDist = MoveDist * XMFloat2Length(XMFLOAT2(Dir.x, Dir.z)) + SphereRadius;
+	XMFLOAT2 Reach = XMFLOAT2(SumDist, SumDist);
+	WallEdgeList NearbyWalls;
+	GatherWallsInBounds(StartXZ - Reach, StartXZ + Reach, &NearbyWalls);
+	for (size_t i=0; i<NearbyWalls.size(); ++i)
+	{
+		XMFLOAT2 U = NearbyWalls[i].U;
+		XMFLOAT2 V = NearbyWalls[i].V;
+		float UVLength = XMFloat2Length(V-U);
+		if (UVLength >= MinSize)
+			continue;
+
+		// can UV be reached from S?
+		XMFLOAT2 UVDir = (V-U) / UVLength;
+		if (SumDist >= abs(XMFloat2Cross(StartXZ-U, UVDir)) &&
+			XMFloat2Dot(StartXZ-V, UVDir) <= SumDist && XMFloat2Dot(StartXZ-U, UVDir) >= -SumDist)
+		{
+			MinSize = UVLength;
+		}
+	}
+	return MinSize;
+}
+
+
 
 void Room::BuildMeshData(GeometryGenerator::MeshData *RoomMesh, SubmeshGeometry *WallsSubmesh,
       SubmeshGeometry *FloorSubmesh, SubmeshGeometry *CeilingSubmesh) const
@@ -778,87 +968,79 @@ void Room::BuildMeshData(GeometryGenerator::MeshData *RoomMesh, SubmeshGeometry
 
 	//dprintf("Xminmax [%f %f] Zminmax [%f %f]\n",MinX,MaxX,MinZ,MaxZ);
 
-	float FloorWidth = MaxX - MinX;
-	float FloorHeight = MaxZ - MinZ;
+	// triangulate the floor plan, holes included, instead of covering its bounding rectangle;
+	// the triangles are CCW in (x, z), and the floor and ceiling share them
+	std::vector<std::vector<PolygonPoint>> FloorPlan(BoundaryPolygons.size());
+	INT FloorPlanVertexCount = 0;
+	for (unsigned int P=0; P<BoundaryPolygons.size(); ++P)
+	{
+		for (unsigned int i=0; i<BoundaryPolygons[P].size(); ++i)
+		{
+			PolygonPoint Point = { BoundaryPolygons[P][i].x, BoundaryPolygons[P][i].y };
+			FloorPlan[P].push_back(Point);
+		}
+		FloorPlanVertexCount += (INT)BoundaryPolygons[P].size();
+	}
+	std::vector<uint32_t> FloorPlanIndices;
+	if (!TriangulatePolygons(FloorPlan, &FloorPlanIndices))
+		dprintf("Room::BuildMeshData: boundary polygons aren't simple; floor may spill past walls\n");
+	UINT FloorPlanIndexCount = (UINT)FloorPlanIndices.size();
 
 	// add floor offsets
-  FloorSubmesh->IndexCount = 6;
+  FloorSubmesh->IndexCount = FloorPlanIndexCount;
   FloorSubmesh->StartIndexLocation = TotalIndexCount;
   FloorSubmesh->BaseVertexLocation = 0;
 
 	// add floor vertices
+	// textures are tiled to 1x1 squares, lined up with the bounding rectangle's top left
 	Vert.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
 	Vert.Tangent = XMFLOAT3(1.0f, 0.0f, 0.0f);
+	for (unsigned int P=0; P<FloorPlan.size(); ++P)
+	{
+		for (unsigned int i=0; i<FloorPlan[P].size(); ++i)
+		{
+			const PolygonPoint &Point = FloorPlan[P][i];
+			Vert.Position = XMFLOAT3(Point.x, FloorY, Point.y);
+			Vert.TexCoord = XMFLOAT2(Point.x - MinX, MaxZ - Point.y);
+			RoomMesh->Vertices.push_back(Vert);
+		}
+	}
 
-	// bottom left
-	Vert.Position = XMFLOAT3(MinX, FloorY, MinZ);
-	Vert.TexCoord = XMFLOAT2(0.0f, FloorHeight);
-	RoomMesh->Vertices.push_back(Vert);
-
-	// top left
-	Vert.Position = XMFLOAT3(MinX, FloorY, MaxZ);
-	Vert.TexCoord = XMFLOAT2(0.0f, 0.0f);
-	RoomMesh->Vertices.push_back(Vert);
-
-	// top right
-	Vert.Position = XMFLOAT3(MaxX, FloorY, MaxZ);
-	Vert.TexCoord = XMFLOAT2(FloorWidth, 0.0f);
-	RoomMesh->Vertices.push_back(Vert);
-
-	// bottom right
-	Vert.Position = XMFLOAT3(MaxX, FloorY, MinZ);
-	Vert.TexCoord = XMFLOAT2(FloorWidth, FloorHeight);
-	RoomMesh->Vertices.push_back(Vert);
-
-	// add floor indices
-	RoomMesh->Indices.push_back(TotalVertexCount + 0);
-	RoomMesh->Indices.push_back(TotalVertexCount + 1);
-	RoomMesh->Indices.push_back(TotalVertexCount + 2);
-	RoomMesh->Indices.push_back(TotalVertexCount + 0);
-	RoomMesh->Indices.push_back(TotalVertexCount + 2);
-	RoomMesh->Indices.push_back(TotalVertexCount + 3);
+	// add floor indices, flipped to CW so the floor faces up
+	for (unsigned int i=0; i<FloorPlanIndexCount; i+=3)
+	{
+		RoomMesh->Indices.push_back(TotalVertexCount + FloorPlanIndices[i]);
+		RoomMesh->Indices.push_back(TotalVertexCount + FloorPlanIndices[i + 2]);
+		RoomMesh->Indices.push_back(TotalVertexCount + FloorPlanIndices[i + 1]);
+	}
 
-  TotalVertexCount += 4;
-  TotalIndexCount += 6;
+  TotalVertexCount += FloorPlanVertexCount;
+  TotalIndexCount += FloorPlanIndexCount;
 
 
 	// add ceiling offsets
-  CeilingSubmesh->IndexCount = 6;
+  CeilingSubmesh->IndexCount = FloorPlanIndexCount;
   CeilingSubmesh->StartIndexLocation = TotalIndexCount;
   CeilingSubmesh->BaseVertexLocation = 0;
 
 	// add ceiling vertices
 	Vert.Normal = XMFLOAT3(0.0f, -1.0f, 0.0f);
 	Vert.Tangent = XMFLOAT3(1.0f, 0.0f, 0.0f);
+	for (unsigned int P=0; P<FloorPlan.size(); ++P)
+	{
+		for (unsigned int i=0; i<FloorPlan[P].size(); ++i)
+		{
+			const PolygonPoint &Point = FloorPlan[P][i];
+			Vert.Position = XMFLOAT3(Point.x, CeilingY, Point.y);
+			Vert.TexCoord = XMFLOAT2(Point.x - MinX, MaxZ - Point.y);
+			RoomMesh->Vertices.push_back(Vert);
+		}
+	}
+
+	// add ceiling indices, CCW so the ceiling faces down
+	for (unsigned int i=0; i<FloorPlanIndexCount; ++i)
+		RoomMesh->Indices.push_back(TotalVertexCount + FloorPlanIndices[i]);
 
-	// bottom left
-	Vert.Position = XMFLOAT3(MinX, CeilingY, MinZ);
-	Vert.TexCoord = XMFLOAT2(0.0f, FloorHeight);
-	RoomMesh->Vertices.push_back(Vert);
-
-	// bottom right
-	Vert.Position = XMFLOAT3(MaxX, CeilingY, MinZ);
-	Vert.TexCoord = XMFLOAT2(FloorWidth, FloorHeight);
-	RoomMesh->Vertices.push_back(Vert);
-
-	// top right
-	Vert.Position = XMFLOAT3(MaxX, CeilingY, MaxZ);
-	Vert.TexCoord = XMFLOAT2(FloorWidth, 0.0f);
-	RoomMesh->Vertices.push_back(Vert);
-
-	// top left
-	Vert.Position = XMFLOAT3(MinX, CeilingY, MaxZ);
-	Vert.TexCoord = XMFLOAT2(0.0f, 0.0f);
-	RoomMesh->Vertices.push_back(Vert);
-
-	// add ceiling indices
-	RoomMesh->Indices.push_back(TotalVertexCount + 0);
-	RoomMesh->Indices.push_back(TotalVertexCount + 2);
-	RoomMesh->Indices.push_back(TotalVertexCount + 3);
-	RoomMesh->Indices.push_back(TotalVertexCount + 0);
-	RoomMesh->Indices.push_back(TotalVertexCount + 1);
-	RoomMesh->Indices.push_back(TotalVertexCount + 2);
-
-  TotalVertexCount += 4;
-  TotalIndexCount += 6;
+  TotalVertexCount += FloorPlanVertexCount;
+  TotalIndexCount += FloorPlanIndexCount;
 }
\ No newline at end of file
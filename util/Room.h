@@ -10,6 +10,7 @@
 #include "MathFunctions.h"
 #include "GeometryGenerator.h"
 #include "Portal.h"
+#include "CellGraph.h"
 
 using namespace DirectX;
 
@@ -76,19 +77,34 @@ private:
 
 
 public:
+	// wall edges (U,V) of the boundary polygons, used to restrict collision to a subset of walls
+	struct WallEdge
+	{
+		XMFLOAT2 U;
+		XMFLOAT2 V;
+	};
+	typedef std::vector<WallEdge> WallEdgeList;
+
 	Room();
 
 	void SetFloorAndCeiling(float FloorHeight, float CeilingHeight);
 	void SetTopography(const std::vector<std::vector<XMFLOAT2>> &PhysicalBoundariesVerticesList);
+	// takes PrebuiltCells' cells, built from the same polygons (see CellGraph::Load), rather than
+	// building them again; with null, it's the same as the overload above
+	void SetTopography(const std::vector<std::vector<XMFLOAT2>> &PhysicalBoundariesVerticesList,
+		CellGraph *PrebuiltCells);
 	void PrintBoundaries();
 	
   void BuildMeshData(GeometryGenerator::MeshData *RoomMesh,
                   SubmeshGeometry *WallsSubmesh, SubmeshGeometry *FloorSubmesh,
                   SubmeshGeometry *CeilingSubmesh)const;
 
+	// if CandidateWalls is not null, only those walls are checked for collision.  It must contain
+	// every wall the path can reach (see GatherWallsInBounds)
 	XMFLOAT3 SpherePathCollision(float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist,
 									float *XDist_ptr, float *RedirectRatio_ptr, XMFLOAT3 *RedirectDir_ptr,
-									XMFLOAT3 *T_ptr, XMFLOAT3 *TNormal_ptr)const;
+									XMFLOAT3 *T_ptr, XMFLOAT3 *TNormal_ptr,
+									const WallEdgeList *CandidateWalls = nullptr)const;
 
 	XMFLOAT3 SpherePathVirtualCollision(const XMMATRIX &Virtualize, const XMMATRIX &Unvirtualize,
 									float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist,
@@ -97,6 +113,22 @@ public:
 
 	void PortalRelocate(XMFLOAT3 S, XMFLOAT3 Dir, Portal *ThisPortal, const Portal &OtherPortal)const;
 
+	// the polygon of the wall, floor or ceiling that Point is on and Normal faces out of.  floors
+	// and ceilings give the room's bounding rectangle, which contains them.  returns false if Point
+	// isn't on any of them
+	bool GetSurfacePolygon(XMFLOAT3 Point, XMFLOAT3 Normal, std::vector<XMFLOAT3> *Polygon)const;
+
+	// appends the walls that overlap the XZ-plane box [BoundsMin, BoundsMax].  only the walls of
+	// the cells that overlap it are looked at
+	void GatherWallsInBounds(XMFLOAT2 BoundsMin, XMFLOAT2 BoundsMax, WallEdgeList *Walls)const;
+
+	// the floor plan split into convex cells, with what each can see; empty if the boundary
+	// polygons couldn't be split
+	const CellGraph& GetCells()const;
+
+	// length of the shortest wall the sphere can reach along the path, or infinity if none
+	float MinFeatureSizeNearPath(float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist)const;
+
 private:
 	XMFLOAT2 FindFirstExit(float DiscRadius, XMFLOAT2 S, XMFLOAT2 Dir, float MoveDist, 
 							const BoundaryElementsList &DiscCenterBoundaryElements,
@@ -106,7 +138,11 @@ private:
 
 	XMFLOAT3 SpherePathWallCollision(float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist,
 									float *XDist_ptr, float *RedirectRatio_ptr, XMFLOAT3 *RedirectDir_ptr,
-									XMFLOAT3 *T_ptr, XMFLOAT3 *TNormal_ptr)const;
+									XMFLOAT3 *T_ptr, XMFLOAT3 *TNormal_ptr,
+									const WallEdgeList *CandidateWalls)const;
+
+	static void AddReachableBoundaryElements(XMFLOAT2 StartXZ, float SumDist, XMFLOAT2 U, XMFLOAT2 V,
+									BoundaryElementsList *Elements);
 
 	XMFLOAT3 SpherePathFloorCeilingCollision(float SphereRadius, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist,
 									float *XDist_ptr, float *RedirectRatio_ptr, XMFLOAT3 *RedirectDir_ptr,
@@ -124,6 +160,9 @@ private:
 	
 	// a vector of vertexlists, each representing a boundary polygon in the room
 	std::vector<std::vector<XMFLOAT2>> BoundaryPolygons;
+
+	// BoundaryPolygons split into cells, rebuilt by SetTopography
+	CellGraph Cells;
 };
 
 #endif
@@ -0,0 +1,180 @@
+#include "RoomBinary.h"
+
+#include <cstring>
+#include <fstream>
+
+static_assert(sizeof(RoomBinaryHeader) == 224, "RoomBinaryHeader must have no padding.");
+static_assert(sizeof(RoomBinaryVertex) == 11 * sizeof(float), "RoomBinaryVertex must be packed.");
+static_assert(sizeof(RoomBinaryChunk) == 32, "RoomBinaryChunk must be packed.");
+
+namespace {
+  const uint64_t SECTION_ALIGNMENT = 16;
+
+  const size_t SECTION_ELEMENT_SIZES[ROOM_SECTION_COUNT] = {
+    sizeof(uint32_t),
+    sizeof(PolygonPoint),
+    1,
+    sizeof(RoomBinaryVertex),
+    sizeof(uint32_t),
+    sizeof(RoomBinaryChunk),
+  };
+
+  uint64_t AlignUp(uint64_t offset) {
+    return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+  }
+}
+
+const char* RoomBinaryParseResultString(RoomBinaryParseResult result) {
+  switch (result) {
+    case ROOM_BINARY_OK: return "OK";
+    case ROOM_BINARY_TOO_SMALL: return "File is smaller than its header";
+    case ROOM_BINARY_BAD_MAGIC: return "Not a binary room file";
+    case ROOM_BINARY_UNSUPPORTED_VERSION: return "Unsupported binary room file version";
+    case ROOM_BINARY_BAD_SECTION: return "Binary room file section is damaged";
+  }
+  return "Unknown binary room file error";
+}
+
+RoomBinaryParseResult ParseRoomBinary(const uint8_t* data, size_t size, RoomBinaryView* view) {
+  if (size < sizeof(RoomBinaryHeader))
+    return ROOM_BINARY_TOO_SMALL;
+  const RoomBinaryHeader* header = reinterpret_cast<const RoomBinaryHeader*>(data);
+  if (header->Magic != ROOM_BINARY_MAGIC)
+    return ROOM_BINARY_BAD_MAGIC;
+  if (header->Version != ROOM_BINARY_VERSION)
+    return ROOM_BINARY_UNSUPPORTED_VERSION;
+
+  const void* sections[ROOM_SECTION_COUNT] = {};
+  size_t counts[ROOM_SECTION_COUNT] = {};
+  for (int i = 0; i < ROOM_SECTION_COUNT; ++i) {
+    const RoomBinarySectionEntry& entry = header->Sections[i];
+    if (entry.Count == 0)
+      continue;
+    if (entry.Offset % SECTION_ALIGNMENT != 0 || entry.Offset < sizeof(RoomBinaryHeader) ||
+        entry.Offset > size || entry.Count > (size - entry.Offset) / SECTION_ELEMENT_SIZES[i])
+      return ROOM_BINARY_BAD_SECTION;
+    sections[i] = data + entry.Offset;
+    counts[i] = static_cast<size_t>(entry.Count);
+  }
+
+  // No two sections may share bytes.
+  for (int i = 0; i < ROOM_SECTION_COUNT; ++i) {
+    for (int j = i + 1; j < ROOM_SECTION_COUNT; ++j) {
+      if (counts[i] == 0 || counts[j] == 0)
+        continue;
+      const uint64_t endI = header->Sections[i].Offset + counts[i] * SECTION_ELEMENT_SIZES[i];
+      const uint64_t endJ = header->Sections[j].Offset + counts[j] * SECTION_ELEMENT_SIZES[j];
+      if (header->Sections[i].Offset < endJ && header->Sections[j].Offset < endI)
+        return ROOM_BINARY_BAD_SECTION;
+    }
+  }
+
+  RoomBinaryView parsed;
+  parsed.Header = header;
+  parsed.PolygonSizes = static_cast<const uint32_t*>(sections[ROOM_SECTION_POLYGON_SIZES]);
+  parsed.PolygonCount = counts[ROOM_SECTION_POLYGON_SIZES];
+  parsed.PolygonPoints = static_cast<const PolygonPoint*>(sections[ROOM_SECTION_POLYGON_POINTS]);
+  parsed.PolygonPointCount = counts[ROOM_SECTION_POLYGON_POINTS];
+  parsed.Cells = static_cast<const uint8_t*>(sections[ROOM_SECTION_CELLS]);
+  parsed.CellsSize = counts[ROOM_SECTION_CELLS];
+  parsed.MeshVertices = static_cast<const RoomBinaryVertex*>(sections[ROOM_SECTION_MESH_VERTICES]);
+  parsed.MeshVertexCount = counts[ROOM_SECTION_MESH_VERTICES];
+  parsed.MeshIndices = static_cast<const uint32_t*>(sections[ROOM_SECTION_MESH_INDICES]);
+  parsed.MeshIndexCount = counts[ROOM_SECTION_MESH_INDICES];
+  parsed.MeshChunks = static_cast<const RoomBinaryChunk*>(sections[ROOM_SECTION_MESH_CHUNKS]);
+  parsed.MeshChunkCount = counts[ROOM_SECTION_MESH_CHUNKS];
+
+  // The polygons' sizes must add up to the points.
+  uint64_t pointCount = 0;
+  for (size_t i = 0; i < parsed.PolygonCount; ++i) {
+    if (parsed.PolygonSizes[i] < 3)
+      return ROOM_BINARY_BAD_SECTION;
+    pointCount += parsed.PolygonSizes[i];
+  }
+  if (pointCount != parsed.PolygonPointCount)
+    return ROOM_BINARY_BAD_SECTION;
+
+  // A mesh is whole triangles of vertices it has, and its chunks cover its indices in order.
+  const bool hasMesh = parsed.MeshVertexCount > 0 || parsed.MeshIndexCount > 0 ||
+                       parsed.MeshChunkCount > 0;
+  if (hasMesh) {
+    if (parsed.MeshVertexCount == 0 || parsed.MeshIndexCount % 3 != 0 ||
+        parsed.MeshChunkCount == 0 || parsed.MeshVertexCount > UINT32_MAX)
+      return ROOM_BINARY_BAD_SECTION;
+    const uint32_t vertexCount = static_cast<uint32_t>(parsed.MeshVertexCount);
+    for (size_t i = 0; i < parsed.MeshIndexCount; ++i) {
+      if (parsed.MeshIndices[i] >= vertexCount)
+        return ROOM_BINARY_BAD_SECTION;
+    }
+    uint64_t nextIndex = 0;
+    for (size_t i = 0; i < parsed.MeshChunkCount; ++i) {
+      if (parsed.MeshChunks[i].StartIndex != nextIndex)
+        return ROOM_BINARY_BAD_SECTION;
+      nextIndex += parsed.MeshChunks[i].IndexCount;
+    }
+    if (nextIndex != parsed.MeshIndexCount)
+      return ROOM_BINARY_BAD_SECTION;
+  }
+
+  *view = parsed;
+  return ROOM_BINARY_OK;
+}
+
+bool WriteRoomBinary(const std::string& path, const RoomBinaryContents& contents,
+                     std::string* error) {
+  const RoomFileData& room = *contents.Room;
+  std::vector<uint32_t> polygonSizes;
+  std::vector<PolygonPoint> polygonPoints;
+  for (const std::vector<PolygonPoint>& polygon : room.Polygons) {
+    polygonSizes.push_back(static_cast<uint32_t>(polygon.size()));
+    polygonPoints.insert(polygonPoints.end(), polygon.begin(), polygon.end());
+  }
+
+  const void* sections[ROOM_SECTION_COUNT] = {
+    polygonSizes.data(), polygonPoints.data(), contents.Cells.data(), contents.MeshVertices,
+    contents.MeshIndices, contents.MeshChunks.data(),
+  };
+  const size_t counts[ROOM_SECTION_COUNT] = {
+    polygonSizes.size(), polygonPoints.size(), contents.Cells.size(), contents.MeshVertexCount,
+    contents.MeshIndexCount, contents.MeshChunks.size(),
+  };
+
+  RoomBinaryHeader header = {};
+  header.Magic = ROOM_BINARY_MAGIC;
+  header.Version = ROOM_BINARY_VERSION;
+  memcpy(header.CameraPosition, room.CameraPosition, sizeof(header.CameraPosition));
+  header.PlayerRadius = room.PlayerRadius;
+  memcpy(header.PlayerPosition, room.PlayerPosition, sizeof(header.PlayerPosition));
+  header.FloorHeight = room.FloorHeight;
+  header.CeilingHeight = room.CeilingHeight;
+  header.PortalA = room.PortalA;
+  header.PortalB = room.PortalB;
+  uint64_t offset = sizeof(RoomBinaryHeader);
+  for (int i = 0; i < ROOM_SECTION_COUNT; ++i) {
+    if (counts[i] == 0)
+      continue;
+    offset = AlignUp(offset);
+    header.Sections[i].Offset = offset;
+    header.Sections[i].Count = counts[i];
+    offset += counts[i] * SECTION_ELEMENT_SIZES[i];
+  }
+
+  std::ofstream out(path, std::ofstream::binary | std::ofstream::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  const char padding[SECTION_ALIGNMENT] = {};
+  uint64_t written = sizeof(header);
+  for (int i = 0; i < ROOM_SECTION_COUNT; ++i) {
+    if (counts[i] == 0)
+      continue;
+    out.write(padding, static_cast<std::streamsize>(header.Sections[i].Offset - written));
+    const uint64_t bytes = counts[i] * SECTION_ELEMENT_SIZES[i];
+    out.write(static_cast<const char*>(sections[i]), static_cast<std::streamsize>(bytes));
+    written = header.Sections[i].Offset + bytes;
+  }
+  out.close();
+  if (!out.good()) {
+    *error = "Could not write binary room file " + path;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "RoomFile.h"
+
+// A room file in binary.  The header holds what the first lines of a text room file do (see
+// RoomFile.h), and sections after it hold the floor plan and, optionally, what's built from it
+// ahead of time: the cells (see CellGraph::Save) and the optimized, chunked mesh.  Each section
+// is an array at a 16-byte aligned offset the header gives, in the machine's own layout, so
+// ParseRoomBinary only checks the file and points into it: a memory-mapped file is used in place,
+// without reading or converting anything.
+
+const uint32_t ROOM_BINARY_MAGIC = 0x4D4F4F52;   // "ROOM"
+const uint32_t ROOM_BINARY_VERSION = 1;
+
+enum RoomBinarySection {
+  ROOM_SECTION_POLYGON_SIZES,     // uint32_t vertex count of each polygon
+  ROOM_SECTION_POLYGON_POINTS,    // PolygonPoint; every polygon's, in order
+  ROOM_SECTION_CELLS,             // Bytes written by CellGraph::Save
+  ROOM_SECTION_MESH_VERTICES,     // RoomBinaryVertex
+  ROOM_SECTION_MESH_INDICES,      // uint32_t, three per triangle
+  ROOM_SECTION_MESH_CHUNKS,       // RoomBinaryChunk, covering the indices in order
+  ROOM_SECTION_COUNT
+};
+
+struct RoomBinarySectionEntry {
+  uint64_t Offset;                // From the start of the file
+  uint64_t Count;                 // Elements; 0 if the section is left out
+};
+
+struct RoomBinaryHeader {
+  uint32_t Magic;
+  uint32_t Version;
+  float CameraPosition[3];
+  float PlayerRadius;
+  float PlayerPosition[3];
+  float FloorHeight;
+  float CeilingHeight;
+  PortalPlacement PortalA;
+  PortalPlacement PortalB;
+  uint32_t Reserved;              // 0; aligns Sections
+  RoomBinarySectionEntry Sections[ROOM_SECTION_COUNT];
+};
+
+// The same layout as GeometryGenerator::Vertex.
+struct RoomBinaryVertex {
+  float Position[3];
+  float Normal[3];
+  float Tangent[3];
+  float TexCoord[2];
+};
+
+struct RoomBinaryChunk {
+  uint32_t StartIndex;
+  uint32_t IndexCount;
+  float BoundsMin[3];
+  float BoundsMax[3];
+};
+
+enum RoomBinaryParseResult {
+  ROOM_BINARY_OK,
+  ROOM_BINARY_TOO_SMALL,
+  ROOM_BINARY_BAD_MAGIC,
+  ROOM_BINARY_UNSUPPORTED_VERSION,
+  ROOM_BINARY_BAD_SECTION,        // Outside the file, misaligned, or inconsistent with the others
+};
+
+const char* RoomBinaryParseResultString(RoomBinaryParseResult result);
+
+// Pointers into the parsed file, which must outlive them.  Sections that were left out are null
+// with a count of 0.
+struct RoomBinaryView {
+  const RoomBinaryHeader* Header = nullptr;
+  const uint32_t* PolygonSizes = nullptr;
+  size_t PolygonCount = 0;
+  const PolygonPoint* PolygonPoints = nullptr;
+  size_t PolygonPointCount = 0;
+  const uint8_t* Cells = nullptr;
+  size_t CellsSize = 0;
+  const RoomBinaryVertex* MeshVertices = nullptr;
+  size_t MeshVertexCount = 0;
+  const uint32_t* MeshIndices = nullptr;
+  size_t MeshIndexCount = 0;
+  const RoomBinaryChunk* MeshChunks = nullptr;
+  size_t MeshChunkCount = 0;
+};
+
+// Checks the header and that every section lies in the file, apart from the others, and agrees
+// with them (polygon sizes add up to the points, indices are in range and chunks cover them), then
+// fills in view.
+// data must be 16-byte aligned, as a mapped file is.
+RoomBinaryParseResult ParseRoomBinary(const uint8_t* data, size_t size, RoomBinaryView* view);
+
+// What WriteRoomBinary stores.  room's polygons are the floor plan; the other parts are left out
+// if they're empty.
+struct RoomBinaryContents {
+  const RoomFileData* Room = nullptr;
+  std::vector<uint8_t> Cells;
+  const RoomBinaryVertex* MeshVertices = nullptr;
+  size_t MeshVertexCount = 0;
+  const uint32_t* MeshIndices = nullptr;
+  size_t MeshIndexCount = 0;
+  std::vector<RoomBinaryChunk> MeshChunks;
+};
+
+// Returns false, with a message in *error, if the file can't be written.
+bool WriteRoomBinary(const std::string& path, const RoomBinaryContents& contents,
+                     std::string* error);
@@ -0,0 +1,566 @@
+#include "RoomFile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace {
+  // Powers of ten a double holds exactly.  A mantissa of up to 53 bits multiplied or divided by
+  // one of them is correctly rounded.
+  const double EXACT_POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+  const int MAX_EXACT_POWER_OF_TEN = 22;
+  const uint64_t MAX_EXACT_MANTISSA = uint64_t(1) << 53;
+  const int MAX_MANTISSA_DIGITS = 19;     // Always fit in a uint64_t
+
+  // A float is written in fixed point with the fewest decimals, up to MAX_FIXED_DECIMALS, that
+  // read back as the same float.  Failing that, it's written the way %g does with the fewest
+  // significant digits that do; nine always do.
+  const int MAX_FIXED_DECIMALS = 9;
+  const int MIN_FLOAT_DIGITS = 6;
+  const int MAX_FLOAT_DIGITS = 9;
+
+  // Numbers longer than this are copied to the heap for strtof.
+  const size_t MAX_SHORT_NUMBER_LENGTH = 63;
+
+  bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  // Spaces within a line.  '\r' is one, so files with Windows line endings read the same.
+  bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+  }
+
+  // Whether a number may end before c: numbers are separated by spaces, and a comment may follow
+  // the last one.
+  bool EndsNumber(const char* p, const char* last) {
+    return p == last || IsSpace(*p) || *p == '#';
+  }
+
+  // Whether a double rounds to the float nearest the exact value it was itself rounded from.
+  // That's so unless it's outside the normal floats or landed exactly halfway between two of
+  // them, where rounding again might go the wrong way.
+  bool RoundsToNearestFloat(double value) {
+    if (!(value >= FLT_MIN && value <= FLT_MAX))
+      return false;
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    // The 29 low bits of the double's mantissa are the ones a float doesn't have.
+    return (bits & 0x1FFFFFFF) != 0x10000000;
+  }
+
+  // Rounds correctly in every case, but needs a terminated copy and depends on the locale, so
+  // it's only used for what ParseFloat's fast path can't handle.
+  const char* ParseFloatSlowly(const char* first, const char* last, float* value) {
+    const size_t length = static_cast<size_t>(last - first);
+    char shortNumber[MAX_SHORT_NUMBER_LENGTH + 1];
+    std::string longNumber;
+    const char* number = shortNumber;
+    if (length <= MAX_SHORT_NUMBER_LENGTH) {
+      memcpy(shortNumber, first, length);
+      shortNumber[length] = '\0';
+    } else {
+      longNumber.assign(first, last);
+      number = longNumber.c_str();
+    }
+    char* end;
+    errno = 0;
+    *value = std::strtof(number, &end);
+    if (end != number + length || errno == ERANGE)
+      return nullptr;
+    return last;
+  }
+
+  // Parses a decimal float at the start of [first, last) the way std::from_chars does, which
+  // Visual Studio 2017 only has for integers; a leading '+' is allowed too, as it is in room
+  // files strtof read.  Returns the end of the number, or null if there isn't one or it's out of
+  // range.  Numbers of up to 15 or so significant digits take the fast path, which is exact;
+  // anything else falls back on strtof.
+  const char* ParseFloat(const char* first, const char* last, float* value) {
+    const char* p = first;
+    bool negative = false;
+    if (p != last && (*p == '-' || *p == '+')) {
+      negative = *p == '-';
+      ++p;
+    }
+
+    // The number is mantissa * 10^exponent, with only the first MAX_MANTISSA_DIGITS significant
+    // digits in the mantissa.
+    uint64_t mantissa = 0;
+    int mantissaDigits = 0;
+    int exponent = 0;
+    bool sawDigit = false;
+    bool truncated = false;
+    for (; p != last && IsDigit(*p); ++p) {
+      sawDigit = true;
+      if (mantissaDigits < MAX_MANTISSA_DIGITS) {
+        mantissa = mantissa * 10 + (*p - '0');
+        mantissaDigits += mantissa != 0;
+      } else {
+        ++exponent;
+        truncated |= *p != '0';
+      }
+    }
+    if (p != last && *p == '.') {
+      for (++p; p != last && IsDigit(*p); ++p) {
+        sawDigit = true;
+        if (mantissaDigits < MAX_MANTISSA_DIGITS) {
+          mantissa = mantissa * 10 + (*p - '0');
+          mantissaDigits += mantissa != 0;
+          --exponent;
+        } else {
+          truncated |= *p != '0';
+        }
+      }
+    }
+    if (!sawDigit)
+      return nullptr;
+
+    // Like from_chars, an 'e' without digits after it isn't part of the number.
+    if (p != last && (*p == 'e' || *p == 'E')) {
+      const char* q = p + 1;
+      bool negativeExponent = false;
+      if (q != last && (*q == '-' || *q == '+')) {
+        negativeExponent = *q == '-';
+        ++q;
+      }
+      if (q != last && IsDigit(*q)) {
+        int written = 0;
+        for (; q != last && IsDigit(*q); ++q) {
+          if (written < 100000)
+            written = written * 10 + (*q - '0');
+        }
+        exponent += negativeExponent ? -written : written;
+        p = q;
+      }
+    }
+
+    if (mantissa == 0) {
+      *value = negative ? -0.0f : 0.0f;
+      return p;
+    }
+    if (!truncated && mantissa < MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POWER_OF_TEN &&
+        exponent <= MAX_EXACT_POWER_OF_TEN) {
+      const double power = EXACT_POWERS_OF_TEN[exponent < 0 ? -exponent : exponent];
+      const double exact = exponent < 0 ? mantissa / power : mantissa * power;
+      if (RoundsToNearestFloat(exact)) {
+        const float rounded = static_cast<float>(exact);
+        *value = negative ? -rounded : rounded;
+        return p;
+      }
+    }
+    return ParseFloatSlowly(first, p, value);
+  }
+
+  // std::from_chars for an int, plus a leading '+'.
+  const char* ParseInt(const char* first, const char* last, int* value) {
+    const char* p = first;
+    bool negative = false;
+    if (p != last && (*p == '-' || *p == '+')) {
+      negative = *p == '-';
+      ++p;
+    }
+    if (p == last || !IsDigit(*p))
+      return nullptr;
+    int64_t magnitude = 0;
+    for (; p != last && IsDigit(*p); ++p) {
+      magnitude = magnitude * 10 + (*p - '0');
+      if (magnitude > static_cast<int64_t>(INT_MAX) + 1)
+        return nullptr;
+    }
+    const int64_t signedValue = negative ? -magnitude : magnitude;
+    if (signedValue > INT_MAX)
+      return nullptr;
+    *value = static_cast<int>(signedValue);
+    return p;
+  }
+
+  // Appends mantissa / 10^decimals in fixed point, which ParseFloat reads as exactly that.
+  void AppendFixed(bool negative, uint64_t mantissa, int decimals, std::string* text) {
+    char digits[32];
+    char* p = digits + sizeof(digits);
+    int written = 0;
+    do {
+      if (written == decimals && decimals > 0)
+        *--p = '.';
+      *--p = static_cast<char>('0' + mantissa % 10);
+      mantissa /= 10;
+      ++written;
+    } while (mantissa != 0 || written <= decimals);
+    if (negative)
+      *--p = '-';
+    text->append(p, digits + sizeof(digits));
+  }
+
+  void AppendFloat(float value, std::string* text) {
+    if (value == 0.0f) {
+      text->append(std::signbit(value) ? "-0" : "0");
+      return;
+    }
+    // The decimals ParseFloat's fast path would read back as this float, if there are few enough.
+    const float magnitude = std::fabs(value);
+    for (int decimals = 0; decimals <= MAX_FIXED_DECIMALS; ++decimals) {
+      const double power = EXACT_POWERS_OF_TEN[decimals];
+      const double scaled = magnitude * power;
+      if (scaled >= static_cast<double>(MAX_EXACT_MANTISSA))
+        break;
+      const uint64_t mantissa = static_cast<uint64_t>(scaled + 0.5);
+      const double exact = mantissa / power;
+      if (RoundsToNearestFloat(exact) && static_cast<float>(exact) == magnitude) {
+        AppendFixed(value < 0.0f, mantissa, decimals, text);
+        return;
+      }
+    }
+
+    char digits[32];
+    for (int precision = MIN_FLOAT_DIGITS; precision <= MAX_FLOAT_DIGITS; ++precision) {
+      const int length = snprintf(digits, sizeof(digits), "%.*g", precision, value);
+      float readBack;
+      if (precision == MAX_FLOAT_DIGITS ||
+          (ParseFloat(digits, digits + length, &readBack) != nullptr && readBack == value))
+        break;
+    }
+    text->append(digits);
+  }
+
+  void AppendFloats(const float* values, int count, std::string* text) {
+    for (int i = 0; i < count; ++i) {
+      if (i > 0)
+        text->push_back(' ');
+      AppendFloat(values[i], text);
+    }
+    text->push_back('\n');
+  }
+
+  void AppendPortal(const PortalPlacement& portal, const char* name, std::string* text) {
+    text->append("# ").append(name).append(": radius, position, normal, up\n");
+    AppendFloats(&portal.Radius, 1, text);
+    AppendFloats(portal.Position, 3, text);
+    AppendFloats(portal.Normal, 3, text);
+    AppendFloats(portal.Up, 3, text);
+  }
+
+  // Reads a whole file into text with a single read.
+  bool ReadWholeFile(const std::string& path, std::string* text) {
+    std::ifstream in(path, std::ifstream::binary | std::ifstream::ate);
+    if (!in.good())
+      return false;
+    const std::streamoff size = in.tellg();
+    if (size < 0)
+      return false;
+    text->resize(static_cast<size_t>(size));
+    in.seekg(0);
+    return size == 0 || in.read(&(*text)[0], size).good();
+  }
+
+  // The data lines of a file that's been read into memory, skipping blank lines and comments.
+  // Numbers are parsed straight out of the text, without copying any line.
+  class DataLineReader {
+  public:
+    DataLineReader(const std::string& name, const char* text, size_t size, std::string* error)
+      : mName(name), mNext(text), mEnd(text + size), mError(error) {}
+
+    // Reads the next data line and parses count numbers from it into values.  what names them in
+    // the error message if they're missing.  Anything after them on the line is ignored.
+    bool ReadFloats(int count, float* values, const char* what) {
+      if (!NextLine(what))
+        return false;
+      for (int i = 0; i < count; ++i) {
+        SkipSpaces();
+        mToken = mCursor;
+        const char* end = ParseFloat(mCursor, mLineEnd, &values[i]);
+        if (end == nullptr || !EndsNumber(end, mLineEnd))
+          return Fail(what);
+        mCursor = end;
+      }
+      return true;
+    }
+
+    bool ReadInts(int count, int* values, const char* what) {
+      if (!NextLine(what))
+        return false;
+      for (int i = 0; i < count; ++i) {
+        SkipSpaces();
+        mToken = mCursor;
+        const char* end = ParseInt(mCursor, mLineEnd, &values[i]);
+        if (end == nullptr || !EndsNumber(end, mLineEnd))
+          return Fail(what);
+        mCursor = end;
+      }
+      return true;
+    }
+
+    bool ReadPortal(PortalPlacement* portal, const char* name) {
+      const std::string what(name);
+      return ReadFloats(1, &portal->Radius, (what + "'s radius").c_str()) &&
+             ReadFloats(3, portal->Position, (what + "'s position").c_str()) &&
+             ReadFloats(3, portal->Normal, (what + "'s normal").c_str()) &&
+             ReadFloats(3, portal->Up, (what + "'s up").c_str());
+    }
+
+    // The rest of the next data line, without trailing whitespace.
+    bool ReadLine(std::string* line, const char* what) {
+      if (!NextLine(what))
+        return false;
+      const char* end = mLineEnd;
+      while (end != mCursor && IsSpace(end[-1]))
+        --end;
+      mToken = mCursor;
+      line->assign(mCursor, end);
+      mCursor = mLineEnd;
+      return true;
+    }
+
+    // Whether there's another data line, without reading it.
+    bool AtEnd() {
+      if (!mPending)
+        mPending = FindDataLine();
+      return !mPending;
+    }
+
+    // An upper bound on how many more data lines there can be, for checking counts before
+    // allocating for them: each takes at least a character and a line break.
+    size_t GetMaxLinesLeft() const {
+      return static_cast<size_t>(mEnd - mNext) / 2 + 1;
+    }
+
+    // Fails at the number the last read couldn't parse, or else at the last one it did.
+    bool Fail(const char* what) {
+      const size_t column = static_cast<size_t>(mToken - mLineStart) + 1;
+      *mError = mName + ":" + std::to_string(mLineNumber) + ":" + std::to_string(column) +
+                ": expected " + what;
+      return false;
+    }
+
+  private:
+    // Makes the next data line current, or returns false (with the error set) at the end of the
+    // file.
+    bool NextLine(const char* what) {
+      const bool found = mPending || FindDataLine();
+      mPending = false;
+      if (!found)
+        *mError = mName + ":" + std::to_string(mLineNumber) + ": ended before " + what;
+      return found;
+    }
+
+    // Finds the next non-blank, non-comment line and points mCursor at its first non-space.
+    bool FindDataLine() {
+      while (mNext != mEnd) {
+        mLineStart = mNext;
+        const void* newline = memchr(mNext, '\n', static_cast<size_t>(mEnd - mNext));
+        mLineEnd = newline != nullptr ? static_cast<const char*>(newline) : mEnd;
+        mNext = newline != nullptr ? mLineEnd + 1 : mEnd;
+        ++mLineNumber;
+        mCursor = mLineStart;
+        SkipSpaces();
+        mToken = mCursor;
+        if (mCursor != mLineEnd && *mCursor != '#')
+          return true;
+      }
+      return false;
+    }
+
+    void SkipSpaces() {
+      while (mCursor != mLineEnd && IsSpace(*mCursor))
+        ++mCursor;
+    }
+
+    std::string mName;
+    const char* mNext;                  // Start of the line after the current one
+    const char* mEnd;
+    std::string* mError;
+    const char* mLineStart = nullptr;
+    const char* mLineEnd = nullptr;
+    const char* mCursor = nullptr;      // Where the next number starts, give or take spaces
+    const char* mToken = nullptr;       // Start of the number being read, or last read
+    bool mPending = false;              // A data line AtEnd found but nothing has read yet
+    int mLineNumber = 0;
+  };
+}
+
+bool ParseRoomText(const char* text, size_t size, const std::string& name, RoomFileData* room,
+                   std::string* error) {
+  DataLineReader reader(name, text, size, error);
+  float heights[2];
+  if (!reader.ReadFloats(3, room->CameraPosition, "the camera's position") ||
+      !reader.ReadFloats(1, &room->PlayerRadius, "the player's radius") ||
+      !reader.ReadFloats(3, room->PlayerPosition, "the player's position") ||
+      !reader.ReadPortal(&room->PortalA, "portal A") ||
+      !reader.ReadPortal(&room->PortalB, "portal B") ||
+      !reader.ReadFloats(2, heights, "the floor and ceiling heights"))
+    return false;
+  room->FloorHeight = heights[0];
+  room->CeilingHeight = heights[1];
+
+  room->Polygons.clear();
+  while (!reader.AtEnd()) {
+    int vertexCount;
+    if (!reader.ReadInts(1, &vertexCount, "a polygon's vertex count"))
+      return false;
+    if (vertexCount < 3)
+      return reader.Fail("a polygon of at least 3 vertices");
+    if (static_cast<size_t>(vertexCount) > reader.GetMaxLinesLeft())
+      return reader.Fail("a polygon's vertex count no more than the lines left in the file");
+    std::vector<PolygonPoint> polygon(vertexCount);
+    for (PolygonPoint& point : polygon) {
+      float xz[2];
+      if (!reader.ReadFloats(2, xz, "a polygon vertex"))
+        return false;
+      point = { xz[0], xz[1] };
+    }
+    room->Polygons.push_back(std::move(polygon));
+  }
+  return true;
+}
+
+bool ReadRoomFile(const std::string& path, RoomFileData* room, std::string* error) {
+  std::string text;
+  if (!ReadWholeFile(path, &text)) {
+    *error = "Could not open room file " + path;
+    return false;
+  }
+  return ParseRoomText(text.data(), text.size(), path, room, error);
+}
+
+void FormatRoomText(const RoomFileData& room, std::string* text) {
+  text->append("# camera position\n");
+  AppendFloats(room.CameraPosition, 3, text);
+  text->append("# player radius, position\n");
+  AppendFloats(&room.PlayerRadius, 1, text);
+  AppendFloats(room.PlayerPosition, 3, text);
+  AppendPortal(room.PortalA, "portal A", text);
+  AppendPortal(room.PortalB, "portal B", text);
+  text->append("# floor and ceiling heights\n");
+  const float heights[2] = { room.FloorHeight, room.CeilingHeight };
+  AppendFloats(heights, 2, text);
+  text->append("# floor plan\n");
+  for (const std::vector<PolygonPoint>& polygon : room.Polygons) {
+    text->append(std::to_string(polygon.size())).push_back('\n');
+    for (const PolygonPoint& point : polygon) {
+      const float xz[2] = { point.x, point.y };
+      AppendFloats(xz, 2, text);
+    }
+  }
+}
+
+bool WriteRoomFile(const std::string& path, const RoomFileData& room, std::string* error) {
+  std::string text;
+  FormatRoomText(room, &text);
+  std::ofstream out(path, std::ofstream::binary | std::ofstream::trunc);
+  out.write(text.data(), static_cast<std::streamsize>(text.size()));
+  out.close();
+  if (!out.good()) {
+    *error = "Could not write room file " + path;
+    return false;
+  }
+  return true;
+}
+
+bool ReadWorldFile(const std::string& path, WorldFileData* world, std::string* error) {
+  std::string text;
+  if (!ReadWholeFile(path, &text)) {
+    *error = "Could not open world file " + path;
+    return false;
+  }
+
+  DataLineReader reader(path, text.data(), text.size(), error);
+  int roomCount;
+  if (!reader.ReadInts(1, &roomCount, "the number of rooms"))
+    return false;
+  if (roomCount < 1)
+    return reader.Fail("at least one room");
+  if (static_cast<size_t>(roomCount) > reader.GetMaxLinesLeft())
+    return reader.Fail("a room count no more than the lines left in the file");
+  world->RoomPaths.resize(roomCount);
+  for (std::string& roomPath : world->RoomPaths) {
+    if (!reader.ReadLine(&roomPath, "a room file path"))
+      return false;
+  }
+
+  int linkCount;
+  if (!reader.ReadInts(1, &linkCount, "the number of doorways"))
+    return false;
+  if (linkCount < 0)
+    return reader.Fail("a doorway count of at least 0");
+  if (static_cast<size_t>(linkCount) > reader.GetMaxLinesLeft())
+    return reader.Fail("a doorway count no more than the lines left in the file");
+  world->Links.resize(linkCount);
+  for (WorldLink& link : world->Links) {
+    float radius;
+    if (!reader.ReadInts(2, link.Rooms, "a doorway's two rooms"))
+      return false;
+    for (int room : link.Rooms) {
+      if (room < 0 || room >= roomCount)
+        return reader.Fail("doorway rooms between 0 and the number of rooms");
+    }
+    if (!reader.ReadFloats(1, &radius, "a doorway's radius"))
+      return false;
+    for (PortalPlacement& end : link.Ends) {
+      end.Radius = radius;
+      if (!reader.ReadFloats(3, end.Position, "a doorway end's position") ||
+          !reader.ReadFloats(3, end.Normal, "a doorway end's normal") ||
+          !reader.ReadFloats(3, end.Up, "a doorway end's up"))
+        return false;
+    }
+  }
+  return true;
+}
+
+RoomParsingBenchmarkResult BenchmarkRoomParsing(size_t vertexCount, int runs) {
+  // A sawtooth wall along the top of a long strip, with coordinates of a few decimal places as
+  // an editor would write them.
+  RoomFileData room;
+  room.PlayerPosition[1] = 0.5f;
+  room.FloorHeight = -1.0f;
+  room.CeilingHeight = 2.5f;
+  std::vector<PolygonPoint> polygon;
+  const size_t teeth = std::max<size_t>(vertexCount, 3) - 2;
+  for (size_t i = 0; i < teeth; ++i)
+    polygon.push_back({ i * 0.125f, i % 2 == 0 ? 3.75f : 4.3125f });
+  polygon.push_back({ (teeth - 1) * 0.125f, 0.0f });
+  polygon.push_back({ 0.0f, 0.0f });
+  std::reverse(polygon.begin(), polygon.end());
+  room.Polygons.push_back(polygon);
+
+  RoomParsingBenchmarkResult result;
+  result.VertexCount = polygon.size();
+  runs = std::max(runs, 1);
+
+  std::string text;
+  auto start = std::chrono::steady_clock::now();
+  for (int run = 0; run < runs; ++run) {
+    text.clear();
+    FormatRoomText(room, &text);
+  }
+  const std::chrono::duration<double> formatElapsed = std::chrono::steady_clock::now() - start;
+  result.Bytes = text.size();
+
+  RoomFileData parsed;
+  std::string error;
+  start = std::chrono::steady_clock::now();
+  for (int run = 0; run < runs; ++run)
+    result.Parsed = ParseRoomText(text.data(), text.size(), "benchmark", &parsed, &error);
+  const std::chrono::duration<double> parseElapsed = std::chrono::steady_clock::now() - start;
+  result.Parsed = result.Parsed && parsed.Polygons.size() == 1 &&
+                  memcmp(parsed.Polygons[0].data(), polygon.data(),
+                         polygon.size() * sizeof(PolygonPoint)) == 0;
+
+  result.FormatSecondsPerRun = formatElapsed.count() / runs;
+  result.ParseSecondsPerRun = parseElapsed.count() / runs;
+  if (result.ParseSecondsPerRun > 0.0) {
+    result.ParseBytesPerSecond = result.Bytes / result.ParseSecondsPerRun;
+    result.ParseVerticesPerSecond = result.VertexCount / result.ParseSecondsPerRun;
+  }
+  return result;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "PolygonTriangulator.h"
+
+// Reads the text files a world is made of: world.txt lists the rooms and the doorways between
+// them, and each room has a file like room.txt with where things start and its floor plan.  Lines
+// starting with '#' are comments, and blank lines are skipped.  Numbers are separated by spaces;
+// anything after the last one a line needs is ignored.  Each file is read with a single read and
+// parsed in place, without copying its lines or, for most numbers, going through the C library.
+
+// Where a portal (or one end of a doorway) is.  Normal faces out of the surface it's on, and Up
+// is in its plane.
+struct PortalPlacement {
+  float Radius = 1.0f;
+  float Position[3] = {};
+  float Normal[3] = {};
+  float Up[3] = {};
+};
+
+// A room file is, one item per line:
+//   the spectator camera's position (x y z)
+//   the player's radius, then its position
+//   portal A's radius, position, normal and up
+//   portal B's, likewise
+//   the floor and ceiling heights
+//   the floor plan: any number of polygons, each a vertex count followed by that many "x z" lines
+struct RoomFileData {
+  float CameraPosition[3] = {};
+  float PlayerRadius = 1.0f;
+  float PlayerPosition[3] = {};
+  PortalPlacement PortalA;
+  PortalPlacement PortalB;
+  float FloorHeight = 0.0f;
+  float CeilingHeight = 0.0f;
+  std::vector<std::vector<PolygonPoint>> Polygons;   // Room's convention: floor on the left
+};
+
+// A doorway between two rooms, with an end on a wall of each.  Walking into one end comes out of
+// the other, the way walking into a portal does.
+struct WorldLink {
+  int Rooms[2];
+  PortalPlacement Ends[2];
+};
+
+// A world file is the number of rooms and a room file path per line, then the number of doorways
+// and, for each, its two rooms' indices ("a b"), the radius of both ends, and each end's position,
+// normal and up.
+struct WorldFileData {
+  std::vector<std::string> RoomPaths;
+  std::vector<WorldLink> Links;
+};
+
+// Each returns false, with a message naming the file, line and column in *error, if the file
+// can't be read or isn't in the format above.
+bool ReadRoomFile(const std::string& path, RoomFileData* room, std::string* error);
+bool ReadWorldFile(const std::string& path, WorldFileData* world, std::string* error);
+
+// ReadRoomFile for a room file already in memory.  name stands for the file in error messages.
+bool ParseRoomText(const char* text, size_t size, const std::string& name, RoomFileData* room,
+                   std::string* error);
+
+// Appends room to text in the room file format, with each number in the fewest digits that read
+// back as the same float, so reading and writing a room again doesn't change it.
+void FormatRoomText(const RoomFileData& room, std::string* text);
+// Returns false, with a message in *error, if the file can't be written.
+bool WriteRoomFile(const std::string& path, const RoomFileData& room, std::string* error);
+
+struct RoomParsingBenchmarkResult {
+  size_t VertexCount = 0;
+  size_t Bytes = 0;                     // Of the room file
+  bool Parsed = false;                  // Whether it read back to the same room
+  double FormatSecondsPerRun = 0.0;
+  double ParseSecondsPerRun = 0.0;
+  double ParseBytesPerSecond = 0.0;
+  double ParseVerticesPerSecond = 0.0;
+};
+
+// Times FormatRoomText and ParseRoomText on a generated room whose floor plan has vertexCount
+// vertices, averaged over runs.
+RoomParsingBenchmarkResult BenchmarkRoomParsing(size_t vertexCount, int runs);
@@ -0,0 +1,291 @@
+#include "RoomLoader.h"
+
+#include "RoomBinary.h"
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+  // Until a room has been loaded, its size is guessed from its file's.  Each line of a floor plan
+  // (about 16 bytes) becomes a wall quad and floor and ceiling vertices, plus its share of the
+  // cells and collision data.  A binary room file already holds most of that.
+  const uint64_t ROOM_BYTES_PER_FILE_BYTE = 32;
+  const uint64_t ROOM_BYTES_PER_BINARY_FILE_BYTE = 2;
+
+  const char* const BINARY_ROOM_EXTENSION = ".bin";
+
+  bool IsBinaryRoomPath(const std::string& path) {
+    const size_t length = strlen(BINARY_ROOM_EXTENSION);
+    return path.size() >= length &&
+           path.compare(path.size() - length, length, BINARY_ROOM_EXTENSION) == 0;
+  }
+
+  uint64_t GetFileSize(const std::string& path) {
+    std::ifstream in(path, std::ifstream::binary | std::ifstream::ate);
+    const std::streamoff size = in.good() ? static_cast<std::streamoff>(in.tellg()) : 0;
+    return size > 0 ? static_cast<uint64_t>(size) : 0;
+  }
+
+  uint64_t CountRoomBytes(const LoadedRoom& room, size_t polygonVertices) {
+    uint64_t bytes = sizeof(LoadedRoom) + polygonVertices * sizeof(XMFLOAT2);
+    const CellGraph& cells = room.Collision.GetCells();
+    for (int i = 0; i < cells.GetCellCount(); ++i) {
+      const CellGraph::Cell& cell = cells.GetCell(i);
+      bytes += sizeof(CellGraph::Cell) + cell.Ring.size() * sizeof(PolygonPoint) +
+               cell.Openings.size() * sizeof(CellGraph::Opening) +
+               cell.Walls.size() * sizeof(CellGraph::Wall) + cell.VisibleCells.size() * sizeof(int);
+    }
+    bytes += room.MeshVertexCount * sizeof(GeometryGenerator::Vertex) +
+             room.MeshIndexCount * sizeof(uint32_t) + room.Chunks.size() * sizeof(MeshChunk);
+    return bytes;
+  }
+
+  // Builds room's collision structures from the floor plan, taking prebuiltCells' cells if it
+  // isn't null.
+  void BuildCollision(LoadedRoom* room, const std::vector<std::vector<XMFLOAT2>>& polygons,
+                      CellGraph* prebuiltCells) {
+    room->Collision.SetFloorAndCeiling(room->File.FloorHeight, room->File.CeilingHeight);
+    room->Collision.SetTopography(polygons, prebuiltCells);
+  }
+
+  // Points room's mesh at the one its PrepareFunction built.
+  void UseBuiltMesh(LoadedRoom* room) {
+    room->MeshVertices = room->Mesh.Vertices.data();
+    room->MeshVertexCount = room->Mesh.Vertices.size();
+    room->MeshIndices = room->Mesh.Indices.data();
+    room->MeshIndexCount = room->Mesh.Indices.size();
+  }
+
+  // Reads a text room file into room->File and builds its collision structures.  Returns the
+  // number of polygon vertices.
+  size_t ReadTextRoom(const std::string& path, LoadedRoom* room) {
+    std::string error;
+    if (!ReadRoomFile(path, &room->File, &error))
+      throw std::runtime_error(error);
+
+    size_t polygonVertices = 0;
+    std::vector<std::vector<XMFLOAT2>> polygons(room->File.Polygons.size());
+    for (size_t i = 0; i < polygons.size(); ++i) {
+      for (const PolygonPoint& point : room->File.Polygons[i])
+        polygons[i].push_back(XMFLOAT2(point.x, point.y));
+      polygonVertices += polygons[i].size();
+    }
+    BuildCollision(room, polygons, nullptr);
+    return polygonVertices;
+  }
+
+  std::shared_ptr<LoadedRoom> LoadTextRoom(const std::string& path,
+                                           const RoomLoader::PrepareFunction& prepare) {
+    std::shared_ptr<LoadedRoom> room = std::make_shared<LoadedRoom>();
+    room->Path = path;
+    const size_t polygonVertices = ReadTextRoom(path, room.get());
+    std::vector<std::vector<PolygonPoint>>().swap(room->File.Polygons);
+
+    prepare(room.get());
+    UseBuiltMesh(room.get());
+    room->Bytes = CountRoomBytes(*room, polygonVertices);
+    return room;
+  }
+
+  // The header and sections are used straight from the mapping.  Only the floor plan is copied,
+  // as Room keeps its own, and the cells, which CellGraph::Load rebuilds its grid for.
+  std::shared_ptr<LoadedRoom> LoadBinaryRoom(const std::string& path,
+                                             const RoomLoader::PrepareFunction& prepare) {
+    static_assert(sizeof(GeometryGenerator::Vertex) == sizeof(RoomBinaryVertex),
+                  "RoomBinaryVertex must match GeometryGenerator::Vertex.");
+    std::shared_ptr<LoadedRoom> room = std::make_shared<LoadedRoom>();
+    room->Path = path;
+    room->Mapping = std::make_unique<MappedFile>(AnsiToWString(path));
+    RoomBinaryView view;
+    const RoomBinaryParseResult result =
+        ParseRoomBinary(room->Mapping->GetData(), room->Mapping->GetSize(), &view);
+    if (result != ROOM_BINARY_OK)
+      throw std::runtime_error(path + ": " + RoomBinaryParseResultString(result));
+
+    const RoomBinaryHeader& header = *view.Header;
+    RoomFileData& file = room->File;
+    memcpy(file.CameraPosition, header.CameraPosition, sizeof(file.CameraPosition));
+    file.PlayerRadius = header.PlayerRadius;
+    memcpy(file.PlayerPosition, header.PlayerPosition, sizeof(file.PlayerPosition));
+    file.PortalA = header.PortalA;
+    file.PortalB = header.PortalB;
+    file.FloorHeight = header.FloorHeight;
+    file.CeilingHeight = header.CeilingHeight;
+
+    std::vector<std::vector<XMFLOAT2>> polygons(view.PolygonCount);
+    const PolygonPoint* point = view.PolygonPoints;
+    for (size_t i = 0; i < polygons.size(); ++i) {
+      polygons[i].resize(view.PolygonSizes[i]);
+      for (XMFLOAT2& vertex : polygons[i]) {
+        vertex = XMFLOAT2(point->x, point->y);
+        ++point;
+      }
+    }
+    CellGraph cells;
+    if (view.CellsSize > 0 && !cells.Load(view.Cells, view.CellsSize))
+      throw std::runtime_error(path + ": cells are damaged");
+    BuildCollision(room.get(), polygons, view.CellsSize > 0 ? &cells : nullptr);
+
+    if (view.MeshVertexCount > 0) {
+      room->MeshVertices = reinterpret_cast<const GeometryGenerator::Vertex*>(view.MeshVertices);
+      room->MeshVertexCount = view.MeshVertexCount;
+      room->MeshIndices = view.MeshIndices;
+      room->MeshIndexCount = view.MeshIndexCount;
+      room->Chunks.resize(view.MeshChunkCount);
+      for (size_t i = 0; i < view.MeshChunkCount; ++i) {
+        const RoomBinaryChunk& stored = view.MeshChunks[i];
+        MeshChunk& chunk = room->Chunks[i];
+        chunk.StartIndex = stored.StartIndex;
+        chunk.IndexCount = stored.IndexCount;
+        memcpy(chunk.BoundsMin, stored.BoundsMin, sizeof(chunk.BoundsMin));
+        memcpy(chunk.BoundsMax, stored.BoundsMax, sizeof(chunk.BoundsMax));
+      }
+    } else {
+      prepare(room.get());
+      UseBuiltMesh(room.get());
+    }
+    room->Bytes = CountRoomBytes(*room, view.PolygonPointCount);
+    return room;
+  }
+
+  std::shared_ptr<LoadedRoom> LoadRoom(const std::string& path,
+                                       const RoomLoader::PrepareFunction& prepare) {
+    return IsBinaryRoomPath(path) ? LoadBinaryRoom(path, prepare) : LoadTextRoom(path, prepare);
+  }
+}
+
+RoomLoader::RoomLoader(const WorldFileData& world, uint64_t budgetBytes, int maxHops,
+                       int maxLoadsInFlight, PrepareFunction prepare)
+  : mPaths(world.RoomPaths),
+    mPrepare(std::move(prepare)),
+    mStreamer(budgetBytes, maxHops, maxLoadsInFlight),
+    mRooms(world.RoomPaths.size()) {
+  for (const std::string& path : mPaths) {
+    mStreamer.AddRoom(GetFileSize(path) * (IsBinaryRoomPath(path) ?
+        ROOM_BYTES_PER_BINARY_FILE_BYTE : ROOM_BYTES_PER_FILE_BYTE));
+  }
+  for (const WorldLink& link : world.Links)
+    mStreamer.AddLink(link.Rooms[0], link.Rooms[1]);
+  mLoadThread = std::thread(&RoomLoader::LoadThreadMain, this);
+}
+
+RoomLoader::~RoomLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    mQuit = true;
+  }
+  mLoadCondition.notify_all();
+  mLoadThread.join();
+}
+
+void RoomLoader::Update(uint64_t frame, int currentRoom) {
+  TakeCompletedLoads();
+
+  std::vector<int> loads;
+  std::vector<int> evictions;
+  mStreamer.Update(frame, currentRoom, &loads, &evictions);
+  for (int room : evictions)
+    mRooms[room].reset();
+
+  if (!loads.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(mLoadMutex);
+      mLoadQueue.insert(mLoadQueue.end(), loads.begin(), loads.end());
+    }
+    mLoadCondition.notify_one();
+  }
+}
+
+std::shared_ptr<const LoadedRoom> RoomLoader::WaitForRoom(int room) {
+  assert(mStreamer.IsResident(room) || mStreamer.IsLoading(room));
+  while (mRooms[room] == nullptr) {
+    {
+      std::unique_lock<std::mutex> lock(mLoadMutex);
+      mCompletedCondition.wait(lock, [this] {
+        return mLoadException != nullptr || !mCompletedLoads.empty();
+      });
+    }
+    TakeCompletedLoads();
+  }
+  return mRooms[room];
+}
+
+void RoomLoader::TakeCompletedLoads() {
+  std::vector<CompletedLoad> completedLoads;
+  {
+    std::lock_guard<std::mutex> lock(mLoadMutex);
+    if (mLoadException != nullptr)
+      std::rethrow_exception(mLoadException);
+    completedLoads.swap(mCompletedLoads);
+  }
+  for (CompletedLoad& load : completedLoads) {
+    mStreamer.OnLoadComplete(load.Room, load.Data->Bytes);
+    mRooms[load.Room] = std::move(load.Data);
+  }
+}
+
+void RoomLoader::LoadThreadMain() {
+  for (;;) {
+    int room;
+    {
+      std::unique_lock<std::mutex> lock(mLoadMutex);
+      mLoadCondition.wait(lock, [this] { return mQuit || !mLoadQueue.empty(); });
+      if (mQuit)
+        return;
+      room = mLoadQueue.front();
+      mLoadQueue.pop_front();
+    }
+
+    // The paths and mPrepare never change, so they're used without any lock.
+    try {
+      std::shared_ptr<const LoadedRoom> data = LoadRoom(mPaths[room], mPrepare);
+      {
+        std::lock_guard<std::mutex> lock(mLoadMutex);
+        mCompletedLoads.push_back({ room, std::move(data) });
+      }
+      mCompletedCondition.notify_all();
+    } catch (...) {
+      {
+        std::lock_guard<std::mutex> lock(mLoadMutex);
+        mLoadException = std::current_exception();
+      }
+      mCompletedCondition.notify_all();
+      return;
+    }
+  }
+}
+
+void RoomLoader::ConvertRoomFile(const std::string& textPath, const std::string& binaryPath,
+                                 const PrepareFunction& prepare) {
+  static_assert(sizeof(GeometryGenerator::Vertex) == sizeof(RoomBinaryVertex),
+                "RoomBinaryVertex must match GeometryGenerator::Vertex.");
+  std::unique_ptr<LoadedRoom> room = std::make_unique<LoadedRoom>();
+  room->Path = textPath;
+  ReadTextRoom(textPath, room.get());
+  prepare(room.get());
+
+  RoomBinaryContents contents;
+  contents.Room = &room->File;
+  if (!room->Collision.GetCells().Empty())
+    room->Collision.GetCells().Save(&contents.Cells);
+  contents.MeshVertices = reinterpret_cast<const RoomBinaryVertex*>(room->Mesh.Vertices.data());
+  contents.MeshVertexCount = room->Mesh.Vertices.size();
+  contents.MeshIndices = room->Mesh.Indices.data();
+  contents.MeshIndexCount = room->Mesh.Indices.size();
+  for (const MeshChunk& chunk : room->Chunks) {
+    RoomBinaryChunk stored;
+    stored.StartIndex = static_cast<uint32_t>(chunk.StartIndex);
+    stored.IndexCount = static_cast<uint32_t>(chunk.IndexCount);
+    memcpy(stored.BoundsMin, chunk.BoundsMin, sizeof(stored.BoundsMin));
+    memcpy(stored.BoundsMax, chunk.BoundsMax, sizeof(stored.BoundsMax));
+    contents.MeshChunks.push_back(stored);
+  }
+  std::string error;
+  if (!WriteRoomBinary(binaryPath, contents, &error))
+    throw std::runtime_error(error);
+  dprintf("%s: %zu polygons, %d cells, %zu vertices in %zu chunks written to %s\n",
+      textPath.c_str(), room->File.Polygons.size(), room->Collision.GetCells().GetCellCount(),
+      contents.MeshVertexCount, contents.MeshChunks.size(), binaryPath.c_str());
+}
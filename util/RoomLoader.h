@@ -0,0 +1,98 @@
+#pragma once
+
+#include "GeometryGenerator.h"
+#include "MappedDdsTexture.h"
+#include "MeshChunker.h"
+#include "Room.h"
+#include "RoomFile.h"
+#include "RoomStreamer.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// A room read from its file, with everything built from it that the app needs to enter it.
+struct LoadedRoom {
+  std::string Path;
+  RoomFileData File;                      // Polygons are cleared once Collision has them
+  Room Collision;                         // Walls, floor, ceiling and cells
+  GeometryGenerator::MeshData Mesh;       // Filled in by the loader's PrepareFunction
+  std::vector<MeshChunk> Chunks;
+
+  // The mesh to draw: Mesh's, or one stored in a binary room file and used from Mapping in place.
+  const GeometryGenerator::Vertex* MeshVertices = nullptr;
+  size_t MeshVertexCount = 0;
+  const uint32_t* MeshIndices = nullptr;
+  size_t MeshIndexCount = 0;
+  std::unique_ptr<MappedFile> Mapping;    // A binary room file, kept mapped while it's used
+
+  uint64_t Bytes = 0;                     // Roughly what all the above take
+};
+
+// Loads and evicts the rooms of a world as a RoomStreamer decides, on a background thread.  Each
+// load reads the room's file, builds its collision structures (see Room::SetTopography), and then
+// calls the PrepareFunction given to the constructor to build whatever else the app wants, such
+// as its mesh.
+//
+// Rooms whose paths end in ".bin" are binary room files (see RoomBinary.h and ConvertRoomFile).
+// They're memory-mapped rather than read, and whatever they hold prebuilt isn't built again: with
+// cells the floor plan isn't split, and with a mesh the PrepareFunction isn't called at all.
+//
+// Loaded rooms are shared and never changed, so the app can keep using one after it's evicted.
+// Everything must be called from one thread.
+class RoomLoader {
+public:
+  typedef std::function<void(LoadedRoom* room)> PrepareFunction;
+
+  // Rooms' sizes are estimated from their files' until they've been loaded.
+  RoomLoader(const WorldFileData& world, uint64_t budgetBytes, int maxHops, int maxLoadsInFlight,
+             PrepareFunction prepare);
+  ~RoomLoader();
+
+  RoomLoader(const RoomLoader&) = delete;
+  RoomLoader& operator=(const RoomLoader&) = delete;
+
+  // Takes in finished loads, applies the streamer's evictions and starts its next loads.
+  // Rethrows anything a load threw.
+  void Update(uint64_t frame, int currentRoom);
+
+  // The room if it's resident, or null.
+  std::shared_ptr<const LoadedRoom> GetRoom(int room) const { return mRooms[room]; }
+
+  // Waits for a room that's resident or being loaded, and returns it.
+  std::shared_ptr<const LoadedRoom> WaitForRoom(int room);
+
+  const RoomStreamer::Stats& GetStats() const { return mStreamer.GetStats(); }
+
+  // Reads a text room file and writes it to binaryPath as a binary one, with its cells and the
+  // mesh prepare builds, so loading it later builds neither.  Throws if either file fails.
+  static void ConvertRoomFile(const std::string& textPath, const std::string& binaryPath,
+                              const PrepareFunction& prepare);
+
+private:
+  struct CompletedLoad {
+    int Room;
+    std::shared_ptr<const LoadedRoom> Data;
+  };
+
+  void TakeCompletedLoads();
+  void LoadThreadMain();
+
+  std::vector<std::string> mPaths;
+  PrepareFunction mPrepare;
+  RoomStreamer mStreamer;
+  std::vector<std::shared_ptr<const LoadedRoom>> mRooms;
+
+  std::thread mLoadThread;
+  std::mutex mLoadMutex;
+  std::condition_variable mLoadCondition;
+  std::condition_variable mCompletedCondition;
+  std::deque<int> mLoadQueue;
+  std::vector<CompletedLoad> mCompletedLoads;
+  std::exception_ptr mLoadException;    // Rethrown by Update and WaitForRoom
+  bool mQuit = false;
+};
@@ -0,0 +1,148 @@
+#include "RoomStreamer.h"
+
+#include <cassert>
+
+RoomStreamer::RoomStreamer(uint64_t budgetBytes, int maxHops, int maxLoadsInFlight)
+  : mMaxHops(maxHops),
+    mMaxLoadsInFlight(maxLoadsInFlight) {
+  mStats.BudgetBytes = budgetBytes;
+}
+
+int RoomStreamer::AddRoom(uint64_t estimatedBytes) {
+  StreamedRoom room;
+  room.Bytes = estimatedBytes;
+  mRooms.push_back(room);
+  return static_cast<int>(mRooms.size()) - 1;
+}
+
+void RoomStreamer::AddLink(int roomA, int roomB) {
+  assert(roomA >= 0 && roomA < GetRoomCount() && roomB >= 0 && roomB < GetRoomCount());
+  mRooms[roomA].Links.push_back(roomB);
+  mRooms[roomB].Links.push_back(roomA);
+}
+
+// Breadth first from currentRoom, so wanted comes out nearest first.
+void RoomStreamer::FindWantedRooms(int currentRoom, std::vector<int>* wanted) {
+  for (StreamedRoom& room : mRooms)
+    room.Hops = -1;
+  mRooms[currentRoom].Hops = 0;
+  wanted->push_back(currentRoom);
+  for (size_t next = 0; next < wanted->size(); ++next) {
+    const StreamedRoom& room = mRooms[(*wanted)[next]];
+    if (room.Hops == mMaxHops)
+      continue;
+    for (int link : room.Links) {
+      if (mRooms[link].Hops == -1) {
+        mRooms[link].Hops = room.Hops + 1;
+        wanted->push_back(link);
+      }
+    }
+  }
+}
+
+int RoomStreamer::FindVictim(int loadingRoom, int loadHops) const {
+  // Best victim first: rooms nobody wants, then the farthest, then the least recently wanted.
+  // Wanted rooms only give way to nearer ones, and the current room never does.
+  int victim = -1;
+  for (int i = 0; i < GetRoomCount(); ++i) {
+    const StreamedRoom& r = mRooms[i];
+    if (i == loadingRoom || !r.Resident || r.Hops == 0)
+      continue;
+    if (r.Hops != -1 && r.Hops <= loadHops)
+      continue;
+
+    if (victim == -1) {
+      victim = i;
+      continue;
+    }
+    const StreamedRoom& v = mRooms[victim];
+    if ((r.Hops == -1) != (v.Hops == -1)) {
+      if (r.Hops == -1)
+        victim = i;
+    } else if (r.Hops != v.Hops) {
+      if (r.Hops > v.Hops)
+        victim = i;
+    } else if (r.LastWantedFrame < v.LastWantedFrame) {
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+void RoomStreamer::Update(
+    uint64_t frame, int currentRoom, std::vector<int>* loads, std::vector<int>* evictions) {
+  std::vector<int> wanted;
+  FindWantedRooms(currentRoom, &wanted);
+  for (int i : wanted)
+    mRooms[i].LastWantedFrame = frame;
+
+  const auto evict = [this](int room) {
+    StreamedRoom& r = mRooms[room];
+    r.Resident = false;
+    mStats.ResidentBytes -= r.Bytes;
+    --mStats.ResidentRooms;
+  };
+
+  // Rooms can turn out bigger than estimated, so the budget may already be exceeded; only rooms
+  // nobody wants make way for that.
+  while (mStats.ResidentBytes + mStats.LoadingBytes > mStats.BudgetBytes) {
+    const int victim = FindVictim(-1, mMaxHops);
+    if (victim == -1)
+      break;
+    evict(victim);
+    evictions->push_back(victim);
+    ++mStats.RoomsEvicted;
+  }
+
+  std::vector<int> victims;
+  for (int i : wanted) {
+    StreamedRoom& r = mRooms[i];
+    if (r.Resident || r.Loading)
+      continue;
+    const bool current = i == currentRoom;
+    if (!current && mLoadsInFlight >= mMaxLoadsInFlight)
+      break;
+
+    // Make room by evicting the best victims.  If that still isn't enough, put them back, unless
+    // this is the current room, which has to be loaded anyway.
+    victims.clear();
+    while (mStats.ResidentBytes + mStats.LoadingBytes + r.Bytes > mStats.BudgetBytes) {
+      const int victim = FindVictim(i, r.Hops);
+      if (victim == -1)
+        break;
+      evict(victim);
+      victims.push_back(victim);
+    }
+    if (!current && mStats.ResidentBytes + mStats.LoadingBytes + r.Bytes > mStats.BudgetBytes) {
+      for (int victim : victims) {
+        StreamedRoom& v = mRooms[victim];
+        v.Resident = true;
+        mStats.ResidentBytes += v.Bytes;
+        ++mStats.ResidentRooms;
+      }
+      ++mStats.LoadsDeferred;
+      continue;
+    }
+    evictions->insert(evictions->end(), victims.begin(), victims.end());
+    mStats.RoomsEvicted += static_cast<uint32_t>(victims.size());
+
+    r.Loading = true;
+    mStats.LoadingBytes += r.Bytes;
+    ++mLoadsInFlight;
+    ++mStats.LoadsIssued;
+    loads->push_back(i);
+  }
+}
+
+void RoomStreamer::OnLoadComplete(int room, uint64_t bytes) {
+  StreamedRoom& r = mRooms[room];
+  assert(r.Loading);
+  r.Loading = false;
+  r.Resident = true;
+  mStats.LoadingBytes -= r.Bytes;
+  r.Bytes = bytes;
+  mStats.ResidentBytes += bytes;
+  ++mStats.ResidentRooms;
+  --mLoadsInFlight;
+  ++mStats.LoadsCompleted;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Decides which rooms of a world should be in memory.  Rooms are joined by links (doorways or
+// portals), and every room within maxHops links of the one the player is in is wanted: the
+// streamer asks for the nearest ones first, while keeping everything that's resident or being
+// loaded within a byte budget.  When a load doesn't fit, rooms nobody wants go first, then wanted
+// rooms farther away than the one being loaded, the least recently wanted first.  The player's
+// own room is always loaded, even if that goes over the budget, and never evicted.
+//
+// A room's size is only estimated until it has been loaded once; OnLoadComplete gives the real
+// one.
+//
+// This is only the bookkeeping, like TextureStreamer: the caller does the loading and evicting and
+// reports back when a load has finished.
+class RoomStreamer {
+public:
+  struct Stats {
+    uint64_t BudgetBytes = 0;
+    uint64_t ResidentBytes = 0;
+    uint64_t LoadingBytes = 0;
+    uint32_t ResidentRooms = 0;
+    uint32_t LoadsIssued = 0;
+    uint32_t LoadsCompleted = 0;
+    uint32_t LoadsDeferred = 0;     // Wanted but couldn't be fit in the budget
+    uint32_t RoomsEvicted = 0;
+  };
+
+  RoomStreamer(uint64_t budgetBytes, int maxHops, int maxLoadsInFlight);
+
+  int AddRoom(uint64_t estimatedBytes);
+  // Links are two-way.
+  void AddLink(int roomA, int roomB);
+
+  // Works out which rooms are wanted from currentRoom and appends the loads to start and the rooms
+  // to evict now.  Evicted bytes are available to loads issued by the same call.
+  void Update(uint64_t frame, int currentRoom, std::vector<int>* loads,
+              std::vector<int>* evictions);
+
+  // Reports that a load has finished and the room, which takes bytes, is now resident.
+  void OnLoadComplete(int room, uint64_t bytes);
+
+  int GetRoomCount() const { return static_cast<int>(mRooms.size()); }
+  bool IsResident(int room) const { return mRooms[room].Resident; }
+  bool IsLoading(int room) const { return mRooms[room].Loading; }
+  // Links from the current room as of the last Update, or -1 if it's more than maxHops away.
+  int GetHops(int room) const { return mRooms[room].Hops; }
+  const Stats& GetStats() const { return mStats; }
+
+private:
+  struct StreamedRoom {
+    std::vector<int> Links;
+    uint64_t Bytes;
+    int Hops = -1;
+    uint64_t LastWantedFrame = 0;
+    bool Resident = false;
+    bool Loading = false;
+  };
+
+  void FindWantedRooms(int currentRoom, std::vector<int>* wanted);
+  int FindVictim(int loadingRoom, int loadHops) const;
+
+  std::vector<StreamedRoom> mRooms;
+  int mMaxHops;
+  int mMaxLoadsInFlight;
+  int mLoadsInFlight = 0;
+  Stats mStats;
+};
@@ -0,0 +1,164 @@
+#include "ShaderCache.h"
+
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+namespace {
+  // Bump whenever the key layout below changes, so keys from older builds can't collide.
+  const uint32_t KEY_VERSION = 1;
+
+  // 64-bit FNV-1a.
+  class Hasher {
+  public:
+    void Add(const void* data, size_t size) {
+      const uint8_t* bytes = static_cast<const uint8_t*>(data);
+      for (size_t i = 0; i < size; ++i) {
+        mHash ^= bytes[i];
+        mHash *= 1099511628211ull;
+      }
+    }
+
+    // Length-prefixed, so "ab" + "c" and "a" + "bc" hash differently.
+    void Add(const std::string& str) {
+      Add(static_cast<uint64_t>(str.size()));
+      Add(str.data(), str.size());
+    }
+
+    void Add(uint64_t value) { Add(&value, sizeof(value)); }
+
+    uint64_t Get() const { return mHash; }
+
+  private:
+    uint64_t mHash = 14695981039346656037ull;
+  };
+
+  bool ReadFile(const std::string& path, std::string* contents) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin)
+      return false;
+    std::ostringstream ss;
+    ss << fin.rdbuf();
+    *contents = ss.str();
+    return true;
+  }
+
+  std::string GetDirectory(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+  }
+
+  // Returns the names in the file's #include "..." lines, in order.
+  std::vector<std::string> FindIncludes(const std::string& source) {
+    std::vector<std::string> includes;
+    std::istringstream lines(source);
+    std::string line;
+    while (std::getline(lines, line)) {
+      size_t pos = line.find_first_not_of(" \t");
+      if (pos == std::string::npos || line[pos] != '#')
+        continue;
+      pos = line.find_first_not_of(" \t", pos + 1);
+      if (pos == std::string::npos || line.compare(pos, 7, "include") != 0)
+        continue;
+      size_t open = line.find('"', pos + 7);
+      size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+      if (close != std::string::npos)
+        includes.push_back(line.substr(open + 1, close - open - 1));
+    }
+    return includes;
+  }
+
+  // Hashes a file and then its includes, depth first.  Each file is hashed once, as if every
+  // file had an include guard; that's enough for the key to change whenever any of them do.
+  void HashIncludeChain(
+      const std::string& path, const std::string& source, std::set<std::string>* visited,
+      Hasher* hasher) {
+    hasher->Add(source);
+
+    const std::string directory = GetDirectory(path);
+    for (const std::string& name : FindIncludes(source)) {
+      std::string includePath = directory + name;
+      hasher->Add(name);
+      if (!visited->insert(includePath).second)
+        continue;
+
+      std::string includeSource;
+      if (ReadFile(includePath, &includeSource))
+        HashIncludeChain(includePath, includeSource, visited, hasher);
+      else
+        hasher->Add(std::string());
+    }
+  }
+}
+
+ShaderCache::ShaderCache(const std::string& directory)
+  : mDirectory(directory) {
+  if (!mDirectory.empty() && mDirectory.back() != '/' && mDirectory.back() != '\\')
+    mDirectory += '/';
+}
+
+bool ShaderCache::ComputeKey(const ShaderCompileDesc& desc, uint64_t* key) {
+  std::string source;
+  if (!ReadFile(desc.Path, &source))
+    return false;
+
+  Hasher hasher;
+  hasher.Add(KEY_VERSION);
+  std::set<std::string> visited = { desc.Path };
+  HashIncludeChain(desc.Path, source, &visited, &hasher);
+  hasher.Add(desc.EntryPoint);
+  hasher.Add(desc.Target);
+  hasher.Add(desc.Flags);
+  hasher.Add(static_cast<uint64_t>(desc.Defines.size()));
+  for (const ShaderDefine& define : desc.Defines) {
+    hasher.Add(define.Name);
+    hasher.Add(define.Definition);
+  }
+  *key = hasher.Get();
+  return true;
+}
+
+std::string ShaderCache::GetBinaryPath(uint64_t key) const {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.cso", static_cast<unsigned long long>(key));
+  return mDirectory + name;
+}
+
+bool ShaderCache::Contains(uint64_t key) {
+  std::ifstream fin(GetBinaryPath(key), std::ios::binary | std::ios::ate);
+  bool found = fin && fin.tellg() > 0;
+  if (found)
+    ++mStats.Hits;
+  else
+    ++mStats.Misses;
+  return found;
+}
+
+bool ShaderCache::Store(uint64_t key, const void* data, size_t size) {
+  const std::string path = GetBinaryPath(key);
+  const std::string tempPath = path + ".tmp";
+  {
+    std::ofstream fout(tempPath, std::ios::binary | std::ios::trunc);
+    fout.write(static_cast<const char*>(data), size);
+    if (!fout) {
+      fout.close();
+      std::remove(tempPath.c_str());
+      ++mStats.StoreFailures;
+      return false;
+    }
+  }
+
+  // rename won't replace an existing file on Windows.  If another instance stored the same key
+  // in the meantime, its bytecode is identical, so keep it.
+  if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+    std::remove(tempPath.c_str());
+    std::ifstream existing(path, std::ios::binary);
+    if (!existing) {
+      ++mStats.StoreFailures;
+      return false;
+    }
+  }
+  ++mStats.Stores;
+  return true;
+}
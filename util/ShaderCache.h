@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A directory of compiled shader bytecode, one file per permutation, named after a hash of
+// everything that affects the compiler's output: the source file and every file it #includes,
+// the entry point, the target profile, the defines and the compile flags.  Editing any of those
+// gives a new key, so stale entries are never loaded; they're just left behind in the directory.
+//
+// The cache only does the hashing and file bookkeeping.  Loading and compiling are up to the
+// caller, which keeps this free of Windows and D3D.
+
+struct ShaderDefine {
+  std::string Name;
+  std::string Definition;   // Empty for a define with no value
+};
+
+struct ShaderCompileDesc {
+  std::string Path;
+  std::vector<ShaderDefine> Defines;
+  std::string EntryPoint;
+  std::string Target;
+  uint32_t Flags = 0;
+};
+
+class ShaderCache {
+public:
+  struct Stats {
+    uint32_t Hits = 0;
+    uint32_t Misses = 0;
+    uint32_t Stores = 0;
+    uint32_t StoreFailures = 0;
+  };
+
+  // directory must already exist.  Cached files are written to it as <key>.cso.
+  explicit ShaderCache(const std::string& directory);
+
+  // Hashes desc along with the contents of desc.Path and, recursively, every file it includes
+  // with #include "...".  Includes are resolved relative to the including file, like
+  // D3D_COMPILE_STANDARD_FILE_INCLUDE does; ones that can't be opened are hashed by name only,
+  // since the compile will fail on them anyway.  Returns false if desc.Path can't be read.
+  static bool ComputeKey(const ShaderCompileDesc& desc, uint64_t* key);
+
+  std::string GetBinaryPath(uint64_t key) const;
+
+  // True if bytecode for key is in the cache.  Counts a hit or a miss.
+  bool Contains(uint64_t key);
+
+  // Writes bytecode for key.  The file is written under a temporary name and then renamed, so a
+  // crash part way through never leaves a truncated entry behind.  Returns false on failure,
+  // which only means the shader will be compiled again next time.
+  bool Store(uint64_t key, const void* data, size_t size);
+
+  const Stats& GetStats() const { return mStats; }
+
+private:
+  std::string mDirectory;
+  Stats mStats;
+};
@@ -0,0 +1,264 @@
+#include "SoftwarePortalRenderer.h"
+
+namespace {
+  // PortalsApp's PORTAL_DECAL_DEPTH_BIAS and PORTAL_DECAL_SLOPE_SCALED_DEPTH_BIAS.
+  const int PORTAL_DECAL_DEPTH_BIAS = -64;
+  const float PORTAL_DECAL_SLOPE_SCALED_DEPTH_BIAS = -2.0f;
+}
+
+SoftwarePortalRenderer::SoftwarePortalRenderer(const SwShaderDefines& defines)
+  : mRasterizer(defines) {
+  BuildPSOs();
+}
+
+// Same states as PortalsApp::BuildPSOs.
+void SoftwarePortalRenderer::BuildPSOs() {
+  SwPipelineState* pso = &mPSOs[PSO_DEFAULT_CLIP];
+  pso->Shader = SwPipelineState::PROGRAM_DEFAULT;
+  pso->NumClipPlanes = 1;
+  pso->StencilFunc = SwPipelineState::COMPARISON_LESS_EQUAL;
+
+  pso = &mPSOs[PSO_DEFAULT_CLIP_TWICE];
+  pso->Shader = SwPipelineState::PROGRAM_DEFAULT;
+  pso->NumClipPlanes = 2;
+  pso->StencilFunc = SwPipelineState::COMPARISON_LESS_EQUAL;
+
+  pso = &mPSOs[PSO_DEFAULT_PORTALS_CLIP];
+  pso->Shader = SwPipelineState::PROGRAM_DEFAULT_PORTAL_HOLES;
+  pso->NumClipPlanes = 1;
+  pso->StencilFunc = SwPipelineState::COMPARISON_LESS_EQUAL;
+
+  pso = &mPSOs[PSO_PORTAL_BOX_STENCIL_SET];
+  pso->Shader = SwPipelineState::PROGRAM_PORTAL_BOX;
+  pso->StencilFunc = SwPipelineState::COMPARISON_ALWAYS;
+  pso->StencilPassOp = SwPipelineState::STENCIL_OP_REPLACE;
+
+  pso = &mPSOs[PSO_PORTAL_BOX_STENCIL_INCR];
+  pso->Shader = SwPipelineState::PROGRAM_PORTAL_BOX;
+  pso->NumClipPlanes = 1;
+  pso->StencilFunc = SwPipelineState::COMPARISON_LESS_EQUAL;
+  pso->StencilPassOp = SwPipelineState::STENCIL_OP_INCR;
+
+  pso = &mPSOs[PSO_PORTAL_BOX_CLEAR_DEPTH];
+  pso->Shader = SwPipelineState::PROGRAM_PORTAL_BOX_CLEAR_DEPTH;
+  pso->DepthFunc = SwPipelineState::COMPARISON_ALWAYS;
+  pso->StencilFunc = SwPipelineState::COMPARISON_LESS_EQUAL;
+
+  pso = &mPSOs[PSO_PORTAL_BOX_DEPTH_ALWAYS_STENCIL_ZERO];
+  pso->Shader = SwPipelineState::PROGRAM_PORTAL_BOX;
+  pso->DepthFunc = SwPipelineState::COMPARISON_ALWAYS;
+  pso->StencilFunc = SwPipelineState::COMPARISON_LESS_EQUAL;
+  pso->StencilPassOp = SwPipelineState::STENCIL_OP_ZERO;
+  pso->ColorWrite = false;
+
+  const PsoId decalPsos[2] = { PSO_PORTAL_DECAL_A_CLIP, PSO_PORTAL_DECAL_B_CLIP };
+  const SwPipelineState::Program decalPrograms[2] = {
+    SwPipelineState::PROGRAM_PORTAL_DECAL_A, SwPipelineState::PROGRAM_PORTAL_DECAL_B
+  };
+  for (int i = 0; i < 2; ++i) {
+    pso = &mPSOs[decalPsos[i]];
+    pso->Shader = decalPrograms[i];
+    pso->NumClipPlanes = 1;
+    pso->DepthFunc = SwPipelineState::COMPARISON_LESS_EQUAL;
+    pso->DepthWrite = false;
+    pso->DepthBias = PORTAL_DECAL_DEPTH_BIAS;
+    pso->SlopeScaledDepthBias = PORTAL_DECAL_SLOPE_SCALED_DEPTH_BIAS;
+    pso->StencilFunc = SwPipelineState::COMPARISON_LESS_EQUAL;
+    pso->AlphaBlend = true;
+  }
+}
+
+void SoftwarePortalRenderer::Render(const SoftwarePortalScene& scene, SwRenderTarget* target) {
+  mScene = &scene;
+  mRasterizer.ResetStats();
+  mRasterizer.SetRenderTarget(target);
+
+  const int portalAPassIndexBase = 1;
+  const int portalBPassIndexBase = portalAPassIndexBase + scene.PortalAIterations;
+  const bool playerIntersectPortal = scene.PlayerIntersectPortalA || scene.PlayerIntersectPortalB;
+
+  // Main view.
+  SetCommonDrawState();
+  target->ClearColor(scene.ClearColor);
+  target->ClearDepthStencil(1.0f, 0);
+
+  DrawRenderItem(scene.Room);
+  DrawPortalDecals();
+
+  if (scene.PlayerIntersectPortalA) {
+    DrawIntersectingPlayerRealHalves(
+        SoftwarePortalScene::CLIP_PLANE_PORTAL_A_B, SoftwarePortalScene::CLIP_PLANE_PORTAL_B_A,
+        SoftwarePortalScene::WORLD2_PORTAL_A_TO_B);
+  } else if (scene.PlayerIntersectPortalB) {
+    DrawIntersectingPlayerRealHalves(
+        SoftwarePortalScene::CLIP_PLANE_PORTAL_B_A, SoftwarePortalScene::CLIP_PLANE_PORTAL_A_B,
+        SoftwarePortalScene::WORLD2_PORTAL_B_TO_A);
+  } else {
+    mRasterizer.SetPipelineState(&mPSOs[PSO_DEFAULT_CLIP]);
+    DrawRenderItem(scene.Player);
+  }
+
+  mRasterizer.SetPipelineState(&mPSOs[PSO_PORTAL_BOX_STENCIL_SET]);
+  mRasterizer.SetStencilRef(scene.PortalAStencilRef);
+  DrawRenderItem(scene.PortalBoxA);
+  mRasterizer.SetStencilRef(scene.PortalBStencilRef);
+  DrawRenderItem(scene.PortalBoxB);
+
+  // Inside portal A.
+  SetCommonDrawState();
+  if (playerIntersectPortal) {
+    DrawRoomsAndIntersectingPlayersForPortal(
+        scene.PortalAStencilRef, scene.PortalBoxA, portalAPassIndexBase, scene.PortalAIterations,
+        SoftwarePortalScene::CLIP_PLANE_PORTAL_A_B, SoftwarePortalScene::CLIP_PLANE_PORTAL_B_A,
+        scene.PlayerIntersectPortalA, SoftwarePortalScene::WORLD2_PORTAL_A_TO_B,
+        SoftwarePortalScene::WORLD2_PORTAL_B_TO_A);
+  } else {
+    DrawRoomAndPlayerIterations(
+        scene.PortalAStencilRef, scene.PortalBoxA, portalAPassIndexBase, scene.PortalAIterations,
+        SoftwarePortalScene::CLIP_PLANE_PORTAL_B_A, true);
+  }
+  DrawPortalBoxToCoverDepthHoleAndZeroStencil(scene.PortalAStencilRef, scene.PortalBoxA);
+
+  // Inside portal B.
+  SetCommonDrawState();
+  if (playerIntersectPortal) {
+    DrawRoomsAndIntersectingPlayersForPortal(
+        scene.PortalBStencilRef, scene.PortalBoxB, portalBPassIndexBase, scene.PortalBIterations,
+        SoftwarePortalScene::CLIP_PLANE_PORTAL_B_A, SoftwarePortalScene::CLIP_PLANE_PORTAL_A_B,
+        scene.PlayerIntersectPortalB, SoftwarePortalScene::WORLD2_PORTAL_B_TO_A,
+        SoftwarePortalScene::WORLD2_PORTAL_A_TO_B);
+  } else {
+    DrawRoomAndPlayerIterations(
+        scene.PortalBStencilRef, scene.PortalBoxB, portalBPassIndexBase, scene.PortalBIterations,
+        SoftwarePortalScene::CLIP_PLANE_PORTAL_A_B, true);
+  }
+
+  mScene = nullptr;
+}
+
+// Same bindings as PortalsApp::SetCommonDrawState.
+void SoftwarePortalRenderer::SetCommonDrawState() {
+  mRasterizer.SetVertexBuffer(mScene->Vertices.data(), mScene->Vertices.size());
+  mRasterizer.SetIndexBuffer(mScene->Indices.data(), mScene->Indices.size());
+  mRasterizer.SetMaterials(mScene->Materials.data(), static_cast<int>(mScene->Materials.size()));
+  mRasterizer.SetTextureMaps(
+      mScene->TextureMaps.data(), static_cast<int>(mScene->TextureMaps.size()));
+  mRasterizer.SetPortalMaps(&mScene->PortalAMap, &mScene->PortalBMap);
+  mRasterizer.SetFrameConstants(&mScene->Frame);
+
+  mRasterizer.SetPipelineState(&mPSOs[PSO_DEFAULT_PORTALS_CLIP]);
+  mRasterizer.SetClipPlaneConstants(&mScene->ClipPlanes[SoftwarePortalScene::CLIP_PLANE_DUMMY]);
+  mRasterizer.SetPassConstants(&mScene->Passes[0]);
+  mRasterizer.SetWorld2Constants(&mScene->World2s[SoftwarePortalScene::WORLD2_IDENTITY]);
+  mRasterizer.SetStencilRef(0);
+}
+
+void SoftwarePortalRenderer::DrawRenderItem(const SwRenderItem& ri) {
+  mRasterizer.SetObjectConstants(&ri.Object);
+  mRasterizer.DrawIndexed(ri.IndexCount, ri.StartIndexLocation, ri.BaseVertexLocation);
+}
+
+void SoftwarePortalRenderer::DrawPortalDecals() {
+  mRasterizer.SetPipelineState(&mPSOs[PSO_PORTAL_DECAL_A_CLIP]);
+  DrawRenderItem(mScene->PortalDecalA);
+  mRasterizer.SetPipelineState(&mPSOs[PSO_PORTAL_DECAL_B_CLIP]);
+  DrawRenderItem(mScene->PortalDecalB);
+}
+
+void SoftwarePortalRenderer::DrawIntersectingPlayerRealHalves(
+    int clipPlanePortalIndex, int clipPlaneOtherPortalIndex, int world2ThisToOtherIndex) {
+  mRasterizer.SetPipelineState(&mPSOs[PSO_DEFAULT_CLIP]);
+
+  // Larger half of player.
+  mRasterizer.SetClipPlaneConstants(&mScene->ClipPlanes[clipPlanePortalIndex]);
+  DrawRenderItem(mScene->Player);
+
+  // Smaller half of player, moved through the portal.
+  mRasterizer.SetClipPlaneConstants(&mScene->ClipPlanes[clipPlaneOtherPortalIndex]);
+  mRasterizer.SetWorld2Constants(&mScene->World2s[world2ThisToOtherIndex]);
+  DrawRenderItem(mScene->Player);
+  mRasterizer.SetWorld2Constants(&mScene->World2s[SoftwarePortalScene::WORLD2_IDENTITY]);
+}
+
+void SoftwarePortalRenderer::DrawRoomAndPlayerIterations(
+    uint8_t stencilRef, const SwRenderItem& portalBoxRi, int passIndexBase, int numIterations,
+    int clipPlaneOtherPortalIndex, bool drawPlayers) {
+  mRasterizer.SetPassConstants(&mScene->Passes[0]);
+  mRasterizer.SetClipPlaneConstants(&mScene->ClipPlanes[clipPlaneOtherPortalIndex]);
+
+  int passIndex = passIndexBase;
+  for (int i = 0; i < numIterations; ++i, ++stencilRef, ++passIndex) {
+    mRasterizer.SetStencilRef(stencilRef);
+
+    // Portal box clears depth values inside the portal hole.
+    mRasterizer.SetPipelineState(&mPSOs[PSO_PORTAL_BOX_CLEAR_DEPTH]);
+    DrawRenderItem(portalBoxRi);
+
+    mRasterizer.SetPassConstants(&mScene->Passes[passIndex]);
+
+    mRasterizer.SetPipelineState(&mPSOs[PSO_DEFAULT_PORTALS_CLIP]);
+    DrawRenderItem(mScene->Room);
+    DrawPortalDecals();
+
+    if (drawPlayers) {
+      mRasterizer.SetPipelineState(&mPSOs[PSO_DEFAULT_CLIP]);
+      DrawRenderItem(mScene->Player);
+    }
+
+    // Portal box increments stencil values inside the portal hole.
+    mRasterizer.SetPipelineState(&mPSOs[PSO_PORTAL_BOX_STENCIL_INCR]);
+    DrawRenderItem(portalBoxRi);
+  }
+}
+
+void SoftwarePortalRenderer::DrawPlayerIterations(
+    uint8_t stencilRef, int passIndexBase, int numIterations, PsoId pso) {
+  mRasterizer.SetPipelineState(&mPSOs[pso]);
+
+  int passIndex = passIndexBase;
+  for (int i = 0; i < numIterations; ++i, ++stencilRef, ++passIndex) {
+    mRasterizer.SetStencilRef(stencilRef);
+    mRasterizer.SetPassConstants(&mScene->Passes[passIndex]);
+    DrawRenderItem(mScene->Player);
+  }
+}
+
+void SoftwarePortalRenderer::DrawRoomsAndIntersectingPlayersForPortal(
+    uint8_t stencilRef, const SwRenderItem& portalBoxRi, int passIndexBase, int numIterations,
+    int clipPlanePortalIndex, int clipPlaneOtherPortalIndex, bool playerIntersectPortal,
+    int world2ThisToOtherIndex, int world2OtherToThisIndex) {
+  DrawRoomAndPlayerIterations(
+      stencilRef, portalBoxRi, passIndexBase, numIterations, clipPlaneOtherPortalIndex, false);
+
+  // Clip plane 1 is this portal, clip plane 2 is the other portal.
+  mRasterizer.SetClipPlaneConstants(&mScene->ClipPlanes[clipPlanePortalIndex]);
+  if (playerIntersectPortal) {
+    // Larger half of players.
+    DrawPlayerIterations(stencilRef, passIndexBase, numIterations, PSO_DEFAULT_CLIP_TWICE);
+  } else {
+    // Smaller half of players.
+    mRasterizer.SetWorld2Constants(&mScene->World2s[world2OtherToThisIndex]);
+    DrawPlayerIterations(stencilRef, passIndexBase, numIterations, PSO_DEFAULT_CLIP_TWICE);
+    mRasterizer.SetWorld2Constants(&mScene->World2s[SoftwarePortalScene::WORLD2_IDENTITY]);
+  }
+
+  // Clip plane is the other portal.
+  mRasterizer.SetClipPlaneConstants(&mScene->ClipPlanes[clipPlaneOtherPortalIndex]);
+  if (playerIntersectPortal) {
+    // Smaller half of players.
+    mRasterizer.SetWorld2Constants(&mScene->World2s[world2ThisToOtherIndex]);
+    DrawPlayerIterations(stencilRef, passIndexBase, numIterations, PSO_DEFAULT_CLIP);
+    mRasterizer.SetWorld2Constants(&mScene->World2s[SoftwarePortalScene::WORLD2_IDENTITY]);
+  } else {
+    // Larger half of players.
+    DrawPlayerIterations(stencilRef, passIndexBase, numIterations, PSO_DEFAULT_CLIP);
+  }
+}
+
+void SoftwarePortalRenderer::DrawPortalBoxToCoverDepthHoleAndZeroStencil(
+    uint8_t stencilRef, const SwRenderItem& portalBoxRi) {
+  mRasterizer.SetPassConstants(&mScene->Passes[0]);
+  mRasterizer.SetStencilRef(stencilRef);
+  mRasterizer.SetPipelineState(&mPSOs[PSO_PORTAL_BOX_DEPTH_ALWAYS_STENCIL_ZERO]);
+  DrawRenderItem(portalBoxRi);
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+
+#include "SoftwareRasterizer.h"
+
+// A render item as SoftwarePortalRenderer sees it: the object constants PortalsApp uploads for it
+// and the DrawIndexedInstanced arguments for its submesh.
+struct SwRenderItem {
+  SwObjectConstants Object;
+  uint32_t IndexCount = 0;
+  uint32_t StartIndexLocation = 0;
+  int BaseVertexLocation = 0;
+};
+
+// Everything PortalsApp::Draw reads: geometry, render items, materials, textures and the per-frame
+// constants.  PortalsApp::BuildSoftwareScene fills one in from the running app; tests can also
+// build one by hand.
+struct SoftwarePortalScene {
+  // Same meaning as PortalsApp's CLIP_PLANE_*_CB_INDEX and WORLD2_*_CB_INDEX.
+  enum ClipPlaneIndex {
+    CLIP_PLANE_DUMMY,
+    CLIP_PLANE_PORTAL_A_B,
+    CLIP_PLANE_PORTAL_B_A,
+    NUM_CLIP_PLANES
+  };
+
+  enum World2Index {
+    WORLD2_IDENTITY,
+    WORLD2_PORTAL_A_TO_B,
+    WORLD2_PORTAL_B_TO_A,
+    NUM_WORLD2S
+  };
+
+  std::vector<SwVertex> Vertices;
+  std::vector<uint32_t> Indices;      // Widened if the index buffer is 16-bit
+
+  SwRenderItem Room;
+  SwRenderItem Player;
+  SwRenderItem PortalBoxA;
+  SwRenderItem PortalBoxB;
+  SwRenderItem PortalDecalA;
+  SwRenderItem PortalDecalB;
+
+  std::vector<SwMaterialData> Materials;
+  std::vector<SwTexture> TextureMaps;
+  SwTexture PortalAMap;
+  SwTexture PortalBMap;
+
+  SwFrameConstants Frame;
+  std::array<SwClipPlaneConstants, NUM_CLIP_PLANES> ClipPlanes;
+  std::array<SwWorld2Constants, NUM_WORLD2S> World2s;
+
+  // Main view first, then PortalAIterations passes inside portal A, then PortalBIterations passes
+  // inside portal B.
+  std::vector<SwPassConstants> Passes;
+
+  uint8_t PortalAStencilRef = 2;
+  uint8_t PortalBStencilRef = 1;
+  int PortalAIterations = 8;
+  int PortalBIterations = 8;
+  bool PlayerIntersectPortalA = false;
+  bool PlayerIntersectPortalB = false;
+
+  SwVec4 ClearColor = { 0.529411793f, 0.807843208f, 0.921568692f, 1.0f };   // Colors::SkyBlue
+};
+
+// Reproduces PortalsApp::Draw on the CPU: the same draws, in the same order, with the same pipeline
+// states, stencil refs and constants.  The resulting color, depth and stencil buffers are a
+// reference for the GPU path and for changes to the recursion (culling, scissoring, ...), which
+// should leave them unchanged pixel for pixel.
+//
+// Keep the Draw* helpers here in step with PortalsApp's helpers of the same names.
+class SoftwarePortalRenderer {
+public:
+  explicit SoftwarePortalRenderer(const SwShaderDefines& defines = SwShaderDefines());
+
+  void Render(const SoftwarePortalScene& scene, SwRenderTarget* target);
+
+  // Totals for the last Render.
+  const SoftwareRasterizer::Stats& GetStats() const { return mRasterizer.GetStats(); }
+
+private:
+  // Software counterparts of PortalsApp::PsoId.
+  enum PsoId {
+    PSO_DEFAULT_CLIP,
+    PSO_DEFAULT_CLIP_TWICE,
+    PSO_DEFAULT_PORTALS_CLIP,
+    PSO_PORTAL_BOX_STENCIL_SET,
+    PSO_PORTAL_BOX_STENCIL_INCR,
+    PSO_PORTAL_BOX_CLEAR_DEPTH,
+    PSO_PORTAL_BOX_DEPTH_ALWAYS_STENCIL_ZERO,
+    PSO_PORTAL_DECAL_A_CLIP,
+    PSO_PORTAL_DECAL_B_CLIP,
+    NUM_PSOS
+  };
+
+  void BuildPSOs();
+  void SetCommonDrawState();
+  void DrawRenderItem(const SwRenderItem& ri);
+  void DrawPortalDecals();
+
+  void DrawIntersectingPlayerRealHalves(
+      int clipPlanePortalIndex, int clipPlaneOtherPortalIndex, int world2ThisToOtherIndex);
+
+  void DrawRoomAndPlayerIterations(
+      uint8_t stencilRef, const SwRenderItem& portalBoxRi, int passIndexBase, int numIterations,
+      int clipPlaneOtherPortalIndex, bool drawPlayers);
+
+  void DrawPlayerIterations(uint8_t stencilRef, int passIndexBase, int numIterations, PsoId pso);
+
+  void DrawRoomsAndIntersectingPlayersForPortal(
+      uint8_t stencilRef, const SwRenderItem& portalBoxRi, int passIndexBase, int numIterations,
+      int clipPlanePortalIndex, int clipPlaneOtherPortalIndex, bool playerIntersectPortal,
+      int world2ThisToOtherIndex, int world2OtherToThisIndex);
+
+  void DrawPortalBoxToCoverDepthHoleAndZeroStencil(
+      uint8_t stencilRef, const SwRenderItem& portalBoxRi);
+
+  SoftwareRasterizer mRasterizer;
+  std::array<SwPipelineState, NUM_PSOS> mPSOs;
+
+  const SoftwarePortalScene* mScene = nullptr;
+};
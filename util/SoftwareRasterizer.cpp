@@ -0,0 +1,529 @@
+#include "SoftwareRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+namespace {
+  // Sub-pixel precision of vertex positions, as on D3D12 hardware.
+  const double SUBPIXEL_SCALE = 256.0;
+
+  // Vertices closer to w = 0 than this are clipped away so the perspective divide stays finite.
+  const float MIN_CLIP_W = 1e-5f;
+
+  // Default.hlsl's PORTAL_Z_EPSILON.
+  const float PORTAL_Z_EPSILON = 0.001f;
+
+  // One unit of DepthBias for a 24-bit depth buffer.
+  const float DEPTH_BIAS_UNIT = 1.0f / 16777216.0f;
+
+  SwVec3 operator+(const SwVec3& a, const SwVec3& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+  SwVec3 operator-(const SwVec3& a, const SwVec3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+  SwVec3 operator*(const SwVec3& a, const SwVec3& b) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+  SwVec3 operator*(const SwVec3& a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+  float Dot(const SwVec3& a, const SwVec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+  SwVec3 Lerp(const SwVec3& a, const SwVec3& b, float t) { return a + (b - a) * t; }
+  SwVec3 Xyz(const SwVec4& v) { return { v.x, v.y, v.z }; }
+  SwVec3 Normalize(const SwVec3& v) { return v * (1.0f / std::sqrt(Dot(v, v))); }
+  float Saturate(float x) { return std::min(std::max(x, 0.0f), 1.0f); }
+
+  SwVec4 Lerp(const SwVec4& a, const SwVec4& b, float t) {
+    return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t,
+             a.w + (b.w - a.w) * t };
+  }
+  SwVec2 Lerp(const SwVec2& a, const SwVec2& b, float t) {
+    return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t };
+  }
+
+  // HLSL reflect().
+  SwVec3 Reflect(const SwVec3& i, const SwVec3& n) {
+    return i - n * (2.0f * Dot(i, n));
+  }
+
+  uint32_t PackUnorm8(const SwVec4& color) {
+    auto toByte = [](float c) { return static_cast<uint32_t>(Saturate(c) * 255.0f + 0.5f); };
+    return toByte(color.x) | (toByte(color.y) << 8) | (toByte(color.z) << 16) |
+        (toByte(color.w) << 24);
+  }
+
+  SwVec4 UnpackUnorm8(uint32_t color) {
+    auto toFloat = [](uint32_t c) { return (c & 0xff) / 255.0f; };
+    return { toFloat(color), toFloat(color >> 8), toFloat(color >> 16), toFloat(color >> 24) };
+  }
+
+  // Default.hlsl's PortalHoleTest: negative inside the hole.
+  float PortalHoleTest(const SwVec3& posW, const SwVec4& hole, const SwVec3& normal) {
+    SwVec3 toPos = posW - Xyz(hole);
+    float z = Dot(toPos, normal);
+    if (std::fabs(z) > PORTAL_Z_EPSILON)
+      return 1.0f;
+    return Dot(toPos, toPos) - z * z - hole.w * hole.w;
+  }
+
+  bool WriteImage(const std::string& path, const char* magic, int width, int height,
+                  const std::vector<uint8_t>& bytes) {
+    std::ofstream ofs(path, std::ios::binary);
+    if (!ofs)
+      return false;
+    ofs << magic << "\n" << width << " " << height << "\n255\n";
+    ofs.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return static_cast<bool>(ofs);
+  }
+}
+
+SwMatrix SwMatrix::Identity() {
+  SwMatrix identity = {};
+  for (int i = 0; i < 4; ++i)
+    identity.m[i][i] = 1.0f;
+  return identity;
+}
+
+SwVec4 SwMatrix::MulPoint(const SwVec3& v) const {
+  return Mul({ v.x, v.y, v.z, 1.0f });
+}
+
+SwVec4 SwMatrix::Mul(const SwVec4& v) const {
+  // Column c of the result is v dotted with column c of the matrix, which is stored contiguously.
+  SwVec4 result;
+  float* out = &result.x;
+  for (int c = 0; c < 4; ++c)
+    out[c] = v.x * m[c][0] + v.y * m[c][1] + v.z * m[c][2] + v.w * m[c][3];
+  return result;
+}
+
+SwVec3 SwMatrix::MulNormal(const SwVec3& v) const {
+  SwVec3 result;
+  float* out = &result.x;
+  for (int c = 0; c < 3; ++c)
+    out[c] = v.x * m[c][0] + v.y * m[c][1] + v.z * m[c][2];
+  return result;
+}
+
+SwVec4 SwTexture::Sample(const SwVec2& texC, AddressMode addressMode) const {
+  if (Texels.empty()) {
+    return addressMode == ADDRESS_WRAP ? SwVec4{ 1.0f, 1.0f, 1.0f, 1.0f }
+                                       : SwVec4{ 0.0f, 0.0f, 0.0f, 0.0f };
+  }
+
+  // Bilinear filter between the four texels whose centers surround texC.
+  float u = texC.x * Width - 0.5f;
+  float v = texC.y * Height - 0.5f;
+  float u0 = std::floor(u);
+  float v0 = std::floor(v);
+  float fu = u - u0;
+  float fv = v - v0;
+
+  auto texel = [&](int x, int y) -> SwVec4 {
+    if (addressMode == ADDRESS_WRAP) {
+      x = ((x % Width) + Width) % Width;
+      y = ((y % Height) + Height) % Height;
+    } else if (x < 0 || x >= Width || y < 0 || y >= Height) {
+      return { 0.0f, 0.0f, 0.0f, 0.0f };
+    }
+    return Texels[static_cast<size_t>(y) * Width + x];
+  };
+
+  int x0 = static_cast<int>(u0);
+  int y0 = static_cast<int>(v0);
+  SwVec4 top = Lerp(texel(x0, y0), texel(x0 + 1, y0), fu);
+  SwVec4 bottom = Lerp(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), fu);
+  return Lerp(top, bottom, fv);
+}
+
+SwRenderTarget::SwRenderTarget(int width, int height)
+  : mWidth(width),
+    mHeight(height),
+    mColor(static_cast<size_t>(width) * height, 0),
+    mDepth(static_cast<size_t>(width) * height, 1.0f),
+    mStencil(static_cast<size_t>(width) * height, 0) {
+}
+
+void SwRenderTarget::ClearColor(const SwVec4& color) {
+  std::fill(mColor.begin(), mColor.end(), PackUnorm8(color));
+}
+
+void SwRenderTarget::ClearDepthStencil(float depth, uint8_t stencil) {
+  std::fill(mDepth.begin(), mDepth.end(), depth);
+  std::fill(mStencil.begin(), mStencil.end(), stencil);
+}
+
+bool SwRenderTarget::WriteColorPpm(const std::string& path) const {
+  std::vector<uint8_t> bytes;
+  bytes.reserve(mColor.size() * 3);
+  for (uint32_t c : mColor) {
+    bytes.push_back(static_cast<uint8_t>(c));
+    bytes.push_back(static_cast<uint8_t>(c >> 8));
+    bytes.push_back(static_cast<uint8_t>(c >> 16));
+  }
+  return WriteImage(path, "P6", mWidth, mHeight, bytes);
+}
+
+bool SwRenderTarget::WriteDepthPgm(const std::string& path) const {
+  std::vector<uint8_t> bytes;
+  bytes.reserve(mDepth.size());
+  for (float d : mDepth)
+    bytes.push_back(static_cast<uint8_t>(Saturate(d) * 255.0f + 0.5f));
+  return WriteImage(path, "P5", mWidth, mHeight, bytes);
+}
+
+bool SwRenderTarget::WriteStencilPgm(const std::string& path) const {
+  return WriteImage(path, "P5", mWidth, mHeight, mStencil);
+}
+
+SoftwareRasterizer::SoftwareRasterizer(const SwShaderDefines& defines)
+  : mDefines(defines) {
+}
+
+void SoftwareRasterizer::SetMaterials(const SwMaterialData* materials, int count) {
+  mMaterials = materials;
+  mMaterialCount = count;
+}
+
+void SoftwareRasterizer::SetTextureMaps(const SwTexture* textures, int count) {
+  mTextureMaps = textures;
+  mTextureMapCount = count;
+}
+
+void SoftwareRasterizer::SetPortalMaps(const SwTexture* portalAMap, const SwTexture* portalBMap) {
+  mPortalAMap = portalAMap;
+  mPortalBMap = portalBMap;
+}
+
+void SoftwareRasterizer::SetVertexBuffer(const SwVertex* vertices, size_t count) {
+  mVertices = vertices;
+  mVertexCount = count;
+}
+
+void SoftwareRasterizer::SetIndexBuffer(const uint32_t* indices, size_t count) {
+  mIndices = indices;
+  mIndexCount = count;
+}
+
+void SoftwareRasterizer::DrawIndexed(
+    uint32_t indexCount, uint32_t startIndexLocation, int baseVertexLocation) {
+  ++mStats.Draws;
+
+  for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+    VertexOut v[3];
+    for (int k = 0; k < 3; ++k) {
+      size_t vertexIndex = mIndices[startIndexLocation + i + k] + baseVertexLocation;
+      v[k] = RunVertexShader(mVertices[vertexIndex]);
+    }
+    ++mStats.Triangles;
+    DrawTriangle(v[0], v[1], v[2]);
+  }
+}
+
+SoftwareRasterizer::VertexOut SoftwareRasterizer::RunVertexShader(const SwVertex& vin) const {
+  VertexOut vout = {};
+
+  // Transform to world space.
+  SwVec4 posW = mObject->World.MulPoint(vin.Pos);
+
+  if (mPso->Shader == SwPipelineState::PROGRAM_PORTAL_BOX ||
+      mPso->Shader == SwPipelineState::PROGRAM_PORTAL_BOX_CLEAR_DEPTH) {
+    vout.PosW = Xyz(posW);
+    vout.PosH = mPass->ViewProj.Mul(posW);
+    if (mPso->Shader == SwPipelineState::PROGRAM_PORTAL_BOX_CLEAR_DEPTH)
+      vout.PosH.z = vout.PosH.w;
+    return vout;
+  }
+
+  if (mPso->Shader == SwPipelineState::PROGRAM_PORTAL_DECAL_A ||
+      mPso->Shader == SwPipelineState::PROGRAM_PORTAL_DECAL_B) {
+    vout.PosW = Xyz(posW);
+    vout.PosH = mPass->ViewProj.Mul(posW);
+    vout.TexC = vin.TexC;
+    return vout;
+  }
+
+  vout.NormalW = mObject->WorldInvTranspose.MulNormal(vin.Normal);
+  // Modify world-space position and normal by the world2 transformation.
+  posW = mWorld2->World2.Mul(posW);
+  vout.NormalW = mWorld2->World2InvTranspose.MulNormal(vout.NormalW);
+
+  vout.PosW = Xyz(posW);
+  vout.PosH = mPass->ViewProj.Mul(posW);
+
+  SwVec4 texC = mObject->TexTransform.Mul({ vin.TexC.x, vin.TexC.y, 0.0f, 1.0f });
+  vout.TexC = { texC.x, texC.y };
+  return vout;
+}
+
+bool SoftwareRasterizer::RunPixelShader(const VertexOut& pin, SwVec4* color) const {
+  if (mPso->NumClipPlanes >= 1 &&
+      Dot(pin.PosW, mClipPlane->ClipPlaneNormal) - mClipPlane->ClipPlaneOffset < 0.0f)
+    return false;
+  if (mPso->NumClipPlanes >= 2 &&
+      Dot(pin.PosW, mClipPlane->ClipPlane2Normal) - mClipPlane->ClipPlane2Offset < 0.0f)
+    return false;
+
+  if (mPso->Shader == SwPipelineState::PROGRAM_PORTAL_BOX ||
+      mPso->Shader == SwPipelineState::PROGRAM_PORTAL_BOX_CLEAR_DEPTH) {
+    const SwVec3& c = mDefines.PortalBoxColor;
+    *color = { c.x, c.y, c.z, 1.0f };
+    return true;
+  }
+
+  if (mPso->Shader == SwPipelineState::PROGRAM_PORTAL_DECAL_A ||
+      mPso->Shader == SwPipelineState::PROGRAM_PORTAL_DECAL_B) {
+    // The quads' inner edges cut across the hole; drop what's inside it.
+    float x = mDefines.PortalTexRadRatio * (1.0f - 2.0f * pin.TexC.x);
+    float y = mDefines.PortalTexRadRatio * (1.0f - 2.0f * pin.TexC.y);
+    if (x * x + y * y - 1.0f < 0.0f)
+      return false;
+
+    static const SwTexture missingPortalMap;
+    const SwTexture* portalMap =
+        mPso->Shader == SwPipelineState::PROGRAM_PORTAL_DECAL_A ? mPortalAMap : mPortalBMap;
+    SwVec4 portalDiffuse = (portalMap != nullptr ? *portalMap : missingPortalMap).Sample(
+        pin.TexC, SwTexture::ADDRESS_BORDER_TRANSPARENT_BLACK);
+
+    SwVec3 toEye = mPass->EyePosW - pin.PosW;
+    float distToEye = std::sqrt(Dot(toEye, toEye));
+    float fogS =
+        Saturate((distToEye * mPass->DistDilation - mDefines.FogStart) / mDefines.FogRange);
+    SwVec3 result = Lerp(Xyz(portalDiffuse), mDefines.FogColor, fogS);
+    *color = { result.x, result.y, result.z, portalDiffuse.w };
+    return true;
+  }
+
+  // Drop pixels in either portal's hole.
+  if (mPso->Shader == SwPipelineState::PROGRAM_DEFAULT_PORTAL_HOLES &&
+      (PortalHoleTest(pin.PosW, mFrame->PortalAHole, mFrame->PortalANormal) < 0.0f ||
+       PortalHoleTest(pin.PosW, mFrame->PortalBHole, mFrame->PortalBNormal) < 0.0f))
+    return false;
+
+  // Interpolating normal can unnormalize it, so renormalize it.
+  SwVec3 normalW = Normalize(pin.NormalW);
+
+  SwVec3 toEyeDirW = mPass->EyePosW - pin.PosW;
+  float distToEye = std::sqrt(Dot(toEyeDirW, toEyeDirW));
+  toEyeDirW = toEyeDirW * (1.0f / distToEye);
+
+  const SwMaterialData& matData = mMaterials[mObject->MaterialIndex];
+  static const SwTexture missingTexture;
+  const SwTexture& diffuseMap = static_cast<int>(matData.DiffuseMapIndex) < mTextureMapCount
+      ? mTextureMaps[matData.DiffuseMapIndex] : missingTexture;
+  SwVec4 texel = diffuseMap.Sample(pin.TexC, SwTexture::ADDRESS_WRAP);
+  SwVec3 diffuseAlbedo = { matData.Diffuse.x * texel.x, matData.Diffuse.y * texel.y,
+                           matData.Diffuse.z * texel.z };
+  SwVec3 specular = Xyz(matData.Specular);
+
+  SwVec3 result = mFrame->AmbientLight * diffuseAlbedo;
+  for (int i = 0; i < SW_NUM_LIGHTS; ++i) {
+    const SwDirectionalLight& light = mFrame->Lights[i];
+    float diffuseFactor = std::max(-Dot(light.Direction, normalW), 0.0f);
+    SwVec3 toLightReflectedDir = Reflect(light.Direction, normalW);
+    float specFactor = std::pow(std::max(Dot(toLightReflectedDir, toEyeDirW), 0.0f),
+                                matData.Specular.w);
+    result = result + light.Strength * (diffuseAlbedo * diffuseFactor + specular * specFactor);
+  }
+
+  // Blend result with fog color.
+  float fogS = Saturate((distToEye * mPass->DistDilation - mDefines.FogStart) / mDefines.FogRange);
+  result = Lerp(result, mDefines.FogColor, fogS);
+
+  *color = { result.x, result.y, result.z, 1.0f };
+  return true;
+}
+
+void SoftwareRasterizer::DrawTriangle(
+    const VertexOut& v0, const VertexOut& v1, const VertexOut& v2) {
+  // Clip against the near plane (z >= 0), the far plane (z <= w) and w > 0.
+  mClipIn.assign({ v0, v1, v2 });
+
+  auto lerpVertex = [](const VertexOut& a, const VertexOut& b, float t) {
+    VertexOut v;
+    v.PosH = Lerp(a.PosH, b.PosH, t);
+    v.PosW = Lerp(a.PosW, b.PosW, t);
+    v.NormalW = Lerp(a.NormalW, b.NormalW, t);
+    v.TexC = Lerp(a.TexC, b.TexC, t);
+    return v;
+  };
+  auto nearDist = [](const VertexOut& v) { return v.PosH.z; };
+  auto farDist = [](const VertexOut& v) { return v.PosH.w - v.PosH.z; };
+  auto wDist = [](const VertexOut& v) { return v.PosH.w - MIN_CLIP_W; };
+
+  auto clipAgainst = [&](auto dist) {
+    mClipOut.clear();
+    for (size_t i = 0; i < mClipIn.size(); ++i) {
+      const VertexOut& a = mClipIn[i];
+      const VertexOut& b = mClipIn[(i + 1) % mClipIn.size()];
+      float da = dist(a);
+      float db = dist(b);
+      if (da >= 0.0f)
+        mClipOut.push_back(a);
+      if ((da >= 0.0f) != (db >= 0.0f))
+        mClipOut.push_back(lerpVertex(a, b, da / (da - db)));
+    }
+    mClipIn.swap(mClipOut);
+  };
+  clipAgainst(wDist);
+  clipAgainst(nearDist);
+  clipAgainst(farDist);
+
+  if (mClipIn.size() < 3) {
+    ++mStats.TrianglesCulled;
+    return;
+  }
+
+  // The clipped polygon is convex and planar, so a fan covers it with no overlap.
+  for (size_t i = 1; i + 1 < mClipIn.size(); ++i)
+    RasterizeClippedTriangle(mClipIn[0], mClipIn[i], mClipIn[i + 1]);
+}
+
+void SoftwareRasterizer::RasterizeClippedTriangle(
+    const VertexOut& v0, const VertexOut& v1, const VertexOut& v2) {
+  const VertexOut* v[3] = { &v0, &v1, &v2 };
+  const int width = mTarget->GetWidth();
+  const int height = mTarget->GetHeight();
+
+  // Perspective divide and viewport transform, with positions snapped to the sub-pixel grid.
+  double sx[3], sy[3];
+  float sz[3], invW[3];
+  for (int k = 0; k < 3; ++k) {
+    invW[k] = 1.0f / v[k]->PosH.w;
+    double x = (v[k]->PosH.x * invW[k] + 1.0) * 0.5 * width;
+    double y = (1.0 - v[k]->PosH.y * invW[k]) * 0.5 * height;
+    sx[k] = std::round(x * SUBPIXEL_SCALE) / SUBPIXEL_SCALE;
+    sy[k] = std::round(y * SUBPIXEL_SCALE) / SUBPIXEL_SCALE;
+    sz[k] = v[k]->PosH.z * invW[k];
+  }
+
+  // Clockwise on screen (y down) is front facing; back faces and degenerate triangles are culled.
+  double area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+  if (!(area > 0.0)) {
+    ++mStats.TrianglesCulled;
+    return;
+  }
+
+  // Depth bias from the triangle's depth slopes in x and y per pixel.
+  float depthBias = 0.0f;
+  if (mPso->DepthBias != 0 || mPso->SlopeScaledDepthBias != 0.0f) {
+    double dzdx = ((sz[1] - sz[0]) * (sy[2] - sy[0]) - (sz[2] - sz[0]) * (sy[1] - sy[0])) / area;
+    double dzdy = ((sx[1] - sx[0]) * (sz[2] - sz[0]) - (sx[2] - sx[0]) * (sz[1] - sz[0])) / area;
+    float maxSlope = static_cast<float>(std::max(std::fabs(dzdx), std::fabs(dzdy)));
+    depthBias = mPso->DepthBias * DEPTH_BIAS_UNIT + mPso->SlopeScaledDepthBias * maxSlope;
+  }
+
+  // Edge k is opposite vertex k.  A pixel center exactly on an edge belongs to the triangle only if
+  // the edge is a top or left edge.
+  struct Edge {
+    double ax, ay, dx, dy;
+    bool topLeft;
+    double Eval(double px, double py) const { return dx * (py - ay) - dy * (px - ax); }
+  } edges[3];
+  for (int k = 0; k < 3; ++k) {
+    int a = (k + 1) % 3;
+    int b = (k + 2) % 3;
+    edges[k].ax = sx[a];
+    edges[k].ay = sy[a];
+    edges[k].dx = sx[b] - sx[a];
+    edges[k].dy = sy[b] - sy[a];
+    edges[k].topLeft = (edges[k].dy == 0.0 && edges[k].dx > 0.0) || edges[k].dy < 0.0;
+  }
+
+  int minX = std::max(0, static_cast<int>(std::floor(std::min({ sx[0], sx[1], sx[2] }))));
+  int maxX = std::min(width - 1, static_cast<int>(std::ceil(std::max({ sx[0], sx[1], sx[2] }))));
+  int minY = std::max(0, static_cast<int>(std::floor(std::min({ sy[0], sy[1], sy[2] }))));
+  int maxY = std::min(height - 1, static_cast<int>(std::ceil(std::max({ sy[0], sy[1], sy[2] }))));
+
+  for (int y = minY; y <= maxY; ++y) {
+    double py = y + 0.5;
+    for (int x = minX; x <= maxX; ++x) {
+      double px = x + 0.5;
+
+      double e[3];
+      bool inside = true;
+      for (int k = 0; k < 3 && inside; ++k) {
+        e[k] = edges[k].Eval(px, py);
+        inside = e[k] > 0.0 || (e[k] == 0.0 && edges[k].topLeft);
+      }
+      if (!inside)
+        continue;
+
+      // Screen-space barycentrics.  Depth is interpolated linearly in screen space; everything
+      // else is interpolated perspective-correctly.
+      float b[3];
+      for (int k = 0; k < 3; ++k)
+        b[k] = static_cast<float>(e[k] / area);
+      float depth = b[0] * sz[0] + b[1] * sz[1] + b[2] * sz[2] + depthBias;
+
+      float pw[3];
+      float sumPw = 0.0f;
+      for (int k = 0; k < 3; ++k) {
+        pw[k] = b[k] * invW[k];
+        sumPw += pw[k];
+      }
+      for (int k = 0; k < 3; ++k)
+        pw[k] /= sumPw;
+
+      VertexOut pin;
+      pin.PosH = { static_cast<float>(px), static_cast<float>(py), depth, 1.0f / sumPw };
+      pin.PosW = v0.PosW * pw[0] + v1.PosW * pw[1] + v2.PosW * pw[2];
+      pin.NormalW = v0.NormalW * pw[0] + v1.NormalW * pw[1] + v2.NormalW * pw[2];
+      pin.TexC = { v0.TexC.x * pw[0] + v1.TexC.x * pw[1] + v2.TexC.x * pw[2],
+                   v0.TexC.y * pw[0] + v1.TexC.y * pw[1] + v2.TexC.y * pw[2] };
+
+      ShadePixel(x, y, std::min(std::max(depth, 0.0f), 1.0f), pin);
+    }
+  }
+}
+
+void SoftwareRasterizer::ShadePixel(int x, int y, float depth, const VertexOut& pin) {
+  size_t index = static_cast<size_t>(y) * mTarget->GetWidth() + x;
+  uint8_t& stencil = mTarget->Stencil()[index];
+  float& storedDepth = mTarget->Depth()[index];
+
+  // The tests have no side effects when they fail (all fail ops are KEEP), so they can run before
+  // the pixel shader without changing the result of a clip().
+  if (mPso->StencilEnable && !Compare(mPso->StencilFunc, mStencilRef, stencil))
+    return;
+  if (!Compare(mPso->DepthFunc, depth, storedDepth))
+    return;
+
+  SwVec4 color;
+  if (!RunPixelShader(pin, &color))
+    return;
+  ++mStats.PixelsShaded;
+
+  if (mPso->DepthWrite)
+    storedDepth = depth;
+  if (mPso->StencilEnable) {
+    switch (mPso->StencilPassOp) {
+    case SwPipelineState::STENCIL_OP_KEEP:
+      break;
+    case SwPipelineState::STENCIL_OP_REPLACE:
+      stencil = mStencilRef;
+      break;
+    case SwPipelineState::STENCIL_OP_INCR:
+      ++stencil;
+      break;
+    case SwPipelineState::STENCIL_OP_ZERO:
+      stencil = 0;
+      break;
+    }
+  }
+  if (!mPso->ColorWrite)
+    return;
+  if (mPso->AlphaBlend) {
+    SwVec4 dest = UnpackUnorm8(mTarget->Color()[index]);
+    float a = color.w;
+    color = { color.x * a + dest.x * (1.0f - a), color.y * a + dest.y * (1.0f - a),
+              color.z * a + dest.z * (1.0f - a), color.w * a + dest.w * (1.0f - a) };
+  }
+  mTarget->Color()[index] = PackUnorm8(color);
+}
+
+bool SoftwareRasterizer::Compare(SwPipelineState::ComparisonFunc func, float a, float b) {
+  switch (func) {
+  case SwPipelineState::COMPARISON_ALWAYS:
+    return true;
+  case SwPipelineState::COMPARISON_LESS:
+    return a < b;
+  case SwPipelineState::COMPARISON_LESS_EQUAL:
+    return a <= b;
+  }
+  return false;
+}
@@ -0,0 +1,297 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A small CPU rasterizer that reproduces the fixed-function state and shaders used by PortalsApp
+// (fx/Default.hlsl, fx/PortalBox.hlsl and fx/PortalDecal.hlsl) closely enough to serve as a
+// reference renderer.  It
+// follows D3D12's rules where they matter for the portal recursion: clockwise front faces with
+// back-face culling, top-left fill rule with pixel centers at +0.5, near/far clipping, stencil ops
+// applied only when both the stencil and depth tests pass, and clip() discarding before any depth
+// or stencil write.  Texture filtering is bilinear without mips, so colors differ slightly from the
+// GPU's anisotropic sampling; depth and stencil coverage do not depend on it.
+
+struct SwVec2 {
+  float x, y;
+};
+
+struct SwVec3 {
+  float x, y, z;
+};
+
+struct SwVec4 {
+  float x, y, z, w;
+};
+
+// Stored column-major, the way the shaders see their cbuffer matrices.  PortalsApp writes
+// XMMatrixTranspose(M) into its constant buffers, so those bytes can be copied into a SwMatrix
+// as-is, and MulPoint(v) computes the shaders' mul(v, M).
+struct SwMatrix {
+  float m[4][4];   // m[column][row]
+
+  static SwMatrix Identity();
+
+  SwVec4 MulPoint(const SwVec3& v) const;      // mul(float4(v, 1), M)
+  SwVec4 Mul(const SwVec4& v) const;           // mul(v, M)
+  SwVec3 MulNormal(const SwVec3& v) const;     // mul(v, (float3x3)M)
+};
+
+const int SW_NUM_LIGHTS = 3;
+
+// The following mirror the cbuffers and structured buffer in fx/Common.hlsl, member for member.
+
+struct SwObjectConstants {
+  SwMatrix World;
+  SwMatrix WorldInvTranspose;
+  SwMatrix TexTransform;
+  uint32_t MaterialIndex;
+  uint32_t ObjPad0;
+  uint32_t ObjPad1;
+  uint32_t ObjPad2;
+  // Decode the GPU's compressed vertices; SwVertex is already uncompressed, so they're unused.
+  SwVec3 PosScale;
+  float ObjPad3;
+  SwVec3 PosOffset;
+  float ObjPad4;
+  SwVec2 TexCScale;
+  SwVec2 TexCOffset;
+};
+
+struct SwClipPlaneConstants {
+  SwVec3 ClipPlaneNormal;
+  float ClipPlaneOffset;
+  SwVec3 ClipPlane2Normal;
+  float ClipPlane2Offset;
+};
+
+struct SwWorld2Constants {
+  SwMatrix World2;
+  SwMatrix World2InvTranspose;
+};
+
+struct SwPassConstants {
+  SwMatrix ViewProj;
+  SwVec3 EyePosW;
+  float DistDilation;
+};
+
+struct SwDirectionalLight {
+  SwVec3 Strength;
+  float LightPad0;
+  SwVec3 Direction;
+  float LightPad1;
+};
+
+struct SwFrameConstants {
+  SwVec4 PortalAHole;
+  SwVec3 PortalANormal;
+  float FramePad0;
+  SwVec4 PortalBHole;
+  SwVec3 PortalBNormal;
+  float FramePad1;
+  SwVec3 AmbientLight;
+  float FramePad2;
+  SwDirectionalLight Lights[SW_NUM_LIGHTS];
+};
+
+struct SwMaterialData {
+  SwVec4 Diffuse;
+  SwVec4 Specular;
+  uint32_t DiffuseMapIndex;
+  uint32_t MatPad0;
+  uint32_t MatPad1;
+  uint32_t MatPad2;
+};
+
+// Same layout as the app's Vertex.
+struct SwVertex {
+  SwVec3 Pos;
+  SwVec3 Normal;
+  SwVec2 TexC;
+};
+
+// RGBA texture with texels stored as floats, row by row.  An empty texture samples as opaque white
+// with wrap addressing and as transparent black with border addressing.
+struct SwTexture {
+  enum AddressMode {
+    ADDRESS_WRAP,
+    ADDRESS_BORDER_TRANSPARENT_BLACK
+  };
+
+  int Width = 0;
+  int Height = 0;
+  std::vector<SwVec4> Texels;
+
+  SwVec4 Sample(const SwVec2& texC, AddressMode addressMode) const;
+};
+
+// Color, depth and stencil buffers.  Color is stored as RGBA8 like the app's back buffer.
+class SwRenderTarget {
+public:
+  SwRenderTarget(int width, int height);
+
+  int GetWidth() const { return mWidth; }
+  int GetHeight() const { return mHeight; }
+
+  void ClearColor(const SwVec4& color);
+  void ClearDepthStencil(float depth, uint8_t stencil);
+
+  uint32_t* Color() { return mColor.data(); }
+  const uint32_t* Color() const { return mColor.data(); }
+  float* Depth() { return mDepth.data(); }
+  const float* Depth() const { return mDepth.data(); }
+  uint8_t* Stencil() { return mStencil.data(); }
+  const uint8_t* Stencil() const { return mStencil.data(); }
+
+  // Binary PPM/PGM images, readable by most image tools.  Depth is written as 8 bits with 1.0
+  // white.  Return false if the file can't be written.
+  bool WriteColorPpm(const std::string& path) const;
+  bool WriteDepthPgm(const std::string& path) const;
+  bool WriteStencilPgm(const std::string& path) const;
+
+private:
+  int mWidth;
+  int mHeight;
+  std::vector<uint32_t> mColor;     // 0xAABBGGRR
+  std::vector<float> mDepth;
+  std::vector<uint8_t> mStencil;
+};
+
+// Software counterpart of a pipeline state object.  Defaults match CD3DX12_DEPTH_STENCIL_DESC,
+// CD3DX12_BLEND_DESC(D3D12_DEFAULT) and CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT), except that the
+// stencil test is enabled as it is in all of PortalsApp's PSOs.
+struct SwPipelineState {
+  // Shader pairs from fx/.  The Default programs light the pixel; the PortalBox ones output a flat
+  // color and only exist to write depth and stencil; the PortalDecal ones output a portal's
+  // texture.
+  enum Program {
+    PROGRAM_DEFAULT,                 // Default.hlsl
+    PROGRAM_DEFAULT_PORTAL_HOLES,    // Default.hlsl with CLIP_PORTAL_HOLES
+    PROGRAM_PORTAL_BOX,              // PortalBox.hlsl
+    PROGRAM_PORTAL_BOX_CLEAR_DEPTH,  // PortalBox.hlsl with CLEAR_DEPTH in the VS
+    PROGRAM_PORTAL_DECAL_A,          // PortalDecal.hlsl with PORTAL_MAP gPortalAMap
+    PROGRAM_PORTAL_DECAL_B           // PortalDecal.hlsl with PORTAL_MAP gPortalBMap
+  };
+
+  enum ComparisonFunc {
+    COMPARISON_ALWAYS,
+    COMPARISON_LESS,
+    COMPARISON_LESS_EQUAL
+  };
+
+  enum StencilOp {
+    STENCIL_OP_KEEP,
+    STENCIL_OP_REPLACE,
+    STENCIL_OP_INCR,    // Wraps, like D3D12_STENCIL_OP_INCR
+    STENCIL_OP_ZERO
+  };
+
+  Program Shader = PROGRAM_DEFAULT;
+  int NumClipPlanes = 0;             // 0, 1 (CLIP_PLANE) or 2 (CLIP_PLANE and CLIP_PLANE_2)
+  ComparisonFunc DepthFunc = COMPARISON_LESS;
+  bool DepthWrite = true;
+  // Added to the depth before the test, as D3D12 does for a 24-bit depth buffer:
+  // DepthBias * 2^-24 + SlopeScaledDepthBias * (the triangle's largest depth slope per pixel).
+  int DepthBias = 0;
+  float SlopeScaledDepthBias = 0.0f;
+  bool StencilEnable = true;
+  ComparisonFunc StencilFunc = COMPARISON_ALWAYS;   // Compares ref against the stored value
+  StencilOp StencilPassOp = STENCIL_OP_KEEP;
+  bool ColorWrite = true;
+  bool AlphaBlend = false;           // SRC_ALPHA, INV_SRC_ALPHA
+};
+
+// Values that the shaders take as compile-time defines.
+struct SwShaderDefines {
+  float PortalTexRadRatio = 1.0f;
+  float FogStart = 20.0f;
+  float FogRange = 80.0f;
+  SwVec3 FogColor = { 0.7f, 0.7f, 0.7f };
+  SwVec3 PortalBoxColor = { 0.7f, 0.7f, 0.7f };   // OUT_COLOR in PortalBox.hlsl
+};
+
+// Renders indexed triangle lists into a SwRenderTarget.  State is bound the way it is on a command
+// list: bindings are pointers that must stay valid until the draws that use them are done.
+class SoftwareRasterizer {
+public:
+  struct Stats {
+    uint32_t Draws = 0;
+    uint32_t Triangles = 0;          // Submitted
+    uint32_t TrianglesCulled = 0;    // Back-facing or entirely clipped
+    uint64_t PixelsShaded = 0;       // Passed the stencil and depth tests and weren't discarded
+  };
+
+  explicit SoftwareRasterizer(const SwShaderDefines& defines = SwShaderDefines());
+
+  void SetRenderTarget(SwRenderTarget* target) { mTarget = target; }
+  void SetPipelineState(const SwPipelineState* pso) { mPso = pso; }
+  void SetStencilRef(uint8_t stencilRef) { mStencilRef = stencilRef; }
+
+  void SetObjectConstants(const SwObjectConstants* constants) { mObject = constants; }
+  void SetClipPlaneConstants(const SwClipPlaneConstants* constants) { mClipPlane = constants; }
+  void SetWorld2Constants(const SwWorld2Constants* constants) { mWorld2 = constants; }
+  void SetPassConstants(const SwPassConstants* constants) { mPass = constants; }
+  void SetFrameConstants(const SwFrameConstants* constants) { mFrame = constants; }
+  void SetMaterials(const SwMaterialData* materials, int count);
+
+  // Textures bound to gTextureMaps, gPortalAMap and gPortalBMap.
+  void SetTextureMaps(const SwTexture* textures, int count);
+  void SetPortalMaps(const SwTexture* portalAMap, const SwTexture* portalBMap);
+
+  void SetVertexBuffer(const SwVertex* vertices, size_t count);
+  void SetIndexBuffer(const uint32_t* indices, size_t count);
+
+  void DrawIndexed(uint32_t indexCount, uint32_t startIndexLocation, int baseVertexLocation);
+
+  const Stats& GetStats() const { return mStats; }
+  void ResetStats() { mStats = Stats(); }
+
+private:
+  // Vertex shader outputs.  Everything after PosH is interpolated perspective-correctly.
+  struct VertexOut {
+    SwVec4 PosH;
+    SwVec3 PosW;
+    SwVec3 NormalW;
+    SwVec2 TexC;
+  };
+
+  VertexOut RunVertexShader(const SwVertex& vin) const;
+  bool RunPixelShader(const VertexOut& pin, SwVec4* color) const;   // false if clip() discards
+
+  void DrawTriangle(const VertexOut& v0, const VertexOut& v1, const VertexOut& v2);
+  void RasterizeClippedTriangle(const VertexOut& v0, const VertexOut& v1, const VertexOut& v2);
+  void ShadePixel(int x, int y, float depth, const VertexOut& pin);
+
+  static bool Compare(SwPipelineState::ComparisonFunc func, float a, float b);
+
+  SwShaderDefines mDefines;
+
+  SwRenderTarget* mTarget = nullptr;
+  const SwPipelineState* mPso = nullptr;
+  uint8_t mStencilRef = 0;
+
+  const SwObjectConstants* mObject = nullptr;
+  const SwClipPlaneConstants* mClipPlane = nullptr;
+  const SwWorld2Constants* mWorld2 = nullptr;
+  const SwPassConstants* mPass = nullptr;
+  const SwFrameConstants* mFrame = nullptr;
+  const SwMaterialData* mMaterials = nullptr;
+  int mMaterialCount = 0;
+  const SwTexture* mTextureMaps = nullptr;
+  int mTextureMapCount = 0;
+  const SwTexture* mPortalAMap = nullptr;
+  const SwTexture* mPortalBMap = nullptr;
+
+  const SwVertex* mVertices = nullptr;
+  size_t mVertexCount = 0;
+  const uint32_t* mIndices = nullptr;
+  size_t mIndexCount = 0;
+
+  // Scratch for near/far clipping.
+  std::vector<VertexOut> mClipIn;
+  std::vector<VertexOut> mClipOut;
+
+  Stats mStats;
+};
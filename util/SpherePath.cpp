@@ -33,6 +33,98 @@ void SpherePath::MoveCameraAlongPathIterative(Camera &Cam, XMFLOAT3 Dir, float M
 
 
 
+unsigned int SpherePath::MoveCameraAlongPathAdaptive(Camera &Cam, XMFLOAT3 Dir, float MoveDist,
+									const Room &Level, const Portal &OrangePortal, const Portal &BluePortal,
+									SubstepStats *Stats_ptr)
+{
+	unsigned int Substeps = CalculateSubstepCount(Cam, Dir, MoveDist, Level, OrangePortal, BluePortal);
+
+	if (Stats_ptr)
+	{
+		Stats_ptr->Moves++;
+		Stats_ptr->Substeps += Substeps;
+		if (Substeps > 1)
+			Stats_ptr->SplitMoves++;
+		if (Substeps > Stats_ptr->MaxSubsteps)
+			Stats_ptr->MaxSubsteps = Substeps;
+	}
+
+	// common case: nothing small is near the path, so move in one go
+	if (Substeps == 1)
+	{
+		MoveCameraAlongPathIterative(Cam, Dir, MoveDist, Level, OrangePortal, BluePortal);
+		return 1;
+	}
+
+	// the camera may pass thru a portal partway, which rotates and scales its axes.  store Dir in
+	// camera space so each substep heads in the same direction relative to the camera.
+	// MoveDist is in unscaled units (it's scaled by ViewScale in MoveCameraAlongPath), so it can be
+	// split evenly regardless of any scale change
+	float DirRight = XMFloat3Dot(Dir, Cam.GetRight());
+	float DirUp = XMFloat3Dot(Dir, Cam.GetUp());
+	float DirLook = XMFloat3Dot(Dir, Cam.GetLook());
+	float SubstepDist = MoveDist / (float)Substeps;
+	for (unsigned int i=0; i<Substeps; ++i)
+	{
+		XMFLOAT3 SubstepDir = XMFloat3Normalize(DirRight*Cam.GetRight() + DirUp*Cam.GetUp() + DirLook*Cam.GetLook());
+		MoveCameraAlongPathIterative(Cam, SubstepDir, SubstepDist, Level, OrangePortal, BluePortal);
+	}
+	return Substeps;
+}
+
+
+
+unsigned int SpherePath::CalculateSubstepCount(const Camera &Cam, XMFLOAT3 Dir, float MoveDist,
+									const Room &Level, const Portal &OrangePortal, const Portal &BluePortal)
+{
+	float SphereRadius = Cam.GetBoundingSphereRadius();
+	XMFLOAT3 S = Cam.GetPosition();
+	float PathLength = MoveDist * Cam.GetViewScale();
+	if (PathLength <= 0.0f)
+		return 1;
+
+	// find the smallest feature the swept sphere can reach
+	float FeatureSize = std::numeric_limits<float>::infinity();
+
+	// a portal is approached if the swept sphere can touch the bounding sphere of its ring.
+	// both the ring radius and the sphere radius set the scale of the torus the path is swept against
+	const Portal *Portals[2] = { &OrangePortal, &BluePortal };
+	for (int i=0; i<2; ++i)
+	{
+		float PortalRadius = Portals[i]->GetPhysicalRadius();
+		if (PathDistanceToPoint(S, Dir, PathLength, Portals[i]->GetPosition()) <= PortalRadius + SphereRadius)
+			FeatureSize = min(FeatureSize, min(PortalRadius, SphereRadius));
+	}
+
+	// room walls shorter than the path
+	FeatureSize = min(FeatureSize, Level.MinFeatureSizeNearPath(SphereRadius, S, Dir, PathLength));
+
+	// leave the move whole if nothing nearby is small compared to the path
+	float MaxSubstepLength = ADAPTIVE_SUBSTEP_FEATURE_RATIO * FeatureSize;
+	if (PathLength <= MaxSubstepLength)
+		return 1;
+
+	float Substeps = ceilf(PathLength / MaxSubstepLength);
+	if (Substeps >= (float)ADAPTIVE_SUBSTEP_MAX)
+		return ADAPTIVE_SUBSTEP_MAX;
+	return (unsigned int)Substeps;
+}
+
+
+
+// distance from P to the segment from S to S+MoveDist*Dir (Dir is unit length)
+float SpherePath::PathDistanceToPoint(XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist, XMFLOAT3 P)
+{
+	float t = XMFloat3Dot(P-S, Dir);
+	if (t < 0.0f)
+		t = 0.0f;
+	else if (t > MoveDist)
+		t = MoveDist;
+	return XMFloat3Length(P - (S + t*Dir));
+}
+
+
+
 
 
 
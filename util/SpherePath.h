@@ -12,15 +12,34 @@ using namespace DirectX;
 class SpherePath
 {
 public:
+	// running counts of how moves were split by MoveCameraAlongPathAdaptive
+	struct SubstepStats
+	{
+		unsigned int Moves = 0;			// number of moves requested
+		unsigned int SplitMoves = 0;	// number of moves that were split into more than one substep
+		unsigned int Substeps = 0;		// total number of substeps taken
+		unsigned int MaxSubsteps = 0;	// largest number of substeps a single move was split into
+	};
+
 	static void MoveCameraAlongPathIterative(Camera &Cam, XMFLOAT3 Dir, float MoveDist,
 									const Room &Level, const Portal &OrangePortal, const Portal &BluePortal);
 
+	// splits the move into substeps only if the path approaches portals or room geometry that is small
+	// compared to the length of the path.  returns the number of substeps taken
+	static unsigned int MoveCameraAlongPathAdaptive(Camera &Cam, XMFLOAT3 Dir, float MoveDist,
+									const Room &Level, const Portal &OrangePortal, const Portal &BluePortal,
+									SubstepStats *Stats_ptr = nullptr);
+
+	static unsigned int CalculateSubstepCount(const Camera &Cam, XMFLOAT3 Dir, float MoveDist,
+									const Room &Level, const Portal &OrangePortal, const Portal &BluePortal);
+
 	/*
 	static XMFLOAT3 SpherePathNoSelfClipFindEnd(const FirstPersonObject &Player, XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist,
 											const Room &Level, const Portal &OrangePortal, const Portal &BluePortal);
 	*/
 
 private:
+	static float PathDistanceToPoint(XMFLOAT3 S, XMFLOAT3 Dir, float MoveDist, XMFLOAT3 P);
 
 	// returns whether or not a redirect is necessary
 	static bool MoveCameraAlongPath(Camera &Cam, XMFLOAT3 Dir, float MoveDist,
@@ -0,0 +1,147 @@
+#include "StateFilteredCommandList.h"
+
+StateFilteredCommandList::Stats& StateFilteredCommandList::Stats::operator+=(const Stats& rhs) {
+  RootSignatures += rhs.RootSignatures;
+  RootSignaturesFiltered += rhs.RootSignaturesFiltered;
+  PipelineStates += rhs.PipelineStates;
+  PipelineStatesFiltered += rhs.PipelineStatesFiltered;
+  RootCbvs += rhs.RootCbvs;
+  RootCbvsFiltered += rhs.RootCbvsFiltered;
+  StencilRefs += rhs.StencilRefs;
+  StencilRefsFiltered += rhs.StencilRefsFiltered;
+  IABindings += rhs.IABindings;
+  IABindingsFiltered += rhs.IABindingsFiltered;
+  Draws += rhs.Draws;
+  return *this;
+}
+
+StateFilteredCommandList::StateFilteredCommandList(
+    ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* initialState)
+  : mCmdList(cmdList) {
+  Invalidate();
+  mPipelineState = initialState;
+}
+
+ID3D12GraphicsCommandList* StateFilteredCommandList::Get() const {
+  return mCmdList;
+}
+
+const StateFilteredCommandList::Stats& StateFilteredCommandList::GetStats() const {
+  return mStats;
+}
+
+void StateFilteredCommandList::Invalidate() {
+  mRootSignature = nullptr;
+  mPipelineState = nullptr;
+  for (UINT i = 0; i < kMaxRootCbvs; ++i)
+    mRootCbvs[i] = 0;
+  mStencilRefKnown = false;
+  mStencilRef = 0;
+  for (UINT i = 0; i < D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT; ++i)
+    mVertexBufferKnown[i] = false;
+  mIndexBufferKnown = false;
+  mPrimitiveTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+}
+
+void StateFilteredCommandList::SetGraphicsRootSignature(ID3D12RootSignature* rootSignature) {
+  if (rootSignature == mRootSignature) {
+    ++mStats.RootSignaturesFiltered;
+    return;
+  }
+  mCmdList->SetGraphicsRootSignature(rootSignature);
+  mRootSignature = rootSignature;
+  ++mStats.RootSignatures;
+
+  // Changing the root signature clears all root arguments.
+  for (UINT i = 0; i < kMaxRootCbvs; ++i)
+    mRootCbvs[i] = 0;
+}
+
+void StateFilteredCommandList::SetPipelineState(ID3D12PipelineState* pipelineState) {
+  if (pipelineState == mPipelineState) {
+    ++mStats.PipelineStatesFiltered;
+    return;
+  }
+  mCmdList->SetPipelineState(pipelineState);
+  mPipelineState = pipelineState;
+  ++mStats.PipelineStates;
+}
+
+void StateFilteredCommandList::SetGraphicsRootConstantBufferView(
+    UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation) {
+  assert(rootParameterIndex < kMaxRootCbvs);
+  if (bufferLocation != 0 && mRootCbvs[rootParameterIndex] == bufferLocation) {
+    ++mStats.RootCbvsFiltered;
+    return;
+  }
+  mCmdList->SetGraphicsRootConstantBufferView(rootParameterIndex, bufferLocation);
+  mRootCbvs[rootParameterIndex] = bufferLocation;
+  ++mStats.RootCbvs;
+}
+
+void StateFilteredCommandList::OMSetStencilRef(UINT stencilRef) {
+  if (mStencilRefKnown && mStencilRef == stencilRef) {
+    ++mStats.StencilRefsFiltered;
+    return;
+  }
+  mCmdList->OMSetStencilRef(stencilRef);
+  mStencilRefKnown = true;
+  mStencilRef = stencilRef;
+  ++mStats.StencilRefs;
+}
+
+void StateFilteredCommandList::IASetVertexBuffers(
+    UINT startSlot, UINT numViews, const D3D12_VERTEX_BUFFER_VIEW* views) {
+  assert(startSlot + numViews <= D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT);
+  bool redundant = true;
+  for (UINT i = 0; i < numViews && redundant; ++i) {
+    const D3D12_VERTEX_BUFFER_VIEW& bound = mVertexBuffers[startSlot + i];
+    redundant = mVertexBufferKnown[startSlot + i] &&
+      bound.BufferLocation == views[i].BufferLocation &&
+      bound.SizeInBytes == views[i].SizeInBytes &&
+      bound.StrideInBytes == views[i].StrideInBytes;
+  }
+  if (redundant) {
+    ++mStats.IABindingsFiltered;
+    return;
+  }
+  mCmdList->IASetVertexBuffers(startSlot, numViews, views);
+  for (UINT i = 0; i < numViews; ++i) {
+    mVertexBufferKnown[startSlot + i] = true;
+    mVertexBuffers[startSlot + i] = views[i];
+  }
+  ++mStats.IABindings;
+}
+
+void StateFilteredCommandList::IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view) {
+  if (mIndexBufferKnown &&
+      mIndexBuffer.BufferLocation == view->BufferLocation &&
+      mIndexBuffer.SizeInBytes == view->SizeInBytes &&
+      mIndexBuffer.Format == view->Format) {
+    ++mStats.IABindingsFiltered;
+    return;
+  }
+  mCmdList->IASetIndexBuffer(view);
+  mIndexBufferKnown = true;
+  mIndexBuffer = *view;
+  ++mStats.IABindings;
+}
+
+void StateFilteredCommandList::IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology) {
+  if (primitiveTopology == mPrimitiveTopology) {
+    ++mStats.IABindingsFiltered;
+    return;
+  }
+  mCmdList->IASetPrimitiveTopology(primitiveTopology);
+  mPrimitiveTopology = primitiveTopology;
+  ++mStats.IABindings;
+}
+
+void StateFilteredCommandList::DrawIndexedInstanced(
+    UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation,
+    INT baseVertexLocation, UINT startInstanceLocation) {
+  mCmdList->DrawIndexedInstanced(
+      indexCountPerInstance, instanceCount, startIndexLocation, baseVertexLocation,
+      startInstanceLocation);
+  ++mStats.Draws;
+}
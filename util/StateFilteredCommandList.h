@@ -0,0 +1,70 @@
+#pragma once
+
+#include "d3dUtil.h"
+
+// Wraps a command list and drops state-setting calls that would rebind the value that's already
+// bound: root signature, pipeline state, root constant buffer views, stencil ref and input
+// assembler bindings.
+// Everything else should be called on Get() directly.  The tracked state starts out unknown, so
+// the first call of each kind always goes through.  Counts of issued and filtered calls are kept
+// so the remaining state changes can be inspected.
+class StateFilteredCommandList {
+public:
+  struct Stats {
+    UINT RootSignatures = 0;
+    UINT RootSignaturesFiltered = 0;
+    UINT PipelineStates = 0;
+    UINT PipelineStatesFiltered = 0;
+    UINT RootCbvs = 0;
+    UINT RootCbvsFiltered = 0;
+    UINT StencilRefs = 0;
+    UINT StencilRefsFiltered = 0;
+    UINT IABindings = 0;          // vertex buffers, index buffer and primitive topology
+    UINT IABindingsFiltered = 0;
+    UINT Draws = 0;
+
+    Stats& operator+=(const Stats& rhs);
+  };
+
+  // cmdList must have just been reset with initialState.
+  StateFilteredCommandList(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* initialState);
+
+  StateFilteredCommandList(const StateFilteredCommandList&) = delete;
+  StateFilteredCommandList& operator=(const StateFilteredCommandList&) = delete;
+
+  ID3D12GraphicsCommandList* Get() const;
+  const Stats& GetStats() const;
+
+  // Forgets all tracked state, e.g. after state was changed through Get().
+  void Invalidate();
+
+  void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature);
+  void SetPipelineState(ID3D12PipelineState* pipelineState);
+  void SetGraphicsRootConstantBufferView(
+      UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation);
+  void OMSetStencilRef(UINT stencilRef);
+  void IASetVertexBuffers(UINT startSlot, UINT numViews, const D3D12_VERTEX_BUFFER_VIEW* views);
+  void IASetIndexBuffer(const D3D12_INDEX_BUFFER_VIEW* view);
+  void IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY primitiveTopology);
+  void DrawIndexedInstanced(
+      UINT indexCountPerInstance, UINT instanceCount, UINT startIndexLocation,
+      INT baseVertexLocation, UINT startInstanceLocation);
+
+private:
+  // A root signature holds at most 64 DWORDs, and a root CBV takes 2.
+  static const UINT kMaxRootCbvs = 32;
+
+  ID3D12GraphicsCommandList* mCmdList;
+  Stats mStats;
+
+  ID3D12RootSignature* mRootSignature;
+  ID3D12PipelineState* mPipelineState;
+  D3D12_GPU_VIRTUAL_ADDRESS mRootCbvs[kMaxRootCbvs];   // 0 if unknown
+  bool mStencilRefKnown;
+  UINT mStencilRef;
+  bool mVertexBufferKnown[D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+  D3D12_VERTEX_BUFFER_VIEW mVertexBuffers[D3D12_IA_VERTEX_INPUT_RESOURCE_SLOT_COUNT];
+  bool mIndexBufferKnown;
+  D3D12_INDEX_BUFFER_VIEW mIndexBuffer;
+  D3D12_PRIMITIVE_TOPOLOGY mPrimitiveTopology;      // UNDEFINED if unknown
+};
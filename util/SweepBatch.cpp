@@ -0,0 +1,239 @@
+#include "SweepBatch.h"
+
+#include <utility>
+
+using namespace DirectX;
+
+namespace
+{
+	// grid cell containing the XZ projection of P, used to order room sweeps by location
+	std::pair<int, int> CellOf(const XMFLOAT3 &P)
+	{
+		return std::make_pair((int)floorf(P.x / SWEEP_BATCH_CELL_SIZE), (int)floorf(P.z / SWEEP_BATCH_CELL_SIZE));
+	}
+}
+
+
+// SWEEP HITS ************************************************************************************
+
+void SweepHits::Resize(size_t Count)
+{
+	X.resize(Count);
+	XDist.resize(Count);
+	RedirectRatio.resize(Count);
+	RedirectDir.resize(Count);
+	T.resize(Count);
+	TNormal.resize(Count);
+	Collided.resize(Count);
+}
+
+size_t SweepHits::size()const
+{
+	return X.size();
+}
+
+
+// SWEEP BATCH ***********************************************************************************
+
+SweepBatch::SweepBatch(const Room &Level, const Portal &PortalA, const Portal &PortalB)
+	: Level(Level)
+{
+	Portals[0] = &PortalA;
+	Portals[1] = &PortalB;
+}
+
+void SweepBatch::Run(const SweepQuery *Queries, size_t Count, SweepHits *Hits)
+{
+	Hits->Resize(Count);
+	SweepS.resize(Count);
+	SweepDir.resize(Count);
+	SweepRadius.resize(Count);
+	SweepMoveDist.resize(Count);
+
+	// sort queries by kind
+	RoomIndices.clear();
+	for (int p=0; p<2; ++p)
+	{
+		VirtualRoomIndices[p].clear();
+		PortalRingIndices[p].clear();
+	}
+	for (size_t i=0; i<Count; ++i)
+	{
+		const SweepQuery &Query = Queries[i];
+		switch (Query.Type)
+		{
+		case SweepQuery::ROOM:
+			RoomIndices.push_back(i);
+			SweepS[i] = Query.S;
+			SweepDir[i] = Query.Dir;
+			SweepRadius[i] = Query.SphereRadius;
+			SweepMoveDist[i] = Query.MoveDist;
+			break;
+		case SweepQuery::VIRTUAL_ROOM:
+			VirtualRoomIndices[Query.PortalIndex].push_back(i);
+			break;
+		case SweepQuery::PORTAL_RING:
+			PortalRingIndices[Query.PortalIndex].push_back(i);
+			break;
+		}
+	}
+
+	// real room
+	RunRoomSweeps(RoomIndices, Hits);
+
+	for (int p=0; p<2; ++p)
+	{
+		const Portal &ThisPortal = *Portals[p];
+		const Portal &OtherPortal = *Portals[1-p];
+
+		// virtual room seen through this portal
+		if (!VirtualRoomIndices[p].empty())
+		{
+			XMMATRIX Virtualize = Portal::CalculateVirtualizationMatrix(ThisPortal, OtherPortal);
+			XMMATRIX Unvirtualize = Portal::CalculateVirtualizationMatrix(OtherPortal, ThisPortal);
+			RunVirtualRoomSweeps(Queries, VirtualRoomIndices[p], Virtualize, Unvirtualize, Hits);
+		}
+
+		// this portal's ring
+		if (!PortalRingIndices[p].empty())
+		{
+			XMMATRIX WorldToPortal = ThisPortal.GetWorldToPortalMatrix();
+			for (size_t k=0; k<PortalRingIndices[p].size(); ++k)
+			{
+				size_t i = PortalRingIndices[p][k];
+				const SweepQuery &Query = Queries[i];
+				Hits->X[i] = ThisPortal.SpherePathCollision(WorldToPortal, Query.SphereRadius, Query.S, Query.Dir,
+									Query.MoveDist, &Hits->XDist[i], &Hits->RedirectRatio[i], &Hits->RedirectDir[i]);
+				Hits->Collided[i] = (Hits->XDist[i] < Query.MoveDist);
+
+				// ring collisions don't produce a tangent point
+				Hits->T[i] = Hits->X[i];
+				Hits->TNormal[i] = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			}
+		}
+	}
+}
+
+
+// runs the room sweeps whose room-space inputs are in SweepS, SweepDir, SweepRadius, SweepMoveDist
+void SweepBatch::RunRoomSweeps(const std::vector<size_t> &Indices, SweepHits *Hits)
+{
+	// order sweeps by grid cell so that consecutive sweeps are close together
+	SortedIndices = Indices;
+	std::sort(SortedIndices.begin(), SortedIndices.end(),
+		[this](size_t a, size_t b) { return CellOf(SweepS[a]) < CellOf(SweepS[b]); });
+
+	size_t Begin = 0;
+	while (Begin < SortedIndices.size())
+	{
+		// a cluster is a run of up to SWEEP_BATCH_CLUSTER_SIZE sweeps starting in the same cell
+		std::pair<int, int> Cell = CellOf(SweepS[SortedIndices[Begin]]);
+		size_t End = Begin + 1;
+		while (End < SortedIndices.size() && End - Begin < SWEEP_BATCH_CLUSTER_SIZE &&
+			CellOf(SweepS[SortedIndices[End]]) == Cell)
+		{
+			++End;
+		}
+
+		// find the XZ region that the sweeps in this cluster can reach.  Room only considers walls
+		// within MoveDist+SphereRadius of S along or across the wall, which is at most sqrt(2) times that
+		// distance away in any axis.
+		XMFLOAT2 BoundsMin = XMFLOAT2(std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity());
+		XMFLOAT2 BoundsMax = -BoundsMin;
+		for (size_t j=Begin; j<End; ++j)
+		{
+			size_t i = SortedIndices[j];
+			float Reach = 1.5f * (SweepMoveDist[i] + SweepRadius[i]);
+			BoundsMin.x = min(BoundsMin.x, SweepS[i].x - Reach);
+			BoundsMin.y = min(BoundsMin.y, SweepS[i].z - Reach);
+			BoundsMax.x = max(BoundsMax.x, SweepS[i].x + Reach);
+			BoundsMax.y = max(BoundsMax.y, SweepS[i].z + Reach);
+		}
+
+		// broadphase once for the whole cluster
+		CandidateWalls.clear();
+		Level.GatherWallsInBounds(BoundsMin, BoundsMax, &CandidateWalls);
+
+		for (size_t j=Begin; j<End; ++j)
+		{
+			size_t i = SortedIndices[j];
+			Hits->X[i] = Level.SpherePathCollision(SweepRadius[i], SweepS[i], SweepDir[i], SweepMoveDist[i],
+									&Hits->XDist[i], &Hits->RedirectRatio[i], &Hits->RedirectDir[i],
+									&Hits->T[i], &Hits->TNormal[i], &CandidateWalls);
+			Hits->Collided[i] = (Hits->XDist[i] < SweepMoveDist[i]);
+
+			// Room leaves T undefined if nothing was hit
+			if (!Hits->Collided[i])
+			{
+				Hits->T[i] = Hits->X[i];
+				Hits->TNormal[i] = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			}
+		}
+
+		Begin = End;
+	}
+}
+
+
+void SweepBatch::RunVirtualRoomSweeps(const SweepQuery *Queries, const std::vector<size_t> &Indices,
+									const XMMATRIX &Virtualize, const XMMATRIX &Unvirtualize, SweepHits *Hits)
+{
+	size_t Count = Indices.size();
+	StreamIn.resize(Count);
+	StreamOut.resize(Count);
+	VirtualScale.resize(Count);
+
+	// virtualize the start points of all the sweeps at once
+	for (size_t k=0; k<Count; ++k)
+		StreamIn[k] = Queries[Indices[k]].S;
+	XMVector3TransformCoordStream(StreamOut.data(), sizeof(XMFLOAT3), StreamIn.data(), sizeof(XMFLOAT3), Count, Virtualize);
+	for (size_t k=0; k<Count; ++k)
+		SweepS[Indices[k]] = StreamOut[k];
+
+	// virtualize the directions. the virtualization scales uniformly, so the radius and distance are
+	// scaled by the length of the virtualized direction
+	for (size_t k=0; k<Count; ++k)
+		StreamIn[k] = Queries[Indices[k]].Dir;
+	XMVector3TransformNormalStream(StreamOut.data(), sizeof(XMFLOAT3), StreamIn.data(), sizeof(XMFLOAT3), Count, Virtualize);
+	for (size_t k=0; k<Count; ++k)
+	{
+		size_t i = Indices[k];
+		float Scale = XMFloat3Length(StreamOut[k]);
+		VirtualScale[k] = Scale;
+		SweepDir[i] = StreamOut[k] / Scale;
+		SweepRadius[i] = Queries[i].SphereRadius * Scale;
+		SweepMoveDist[i] = Queries[i].MoveDist * Scale;
+	}
+
+	RunRoomSweeps(Indices, Hits);
+
+	// un-virtualize the points
+	for (size_t k=0; k<Count; ++k)
+		StreamIn[k] = Hits->X[Indices[k]];
+	XMVector3TransformCoordStream(StreamOut.data(), sizeof(XMFLOAT3), StreamIn.data(), sizeof(XMFLOAT3), Count, Unvirtualize);
+	for (size_t k=0; k<Count; ++k)
+		Hits->X[Indices[k]] = StreamOut[k];
+
+	for (size_t k=0; k<Count; ++k)
+		StreamIn[k] = Hits->T[Indices[k]];
+	XMVector3TransformCoordStream(StreamOut.data(), sizeof(XMFLOAT3), StreamIn.data(), sizeof(XMFLOAT3), Count, Unvirtualize);
+	for (size_t k=0; k<Count; ++k)
+		Hits->T[Indices[k]] = StreamOut[k];
+
+	// un-virtualize the directions and restore them to unit length
+	for (size_t k=0; k<Count; ++k)
+		StreamIn[k] = Hits->RedirectDir[Indices[k]];
+	XMVector3TransformNormalStream(StreamOut.data(), sizeof(XMFLOAT3), StreamIn.data(), sizeof(XMFLOAT3), Count, Unvirtualize);
+	for (size_t k=0; k<Count; ++k)
+		Hits->RedirectDir[Indices[k]] = StreamOut[k] * VirtualScale[k];
+
+	for (size_t k=0; k<Count; ++k)
+		StreamIn[k] = Hits->TNormal[Indices[k]];
+	XMVector3TransformNormalStream(StreamOut.data(), sizeof(XMFLOAT3), StreamIn.data(), sizeof(XMFLOAT3), Count, Unvirtualize);
+	for (size_t k=0; k<Count; ++k)
+		Hits->TNormal[Indices[k]] = StreamOut[k] * VirtualScale[k];
+
+	// unscale the distances
+	for (size_t k=0; k<Count; ++k)
+		Hits->XDist[Indices[k]] /= VirtualScale[k];
+}
@@ -0,0 +1,89 @@
+#ifndef SWEEPBATCH_H
+#define SWEEPBATCH_H
+
+#include "d3dUtil.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "Macros.h"
+#include "MathFunctions.h"
+#include "Room.h"
+#include "Portal.h"
+
+using namespace DirectX;
+
+// a single sphere sweep, to be run as part of a batch
+struct SweepQuery
+{
+	enum Kind
+	{
+		ROOM,			// sweep against the real room
+		VIRTUAL_ROOM,	// sweep against the virtual room seen through portal PortalIndex
+		PORTAL_RING		// sweep against the ring of portal PortalIndex
+	};
+
+	Kind Type;
+	int PortalIndex;		// 0 or 1, unused for ROOM
+	float SphereRadius;
+	XMFLOAT3 S;
+	XMFLOAT3 Dir;			// must be unit length
+	float MoveDist;
+};
+
+// results of a batch of sweeps, stored as parallel arrays indexed the same as the queries
+struct SweepHits
+{
+	std::vector<XMFLOAT3> X;				// where the sphere center stops
+	std::vector<float> XDist;				// distance travelled; MoveDist if nothing was hit
+	std::vector<float> RedirectRatio;
+	std::vector<XMFLOAT3> RedirectDir;		// unit length
+	std::vector<XMFLOAT3> T;				// point of contact (ROOM, VIRTUAL_ROOM only)
+	std::vector<XMFLOAT3> TNormal;			// unit normal at T (ROOM, VIRTUAL_ROOM only)
+	std::vector<unsigned char> Collided;	// nonzero if the sweep was stopped before MoveDist
+
+	void Resize(size_t Count);
+	size_t size()const;
+};
+
+// Runs many sphere sweeps against a room and its two portals at once.  Transforms are computed once
+// per batch, queries are grouped by kind and by location so nearby room sweeps share one wall
+// broadphase, and portal virtualizations are applied to whole arrays of points at a time.
+// Scratch storage is kept between calls, so reusing one SweepBatch avoids per-call allocations.
+class SweepBatch
+{
+public:
+	SweepBatch(const Room &Level, const Portal &PortalA, const Portal &PortalB);
+
+	void Run(const SweepQuery *Queries, size_t Count, SweepHits *Hits);
+
+private:
+	void RunRoomSweeps(const std::vector<size_t> &Indices, SweepHits *Hits);
+	void RunVirtualRoomSweeps(const SweepQuery *Queries, const std::vector<size_t> &Indices,
+									const XMMATRIX &Virtualize, const XMMATRIX &Unvirtualize, SweepHits *Hits);
+
+	const Room &Level;
+	const Portal *Portals[2];
+
+	// per-kind query indices
+	std::vector<size_t> RoomIndices;
+	std::vector<size_t> VirtualRoomIndices[2];
+	std::vector<size_t> PortalRingIndices[2];
+
+	// room-space inputs of the sweeps currently handed to RunRoomSweeps, indexed by query index
+	std::vector<XMFLOAT3> SweepS;
+	std::vector<XMFLOAT3> SweepDir;
+	std::vector<float> SweepRadius;
+	std::vector<float> SweepMoveDist;
+	std::vector<size_t> SortedIndices;
+
+	// scratch for virtualized sweeps, indexed by position in the virtual-room index list
+	std::vector<XMFLOAT3> StreamIn;
+	std::vector<XMFLOAT3> StreamOut;
+	std::vector<float> VirtualScale;
+
+	Room::WallEdgeList CandidateWalls;
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "TaskGraph.h"
+
+#include <cassert>
+
+namespace {
+  double MillisecondsBetween(std::chrono::steady_clock::time_point start,
+                             std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  }
+}
+
+TaskGraph::StageId TaskGraph::AddStage(const std::string& name, std::function<void()> work,
+                                       std::initializer_list<StageId> dependencies) {
+  const StageId id = static_cast<StageId>(mStages.size());
+  Stage stage;
+  stage.Work = std::move(work);
+  for (StageId dependency : dependencies) {
+    assert(dependency >= 0 && dependency < id);
+    mStages[dependency].Dependents.push_back(id);
+    ++stage.NumDependencies;
+  }
+  mStages.push_back(std::move(stage));
+
+  StageTiming timing;
+  timing.Name = name;
+  mTimings.push_back(timing);
+  return id;
+}
+
+void TaskGraph::Run(WorkerThreads* threads) {
+  mRunStart = std::chrono::steady_clock::now();
+  for (StageId id = 0; id < static_cast<StageId>(mStages.size()); ++id) {
+    if (mStages[id].NumDependencies == 0)
+      mReadyStages.push_back(id);
+  }
+
+  threads->Run([this](int threadIndex) { ThreadMain(threadIndex); });
+  mTotalMs = MillisecondsBetween(mRunStart, std::chrono::steady_clock::now());
+
+  if (mException)
+    std::rethrow_exception(mException);
+}
+
+void TaskGraph::ThreadMain(int threadIndex) {
+  const int numStages = static_cast<int>(mStages.size());
+  std::unique_lock<std::mutex> lock(mMutex);
+  for (;;) {
+    mReadyCondition.wait(lock, [&] {
+      return !mReadyStages.empty() || mNumFinished == numStages || mException;
+    });
+    if (mNumFinished == numStages || mException)
+      return;
+
+    const StageId id = mReadyStages.front();
+    mReadyStages.pop_front();
+    lock.unlock();
+
+    // Catch everything (including DxException, which isn't a std::exception) so the other
+    // threads can be told to stop.
+    std::exception_ptr exception;
+    const auto start = std::chrono::steady_clock::now();
+    try {
+      mStages[id].Work();
+    } catch (...) {
+      exception = std::current_exception();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    lock.lock();
+    StageTiming& timing = mTimings[id];
+    timing.StartMs = MillisecondsBetween(mRunStart, start);
+    timing.DurationMs = MillisecondsBetween(start, end);
+    timing.ThreadIndex = threadIndex;
+    if (exception) {
+      if (!mException)
+        mException = exception;
+    } else {
+      ++mNumFinished;
+      for (StageId dependent : mStages[id].Dependents) {
+        if (--mStages[dependent].NumDependencies == 0)
+          mReadyStages.push_back(dependent);
+      }
+    }
+    mReadyCondition.notify_all();
+  }
+}
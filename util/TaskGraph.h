@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "WorkerThreads.h"
+
+// Runs a set of stages on worker threads, each one starting as soon as the stages it depends on
+// have finished, and records when each stage ran.  Used to overlap the independent parts of
+// startup (file reads, shader compiles, resource creation) that would otherwise run one after
+// another.
+//
+// Stages can only depend on stages added before them, so the graph can't have cycles.
+class TaskGraph {
+public:
+  typedef int StageId;
+
+  struct StageTiming {
+    std::string Name;
+    double StartMs = 0.0;        // Since Run was called
+    double DurationMs = 0.0;
+    int ThreadIndex = -1;        // Worker thread that ran the stage
+  };
+
+  StageId AddStage(const std::string& name, std::function<void()> work,
+                   std::initializer_list<StageId> dependencies = {});
+
+  // Runs every stage on threads and returns once all have finished.  If a stage throws, no new
+  // stages are started, the ones already running are waited for, and the first exception is
+  // rethrown here.  Can only be called once.
+  void Run(WorkerThreads* threads);
+
+  // In the order the stages were added.  Stages that never ran have a ThreadIndex of -1.
+  const std::vector<StageTiming>& GetTimings() const { return mTimings; }
+  double GetTotalMs() const { return mTotalMs; }
+
+private:
+  struct Stage {
+    std::function<void()> Work;
+    std::vector<StageId> Dependents;
+    int NumDependencies = 0;
+  };
+
+  void ThreadMain(int threadIndex);
+
+  std::vector<Stage> mStages;
+  std::vector<StageTiming> mTimings;
+  double mTotalMs = 0.0;
+
+  std::mutex mMutex;
+  std::condition_variable mReadyCondition;
+  std::deque<StageId> mReadyStages;
+  int mNumFinished = 0;
+  std::exception_ptr mException;
+  std::chrono::steady_clock::time_point mRunStart;
+};
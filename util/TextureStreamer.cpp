@@ -0,0 +1,154 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+TextureStreamer::TextureStreamer(uint64_t budgetBytes, int maxLoadsInFlight)
+  : mMaxLoadsInFlight(maxLoadsInFlight) {
+  mStats.BudgetBytes = budgetBytes;
+}
+
+int TextureStreamer::AddTexture(const std::vector<uint64_t>& mipBytes, int firstPinnedMip) {
+  assert(firstPinnedMip >= 0 && firstPinnedMip < static_cast<int>(mipBytes.size()));
+  Texture texture;
+  texture.MipBytes = mipBytes;
+  texture.FirstPinnedMip = firstPinnedMip;
+  texture.ResidentMip = firstPinnedMip;
+  texture.WantedMip = firstPinnedMip;
+  for (size_t mip = firstPinnedMip; mip < mipBytes.size(); ++mip)
+    mStats.ResidentBytes += mipBytes[mip];
+  mTextures.push_back(texture);
+  return static_cast<int>(mTextures.size()) - 1;
+}
+
+void TextureStreamer::RequestMip(int texture, int mip, float priority) {
+  Texture& t = mTextures[texture];
+  mip = std::max(0, std::min(mip, static_cast<int>(t.MipBytes.size()) - 1));
+  if (t.Priority == 0.0f) {
+    t.WantedMip = mip;
+    t.Priority = priority;
+  } else {
+    t.WantedMip = std::min(t.WantedMip, mip);
+    t.Priority = std::max(t.Priority, priority);
+  }
+}
+
+int TextureStreamer::FindVictim(int loadingTexture, float loadPriority, uint64_t frame) const {
+  // Best victim first: mips more detailed than their texture wants, then the least recently
+  // used texture, then the lowest priority.
+  int victim = -1;
+  for (int i = 0; i < static_cast<int>(mTextures.size()); ++i) {
+    const Texture& t = mTextures[i];
+    if (i == loadingTexture || t.Loading || t.ResidentMip >= t.FirstPinnedMip)
+      continue;
+
+    const bool unwanted = t.ResidentMip < t.WantedMip;
+    // A texture drawn this frame only gives way to a more important one.
+    if (!unwanted && t.LastUsedFrame == frame && t.Priority >= loadPriority)
+      continue;
+
+    if (victim == -1) {
+      victim = i;
+      continue;
+    }
+    const Texture& v = mTextures[victim];
+    const bool victimUnwanted = v.ResidentMip < v.WantedMip;
+    if (unwanted != victimUnwanted) {
+      if (unwanted)
+        victim = i;
+    } else if (t.LastUsedFrame != v.LastUsedFrame) {
+      if (t.LastUsedFrame < v.LastUsedFrame)
+        victim = i;
+    } else if (t.Priority < v.Priority) {
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+void TextureStreamer::Update(
+    uint64_t frame, std::vector<LoadRequest>* loads, std::vector<Eviction>* evictions) {
+  // Textures that need their next mip, most important first.
+  std::vector<int> candidates;
+  for (int i = 0; i < static_cast<int>(mTextures.size()); ++i) {
+    Texture& t = mTextures[i];
+    if (t.Priority > 0.0f)
+      t.LastUsedFrame = frame;
+    if (t.Priority > 0.0f && !t.Loading && t.ResidentMip > t.WantedMip)
+      candidates.push_back(i);
+  }
+  std::stable_sort(candidates.begin(), candidates.end(), [this](int a, int b) {
+    return mTextures[a].Priority > mTextures[b].Priority;
+  });
+
+  std::vector<int> residentMipsBefore(mTextures.size());
+  for (size_t i = 0; i < mTextures.size(); ++i)
+    residentMipsBefore[i] = mTextures[i].ResidentMip;
+
+  std::vector<int> victims;
+  for (int i : candidates) {
+    if (mLoadsInFlight >= mMaxLoadsInFlight)
+      break;
+
+    Texture& t = mTextures[i];
+    const int mip = t.ResidentMip - 1;
+    const uint64_t bytes = t.MipBytes[mip];
+
+    // Make room by dropping one mip at a time from the best victim.  If that still isn't enough,
+    // put them back: evicting without loading anything would only cause churn.
+    victims.clear();
+    while (mStats.ResidentBytes + mStats.LoadingBytes + bytes > mStats.BudgetBytes) {
+      int victim = FindVictim(i, t.Priority, frame);
+      if (victim == -1)
+        break;
+      Texture& v = mTextures[victim];
+      mStats.ResidentBytes -= v.MipBytes[v.ResidentMip];
+      ++v.ResidentMip;
+      victims.push_back(victim);
+    }
+    if (mStats.ResidentBytes + mStats.LoadingBytes + bytes > mStats.BudgetBytes) {
+      for (auto it = victims.rbegin(); it != victims.rend(); ++it) {
+        Texture& v = mTextures[*it];
+        --v.ResidentMip;
+        mStats.ResidentBytes += v.MipBytes[v.ResidentMip];
+      }
+      ++mStats.LoadsDeferred;
+      continue;
+    }
+    mStats.MipsEvicted += static_cast<uint32_t>(victims.size());
+
+    t.Loading = true;
+    mStats.LoadingBytes += bytes;
+    ++mLoadsInFlight;
+    ++mStats.LoadsIssued;
+    loads->push_back({ i, mip });
+  }
+
+  // One eviction per texture, for the least detailed mip it ended up with.
+  for (size_t i = 0; i < mTextures.size(); ++i) {
+    if (mTextures[i].ResidentMip != residentMipsBefore[i])
+      evictions->push_back({ static_cast<int>(i), mTextures[i].ResidentMip });
+  }
+
+  for (Texture& t : mTextures)
+    t.Priority = 0.0f;
+}
+
+void TextureStreamer::OnLoadComplete(int texture, int mip) {
+  Texture& t = mTextures[texture];
+  assert(t.Loading && mip == t.ResidentMip - 1);
+  t.Loading = false;
+  t.ResidentMip = mip;
+  mStats.LoadingBytes -= t.MipBytes[mip];
+  mStats.ResidentBytes += t.MipBytes[mip];
+  --mLoadsInFlight;
+  ++mStats.LoadsCompleted;
+}
+
+int TextureStreamer::ChooseMip(uint32_t textureSize, float screenPixels, int mipLevels) {
+  if (screenPixels <= 0.0f)
+    return mipLevels - 1;
+  int mip = static_cast<int>(std::floor(std::log2(textureSize / screenPixels)));
+  return std::max(0, std::min(mip, mipLevels - 1));
+}
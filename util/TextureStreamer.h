@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Decides which mip levels of which textures should be in memory.  Every texture starts with only
+// its smallest mips resident (the pinned tail, which is never evicted) and each frame the caller
+// says how detailed a mip it would like for each texture it drew and how much that matters.  The
+// streamer then asks for the next more detailed mip of the most important textures, one level at
+// a time, while keeping everything that's resident or being loaded within a byte budget.  When a
+// load doesn't fit, mips nobody asked for go first, then the most detailed mips of the least
+// recently used textures.
+//
+// This is only the bookkeeping: the caller does the loading and evicting and reports back when a
+// load has finished.
+class TextureStreamer {
+public:
+  struct LoadRequest {
+    int Texture;
+    int Mip;             // Always one more detailed than what's resident
+  };
+
+  struct Eviction {
+    int Texture;
+    int ResidentMip;     // Most detailed mip kept; everything more detailed is dropped
+  };
+
+  struct Stats {
+    uint64_t BudgetBytes = 0;
+    uint64_t ResidentBytes = 0;
+    uint64_t LoadingBytes = 0;
+    uint32_t LoadsIssued = 0;
+    uint32_t LoadsCompleted = 0;
+    uint32_t LoadsDeferred = 0;     // Wanted but couldn't be fit in the budget
+    uint32_t MipsEvicted = 0;
+  };
+
+  TextureStreamer(uint64_t budgetBytes, int maxLoadsInFlight);
+
+  // mipBytes[0] is the size of the most detailed mip.  Mips from firstPinnedMip on are counted as
+  // resident from the start and never evicted, even if that goes over the budget.
+  int AddTexture(const std::vector<uint64_t>& mipBytes, int firstPinnedMip);
+
+  // Asks for texture to have mip resident, with the given priority (for example its size on
+  // screen).  Lasts for the current frame only; if called several times in a frame, the most
+  // detailed mip and the highest priority are kept.
+  void RequestMip(int texture, int mip, float priority);
+
+  // Ends the frame's requests and appends the loads to start and the evictions to apply now.
+  // Evicted bytes are available to loads issued by the same call.
+  void Update(uint64_t frame, std::vector<LoadRequest>* loads, std::vector<Eviction>* evictions);
+
+  // Reports that a LoadRequest has finished and its mip is now resident.
+  void OnLoadComplete(int texture, int mip);
+
+  int GetResidentMip(int texture) const { return mTextures[texture].ResidentMip; }
+  int GetMipLevels(int texture) const {
+    return static_cast<int>(mTextures[texture].MipBytes.size());
+  }
+  bool IsLoading(int texture) const { return mTextures[texture].Loading; }
+  const Stats& GetStats() const { return mStats; }
+
+  // The mip of a texture of the given size that's closest to one texel per pixel when drawn
+  // screenPixels pixels across.
+  static int ChooseMip(uint32_t textureSize, float screenPixels, int mipLevels);
+
+private:
+  struct Texture {
+    std::vector<uint64_t> MipBytes;
+    int FirstPinnedMip;
+    int ResidentMip;              // Most detailed resident mip
+    int WantedMip;                // From the last frame it was requested in
+    float Priority = 0.0f;        // 0 if it wasn't requested this frame
+    uint64_t LastUsedFrame = 0;
+    bool Loading = false;
+  };
+
+  int FindVictim(int loadingTexture, float loadPriority, uint64_t frame) const;
+
+  std::vector<Texture> mTextures;
+  int mMaxLoadsInFlight;
+  int mLoadsInFlight = 0;
+  Stats mStats;
+};
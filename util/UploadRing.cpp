@@ -0,0 +1,49 @@
+#include "UploadRing.h"
+
+#include <stdexcept>
+
+UploadRing::UploadRing(ID3D12Device* device, UINT64 byteSize)
+  : mAllocator(byteSize, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT) {
+  ThrowIfFailed(device->CreateCommittedResource(
+      &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+      D3D12_HEAP_FLAG_NONE,
+      &CD3DX12_RESOURCE_DESC::Buffer(mAllocator.GetCapacity()),
+      D3D12_RESOURCE_STATE_GENERIC_READ,
+      nullptr,
+      IID_PPV_ARGS(&mUploadBuffer)));
+
+  // Stays mapped for the lifetime of the ring.  The fences keep the CPU from writing to ranges the
+  // GPU is still reading.
+  ThrowIfFailed(mUploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mMappedData)));
+  mGpuAddress = mUploadBuffer->GetGPUVirtualAddress();
+}
+
+UploadRing::~UploadRing() {
+  if (mUploadBuffer != nullptr)
+    mUploadBuffer->Unmap(0, nullptr);
+
+  mMappedData = nullptr;
+}
+
+UploadAllocation UploadRing::Allocate(UINT64 byteSize) {
+  UINT64 offset = mAllocator.Allocate(byteSize);
+  if (offset == LinearRingAllocator::kInvalidOffset)
+    throw std::runtime_error("Upload ring is out of space.");
+
+  UploadAllocation allocation;
+  allocation.CpuAddress = mMappedData + offset;
+  allocation.GpuAddress = mGpuAddress + offset;
+  return allocation;
+}
+
+void UploadRing::FinishFrame(UINT64 fenceValue) {
+  mAllocator.FinishFrame(fenceValue);
+}
+
+void UploadRing::Reclaim(UINT64 completedFenceValue) {
+  mAllocator.Reclaim(completedFenceValue);
+}
+
+ID3D12Resource* UploadRing::Resource() const {
+  return mUploadBuffer.Get();
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "d3dUtil.h"
+#include "LinearRingAllocator.h"
+
+struct UploadAllocation {
+  void* CpuAddress = nullptr;
+  D3D12_GPU_VIRTUAL_ADDRESS GpuAddress = 0;
+};
+
+// A persistently mapped upload heap buffer that constants are written into on demand.  Each
+// suballocation is 256-byte aligned so it can be bound as a root CBV.  Space is reclaimed by fence
+// value (see LinearRingAllocator), so there are no fixed slots and no per-frame-resource copies.
+class UploadRing {
+public:
+  UploadRing(ID3D12Device* device, UINT64 byteSize);
+  UploadRing(const UploadRing& rhs) = delete;
+  UploadRing& operator=(const UploadRing& rhs) = delete;
+  ~UploadRing();
+
+  // Throws if the ring is full, i.e. the GPU is too far behind for the ring's size.
+  UploadAllocation Allocate(UINT64 byteSize);
+
+  // Copies data into a new suballocation and returns its GPU address.
+  template<typename T>
+  D3D12_GPU_VIRTUAL_ADDRESS AllocateConstants(const T& data) {
+    UploadAllocation allocation = Allocate(sizeof(T));
+    memcpy(allocation.CpuAddress, &data, sizeof(T));
+    return allocation.GpuAddress;
+  }
+
+  // Everything allocated since the last call is in use until fenceValue completes.
+  void FinishFrame(UINT64 fenceValue);
+  void Reclaim(UINT64 completedFenceValue);
+
+  ID3D12Resource* Resource() const;
+
+private:
+  Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
+  BYTE* mMappedData = nullptr;
+  D3D12_GPU_VIRTUAL_ADDRESS mGpuAddress = 0;
+
+  LinearRingAllocator mAllocator;
+};
@@ -0,0 +1,212 @@
+#include "VertexCompression.h"
+
+#include <cfloat>
+#include <cmath>
+
+namespace {
+  const float UNORM16_MAX = 65535.0f;
+  const float SNORM16_MAX = 32767.0f;
+
+  uint16_t EncodeUnorm16(float value, float offset, float scale) {
+    if (scale <= 0.0f)
+      return 0;
+    float unorm = (value - offset) / scale;
+    unorm = unorm < 0.0f ? 0.0f : (unorm > 1.0f ? 1.0f : unorm);
+    return static_cast<uint16_t>(std::floor(unorm * UNORM16_MAX + 0.5f));
+  }
+
+  float DecodeUnorm16(uint16_t value, float offset, float scale) {
+    return offset + scale * (value / UNORM16_MAX);
+  }
+
+  float DecodeSnorm16(int16_t value) {
+    // -32768 and -32767 both decode to -1.
+    float snorm = value / SNORM16_MAX;
+    return snorm < -1.0f ? -1.0f : snorm;
+  }
+
+  float SignNotZero(float value) {
+    return value >= 0.0f ? 1.0f : -1.0f;
+  }
+
+  // Fills in offset and scale so the components of count values, stride floats apart, map to
+  // [0, 1].
+  void ComputeRange(const float* values, size_t count, size_t stride, float* offset,
+                    float* scale) {
+    float minValue = FLT_MAX;
+    float maxValue = -FLT_MAX;
+    for (size_t i = 0; i < count; ++i) {
+      const float value = values[i * stride];
+      minValue = value < minValue ? value : minValue;
+      maxValue = value > maxValue ? value : maxValue;
+    }
+    if (count == 0) {
+      minValue = 0.0f;
+      maxValue = 0.0f;
+    }
+    *offset = minValue;
+    *scale = maxValue - minValue;
+  }
+}
+
+VertexQuantization ComputeVertexQuantization(const FloatVertex* vertices, size_t count) {
+  const size_t stride = sizeof(FloatVertex) / sizeof(float);
+  VertexQuantization quantization;
+  for (int i = 0; i < 3; ++i) {
+    ComputeRange(&vertices[0].Pos[i], count, stride, &quantization.PosOffset[i],
+                 &quantization.PosScale[i]);
+  }
+  for (int i = 0; i < 2; ++i) {
+    ComputeRange(&vertices[0].TexC[i], count, stride, &quantization.TexCOffset[i],
+                 &quantization.TexCScale[i]);
+  }
+  return quantization;
+}
+
+void CompressVertices(const FloatVertex* vertices, size_t count,
+                      const VertexQuantization& quantization, CompressedVertex* compressed) {
+  for (size_t v = 0; v < count; ++v) {
+    const FloatVertex& in = vertices[v];
+    CompressedVertex& out = compressed[v];
+    for (int i = 0; i < 3; ++i)
+      out.Pos[i] = EncodeUnorm16(in.Pos[i], quantization.PosOffset[i], quantization.PosScale[i]);
+    out.Pos[3] = 0;
+    EncodeOctahedral(in.Normal, out.Normal);
+    for (int i = 0; i < 2; ++i) {
+      out.TexC[i] =
+          EncodeUnorm16(in.TexC[i], quantization.TexCOffset[i], quantization.TexCScale[i]);
+    }
+  }
+}
+
+void CompressVertices(const FloatVertex* vertices, size_t count,
+                      const VertexQuantization& quantization, FloatPositionVertex* compressed) {
+  for (size_t v = 0; v < count; ++v) {
+    const FloatVertex& in = vertices[v];
+    FloatPositionVertex& out = compressed[v];
+    for (int i = 0; i < 3; ++i)
+      out.Pos[i] = in.Pos[i];
+    EncodeOctahedral(in.Normal, out.Normal);
+    for (int i = 0; i < 2; ++i) {
+      out.TexC[i] =
+          EncodeUnorm16(in.TexC[i], quantization.TexCOffset[i], quantization.TexCScale[i]);
+    }
+  }
+}
+
+void KeepFloatPositions(VertexQuantization* quantization) {
+  for (int i = 0; i < 3; ++i) {
+    quantization->PosOffset[i] = 0.0f;
+    quantization->PosScale[i] = 1.0f;
+  }
+}
+
+FloatVertex DecompressVertex(const CompressedVertex& compressed,
+                             const VertexQuantization& quantization) {
+  FloatVertex vertex;
+  for (int i = 0; i < 3; ++i) {
+    vertex.Pos[i] =
+        DecodeUnorm16(compressed.Pos[i], quantization.PosOffset[i], quantization.PosScale[i]);
+  }
+  DecodeOctahedral(compressed.Normal, vertex.Normal);
+  for (int i = 0; i < 2; ++i) {
+    vertex.TexC[i] =
+        DecodeUnorm16(compressed.TexC[i], quantization.TexCOffset[i], quantization.TexCScale[i]);
+  }
+  return vertex;
+}
+
+VertexCompressionError MeasureCompressionError(const FloatVertex* vertices,
+                                               const CompressedVertex* compressed, size_t count,
+                                               const VertexQuantization& quantization) {
+  VertexCompressionError error;
+  for (size_t v = 0; v < count; ++v) {
+    const FloatVertex& original = vertices[v];
+    const FloatVertex decoded = DecompressVertex(compressed[v], quantization);
+
+    float distanceSquared = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+      const float d = decoded.Pos[i] - original.Pos[i];
+      distanceSquared += d * d;
+    }
+    const float distance = std::sqrt(distanceSquared);
+    if (distance > error.MaxPositionError)
+      error.MaxPositionError = distance;
+
+    // atan2 of the cross and dot products stays accurate for tiny angles, where acos doesn't.
+    const float* a = original.Normal;
+    const float* b = decoded.Normal;
+    const float cross[3] = {
+      a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]
+    };
+    const float sine =
+        std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+    const float cosine = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    const float degrees = std::atan2(sine, cosine) * (180.0f / 3.14159265f);
+    if (degrees > error.MaxNormalErrorDegrees)
+      error.MaxNormalErrorDegrees = degrees;
+
+    for (int i = 0; i < 2; ++i) {
+      const float d = std::fabs(decoded.TexC[i] - original.TexC[i]);
+      if (d > error.MaxTexCError)
+        error.MaxTexCError = d;
+    }
+  }
+  return error;
+}
+
+void EncodeOctahedral(const float normal[3], int16_t encoded[2]) {
+  const float l1 = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+  if (l1 <= 0.0f) {
+    encoded[0] = 0;
+    encoded[1] = 0;
+    return;
+  }
+
+  // Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower half over the upper.
+  float x = normal[0] / l1;
+  float y = normal[1] / l1;
+  if (normal[2] < 0.0f) {
+    const float foldedX = (1.0f - std::fabs(y)) * SignNotZero(x);
+    const float foldedY = (1.0f - std::fabs(x)) * SignNotZero(y);
+    x = foldedX;
+    y = foldedY;
+  }
+
+  // Rounding each coordinate independently isn't always closest on the sphere, so try both ways.
+  const float scaledX = x * SNORM16_MAX;
+  const float scaledY = y * SNORM16_MAX;
+  float bestDot = -FLT_MAX;
+  for (int i = 0; i < 4; ++i) {
+    const float candidateX = (i & 1) ? std::ceil(scaledX) : std::floor(scaledX);
+    const float candidateY = (i & 2) ? std::ceil(scaledY) : std::floor(scaledY);
+    const int16_t candidate[2] = {
+      static_cast<int16_t>(candidateX < -SNORM16_MAX ? -SNORM16_MAX : candidateX),
+      static_cast<int16_t>(candidateY < -SNORM16_MAX ? -SNORM16_MAX : candidateY)
+    };
+    float decoded[3];
+    DecodeOctahedral(candidate, decoded);
+    const float dot =
+        decoded[0] * normal[0] + decoded[1] * normal[1] + decoded[2] * normal[2];
+    if (dot > bestDot) {
+      bestDot = dot;
+      encoded[0] = candidate[0];
+      encoded[1] = candidate[1];
+    }
+  }
+}
+
+void DecodeOctahedral(const int16_t encoded[2], float normal[3]) {
+  // Same as DecodeOctahedral in Common.hlsl.
+  float x = DecodeSnorm16(encoded[0]);
+  float y = DecodeSnorm16(encoded[1]);
+  const float z = 1.0f - std::fabs(x) - std::fabs(y);
+  if (z < 0.0f) {
+    x += x >= 0.0f ? z : -z;
+    y += y >= 0.0f ? z : -z;
+  }
+  const float length = std::sqrt(x * x + y * y + z * z);
+  normal[0] = x / length;
+  normal[1] = y / length;
+  normal[2] = z / length;
+}
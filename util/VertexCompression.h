@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Encoders for a 16-byte vertex format, half the size of the 32-byte float one:
+//   - Positions are unorm16s over the mesh's bounding box.
+//   - Normals are octahedral-encoded into two snorm16s.
+//   - Texture coordinates are unorm16s over the mesh's texture coordinate range.
+// The per-mesh ranges (VertexQuantization) go in the object constants, and the vertex shader
+// turns the attributes back into floats (see Common.hlsl).
+//
+// A mesh too large for unorm16 positions can keep them as floats in a 20-byte vertex instead,
+// with the other attributes still compressed.
+
+// Same layout as the app's Vertex.
+struct FloatVertex {
+  float Pos[3];
+  float Normal[3];
+  float TexC[2];
+};
+
+// Matches the input layout: R16G16B16A16_UNORM, R16G16_SNORM, R16G16_UNORM.
+struct CompressedVertex {
+  uint16_t Pos[4];          // The 4th is padding; there's no 3-component 16-bit format
+  int16_t Normal[2];
+  uint16_t TexC[2];
+};
+static_assert(sizeof(CompressedVertex) == 16, "CompressedVertex must be 16 bytes.");
+
+// Matches the float position input layout: R32G32B32_FLOAT, R16G16_SNORM, R16G16_UNORM.
+struct FloatPositionVertex {
+  float Pos[3];
+  int16_t Normal[2];
+  uint16_t TexC[2];
+};
+static_assert(sizeof(FloatPositionVertex) == 20, "FloatPositionVertex must be 20 bytes.");
+
+// A mesh's attribute ranges: attribute = Offset + Scale * unorm.
+struct VertexQuantization {
+  float PosOffset[3];
+  float PosScale[3];
+  float TexCOffset[2];
+  float TexCScale[2];
+};
+
+// Largest differences between vertices and their compressed versions.
+struct VertexCompressionError {
+  float MaxPositionError = 0.0f;          // Distance, in the mesh's units
+  float MaxNormalErrorDegrees = 0.0f;
+  float MaxTexCError = 0.0f;              // Per component
+};
+
+VertexQuantization ComputeVertexQuantization(const FloatVertex* vertices, size_t count);
+
+void CompressVertices(const FloatVertex* vertices, size_t count,
+                      const VertexQuantization& quantization, CompressedVertex* compressed);
+// Copies the positions as they are; the quantization's position ranges are ignored.
+void CompressVertices(const FloatVertex* vertices, size_t count,
+                      const VertexQuantization& quantization, FloatPositionVertex* compressed);
+
+// Sets the position ranges so the shader's decode leaves float positions as they are.
+void KeepFloatPositions(VertexQuantization* quantization);
+FloatVertex DecompressVertex(const CompressedVertex& compressed,
+                             const VertexQuantization& quantization);
+
+VertexCompressionError MeasureCompressionError(const FloatVertex* vertices,
+                                               const CompressedVertex* compressed, size_t count,
+                                               const VertexQuantization& quantization);
+
+// A unit vector folded onto an octahedron and unfolded into a square.  Of the four nearest
+// snorm16 encodings, the one that decodes closest to normal is picked.
+void EncodeOctahedral(const float normal[3], int16_t encoded[2]);
+void DecodeOctahedral(const int16_t encoded[2], float normal[3]);
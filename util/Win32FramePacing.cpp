@@ -0,0 +1,54 @@
+#include "Win32FramePacing.h"
+
+#include <timeapi.h>
+
+#pragma comment(lib, "winmm.lib")
+
+QpcPacingClock::QpcPacingClock() {
+  LARGE_INTEGER countsPerSecond;
+  QueryPerformanceFrequency(&countsPerSecond);
+  mSecondsPerCount = 1.0 / static_cast<double>(countsPerSecond.QuadPart);
+
+  timeBeginPeriod(1);
+}
+
+QpcPacingClock::~QpcPacingClock() {
+  timeEndPeriod(1);
+}
+
+double QpcPacingClock::Now() {
+  LARGE_INTEGER count;
+  QueryPerformanceCounter(&count);
+  return static_cast<double>(count.QuadPart) * mSecondsPerCount;
+}
+
+void QpcPacingClock::Sleep(double seconds) {
+  // Round down; FramePacer spins for whatever is left.
+  DWORD milliseconds = static_cast<DWORD>(seconds * 1000.0);
+  if (milliseconds > 0)
+    ::Sleep(milliseconds);
+}
+
+D3D12PacingFence::D3D12PacingFence(ID3D12Fence* fence)
+  : mFence(fence) {
+  mEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+  if (mEvent == nullptr)
+    ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+}
+
+D3D12PacingFence::~D3D12PacingFence() {
+  CloseHandle(mEvent);
+}
+
+uint64_t D3D12PacingFence::GetCompletedValue() {
+  return mFence->GetCompletedValue();
+}
+
+void D3D12PacingFence::WaitForValue(uint64_t value) {
+  if (mFence->GetCompletedValue() >= value)
+    return;
+
+  // Fire event when GPU hits the fence value, then wait for it.
+  ThrowIfFailed(mFence->SetEventOnCompletion(value, mEvent));
+  WaitForSingleObject(mEvent, INFINITE);
+}
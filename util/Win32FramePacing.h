@@ -0,0 +1,38 @@
+#pragma once
+
+#include "d3dUtil.h"
+#include "FramePacer.h"
+
+// PacingClock backed by QueryPerformanceCounter.  Raises the system timer resolution to 1ms while
+// it exists so that Sleep overshoots by less.
+class QpcPacingClock : public PacingClock {
+public:
+  QpcPacingClock();
+  ~QpcPacingClock() override;
+
+  QpcPacingClock(const QpcPacingClock&) = delete;
+  QpcPacingClock& operator=(const QpcPacingClock&) = delete;
+
+  double Now() override;
+  void Sleep(double seconds) override;
+
+private:
+  double mSecondsPerCount;
+};
+
+// PacingFence backed by an ID3D12Fence.  One event is created up front and reused for every wait.
+class D3D12PacingFence : public PacingFence {
+public:
+  explicit D3D12PacingFence(ID3D12Fence* fence);
+  ~D3D12PacingFence() override;
+
+  D3D12PacingFence(const D3D12PacingFence&) = delete;
+  D3D12PacingFence& operator=(const D3D12PacingFence&) = delete;
+
+  uint64_t GetCompletedValue() override;
+  void WaitForValue(uint64_t value) override;
+
+private:
+  ID3D12Fence* mFence;
+  HANDLE mEvent;
+};
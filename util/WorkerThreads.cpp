@@ -0,0 +1,78 @@
+#include "WorkerThreads.h"
+
+WorkerThreads::WorkerThreads(int threadCount) {
+  mThreads.reserve(threadCount);
+  for (int i = 0; i < threadCount; ++i)
+    mThreads.emplace_back(&WorkerThreads::ThreadMain, this, i);
+}
+
+WorkerThreads::~WorkerThreads() {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mQuit = true;
+  }
+  mStartCondition.notify_all();
+  for (std::thread& thread : mThreads)
+    thread.join();
+}
+
+int WorkerThreads::GetThreadCount() const {
+  return static_cast<int>(mThreads.size());
+}
+
+void WorkerThreads::RunJob(JobFunction function, const void* context) {
+  {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mJobFunction = function;
+    mJobContext = context;
+    mRunningCount = static_cast<int>(mThreads.size());
+    ++mGeneration;
+  }
+  mStartCondition.notify_all();
+
+  std::exception_ptr exception;
+  {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDoneCondition.wait(lock, [this] { return mRunningCount == 0; });
+    mJobFunction = nullptr;
+    mJobContext = nullptr;
+    exception = mException;
+    mException = nullptr;
+  }
+  if (exception)
+    std::rethrow_exception(exception);
+}
+
+void WorkerThreads::ThreadMain(int threadIndex) {
+  unsigned long long lastGeneration = 0;
+  for (;;) {
+    JobFunction function;
+    const void* context;
+    {
+      std::unique_lock<std::mutex> lock(mMutex);
+      mStartCondition.wait(lock, [&] { return mQuit || mGeneration != lastGeneration; });
+      if (mQuit)
+        return;
+      lastGeneration = mGeneration;
+      function = mJobFunction;
+      context = mJobContext;
+    }
+
+    // Catch everything (including DxException, which isn't a std::exception) so it can be
+    // rethrown by Run.
+    std::exception_ptr exception;
+    try {
+      function(context, threadIndex);
+    } catch (...) {
+      exception = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mMutex);
+      if (exception && !mException)
+        mException = exception;
+      if (--mRunningCount == 0)
+        mDoneCondition.notify_one();
+    }
+  }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads that all run the same job each time Run is called.  Each thread is passed
+// its index so it can pick its share of the work and use its own per-thread resources (command
+// allocators, scratch buffers).  Threads sleep between runs.
+class WorkerThreads {
+public:
+  explicit WorkerThreads(int threadCount);
+  ~WorkerThreads();
+
+  WorkerThreads(const WorkerThreads&) = delete;
+  WorkerThreads& operator=(const WorkerThreads&) = delete;
+
+  int GetThreadCount() const;
+
+  // Calls job(threadIndex) on every thread and blocks until they have all returned.  If any call
+  // threw, the first exception is rethrown here on the calling thread.  The job is called through
+  // a plain function pointer rather than a std::function, so running one never allocates.
+  template <typename Job>
+  void Run(const Job& job) {
+    RunJob([](const void* context, int threadIndex) {
+      (*static_cast<const Job*>(context))(threadIndex);
+    }, &job);
+  }
+
+private:
+  typedef void (*JobFunction)(const void* context, int threadIndex);
+
+  void RunJob(JobFunction function, const void* context);
+  void ThreadMain(int threadIndex);
+
+  std::vector<std::thread> mThreads;
+
+  std::mutex mMutex;
+  std::condition_variable mStartCondition;
+  std::condition_variable mDoneCondition;
+  JobFunction mJobFunction = nullptr;
+  const void* mJobContext = nullptr;
+  unsigned long long mGeneration = 0;   // incremented by each Run to wake the threads
+  int mRunningCount = 0;
+  bool mQuit = false;
+  std::exception_ptr mException;
+};